@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Converts the models and textures of an asset directory into the runtime formats
+// of CookedAssets, next to their sources. Assets are cooked in parallel. A manifest
+// records a content hash of every input and of the settings it was cooked with,
+// so a re-run only cooks what changed.
+class AssetCooker
+{
+public:
+    struct Settings
+    {
+        std::filesystem::path AssetDir;
+        unsigned ThreadCount = 0; // 0 = one per hardware thread
+        bool Force = false;       // Cook everything, ignoring the manifest
+        bool GenerateTangents = true;
+        bool CompressMeshes = true;
+    };
+
+    explicit AssetCooker(const Settings& settings);
+
+    // Returns the number of assets that failed to cook.
+    int Run();
+
+private:
+    enum class AssetType
+    {
+        Mesh,
+        Texture
+    };
+
+    enum class Status
+    {
+        Cooked,
+        UpToDate,
+        Failed
+    };
+
+    struct Asset
+    {
+        std::filesystem::path Source;
+        std::string Key; // Path relative to the asset directory
+        AssetType Type;
+        uint64_t SourceSize;
+        uint64_t InputHash;
+        uint64_t SettingsHash;
+        uint64_t OutputSize;
+        Status Result;
+        double Milliseconds;
+    };
+
+    struct ManifestEntry
+    {
+        uint64_t InputHash;
+        uint64_t SettingsHash;
+    };
+
+    void FindAssets();
+    void LoadManifest();
+    bool SaveManifest() const;
+    uint64_t GetSettingsHash(AssetType type) const;
+
+    void ProcessAsset(Asset& asset);
+    bool CookMesh(const Asset& asset, const std::filesystem::path& output);
+    bool CookTexture(const Asset& asset, const std::filesystem::path& output);
+    void Report(const Asset& asset);
+
+    Settings mSettings;
+    std::vector<Asset> mAssets;
+    std::unordered_map<std::string, ManifestEntry> mManifest;
+    std::mutex mOutputMutex;
+};
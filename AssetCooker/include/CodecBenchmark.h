@@ -0,0 +1,12 @@
+#pragma once
+
+#include <filesystem>
+
+// Compression of the cooked meshes of an asset directory with MeshCodec: raw and
+// compressed sizes, encode and decode speed per mesh and in total. The meshes are
+// read as cooked, so run the cooker first. Prints a table to stdout. Decoding uses the
+// job system like a load does, compare -j 1 with more threads for the parallel speedup.
+namespace CodecBenchmark
+{
+    void Run(const std::filesystem::path& assetDir);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <filesystem>
+
+// Checks the native importers against stored expected output: every model of an asset
+// directory with a reference mesh next to it (CookedAssets::ReferenceMeshPath) is
+// imported like the cooker does, and the vertices, indices, submeshes and materials
+// must match the reference exactly. References are written by the FBX SDK importer, so
+// this runs the comparison where the SDK is not available. Prints a line per model and
+// returns the number of models that differ or fail to import.
+namespace ImportCheck
+{
+    int Run(const std::filesystem::path& assetDir);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// Scaling of the job system from one thread up to maxThreads (0 = one per hardware
+// thread): job overhead, a compute bound parallel for and a recursive fork-join tree.
+// Prints a table to stdout.
+namespace JobBenchmark
+{
+    void Run(unsigned maxThreads);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// Checks TangentGenerator against analytic tangent frames: generated meshes whose UVs
+// are linear in the surface parameters (planes, a cube with rotated and mirrored face
+// UVs, a plane mirrored about shared vertices, a cylinder with a UV seam, and a grid
+// large enough for the threaded path), so the expected tangent and bitangent sign of
+// every triangle corner are known. Vertices shared by mirrored and unmirrored triangles
+// must be split, no others. Interleaved and split attribute streams must give the same
+// result. Prints a line per mesh and returns the number of meshes that fail.
+namespace TangentCheck
+{
+    int Run();
+}
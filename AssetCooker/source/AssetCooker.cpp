@@ -0,0 +1,336 @@
+#include <AssetCooker.h>
+#include <CookedAssets.h>
+#include <FbxBinaryReader.h>
+#include <Hash.h>
+#include <JobSystem.h>
+#include <MappedFile.h>
+#include <MeshCodec.h>
+#include <ObjReader.h>
+#include <TangentGenerator.h>
+#include <TgaReader.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    const char kManifestName[] = "cook_manifest.txt";
+    const char kManifestHeader[] = "# AssetCooker manifest 1";
+
+    // Bump when the cooking code changes the output, everything is cooked again.
+    const uint64_t kCookerVersion = 1;
+
+    using Clock = std::chrono::high_resolution_clock;
+
+    double MillisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    std::string ToLower(std::string text)
+    {
+        std::transform(text.begin(), text.end(), text.begin(),
+            [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+        return text;
+    }
+}
+
+AssetCooker::AssetCooker(const Settings& settings)
+    : mSettings(settings)
+{
+}
+
+int AssetCooker::Run()
+{
+    auto start = Clock::now();
+
+    FindAssets();
+    if (!mSettings.Force)
+        LoadManifest();
+
+    // Largest assets first, so a big one does not start last and hold up the end.
+    std::sort(mAssets.begin(), mAssets.end(), [](const Asset& a, const Asset& b) { return a.SourceSize > b.SourceSize; });
+
+    // One job per thread takes the assets in order. The decoders inside them run
+    // their own jobs on the same workers.
+    JobSystem& jobs = JobSystem::Get();
+    std::atomic<size_t> nextAsset(0);
+    jobs.ParallelFor(jobs.GetThreadCount(), 1, [&](size_t, size_t)
+    {
+        for (size_t i = nextAsset++; i < mAssets.size(); i = nextAsset++)
+            ProcessAsset(mAssets[i]);
+    });
+
+    size_t cooked = 0, upToDate = 0, failed = 0;
+    uint64_t bytesRead = 0, bytesWritten = 0;
+    for (const Asset& asset : mAssets)
+    {
+        if (asset.Result == Status::Cooked)
+        {
+            cooked++;
+            bytesRead += asset.SourceSize;
+            bytesWritten += asset.OutputSize;
+        }
+        else if (asset.Result == Status::UpToDate)
+        {
+            upToDate++;
+        }
+        else
+        {
+            failed++;
+        }
+    }
+
+    if (!SaveManifest())
+        printf("Failed to write %s\n", kManifestName);
+
+    printf("%zu assets: %zu cooked, %zu up to date, %zu failed; %.1f MB read, %.1f MB written in %.1f ms on %u threads\n",
+        mAssets.size(), cooked, upToDate, failed, bytesRead / (1024.0 * 1024.0), bytesWritten / (1024.0 * 1024.0),
+        MillisecondsSince(start), jobs.GetThreadCount());
+
+    return static_cast<int>(failed);
+}
+
+void AssetCooker::FindAssets()
+{
+    namespace fs = std::filesystem;
+
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(mSettings.AssetDir, ec), end; !ec && it != end; it.increment(ec))
+    {
+        if (!it->is_regular_file(ec))
+            continue;
+
+        std::string extension = ToLower(it->path().extension().u8string());
+        Asset asset;
+        if (extension == ".fbx" || extension == ".obj")
+            asset.Type = AssetType::Mesh;
+        else if (extension == ".tga")
+            asset.Type = AssetType::Texture;
+        else
+            continue;
+
+        asset.Source = it->path();
+        asset.Key = fs::relative(it->path(), mSettings.AssetDir, ec).generic_u8string();
+        asset.SourceSize = it->file_size(ec);
+        asset.InputHash = 0;
+        asset.SettingsHash = GetSettingsHash(asset.Type);
+        asset.OutputSize = 0;
+        asset.Result = Status::Failed;
+        asset.Milliseconds = 0.0;
+        mAssets.push_back(asset);
+    }
+
+    if (ec)
+        printf("Error while scanning %s: %s\n", mSettings.AssetDir.u8string().c_str(), ec.message().c_str());
+}
+
+uint64_t AssetCooker::GetSettingsHash(AssetType type) const
+{
+    uint64_t hash = Hash::Value(kCookerVersion);
+    hash = Hash::Combine(hash, CookedAssets::kFormatVersion);
+    hash = Hash::Combine(hash, static_cast<uint64_t>(type));
+    if (type == AssetType::Mesh)
+    {
+        hash = Hash::Combine(hash, mSettings.GenerateTangents ? 1 : 0);
+        hash = Hash::Combine(hash, mSettings.CompressMeshes ? 1 : 0);
+    }
+    return hash;
+}
+
+void AssetCooker::LoadManifest()
+{
+    std::ifstream file(mSettings.AssetDir / kManifestName);
+    std::string line;
+    if (!std::getline(file, line) || line != kManifestHeader)
+        return;
+
+    // <input hash> <settings hash> <asset path>
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        ManifestEntry entry;
+        std::string key;
+        fields >> std::hex >> entry.InputHash >> entry.SettingsHash;
+        fields.get();
+        if (fields && std::getline(fields, key) && !key.empty())
+            mManifest[key] = entry;
+    }
+}
+
+bool AssetCooker::SaveManifest() const
+{
+    std::filesystem::path path = mSettings.AssetDir / kManifestName;
+    std::filesystem::path temp = path;
+    temp += ".tmp";
+
+    {
+        std::ofstream file(temp, std::ios::trunc);
+        file << kManifestHeader << '\n';
+
+        // Failed assets are left out, so they are retried next time.
+        for (const Asset& asset : mAssets)
+        {
+            if (asset.Result == Status::Failed)
+                continue;
+
+            char hashes[40];
+            snprintf(hashes, sizeof(hashes), "%016llx %016llx ",
+                static_cast<unsigned long long>(asset.InputHash), static_cast<unsigned long long>(asset.SettingsHash));
+            file << hashes << asset.Key << '\n';
+        }
+
+        if (!file.flush())
+            return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp, path, ec);
+    return !ec;
+}
+
+void AssetCooker::ProcessAsset(Asset& asset)
+{
+    auto start = Clock::now();
+
+    const std::filesystem::path output = asset.Type == AssetType::Mesh ?
+        CookedAssets::MeshPath(asset.Source) : CookedAssets::TexturePath(asset.Source);
+
+    // Hashing the mapped file is much cheaper than importing it.
+    {
+        MappedFile file;
+        if (!file.Open(asset.Source))
+        {
+            asset.Result = Status::Failed;
+            asset.Milliseconds = MillisecondsSince(start);
+            Report(asset);
+            return;
+        }
+        asset.InputHash = Hash::Bytes(file.Data(), file.Size());
+    }
+
+    std::error_code ec;
+    auto entry = mManifest.find(asset.Key);
+    if (entry != mManifest.end() && entry->second.InputHash == asset.InputHash &&
+        entry->second.SettingsHash == asset.SettingsHash && std::filesystem::exists(output, ec))
+    {
+        // The runtime compares modification times, keep the output newer than a touched source.
+        if (!CookedAssets::IsUpToDate(output, asset.Source))
+            std::filesystem::last_write_time(output, std::filesystem::file_time_type::clock::now(), ec);
+
+        asset.Result = Status::UpToDate;
+    }
+    else
+    {
+        bool ok = asset.Type == AssetType::Mesh ? CookMesh(asset, output) : CookTexture(asset, output);
+        asset.Result = ok ? Status::Cooked : Status::Failed;
+        if (ok)
+            asset.OutputSize = std::filesystem::file_size(output, ec);
+    }
+
+    asset.Milliseconds = MillisecondsSince(start);
+    Report(asset);
+}
+
+bool AssetCooker::CookMesh(const Asset& asset, const std::filesystem::path& output)
+{
+    CookedAssets::Mesh mesh;
+    if (ToLower(asset.Source.extension().u8string()) == ".obj")
+    {
+        ObjReader reader;
+        if (!reader.LoadObjFile(asset.Source.u8string()))
+            return false;
+        reader.GetVertices(mesh.Vertices, mesh.Indices, mesh.SubMeshes);
+        reader.GetMaterials(mesh.Materials);
+    }
+    else
+    {
+        FbxBinaryReader reader;
+        if (!reader.LoadFbxFile(asset.Source.u8string()))
+            return false;
+        reader.GetVertices(mesh.Vertices, mesh.Indices, mesh.SubMeshes);
+        reader.GetMaterials(mesh.Materials);
+    }
+    if (mesh.Vertices.empty())
+        return false;
+
+    // Before reordering, the vertices split for mirrored UVs are then put in order too.
+    if (mSettings.GenerateTangents && !mesh.Indices.empty())
+    {
+        mesh.Tangents.resize(mesh.Vertices.size());
+
+        TangentGenerator::Input input;
+        input.Positions = &mesh.Vertices.data()->Pos.x;
+        input.PositionStride = sizeof(VertexTextured);
+        input.Normals = &mesh.Vertices.data()->Normal.x;
+        input.NormalStride = sizeof(VertexTextured);
+        input.TexCoords = &mesh.Vertices.data()->Tex.x;
+        input.TexCoordStride = sizeof(VertexTextured);
+        input.VertexCount = mesh.Vertices.size();
+        input.Indices = mesh.Indices.data();
+        input.IndexCount = mesh.Indices.size();
+        std::vector<TangentGenerator::SplitVertex> splits;
+        TangentGenerator::Generate(input, &mesh.Tangents.data()->x, mesh.Indices.data(), splits);
+
+        mesh.Vertices.reserve(mesh.Vertices.size() + splits.size());
+        mesh.Tangents.reserve(mesh.Tangents.size() + splits.size());
+        for (const TangentGenerator::SplitVertex& split : splits)
+        {
+            mesh.Vertices.push_back(mesh.Vertices[split.Source]);
+            mesh.Tangents.push_back(DirectX::XMFLOAT4(split.Tangent[0], split.Tangent[1], split.Tangent[2], split.Tangent[3]));
+        }
+    }
+
+    // First-use order lets the index coder find most vertices as the next new one,
+    // and is also the order the GPU fetches them in.
+    std::vector<uint32_t> remap = MeshCodec::ReorderByFirstUse(mesh.Indices.data(), mesh.Indices.size(), mesh.Vertices.size());
+    std::vector<VertexTextured> vertices(mesh.Vertices.size());
+    for (size_t i = 0; i < remap.size(); i++)
+        vertices[remap[i]] = mesh.Vertices[i];
+    mesh.Vertices.swap(vertices);
+    if (!mesh.Tangents.empty())
+    {
+        std::vector<DirectX::XMFLOAT4> tangents(mesh.Tangents.size());
+        for (size_t i = 0; i < remap.size(); i++)
+            tangents[remap[i]] = mesh.Tangents[i];
+        mesh.Tangents.swap(tangents);
+    }
+
+    return CookedAssets::WriteMesh(output, mesh, mSettings.CompressMeshes);
+}
+
+bool AssetCooker::CookTexture(const Asset& asset, const std::filesystem::path& output)
+{
+    TGAReader reader;
+    if (!reader.Open(asset.Source))
+        return false;
+
+    CookedAssets::Texture texture;
+    texture.Width = reader.GetWidth();
+    texture.Height = reader.GetHeight();
+    texture.Pixels.resize(size_t(texture.Width) * texture.Height * 4);
+    if (!reader.Decode(texture.Pixels.data(), size_t(texture.Width) * 4))
+        return false;
+
+    return CookedAssets::WriteTexture(output, texture);
+}
+
+void AssetCooker::Report(const Asset& asset)
+{
+    static const char* const statusNames[] = { "cooked", "current", "FAILED" };
+
+    std::lock_guard<std::mutex> lock(mOutputMutex);
+    if (asset.Result == Status::Cooked)
+    {
+        printf("%9.1f ms  %-7s  %s (%.1f KB -> %.1f KB)\n", asset.Milliseconds, statusNames[static_cast<int>(asset.Result)],
+            asset.Key.c_str(), asset.SourceSize / 1024.0, asset.OutputSize / 1024.0);
+    }
+    else
+    {
+        printf("%9.1f ms  %-7s  %s\n", asset.Milliseconds, statusNames[static_cast<int>(asset.Result)], asset.Key.c_str());
+    }
+}
@@ -0,0 +1,131 @@
+#include <CodecBenchmark.h>
+#include <CookedAssets.h>
+#include <JobSystem.h>
+#include <MeshCodec.h>
+#include <SimdMath.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    // Each measurement is the best of a few runs
+    const int kRuns = 5;
+
+    double SecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    struct Result
+    {
+        size_t RawSize = 0;
+        size_t CompressedSize = 0;
+        double EncodeSeconds = 0.0;
+        double DecodeSeconds = 0.0;
+        bool Match = true;
+    };
+
+    Result Measure(const CookedAssets::Mesh& mesh)
+    {
+        Result result;
+        result.RawSize = mesh.Vertices.size() * sizeof(VertexTextured) + mesh.Tangents.size() * sizeof(DirectX::XMFLOAT4) +
+            mesh.Indices.size() * sizeof(UINT);
+        result.EncodeSeconds = 1e30;
+        result.DecodeSeconds = 1e30;
+
+        std::vector<uint8_t> vertexData, tangentData, indexData;
+        for (int run = 0; run < kRuns; run++)
+        {
+            vertexData.clear();
+            tangentData.clear();
+            indexData.clear();
+            auto start = Clock::now();
+            MeshCodec::EncodeVertices(mesh.Vertices.data(), mesh.Vertices.size(), sizeof(VertexTextured), vertexData);
+            MeshCodec::EncodeVertices(mesh.Tangents.data(), mesh.Tangents.size(), sizeof(DirectX::XMFLOAT4), tangentData);
+            MeshCodec::EncodeIndices(mesh.Indices.data(), mesh.Indices.size(), indexData);
+            result.EncodeSeconds = (std::min)(result.EncodeSeconds, SecondsSince(start));
+        }
+        result.CompressedSize = vertexData.size() + tangentData.size() + indexData.size();
+
+        std::vector<VertexTextured> vertices(mesh.Vertices.size());
+        std::vector<DirectX::XMFLOAT4> tangents(mesh.Tangents.size());
+        std::vector<UINT> indices(mesh.Indices.size());
+        for (int run = 0; run < kRuns; run++)
+        {
+            auto start = Clock::now();
+            bool ok = MeshCodec::DecodeVertices(vertexData.data(), vertexData.size(), vertices.data(), vertices.size(), sizeof(VertexTextured)) &&
+                MeshCodec::DecodeVertices(tangentData.data(), tangentData.size(), tangents.data(), tangents.size(), sizeof(DirectX::XMFLOAT4)) &&
+                MeshCodec::DecodeIndices(indexData.data(), indexData.size(), indices.data(), indices.size(), vertices.size());
+            result.DecodeSeconds = (std::min)(result.DecodeSeconds, SecondsSince(start));
+            result.Match = result.Match && ok;
+        }
+
+        // Triangles may come back rotated, so indices are compared as sets of three
+        result.Match = result.Match && memcmp(vertices.data(), mesh.Vertices.data(), vertices.size() * sizeof(VertexTextured)) == 0 &&
+            memcmp(tangents.data(), mesh.Tangents.data(), tangents.size() * sizeof(DirectX::XMFLOAT4)) == 0;
+        for (size_t i = 0; i + 2 < indices.size() && result.Match; i += 3)
+        {
+            const UINT* a = &indices[i];
+            const UINT* b = &mesh.Indices[i];
+            result.Match = (a[0] == b[0] && a[1] == b[1] && a[2] == b[2]) || (a[0] == b[1] && a[1] == b[2] && a[2] == b[0]) ||
+                (a[0] == b[2] && a[1] == b[0] && a[2] == b[1]);
+        }
+        return result;
+    }
+
+    void Print(const char* name, const Result& result)
+    {
+        printf("%-32s %10zu %10zu %6.2fx %8.1f %8.2f  %s\n", name, result.RawSize, result.CompressedSize,
+            double(result.RawSize) / (std::max)(result.CompressedSize, size_t(1)),
+            result.RawSize / result.EncodeSeconds / 1e6, result.RawSize / result.DecodeSeconds / 1e9, result.Match ? "ok" : "MISMATCH");
+    }
+}
+
+void CodecBenchmark::Run(const std::filesystem::path& assetDir)
+{
+    std::vector<std::filesystem::path> files;
+    std::error_code ec;
+    for (std::filesystem::recursive_directory_iterator it(assetDir, ec), end; !ec && it != end; it.increment(ec))
+    {
+        if (it->is_regular_file(ec) && it->path().extension() == ".mesh")
+            files.push_back(it->path());
+    }
+    std::sort(files.begin(), files.end());
+    if (files.empty())
+    {
+        printf("No cooked meshes in %s\n", assetDir.u8string().c_str());
+        return;
+    }
+
+    // Large vertex buffers decode a column per job, so the decode speed depends on -j.
+    // rANS streams decode with AVX2 when SimdMath uses it.
+    printf("Job system: %u threads, rANS decode: %s\n", JobSystem::Get().GetThreadCount(),
+        SimdMath::GetBackend() == SimdMath::Backend::AVX2 ? "AVX2" : "scalar");
+    printf("%-32s %10s %10s %7s %8s %8s\n", "mesh", "raw", "compressed", "ratio", "enc MB/s", "dec GB/s");
+    Result total;
+    for (const std::filesystem::path& file : files)
+    {
+        std::string name = std::filesystem::relative(file, assetDir, ec).generic_u8string();
+        CookedAssets::Mesh mesh;
+        if (!CookedAssets::ReadMesh(file, mesh))
+        {
+            printf("%-32s cannot be read\n", name.c_str());
+            continue;
+        }
+
+        Result result = Measure(mesh);
+        Print(name.c_str(), result);
+        total.RawSize += result.RawSize;
+        total.CompressedSize += result.CompressedSize;
+        total.EncodeSeconds += result.EncodeSeconds;
+        total.DecodeSeconds += result.DecodeSeconds;
+        total.Match = total.Match && result.Match;
+    }
+    Print("total", total);
+}
@@ -0,0 +1,184 @@
+#include <ImportCheck.h>
+#include <CookedAssets.h>
+#include <FbxBinaryReader.h>
+#include <ObjReader.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    std::string ToLower(std::string text)
+    {
+        std::transform(text.begin(), text.end(), text.begin(),
+            [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+        return text;
+    }
+
+    // The same importers as the cooker
+    bool Import(const std::filesystem::path& source, CookedAssets::Mesh& mesh)
+    {
+        if (ToLower(source.extension().u8string()) == ".obj")
+        {
+            ObjReader reader;
+            if (!reader.LoadObjFile(source.u8string()))
+                return false;
+            reader.GetVertices(mesh.Vertices, mesh.Indices, mesh.SubMeshes);
+            reader.GetMaterials(mesh.Materials);
+        }
+        else
+        {
+            FbxBinaryReader reader;
+            if (!reader.LoadFbxFile(source.u8string()))
+                return false;
+            reader.GetVertices(mesh.Vertices, mesh.Indices, mesh.SubMeshes);
+            reader.GetMaterials(mesh.Materials);
+        }
+        return true;
+    }
+
+    template<class T>
+    size_t FirstDifference(const std::vector<T>& a, const std::vector<T>& b)
+    {
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            if (memcmp(&a[i], &b[i], sizeof(T)) != 0)
+                return i;
+        }
+        return a.size();
+    }
+
+    // References store texture paths relative to the file, the reader gives them resolved
+    bool SamePath(const std::wstring& a, const std::wstring& b)
+    {
+        return std::filesystem::path(a).lexically_normal() == std::filesystem::path(b).lexically_normal();
+    }
+
+    bool SameMaterial(const MaterialDesc& a, const MaterialDesc& b)
+    {
+        return a.Name == b.Name && SamePath(a.ColorMapFile, b.ColorMapFile) && SamePath(a.NormalMapFile, b.NormalMapFile) &&
+            memcmp(&a.Ambient, &b.Ambient, sizeof(a.Ambient)) == 0 && memcmp(&a.Diffuse, &b.Diffuse, sizeof(a.Diffuse)) == 0 &&
+            memcmp(&a.Specular, &b.Specular, sizeof(a.Specular)) == 0;
+    }
+
+    // Empty if the meshes match, the first difference otherwise
+    std::string Compare(const CookedAssets::Mesh& mesh, const CookedAssets::Mesh& reference)
+    {
+        char text[128];
+        if (mesh.Vertices.size() != reference.Vertices.size())
+        {
+            snprintf(text, sizeof(text), "%zu vertices, expected %zu", mesh.Vertices.size(), reference.Vertices.size());
+            return text;
+        }
+        size_t i = FirstDifference(mesh.Vertices, reference.Vertices);
+        if (i < mesh.Vertices.size())
+        {
+            snprintf(text, sizeof(text), "vertex %zu differs", i);
+            return text;
+        }
+
+        if (mesh.Indices.size() != reference.Indices.size())
+        {
+            snprintf(text, sizeof(text), "%zu indices, expected %zu", mesh.Indices.size(), reference.Indices.size());
+            return text;
+        }
+        i = FirstDifference(mesh.Indices, reference.Indices);
+        if (i < mesh.Indices.size())
+        {
+            snprintf(text, sizeof(text), "index %zu is %u, expected %u", i, mesh.Indices[i], reference.Indices[i]);
+            return text;
+        }
+
+        if (mesh.SubMeshes.size() != reference.SubMeshes.size())
+        {
+            snprintf(text, sizeof(text), "%zu submeshes, expected %zu", mesh.SubMeshes.size(), reference.SubMeshes.size());
+            return text;
+        }
+        i = FirstDifference(mesh.SubMeshes, reference.SubMeshes);
+        if (i < mesh.SubMeshes.size())
+        {
+            snprintf(text, sizeof(text), "submesh %zu differs", i);
+            return text;
+        }
+
+        if (mesh.Materials.size() != reference.Materials.size())
+        {
+            snprintf(text, sizeof(text), "%zu materials, expected %zu", mesh.Materials.size(), reference.Materials.size());
+            return text;
+        }
+        for (i = 0; i < mesh.Materials.size(); i++)
+        {
+            if (!SameMaterial(mesh.Materials[i], reference.Materials[i]))
+            {
+                snprintf(text, sizeof(text), "material %zu (%s) differs", i, reference.Materials[i].Name.c_str());
+                return text;
+            }
+        }
+        return std::string();
+    }
+}
+
+int ImportCheck::Run(const std::filesystem::path& assetDir)
+{
+    std::vector<std::filesystem::path> sources;
+    std::error_code ec;
+    for (std::filesystem::recursive_directory_iterator it(assetDir, ec), end; !ec && it != end; it.increment(ec))
+    {
+        std::string extension = ToLower(it->path().extension().u8string());
+        if (it->is_regular_file(ec) && (extension == ".fbx" || extension == ".obj") &&
+            std::filesystem::is_regular_file(CookedAssets::ReferenceMeshPath(it->path()), ec))
+        {
+            sources.push_back(it->path());
+        }
+    }
+    std::sort(sources.begin(), sources.end());
+    if (sources.empty())
+    {
+        printf("No models with a reference in %s\n", assetDir.u8string().c_str());
+        return 0;
+    }
+
+    int failed = 0;
+    for (const std::filesystem::path& source : sources)
+    {
+        std::string name = std::filesystem::relative(source, assetDir, ec).generic_u8string();
+        CookedAssets::Mesh reference;
+        if (!CookedAssets::ReadMesh(CookedAssets::ReferenceMeshPath(source), reference))
+        {
+            printf("%-32s reference cannot be read\n", name.c_str());
+            failed++;
+            continue;
+        }
+
+        CookedAssets::Mesh mesh;
+        auto start = Clock::now();
+        if (!Import(source, mesh))
+        {
+            printf("%-32s import failed\n", name.c_str());
+            failed++;
+            continue;
+        }
+        double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        std::string difference = Compare(mesh, reference);
+        if (difference.empty())
+        {
+            printf("%-32s ok, %zu vertices, %zu triangles, %.1f ms\n", name.c_str(), mesh.Vertices.size(), mesh.Indices.size() / 3, milliseconds);
+        }
+        else
+        {
+            printf("%-32s MISMATCH: %s\n", name.c_str(), difference.c_str());
+            failed++;
+        }
+    }
+
+    printf("%zu models checked, %d failed\n", sources.size(), failed);
+    return failed;
+}
@@ -0,0 +1,123 @@
+#include <JobBenchmark.h>
+#include <JobSystem.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    const size_t kEmptyJobs = 1 << 20;
+    const size_t kParallelForItems = 1 << 24;
+    const size_t kParallelForGrain = 16 * 1024;
+    const int kTreeDepth = 16;         // 64K leaves
+    const int kLeafIterations = 2000;  // About a microsecond
+
+    double MillisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // Keeps the results of the workloads alive
+    std::atomic<uint64_t> gSink(0);
+
+    uint32_t LeafWork(uint32_t seed)
+    {
+        for (int i = 0; i < kLeafIterations; i++)
+            seed = seed * 1664525u + 1013904223u;
+        return seed;
+    }
+
+    // Jobs that do nothing, started from the calling thread, so the time is the
+    // overhead of starting, stealing and finishing jobs.
+    double EmptyJobs(JobSystem& jobs)
+    {
+        auto start = Clock::now();
+        JobSystem::Counter counter;
+        for (size_t i = 0; i < kEmptyJobs; i++)
+            jobs.Run([]() {}, &counter);
+        jobs.Wait(counter);
+        return MillisecondsSince(start);
+    }
+
+    double ParallelFor(JobSystem& jobs)
+    {
+        auto start = Clock::now();
+        jobs.ParallelFor(kParallelForItems, kParallelForGrain, [](size_t first, size_t end)
+        {
+            float sum = 0.0f;
+            for (size_t i = first; i < end; i++)
+            {
+                float x = static_cast<float>(i);
+                sum += std::sqrt(x) * std::sin(x * 0.001f);
+            }
+            gSink += static_cast<uint64_t>(std::fabs(sum));
+        });
+        return MillisecondsSince(start);
+    }
+
+    // Every node starts its two subtrees as child jobs, the root is waited for.
+    void Tree(JobSystem& jobs, int depth, uint32_t seed)
+    {
+        if (depth == 0)
+        {
+            gSink += LeafWork(seed);
+            return;
+        }
+
+        JobSystem* pJobs = &jobs;
+        jobs.Run([=]() { Tree(*pJobs, depth - 1, seed * 2); });
+        jobs.Run([=]() { Tree(*pJobs, depth - 1, seed * 2 + 1); });
+    }
+
+    double ForkJoin(JobSystem& jobs)
+    {
+        auto start = Clock::now();
+        JobSystem::Counter counter;
+        JobSystem* pJobs = &jobs;
+        jobs.Run([=]() { Tree(*pJobs, kTreeDepth, 1); }, &counter);
+        jobs.Wait(counter);
+        return MillisecondsSince(start);
+    }
+}
+
+void JobBenchmark::Run(unsigned maxThreads)
+{
+    if (maxThreads == 0)
+        maxThreads = (std::max)(1u, std::thread::hardware_concurrency());
+
+    printf("%u empty jobs, parallel for over %u items in %u item jobs, fork-join tree of %u leaves\n",
+        static_cast<unsigned>(kEmptyJobs), static_cast<unsigned>(kParallelForItems), static_cast<unsigned>(kParallelForGrain),
+        1u << kTreeDepth);
+    printf("threads  empty jobs (ns/job)  parallel for (ms, speedup)  fork-join (ms, speedup)  stolen\n");
+
+    double baseParallelFor = 0.0;
+    double baseForkJoin = 0.0;
+    for (unsigned threads = 1; threads <= maxThreads; threads++)
+    {
+        JobSystem jobs(threads);
+
+        // Warm up the job pools and wake the workers once.
+        EmptyJobs(jobs);
+
+        double emptyMs = EmptyJobs(jobs);
+        double parallelForMs = ParallelFor(jobs);
+        double forkJoinMs = ForkJoin(jobs);
+        if (threads == 1)
+        {
+            baseParallelFor = parallelForMs;
+            baseForkJoin = forkJoinMs;
+        }
+
+        const JobSystem::Stats stats = jobs.GetStats();
+        printf("%7u  %19.1f  %14.1f %10.2fx  %11.1f %10.2fx  %6llu\n", threads, emptyMs * 1e6 / kEmptyJobs,
+            parallelForMs, baseParallelFor / parallelForMs, forkJoinMs, baseForkJoin / forkJoinMs,
+            static_cast<unsigned long long>(stats.Stolen));
+    }
+}
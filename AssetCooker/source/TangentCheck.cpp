@@ -0,0 +1,331 @@
+#include <TangentCheck.h>
+#include <TangentGenerator.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    const float kPi = 3.14159265f;
+    // Largest accepted angle between the generated and the expected tangent
+    const double kMaxErrorDegrees = 0.01;
+
+    struct Vec3
+    {
+        float x, y, z;
+    };
+
+    Vec3 operator+(Vec3 a, Vec3 b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+    Vec3 operator*(Vec3 a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+    float Dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    Vec3 Cross(Vec3 a, Vec3 b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+    struct Vertex
+    {
+        Vec3 Position;
+        Vec3 Normal;
+        float U, V;
+    };
+
+    // With the expected frame of every corner: the direction of increasing U and of
+    // increasing V on the surface of its triangle
+    struct TestMesh
+    {
+        const char* Name;
+        std::vector<Vertex> Vertices;
+        std::vector<uint32_t> Indices;
+        std::vector<Vec3> Tangents;
+        std::vector<Vec3> Bitangents;
+        size_t ExpectedSplits = 0;
+    };
+
+    // Two triangles a, b, c and a, c, d, all corners with the same expected frame
+    void AddQuad(TestMesh& mesh, uint32_t a, uint32_t b, uint32_t c, uint32_t d, Vec3 tangent, Vec3 bitangent)
+    {
+        const uint32_t quad[6] = { a, b, c, a, c, d };
+        mesh.Indices.insert(mesh.Indices.end(), quad, quad + 6);
+        mesh.Tangents.insert(mesh.Tangents.end(), 6, tangent);
+        mesh.Bitangents.insert(mesh.Bitangents.end(), 6, bitangent);
+    }
+
+    // A grid of (cells + 1)^2 vertices on the square origin + s * axisS + t * axisT,
+    // s and t in [0, 1]. UV = (s, t) turned by quarter turns and optionally mirrored.
+    void AddGrid(TestMesh& mesh, Vec3 origin, Vec3 axisS, Vec3 axisT, uint32_t cells, int quarterTurns, bool mirrored)
+    {
+        const Vec3 normal = Cross(axisS, axisT);
+        // UV of s and t, and with it the surface directions of U and V
+        float su = 1.0f, tu = 0.0f, sv = 0.0f, tv = 1.0f;
+        for (int i = 0; i < quarterTurns; i++)
+        {
+            float newSu = -sv, newTu = -tv;
+            sv = su;
+            tv = tu;
+            su = newSu;
+            tu = newTu;
+        }
+        if (mirrored)
+        {
+            su = -su;
+            tu = -tu;
+        }
+        // U and V are linear in s and t, the surface direction of U is the row of the
+        // inverse: for an orthonormal quarter turn or mirror it is the transpose.
+        const Vec3 tangent = axisS * su + axisT * tu;
+        const Vec3 bitangent = axisS * sv + axisT * tv;
+
+        const uint32_t first = static_cast<uint32_t>(mesh.Vertices.size());
+        for (uint32_t y = 0; y <= cells; y++)
+        {
+            for (uint32_t x = 0; x <= cells; x++)
+            {
+                const float s = static_cast<float>(x) / cells;
+                const float t = static_cast<float>(y) / cells;
+                Vertex vertex;
+                vertex.Position = origin + axisS * s + axisT * t;
+                vertex.Normal = normal;
+                vertex.U = su * s + tu * t;
+                vertex.V = sv * s + tv * t;
+                mesh.Vertices.push_back(vertex);
+            }
+        }
+        for (uint32_t y = 0; y < cells; y++)
+        {
+            for (uint32_t x = 0; x < cells; x++)
+            {
+                const uint32_t i = first + y * (cells + 1) + x;
+                AddQuad(mesh, i, i + 1, i + cells + 2, i + cells + 1, tangent, bitangent);
+            }
+        }
+    }
+
+    TestMesh Plane(const char* name, uint32_t cells, int quarterTurns, bool mirrored)
+    {
+        TestMesh mesh;
+        mesh.Name = name;
+        AddGrid(mesh, Vec3{ -1.0f, -1.0f, 0.0f }, Vec3{ 2.0f, 0.0f, 0.0f }, Vec3{ 0.0f, 2.0f, 0.0f }, cells, quarterTurns, mirrored);
+        return mesh;
+    }
+
+    // U mirrored about the middle column, whose vertices are shared by both halves as
+    // in a mesh modelled half and mirrored. Each of them must be split in two.
+    TestMesh MirroredSeam(uint32_t cells)
+    {
+        TestMesh mesh;
+        mesh.Name = "plane, mirrored UVs on a seam";
+        const uint32_t columns = 2 * cells + 1;
+        for (uint32_t y = 0; y <= cells; y++)
+        {
+            for (uint32_t x = 0; x < columns; x++)
+            {
+                const float s = static_cast<float>(x) / cells - 1.0f;
+                const float t = static_cast<float>(y) / cells;
+                Vertex vertex;
+                vertex.Position = Vec3{ s, 2.0f * t - 1.0f, 0.0f };
+                vertex.Normal = Vec3{ 0.0f, 0.0f, 1.0f };
+                vertex.U = fabsf(s);
+                vertex.V = t;
+                mesh.Vertices.push_back(vertex);
+            }
+        }
+        for (uint32_t y = 0; y < cells; y++)
+        {
+            for (uint32_t x = 0; x < columns - 1; x++)
+            {
+                const uint32_t i = y * columns + x;
+                const Vec3 tangent{ x < cells ? -1.0f : 1.0f, 0.0f, 0.0f };
+                AddQuad(mesh, i, i + 1, i + columns + 1, i + columns, tangent, Vec3{ 0.0f, 1.0f, 0.0f });
+            }
+        }
+        mesh.ExpectedSplits = cells + 1;
+        return mesh;
+    }
+
+    // Faces unshared, each with its own UV turn, every other one mirrored
+    TestMesh Cube()
+    {
+        TestMesh mesh;
+        mesh.Name = "cube, turned and mirrored UVs";
+        const Vec3 x{ 2.0f, 0.0f, 0.0f }, y{ 0.0f, 2.0f, 0.0f }, z{ 0.0f, 0.0f, 2.0f };
+        const Vec3 corner{ -1.0f, -1.0f, -1.0f };
+        AddGrid(mesh, corner + z, x, y, 8, 0, false);
+        AddGrid(mesh, corner, y, x, 8, 1, true);
+        AddGrid(mesh, corner + x, y, z, 8, 2, false);
+        AddGrid(mesh, corner, z, y, 8, 3, true);
+        AddGrid(mesh, corner + y, z, x, 8, 1, false);
+        AddGrid(mesh, corner, x, z, 8, 2, true);
+        return mesh;
+    }
+
+    // U around, V up, with the seam vertices doubled like an importer splits them
+    TestMesh Cylinder(uint32_t segments, uint32_t rings)
+    {
+        TestMesh mesh;
+        mesh.Name = "cylinder, UV seam";
+        std::vector<Vec3> tangents;
+        for (uint32_t ring = 0; ring <= rings; ring++)
+        {
+            for (uint32_t segment = 0; segment <= segments; segment++)
+            {
+                const float u = static_cast<float>(segment) / segments;
+                const float angle = 2.0f * kPi * u;
+                Vertex vertex;
+                vertex.Normal = Vec3{ cosf(angle), 0.0f, -sinf(angle) };
+                vertex.Position = vertex.Normal + Vec3{ 0.0f, static_cast<float>(ring) / rings, 0.0f };
+                vertex.U = u;
+                vertex.V = static_cast<float>(ring) / rings;
+                mesh.Vertices.push_back(vertex);
+                tangents.push_back(Vec3{ -sinf(angle), 0.0f, -cosf(angle) });
+            }
+        }
+        for (uint32_t ring = 0; ring < rings; ring++)
+        {
+            for (uint32_t segment = 0; segment < segments; segment++)
+            {
+                const uint32_t i = ring * (segments + 1) + segment;
+                const uint32_t quad[6] = { i, i + 1, i + segments + 2, i, i + segments + 2, i + segments + 1 };
+                for (uint32_t index : quad)
+                {
+                    mesh.Indices.push_back(index);
+                    mesh.Tangents.push_back(tangents[index]);
+                    mesh.Bitangents.push_back(Vec3{ 0.0f, 1.0f, 0.0f });
+                }
+            }
+        }
+        return mesh;
+    }
+
+    struct Result
+    {
+        double MaxErrorDegrees = 0.0;
+        size_t SignErrors = 0;
+        size_t LengthErrors = 0;
+        size_t Splits = 0;
+        size_t IndexErrors = 0; // Corners pointing at a vertex with other attributes
+        bool StreamsMatch = true;
+        double Milliseconds = 0.0;
+    };
+
+    Result Check(const TestMesh& mesh)
+    {
+        Result result;
+
+        TangentGenerator::Input input;
+        input.Positions = &mesh.Vertices.data()->Position.x;
+        input.PositionStride = sizeof(Vertex);
+        input.Normals = &mesh.Vertices.data()->Normal.x;
+        input.NormalStride = sizeof(Vertex);
+        input.TexCoords = &mesh.Vertices.data()->U;
+        input.TexCoordStride = sizeof(Vertex);
+        input.VertexCount = mesh.Vertices.size();
+        input.Indices = mesh.Indices.data();
+        input.IndexCount = mesh.Indices.size();
+
+        std::vector<float> tangents(4 * mesh.Vertices.size());
+        std::vector<uint32_t> indices = mesh.Indices;
+        std::vector<TangentGenerator::SplitVertex> splits;
+        auto start = Clock::now();
+        TangentGenerator::Generate(input, tangents.data(), indices.data(), splits);
+        result.Milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        result.Splits = splits.size();
+
+        // The same attributes as split streams
+        std::vector<Vec3> positions, normals;
+        std::vector<float> texCoords;
+        for (const Vertex& vertex : mesh.Vertices)
+        {
+            positions.push_back(vertex.Position);
+            normals.push_back(vertex.Normal);
+            texCoords.push_back(vertex.U);
+            texCoords.push_back(vertex.V);
+        }
+        input.Positions = &positions.data()->x;
+        input.PositionStride = sizeof(Vec3);
+        input.Normals = &normals.data()->x;
+        input.NormalStride = sizeof(Vec3);
+        input.TexCoords = texCoords.data();
+        input.TexCoordStride = 2 * sizeof(float);
+        std::vector<float> splitTangents(tangents.size());
+        std::vector<uint32_t> splitIndices = mesh.Indices;
+        std::vector<TangentGenerator::SplitVertex> splitSplits;
+        TangentGenerator::Generate(input, splitTangents.data(), splitIndices.data(), splitSplits);
+        result.StreamsMatch = memcmp(tangents.data(), splitTangents.data(), tangents.size() * sizeof(float)) == 0 &&
+            indices == splitIndices && splits.size() == splitSplits.size() &&
+            (splits.empty() || memcmp(splits.data(), splitSplits.data(), splits.size() * sizeof(splits[0])) == 0);
+
+        // Every corner against the frame of its triangle, through the rewritten indices
+        for (size_t c = 0; c < indices.size(); c++)
+        {
+            const uint32_t index = indices[c];
+            const float* out;
+            if (index < mesh.Vertices.size())
+            {
+                out = &tangents[4 * index];
+                if (index != mesh.Indices[c])
+                    result.IndexErrors++;
+            }
+            else
+            {
+                const TangentGenerator::SplitVertex& split = splits[index - mesh.Vertices.size()];
+                out = split.Tangent;
+                if (split.Source != mesh.Indices[c])
+                    result.IndexErrors++;
+            }
+
+            const Vec3 tangent{ out[0], out[1], out[2] };
+            const float sign = out[3];
+            const float length = sqrtf(Dot(tangent, tangent));
+            if (fabsf(length - 1.0f) > 1e-4f)
+            {
+                result.LengthErrors++;
+                continue;
+            }
+
+            // acos loses the small angles near 1 in float, atan2 keeps them
+            const Vec3& expected = mesh.Tangents[c];
+            const Vec3 cross = Cross(tangent, expected);
+            const double angle = atan2(sqrt(double(Dot(cross, cross))), double(Dot(tangent, expected)));
+            result.MaxErrorDegrees = (std::max)(result.MaxErrorDegrees, angle * 180.0 / kPi);
+            const Vec3& normal = mesh.Vertices[mesh.Indices[c]].Normal;
+            const float expectedSign = Dot(Cross(normal, expected), mesh.Bitangents[c]) < 0.0f ? -1.0f : 1.0f;
+            if (sign != expectedSign)
+                result.SignErrors++;
+        }
+        return result;
+    }
+}
+
+int TangentCheck::Run()
+{
+    const TestMesh meshes[] =
+    {
+        Plane("plane", 16, 0, false),
+        Plane("plane, turned UVs", 16, 1, false),
+        Plane("plane, mirrored UVs", 16, 0, true),
+        MirroredSeam(16),
+        Cube(),
+        Cylinder(64, 8),
+        Plane("plane, threaded", 400, 3, true),
+    };
+
+    printf("%-32s %10s %8s %12s %8s %8s %8s %8s %10s\n", "mesh", "vertices", "split", "max error", "signs", "lengths", "indices",
+        "streams", "ms");
+    int failed = 0;
+    for (const TestMesh& mesh : meshes)
+    {
+        const Result result = Check(mesh);
+        const bool ok = result.MaxErrorDegrees <= kMaxErrorDegrees && result.SignErrors == 0 && result.LengthErrors == 0 &&
+            result.IndexErrors == 0 && result.Splits == mesh.ExpectedSplits && result.StreamsMatch;
+        printf("%-32s %10zu %8zu %10.5f d %8zu %8zu %8zu %8s %10.2f  %s\n", mesh.Name, mesh.Vertices.size(), result.Splits,
+            result.MaxErrorDegrees, result.SignErrors, result.LengthErrors, result.IndexErrors, result.StreamsMatch ? "same" : "DIFFER",
+            result.Milliseconds, ok ? "ok" : "FAIL");
+        if (!ok)
+            failed++;
+    }
+    return failed;
+}
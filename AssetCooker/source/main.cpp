@@ -0,0 +1,165 @@
+#include <AssetCooker.h>
+#include <CodecBenchmark.h>
+#include <FileWatcher.h>
+#include <ImportCheck.h>
+#include <JobBenchmark.h>
+#include <JobSystem.h>
+#include <TangentCheck.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static void PrintUsage()
+{
+    printf("Usage: AssetCooker <asset directory> [-j <threads>] [--force] [--no-tangents] [--no-compress] [--watch]\n"
+        "       AssetCooker --bench-jobs [-j <threads>]\n"
+        "       AssetCooker --check-tangents [-j <threads>]\n"
+        "       AssetCooker <asset directory> --bench-codec [-j <threads>]\n"
+        "       AssetCooker <asset directory> --check-import\n"
+        "  -j <threads>      worker threads, default is one per hardware thread\n"
+        "  --force           cook every asset, ignoring the manifest\n"
+        "  --no-tangents     do not store tangent frames in cooked meshes\n"
+        "  --no-compress     store cooked mesh buffers uncompressed\n"
+        "  --watch           keep running and cook sources again when they change\n"
+        "  --bench-jobs      measure the job system on 1 to <threads> threads\n"
+        "  --check-tangents  compare generated tangents with analytic ones on test meshes\n"
+        "  --bench-codec     measure mesh compression on the cooked meshes of the directory\n"
+        "  --check-import    compare the imported models with their FBX SDK references (model.fbx.ref)\n");
+}
+
+static bool IsSourceFile(const std::filesystem::path& file)
+{
+    std::string extension = file.extension().u8string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+    return extension == ".fbx" || extension == ".obj" || extension == ".tga";
+}
+
+// Cooks again after sources change, until the process is stopped. The manifest keeps
+// the unchanged assets from being cooked again.
+static int WatchAssets(AssetCooker::Settings settings)
+{
+    FileWatcher watcher;
+    if (!watcher.Watch(settings.AssetDir, true))
+    {
+        printf("Cannot watch %s\n", settings.AssetDir.u8string().c_str());
+        return 1;
+    }
+    printf("Watching %s for changes\n", settings.AssetDir.u8string().c_str());
+
+    settings.Force = false;
+    std::vector<FileWatcher::Change> changes;
+    while (watcher.WaitForChanges(changes))
+    {
+        // The cooked files and the manifest are written into the same directory.
+        auto firstChange = std::chrono::steady_clock::time_point::max();
+        for (const FileWatcher::Change& change : changes)
+        {
+            if (IsSourceFile(change.File))
+                firstChange = (std::min)(firstChange, change.FirstSeen);
+        }
+        if (firstChange == std::chrono::steady_clock::time_point::max())
+            continue;
+
+        AssetCooker cooker(settings);
+        cooker.Run();
+        printf("Cooked %.1f ms after the change\n",
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - firstChange).count());
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    AssetCooker::Settings settings;
+    bool benchmarkJobs = false;
+    bool benchmarkCodec = false;
+    bool checkImport = false;
+    bool checkTangents = false;
+    bool watch = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            settings.ThreadCount = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--force") == 0)
+        {
+            settings.Force = true;
+        }
+        else if (strcmp(argv[i], "--no-tangents") == 0)
+        {
+            settings.GenerateTangents = false;
+        }
+        else if (strcmp(argv[i], "--no-compress") == 0)
+        {
+            settings.CompressMeshes = false;
+        }
+        else if (strcmp(argv[i], "--watch") == 0)
+        {
+            watch = true;
+        }
+        else if (strcmp(argv[i], "--bench-jobs") == 0)
+        {
+            benchmarkJobs = true;
+        }
+        else if (strcmp(argv[i], "--bench-codec") == 0)
+        {
+            benchmarkCodec = true;
+        }
+        else if (strcmp(argv[i], "--check-tangents") == 0)
+        {
+            checkTangents = true;
+        }
+        else if (strcmp(argv[i], "--check-import") == 0)
+        {
+            checkImport = true;
+        }
+        else if (argv[i][0] != '-' && settings.AssetDir.empty())
+        {
+            settings.AssetDir = std::filesystem::u8path(argv[i]);
+        }
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    if (benchmarkJobs)
+    {
+        JobBenchmark::Run(settings.ThreadCount);
+        return 0;
+    }
+    if (checkTangents)
+    {
+        JobSystem::SetDefaultThreadCount(settings.ThreadCount);
+        return TangentCheck::Run() == 0 ? 0 : 1;
+    }
+
+    std::error_code ec;
+    if (settings.AssetDir.empty() || !std::filesystem::is_directory(settings.AssetDir, ec))
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    JobSystem::SetDefaultThreadCount(settings.ThreadCount);
+    if (benchmarkCodec)
+    {
+        CodecBenchmark::Run(settings.AssetDir);
+        return 0;
+    }
+    if (checkImport)
+        return ImportCheck::Run(settings.AssetDir) == 0 ? 0 : 1;
+
+    AssetCooker cooker(settings);
+    int failed = cooker.Run();
+    if (watch)
+        return WatchAssets(settings);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,967 @@
+#include <CameraPath.h>
+#include <CookedAssets.h>
+#include <EnvironmentLighting.h>
+#include <FbxBinaryReader.h>
+#include <FrameTimings.h>
+#include <JobSystem.h>
+#include <LightClusters.h>
+#include <MeshBvh.h>
+#include <Metrics.h>
+#include <ObjReader.h>
+#include <RangeAllocator.h>
+#include <RenderGraph.h>
+#include <SceneCulling.h>
+#include <SimdMath.h>
+#include <Simulation.h>
+#include <TgaReader.h>
+#include <VertexStreams.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <random>
+
+// Set by the x64 configurations, which link DirectXTex like the renderer
+#ifdef DXBENCH_DIRECTXTEX
+#include <DirectXTex\DirectXTex.h>
+#endif
+
+// Headless benchmark of the CPU side of the renderer: loads a model like the renderer
+// does, then replays a camera path at a fixed timestep through the simulation and the
+// occlusion culling, without a window or a device.
+
+using namespace DirectX;
+
+namespace
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    // Same step as the benchmark mode of the renderer
+    const float kTimeStep = 1.0f / 60.0f;
+
+    // Shared memory of -metrics, apart from the renderer's
+    const char kBenchMetricsName[] = "DXBenchMetrics";
+    const uint32_t kBenchMetricSlots = 1024;
+
+    struct Settings
+    {
+        std::string ModelFile;
+        std::string CameraPathFile;
+        std::string CsvFile;
+        std::string EnvironmentSource; // TGA file or "sky"
+        std::string TextureFile;
+        unsigned Frames = 1000;
+        unsigned ThreadCount = 0;
+        unsigned LightCount = 0;
+        bool MeasureVertexStreams = false;
+        bool MeasureGeometryPool = false;
+        bool MeasureSimdMath = false;
+        bool MeasureRenderGraph = false;
+        bool MeasureBvh = false;
+        bool PublishMetrics = false;
+        int Width = 800;
+        int Height = 600;
+    };
+
+    double MillisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // The cooked mesh if it is current, the model through its importer otherwise.
+    // ASCII FBX files need the FBX SDK, which only the renderer has.
+    bool LoadModel(const std::string& modelFile, CookedAssets::Mesh& mesh)
+    {
+        const std::filesystem::path cookedFile = CookedAssets::MeshPath(modelFile);
+        if (CookedAssets::IsUpToDate(cookedFile, modelFile) && CookedAssets::ReadMesh(cookedFile, mesh))
+            return true;
+
+        std::string extension = std::filesystem::u8path(modelFile).extension().u8string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+        if (extension == ".obj")
+        {
+            ObjReader reader;
+            if (!reader.LoadObjFile(modelFile))
+                return false;
+            reader.GetVertices(mesh.Vertices, mesh.Indices, mesh.SubMeshes);
+            reader.GetMaterials(mesh.Materials);
+            return true;
+        }
+
+        FbxBinaryReader reader;
+        if (!reader.LoadFbxFile(modelFile))
+            return false;
+        reader.GetVertices(mesh.Vertices, mesh.Indices, mesh.SubMeshes);
+        reader.GetMaterials(mesh.Materials);
+        return true;
+    }
+
+    // Runs pass until it took at least a quarter second, returns milliseconds per run.
+    template <typename Pass>
+    double TimePass(Pass pass)
+    {
+        auto start = Clock::now();
+        unsigned runs = 0;
+        do
+        {
+            pass();
+            runs++;
+        } while (runs < 3 || MillisecondsSince(start) < 250.0);
+        return MillisecondsSince(start) / runs;
+    }
+
+    // The position-only passes over the interleaved vertices, the position stream and the
+    // SoA positions. Bytes are what each layout drags through the caches, whole vertices
+    // for the interleaved one.
+    void MeasurePositionPasses(const std::vector<VertexTextured>& vertices, const XMFLOAT4X4& worldViewProj)
+    {
+        const VertexStreams streams = VertexStreams::Split(vertices);
+        PositionsSoA soa;
+        soa.Assign(&streams.Positions[0].x, sizeof(XMFLOAT3), streams.GetVertexCount());
+
+        struct Layout
+        {
+            const char* Name;
+            const float* Positions;
+            size_t Stride;
+            size_t Bytes;
+        };
+        const Layout layouts[] =
+        {
+            { "interleaved", &vertices[0].Pos.x, sizeof(VertexTextured), vertices.size() * sizeof(VertexTextured) },
+            { "position stream", &streams.Positions[0].x, sizeof(XMFLOAT3), streams.GetVertexCount() * sizeof(XMFLOAT3) },
+            { "SoA SSE", nullptr, 0, soa.GetPaddedCount() * 3 * sizeof(float) },
+        };
+
+        std::vector<float> depths(soa.GetPaddedCount()), expectedDepths(vertices.size());
+        XMFLOAT3 expectedMin, expectedMax;
+        PositionPass::ComputeBounds(layouts[0].Positions, layouts[0].Stride, vertices.size(), expectedMin, expectedMax);
+        PositionPass::ProjectDepth(layouts[0].Positions, layouts[0].Stride, vertices.size(), worldViewProj, expectedDepths.data());
+
+        printf("Position-only passes over %zu vertices\n", vertices.size());
+        printf("%-16s  %10s  %12s  %10s  %12s  %10s\n", "layout", "MB read", "bounds ms", "GB/s", "depth ms", "GB/s");
+        for (const Layout& layout : layouts)
+        {
+            XMFLOAT3 min, max;
+            double boundsMs = TimePass([&]()
+            {
+                if (layout.Positions)
+                    PositionPass::ComputeBounds(layout.Positions, layout.Stride, vertices.size(), min, max);
+                else
+                    PositionPass::ComputeBounds(soa, min, max);
+            });
+            double depthMs = TimePass([&]()
+            {
+                if (layout.Positions)
+                    PositionPass::ProjectDepth(layout.Positions, layout.Stride, vertices.size(), worldViewProj, depths.data());
+                else
+                    PositionPass::ProjectDepth(soa, worldViewProj, depths.data());
+            });
+
+            // All layouts have to compute the same thing
+            float depthError = 0.0f;
+            for (size_t i = 0; i < vertices.size(); i++)
+                depthError = (std::max)(depthError, std::fabs(depths[i] - expectedDepths[i]));
+            bool boundsEqual = min.x == expectedMin.x && min.y == expectedMin.y && min.z == expectedMin.z &&
+                max.x == expectedMax.x && max.y == expectedMax.y && max.z == expectedMax.z;
+
+            printf("%-16s  %10.2f  %12.4f  %10.2f  %12.4f  %10.2f%s\n", layout.Name, layout.Bytes / 1e6, boundsMs, layout.Bytes / (boundsMs * 1e6),
+                depthMs, layout.Bytes / (depthMs * 1e6), boundsEqual && depthError < 1e-5f ? "" : "  MISMATCH");
+        }
+    }
+
+    // The geometry pool allocators under streaming: the submeshes of the model stand in
+    // for separate meshes, a pool of them is loaded, then meshes are unloaded and others
+    // loaded in their place. The renderer's buffers are only simulated, so this runs
+    // without a device.
+    void MeasureGeometryPool(const CookedAssets::Mesh& mesh)
+    {
+        const uint32_t kResidentMeshes = 512;
+        const uint32_t kSwaps = 20000;
+        const uint32_t kBuffersPerMesh = 3; // Interleaved vertices, tangents, indices
+
+        struct MeshSize
+        {
+            uint32_t Vertices;
+            uint32_t Indices;
+        };
+        std::vector<MeshSize> sizes;
+        for (const SubMesh& subMesh : mesh.SubMeshes)
+        {
+            uint32_t first = UINT32_MAX, last = 0;
+            for (UINT i = 0; i < subMesh.IndexCount; i++)
+            {
+                first = (std::min)(first, mesh.Indices[subMesh.StartIndex + i]);
+                last = (std::max)(last, mesh.Indices[subMesh.StartIndex + i]);
+            }
+            if (subMesh.IndexCount > 0)
+                sizes.push_back(MeshSize{ last - first + 1, subMesh.IndexCount });
+        }
+        if (sizes.empty())
+            return;
+
+        // Sized for the resident meshes at their average size, with an eighth to spare
+        uint64_t vertexTotal = 0, indexTotal = 0;
+        for (const MeshSize& size : sizes)
+        {
+            vertexTotal += size.Vertices;
+            indexTotal += size.Indices;
+        }
+        RangeAllocator vertices(static_cast<uint32_t>(vertexTotal * kResidentMeshes / sizes.size() * 9 / 8));
+        RangeAllocator indices(static_cast<uint32_t>(indexTotal * kResidentMeshes / sizes.size() * 9 / 8));
+
+        struct Resident
+        {
+            uint32_t Vertex;
+            uint32_t Index;
+        };
+        std::vector<Resident> resident;
+        std::mt19937 random(1);
+        uint32_t defragments = 0, moved = 0, failed = 0;
+        float peakFragmentation = 0.0f;
+        auto load = [&]()
+        {
+            const MeshSize& size = sizes[random() % sizes.size()];
+            Resident mesh = { vertices.Allocate(size.Vertices), indices.Allocate(size.Indices) };
+            if (mesh.Vertex == RangeAllocator::kInvalidOffset || mesh.Index == RangeAllocator::kInvalidOffset)
+            {
+                // What the pool does when the space is there in pieces
+                if (mesh.Vertex != RangeAllocator::kInvalidOffset)
+                    vertices.Free(mesh.Vertex);
+                if (mesh.Index != RangeAllocator::kInvalidOffset)
+                    indices.Free(mesh.Index);
+                if (vertices.GetFreeSize() < size.Vertices || indices.GetFreeSize() < size.Indices)
+                {
+                    failed++;
+                    return;
+                }
+                std::vector<RangeAllocator::Move> vertexMoves = vertices.Compact();
+                std::vector<RangeAllocator::Move> indexMoves = indices.Compact();
+                for (Resident& other : resident)
+                {
+                    for (const RangeAllocator::Move& move : vertexMoves)
+                        other.Vertex = other.Vertex == move.From ? move.To : other.Vertex;
+                    for (const RangeAllocator::Move& move : indexMoves)
+                        other.Index = other.Index == move.From ? move.To : other.Index;
+                }
+                defragments++;
+                moved += static_cast<uint32_t>(vertexMoves.size() + indexMoves.size());
+                mesh = { vertices.Allocate(size.Vertices), indices.Allocate(size.Indices) };
+            }
+            resident.push_back(mesh);
+        };
+
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < kResidentMeshes; i++)
+            load();
+        for (uint32_t i = 0; i < kSwaps; i++)
+        {
+            const size_t unload = random() % resident.size();
+            vertices.Free(resident[unload].Vertex);
+            indices.Free(resident[unload].Index);
+            resident[unload] = resident.back();
+            resident.pop_back();
+            load();
+            peakFragmentation = (std::max)(peakFragmentation, vertices.GetStats().Fragmentation);
+        }
+        const double ms = MillisecondsSince(start);
+
+        const RangeAllocator::Stats vertexStats = vertices.GetStats();
+        const RangeAllocator::Stats indexStats = indices.GetStats();
+        printf("Geometry pool: %zu meshes resident out of %zu sizes, %u swaps in %.1f ms (%.2f us per swap)\n", resident.size(), sizes.size(),
+            kSwaps, ms, ms * 1000.0 / kSwaps);
+        printf("  vertices %u/%u used in %u free ranges, fragmentation %.1f%% (peak %.1f%%), indices %u/%u used, fragmentation %.1f%%\n",
+            vertexStats.Used, vertexStats.Capacity, vertexStats.FreeRanges, vertexStats.Fragmentation * 100.0f, peakFragmentation * 100.0f,
+            indexStats.Used, indexStats.Capacity, indexStats.Fragmentation * 100.0f);
+        printf("  %u defragments moving %u ranges, %u loads that did not fit\n", defragments, moved, failed);
+        const size_t finalMoves = vertices.Compact().size() + indices.Compact().size();
+        printf("  defragmenting now moves %zu ranges, fragmentation %.1f%% vertices, %.1f%% indices\n", finalMoves,
+            vertices.GetStats().Fragmentation * 100.0f, indices.GetStats().Fragmentation * 100.0f);
+        printf("  %u buffers instead of %zu, drawing every mesh binds %u buffers instead of %zu\n", kBuffersPerMesh,
+            resident.size() * kBuffersPerMesh, kBuffersPerMesh, resident.size() * kBuffersPerMesh);
+    }
+
+    // Each batch kernel of SimdMath on every backend the CPU has, on data from the model:
+    // its positions, its normals scaled to different lengths, the bounds of its triangles,
+    // and random matrices. Differences are against the scalar backend.
+    void MeasureSimdMath(const CookedAssets::Mesh& mesh, const XMFLOAT4X4& worldViewProj)
+    {
+        const size_t kMatrixCount = 4096;
+        const size_t vertexCount = mesh.Vertices.size();
+        const size_t triangleCount = mesh.Indices.size() / 3;
+
+        SimdMath::Matrix4 matrix;
+        memcpy(matrix.m, worldViewProj.m, sizeof(matrix.m));
+        const SimdMath::Frustum frustum = SimdMath::Frustum::FromMatrix(matrix);
+
+        std::vector<SimdMath::Float3> positions(vertexCount), normals(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            const VertexTextured& v = mesh.Vertices[i];
+            const float scale = 0.5f + (i % 7);
+            positions[i] = { v.Pos.x, v.Pos.y, v.Pos.z };
+            normals[i] = { v.Normal.x * scale, v.Normal.y * scale, v.Normal.z * scale };
+        }
+        std::vector<SimdMath::Aabb> boxes(triangleCount);
+        for (size_t i = 0; i < triangleCount; i++)
+        {
+            SimdMath::Aabb& box = boxes[i];
+            box.Min = box.Max = positions[mesh.Indices[i * 3]];
+            for (int corner = 1; corner < 3; corner++)
+            {
+                const SimdMath::Float3& p = positions[mesh.Indices[i * 3 + corner]];
+                box.Min = { (std::min)(box.Min.x, p.x), (std::min)(box.Min.y, p.y), (std::min)(box.Min.z, p.z) };
+                box.Max = { (std::max)(box.Max.x, p.x), (std::max)(box.Max.y, p.y), (std::max)(box.Max.z, p.z) };
+            }
+        }
+        std::vector<SimdMath::Matrix4> matrices(kMatrixCount);
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> element(-1.0f, 1.0f);
+        for (SimdMath::Matrix4& m : matrices)
+        {
+            for (auto& row : m.m)
+                for (float& value : row)
+                    value = element(random);
+        }
+
+        struct Result
+        {
+            std::vector<float> Values;
+            double Ms;
+        };
+        // Runs a kernel on each backend, the first result is the scalar one
+        auto measure = [&](const char* name, size_t count, auto run)
+        {
+            const SimdMath::Backend backends[] = { SimdMath::Backend::Scalar, SimdMath::Backend::SSE4, SimdMath::Backend::AVX2 };
+            Result scalar;
+            for (SimdMath::Backend backend : backends)
+            {
+                if (!SimdMath::SetBackend(backend))
+                    continue;
+                Result result;
+                result.Ms = TimePass([&]() { run(result.Values); });
+                if (backend == SimdMath::Backend::Scalar)
+                    scalar = result;
+
+                float difference = 0.0f;
+                for (size_t i = 0; i < result.Values.size(); i++)
+                    difference = (std::max)(difference, std::fabs(result.Values[i] - scalar.Values[i]));
+                printf("%-20s  %-8s  %10zu  %10.4f  %12.1f  %8.2fx  %10g\n", name, SimdMath::GetBackendName(backend), count, result.Ms,
+                    count / (result.Ms * 1000.0), scalar.Ms / result.Ms, difference);
+            }
+        };
+
+        const SimdMath::Backend best = SimdMath::GetBackend();
+        printf("SimdMath batch kernels, %s selected\n", SimdMath::GetBackendName(best));
+        printf("%-20s  %-8s  %10s  %10s  %12s  %9s  %10s\n", "kernel", "backend", "items", "ms", "M items/s", "speedup", "max diff");
+        measure("transform points", vertexCount, [&](std::vector<float>& values)
+        {
+            values.resize(vertexCount * 4);
+            SimdMath::TransformPoints(positions.data(), vertexCount, matrix, reinterpret_cast<SimdMath::Float4*>(values.data()));
+        });
+        measure("multiply matrices", kMatrixCount, [&](std::vector<float>& values)
+        {
+            values.resize(kMatrixCount * 16);
+            SimdMath::MultiplyMatrices(matrices.data(), kMatrixCount, matrix, reinterpret_cast<SimdMath::Matrix4*>(values.data()));
+        });
+        std::vector<uint8_t> visible(triangleCount);
+        measure("frustum test", triangleCount, [&](std::vector<float>& values)
+        {
+            SimdMath::TestFrustum(boxes.data(), triangleCount, frustum, visible.data());
+            values.assign(visible.begin(), visible.end());
+        });
+        std::vector<SimdMath::Float3> normalized(vertexCount);
+        measure("normalize vectors", vertexCount, [&](std::vector<float>& values)
+        {
+            normalized = normals;
+            SimdMath::NormalizeVectors(normalized.data(), vertexCount);
+            values.assign(&normalized[0].x, &normalized[0].x + vertexCount * 3);
+        });
+        SimdMath::SetBackend(best);
+    }
+
+    // Bakes of the environment lighting at the renderer settings, the mean and the fastest
+    // of a few runs per stage
+    void MeasureEnvironment(const std::string& source, const XMFLOAT3& lightDirection)
+    {
+        const uint32_t kBaseSize = 128;
+        const uint32_t kLevels = 6;
+        const int kRuns = 5;
+
+        EnvironmentLighting environment;
+        double sum[3] = {};
+        double best[3] = { 1e9, 1e9, 1e9 };
+        for (int run = 0; run < kRuns; run++)
+        {
+            if (source == "sky")
+            {
+                environment.SetProceduralSky(kBaseSize, lightDirection);
+            }
+            else if (!environment.LoadEquirect(source, kBaseSize))
+            {
+                fprintf(stderr, "Cannot read environment map %s\n", source.c_str());
+                return;
+            }
+            environment.Bake(kLevels);
+
+            const EnvironmentLighting::Stats& stats = environment.GetStats();
+            const double ms[3] = { stats.SourceMs, stats.ShMs, stats.PrefilterMs };
+            for (int i = 0; i < 3; i++)
+            {
+                sum[i] += ms[i];
+                best[i] = (std::min)(best[i], ms[i]);
+            }
+        }
+
+        const EnvironmentLighting::Stats& stats = environment.GetStats();
+        size_t texels = 0;
+        for (const EnvironmentLighting::CubeLevel& level : environment.GetPrefilteredLevels())
+            texels += level.Texels.size();
+        printf("Environment lighting from %s: %u base size, %u prefiltered levels, %.1f KB, %u threads\n", source.c_str(), stats.BaseSize,
+            stats.Levels, texels * sizeof(XMFLOAT4) / 1024.0, stats.Threads);
+        printf("%-20s  %10s  %10s\n", "stage", "mean ms", "min ms");
+        const char* names[3] = { "source to cube", "SH projection", "prefilter" };
+        for (int i = 0; i < 3; i++)
+            printf("%-20s  %10.2f  %10.2f\n", names[i], sum[i] / kRuns, best[i]);
+
+        const XMFLOAT4* sh = environment.GetShCoefficients();
+        for (int i = 0; i < 9; i++)
+            printf("SH %d: %8.4f %8.4f %8.4f\n", i, sh[i].x, sh[i].y, sh[i].z);
+    }
+
+    // Loads of a TGA texture the way the renderer does them, up to the upload buffer: the
+    // in-house decoder, the cooked texture when it is current, and DirectXTex where it is
+    // linked. The mean and the fastest of a few runs, the files stay in the OS cache.
+    void MeasureTextureLoads(const std::string& file)
+    {
+        const int kRuns = 10;
+        const std::filesystem::path path = std::filesystem::u8path(file);
+
+        struct Loader
+        {
+            const char* Name;
+            std::function<bool()> Load;
+        };
+        std::vector<Loader> loaders;
+
+        TGAReader header;
+        if (!header.Open(path))
+        {
+            fprintf(stderr, "Cannot read texture %s\n", file.c_str());
+            return;
+        }
+        const uint32_t width = header.GetWidth();
+        const uint32_t height = header.GetHeight();
+        header.Close();
+
+        std::vector<uint8_t> pixels;
+        loaders.push_back({ "TGAReader", [&]()
+        {
+            TGAReader reader;
+            if (!reader.Open(path))
+                return false;
+            pixels.resize(size_t(reader.GetWidth()) * reader.GetHeight() * 4);
+            return reader.Decode(pixels.data(), size_t(reader.GetWidth()) * 4);
+        } });
+
+        const std::filesystem::path cookedFile = CookedAssets::TexturePath(path);
+        if (CookedAssets::IsUpToDate(cookedFile, path))
+        {
+            loaders.push_back({ "cooked texture", [&]()
+            {
+                CookedAssets::Texture texture;
+                return CookedAssets::ReadTexture(cookedFile, texture);
+            } });
+        }
+
+#ifdef DXBENCH_DIRECTXTEX
+        loaders.push_back({ "DirectXTex", [&]()
+        {
+            DirectX::ScratchImage image;
+            return SUCCEEDED(DirectX::LoadFromTGAFile(path.c_str(), nullptr, image));
+        } });
+#endif
+
+        printf("Texture loads of %s: %ux%u, %.1f MB decoded\n", file.c_str(), width, height, width * 4.0 * height / (1024.0 * 1024.0));
+        printf("%-20s  %10s  %10s  %10s\n", "loader", "mean ms", "min ms", "MB/s");
+        for (const Loader& loader : loaders)
+        {
+            double sum = 0.0;
+            double best = 1e9;
+            for (int run = 0; run < kRuns; run++)
+            {
+                auto start = Clock::now();
+                if (!loader.Load())
+                {
+                    fprintf(stderr, "%s cannot load %s\n", loader.Name, file.c_str());
+                    return;
+                }
+                const double ms = MillisecondsSince(start);
+                sum += ms;
+                best = (std::min)(best, ms);
+            }
+            printf("%-20s  %10.2f  %10.2f  %10.0f\n", loader.Name, sum / kRuns, best, width * 4.0 * height / (1024.0 * 1024.0) / (best / 1000.0));
+        }
+    }
+
+    // Build time of the mesh BVH, the fastest of a few builds, and its rays per second for
+    // random rays from a sphere around the mesh to random points inside its bounds, on one
+    // thread and then on all job system threads.
+    void MeasureBvh(const CookedAssets::Mesh& mesh)
+    {
+        const int kBuilds = 5;
+        const size_t kRayCount = 1 << 20;
+
+        MeshBvh bvh;
+        double bestBuildMs = 1e9;
+        for (int build = 0; build < kBuilds; build++)
+        {
+            bvh.Build(&mesh.Vertices[0].Pos.x, sizeof(VertexTextured), mesh.Indices.data(), mesh.Indices.size());
+            bestBuildMs = (std::min)(bestBuildMs, bvh.GetBuildStats().Milliseconds);
+        }
+        const MeshBvh::BuildStats& stats = bvh.GetBuildStats();
+        printf("BVH: %zu triangles, %zu nodes, %zu leaves, built in %.1f ms on %u threads\n", stats.TriangleCount, stats.NodeCount,
+            stats.LeafCount, bestBuildMs, stats.ThreadCount);
+
+        float boxMin[3] = { mesh.Vertices[0].Pos.x, mesh.Vertices[0].Pos.y, mesh.Vertices[0].Pos.z };
+        float boxMax[3] = { boxMin[0], boxMin[1], boxMin[2] };
+        for (const VertexTextured& vertex : mesh.Vertices)
+        {
+            const float* pos = &vertex.Pos.x;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                boxMin[axis] = (std::min)(boxMin[axis], pos[axis]);
+                boxMax[axis] = (std::max)(boxMax[axis], pos[axis]);
+            }
+        }
+        const float radius = std::sqrt((boxMax[0] - boxMin[0]) * (boxMax[0] - boxMin[0]) + (boxMax[1] - boxMin[1]) * (boxMax[1] - boxMin[1]) +
+            (boxMax[2] - boxMin[2]) * (boxMax[2] - boxMin[2]));
+
+        std::vector<XMFLOAT3> origins(kRayCount);
+        std::vector<XMFLOAT3> directions(kRayCount);
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (size_t i = 0; i < kRayCount; i++)
+        {
+            float onSphere[3] = { unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f };
+            const float length = (std::max)(std::sqrt(onSphere[0] * onSphere[0] + onSphere[1] * onSphere[1] + onSphere[2] * onSphere[2]), 1e-6f);
+            float* origin = &origins[i].x;
+            float* direction = &directions[i].x;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                const float center = 0.5f * (boxMin[axis] + boxMax[axis]);
+                const float target = boxMin[axis] + unit(random) * (boxMax[axis] - boxMin[axis]);
+                origin[axis] = center + onSphere[axis] / length * radius;
+                direction[axis] = target - origin[axis];
+            }
+        }
+
+        auto trace = [&](size_t first, size_t end)
+        {
+            MeshBvh::Hit hit;
+            size_t hits = 0;
+            for (size_t i = first; i < end; i++)
+                hits += bvh.Intersect(&origins[i].x, &directions[i].x, 2.0f, hit) ? 1 : 0;
+            return hits;
+        };
+
+        auto start = Clock::now();
+        const size_t hits = trace(0, kRayCount);
+        const double singleMs = MillisecondsSince(start);
+
+        JobSystem& jobs = JobSystem::Get();
+        start = Clock::now();
+        jobs.ParallelFor(kRayCount, 4096, [&](size_t first, size_t end) { trace(first, end); });
+        const double multiMs = MillisecondsSince(start);
+
+        printf("BVH rays: %zu, %zu hits, %.2f Mrays/s on 1 thread, %.2f Mrays/s on %u threads\n", kRayCount, hits,
+            kRayCount / singleMs / 1000.0, kRayCount / multiMs / 1000.0, jobs.GetThreadCount());
+    }
+
+    // A deferred frame drawing into backBuffer: shadow cascades, G-buffer, SSAO, lighting,
+    // motion blur, bloom and tone mapping, plus a debug view nothing reads
+    RenderGraph::TextureHandle AddDeferredFrame(RenderGraph& graph, uint32_t width, uint32_t height, RenderGraph::TextureHandle backBuffer)
+    {
+        typedef RenderGraph::TextureHandle Handle;
+        typedef RenderGraph::TextureFormat Format;
+        auto desc = [](uint32_t w, uint32_t h, Format format) { return RenderGraph::TextureDesc{ w, h, format, 1 }; };
+
+        Handle shadowMaps[4];
+        for (Handle& shadowMap : shadowMaps)
+            shadowMap = graph.AddPass("Shadow cascade").Create("Shadow map", desc(2048, 2048, Format::D32F));
+
+        RenderGraph::PassBuilder gbuffer = graph.AddPass("G-buffer");
+        Handle depth = gbuffer.Create("Depth", desc(width, height, Format::D24S8));
+        Handle albedo = gbuffer.Create("Albedo", desc(width, height, Format::RGBA8));
+        Handle normals = gbuffer.Create("Normals", desc(width, height, Format::RGBA16F));
+        Handle material = gbuffer.Create("Material", desc(width, height, Format::RGBA8));
+
+        RenderGraph::PassBuilder velocityPass = graph.AddPass("Velocity");
+        velocityPass.Read(depth);
+        Handle velocity = velocityPass.Create("Velocity", desc(width, height, Format::RG16F));
+
+        RenderGraph::PassBuilder debugPass = graph.AddPass("Debug view");
+        debugPass.Read(normals);
+        debugPass.Read(depth);
+        debugPass.Create("Debug", desc(width, height, Format::RGBA8));
+
+        RenderGraph::PassBuilder linearDepthPass = graph.AddPass("Linear depth");
+        linearDepthPass.Read(depth);
+        Handle linearDepth = linearDepthPass.Create("Linear depth", desc(width, height, Format::R32F));
+
+        RenderGraph::PassBuilder ssaoPass = graph.AddPass("SSAO");
+        ssaoPass.Read(linearDepth);
+        ssaoPass.Read(normals);
+        Handle occlusion = ssaoPass.Create("Occlusion", desc(width, height, Format::R32F));
+
+        RenderGraph::PassBuilder blurPass = graph.AddPass("SSAO blur");
+        blurPass.Read(occlusion);
+        Handle blurredOcclusion = blurPass.Create("Blurred occlusion", desc(width, height, Format::R32F));
+
+        RenderGraph::PassBuilder lighting = graph.AddPass("Lighting");
+        for (Handle& shadowMap : shadowMaps)
+            lighting.Read(shadowMap);
+        lighting.Read(albedo);
+        lighting.Read(normals);
+        lighting.Read(material);
+        lighting.Read(blurredOcclusion);
+        lighting.Read(depth);
+        Handle hdr = lighting.Create("HDR", desc(width, height, Format::RGBA16F));
+
+        RenderGraph::PassBuilder transparent = graph.AddPass("Transparent");
+        hdr = transparent.Write(hdr);
+        depth = transparent.Write(depth);
+
+        RenderGraph::PassBuilder motionBlur = graph.AddPass("Motion blur");
+        motionBlur.Read(hdr);
+        motionBlur.Read(velocity);
+        hdr = motionBlur.Create("Blurred HDR", desc(width, height, Format::RGBA16F));
+
+        const int kBloomLevels = 5;
+        Handle bloom[kBloomLevels];
+        for (int level = 0; level < kBloomLevels; level++)
+        {
+            RenderGraph::PassBuilder pass = graph.AddPass("Bloom downsample");
+            pass.Read(level == 0 ? hdr : bloom[level - 1]);
+            bloom[level] = pass.Create("Bloom", desc((std::max)(width >> (level + 1), 1u), (std::max)(height >> (level + 1), 1u), Format::RGBA16F));
+        }
+        Handle upsampled = bloom[kBloomLevels - 1];
+        for (int level = kBloomLevels - 2; level >= 0; level--)
+        {
+            RenderGraph::PassBuilder pass = graph.AddPass("Bloom upsample");
+            pass.Read(bloom[level]);
+            pass.Read(upsampled);
+            upsampled = pass.Create("Bloom sum", desc((std::max)(width >> (level + 1), 1u), (std::max)(height >> (level + 1), 1u), Format::RGBA16F));
+        }
+
+        RenderGraph::PassBuilder toneMap = graph.AddPass("Tone map");
+        toneMap.Read(hdr);
+        toneMap.Read(upsampled);
+        Handle ldr = toneMap.Create("LDR", desc(width, height, Format::RGBA8));
+
+        RenderGraph::PassBuilder fxaa = graph.AddPass("FXAA");
+        fxaa.Read(ldr);
+        return fxaa.Write(backBuffer);
+    }
+
+    // Build and compile times of the deferred frame graph, alone and as many views in one
+    // graph, with the texture memory saved by aliasing
+    void MeasureRenderGraph(uint32_t width, uint32_t height)
+    {
+        const int kIterations = 10000;
+        const uint32_t viewCounts[] = { 1, 4, 16 };
+
+        RenderGraph graph;
+        printf("Render graph, deferred frame at %ux%u\n", width, height);
+        printf("%6s  %8s  %8s  %10s  %10s  %10s  %12s  %12s\n", "views", "passes", "culled", "textures", "physical", "build us",
+            "compile us", "saved MB");
+        for (uint32_t views : viewCounts)
+        {
+            double buildMs = 0.0;
+            double compileMs = 0.0;
+            for (int iteration = 0; iteration < kIterations; iteration++)
+            {
+                auto start = Clock::now();
+                graph.Reset();
+                for (uint32_t view = 0; view < views; view++)
+                {
+                    RenderGraph::TextureHandle backBuffer = graph.Import("Back buffer", RenderGraph::TextureDesc{ width, height,
+                        RenderGraph::TextureFormat::RGBA8, 1 });
+                    graph.MarkOutput(AddDeferredFrame(graph, width, height, backBuffer));
+                }
+                buildMs += MillisecondsSince(start);
+                graph.Compile();
+                compileMs += graph.GetStats().CompileMs;
+            }
+
+            const RenderGraph::Stats& stats = graph.GetStats();
+            printf("%6u  %8u  %8u  %10u  %10u  %10.2f  %12.2f  %5.1f of %4.1f\n", views, stats.Passes, stats.CulledPasses, stats.Textures,
+                stats.PhysicalTextures, buildMs * 1000.0 / kIterations, compileMs * 1000.0 / kIterations,
+                (stats.RequestedBytes - stats.AllocatedBytes) / 1048576.0, stats.RequestedBytes / 1048576.0);
+        }
+
+        graph.Reset();
+        RenderGraph::TextureHandle backBuffer = graph.Import("Back buffer", RenderGraph::TextureDesc{ width, height,
+            RenderGraph::TextureFormat::RGBA8, 1 });
+        graph.MarkOutput(AddDeferredFrame(graph, width, height, backBuffer));
+        graph.Compile();
+        std::string order;
+        for (uint32_t pass : graph.GetPassOrder())
+            order += std::string(order.empty() ? "" : ", ") + graph.GetPassName(pass);
+        printf("Pass order: %s\n", order.c_str());
+    }
+
+    void PrintUsage()
+    {
+        printf("Usage: DXBench <model> [-frames <count>] [-camera <path file>] [-csv <file>] [-j <threads>] [-size <width> <height>] [-lights <count>] [-environment <tga file|sky>] [-textures <tga file>] [-vertex-streams] [-geometry-pool] [-simd-math] [-render-graph] [-bvh] [-metrics]\n"
+            "  -frames <count>       frames to run, default 1000\n"
+            "  -camera <path file>   camera path recorded by the renderer, default is an orbit around the model\n"
+            "  -csv <file>           write the per-frame timings\n"
+            "  -j <threads>          job system threads, default is one per hardware thread\n"
+            "  -size <w> <h>         viewport size for the aspect ratio and the occlusion buffer, default 800 600\n"
+            "  -lights <count>       also bin this many moving point and spot lights into the light clusters every frame\n"
+            "  -environment <source> also time the SH projection and prefiltering of an environment map, \"sky\" for the procedural one\n"
+            "  -textures <tga file>  also time loading a texture with TGAReader, from its cooked file and with DirectXTex where linked\n"
+            "  -vertex-streams       also time position-only passes over each vertex layout\n"
+            "  -geometry-pool        also measure fragmentation of the geometry pool allocators under streaming\n"
+            "  -simd-math            also time the batch math kernels on each instruction set against the scalar ones\n"
+            "  -render-graph         also time building and compiling the render graph of a deferred frame\n"
+            "  -bvh                  also time building the mesh BVH and tracing random rays through it\n"
+            "  -metrics              publish the frame timings to DXBenchMetrics for DXMetrics and time the publishing\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+        {
+            settings.Frames = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-camera") == 0 && i + 1 < argc)
+        {
+            settings.CameraPathFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "-csv") == 0 && i + 1 < argc)
+        {
+            settings.CsvFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            settings.ThreadCount = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-size") == 0 && i + 2 < argc)
+        {
+            settings.Width = atoi(argv[++i]);
+            settings.Height = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-lights") == 0 && i + 1 < argc)
+        {
+            settings.LightCount = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-environment") == 0 && i + 1 < argc)
+        {
+            settings.EnvironmentSource = argv[++i];
+        }
+        else if (strcmp(argv[i], "-textures") == 0 && i + 1 < argc)
+        {
+            settings.TextureFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "-vertex-streams") == 0)
+        {
+            settings.MeasureVertexStreams = true;
+        }
+        else if (strcmp(argv[i], "-geometry-pool") == 0)
+        {
+            settings.MeasureGeometryPool = true;
+        }
+        else if (strcmp(argv[i], "-simd-math") == 0)
+        {
+            settings.MeasureSimdMath = true;
+        }
+        else if (strcmp(argv[i], "-render-graph") == 0)
+        {
+            settings.MeasureRenderGraph = true;
+        }
+        else if (strcmp(argv[i], "-bvh") == 0)
+        {
+            settings.MeasureBvh = true;
+        }
+        else if (strcmp(argv[i], "-metrics") == 0)
+        {
+            settings.PublishMetrics = true;
+        }
+        else if (argv[i][0] != '-' && settings.ModelFile.empty())
+        {
+            settings.ModelFile = argv[i];
+        }
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+    if (settings.ModelFile.empty() || settings.Frames == 0 || settings.Width <= 0 || settings.Height <= 0)
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    JobSystem::SetDefaultThreadCount(settings.ThreadCount);
+    printf("Job system: %u threads\n", JobSystem::Get().GetThreadCount());
+
+    CameraPath path = CameraPath::DefaultOrbit();
+    if (!settings.CameraPathFile.empty() && !path.Load(settings.CameraPathFile))
+    {
+        fprintf(stderr, "Cannot read camera path %s\n", settings.CameraPathFile.c_str());
+        return 1;
+    }
+
+    // Loading
+    auto start = Clock::now();
+    CookedAssets::Mesh mesh;
+    if (!LoadModel(settings.ModelFile, mesh) || mesh.Vertices.empty())
+    {
+        fprintf(stderr, "Cannot load %s\n", settings.ModelFile.c_str());
+        return 1;
+    }
+    double loadMs = MillisecondsSince(start);
+
+    start = Clock::now();
+    MeshBvh bvh;
+    bvh.Build(&mesh.Vertices[0].Pos.x, sizeof(VertexTextured), mesh.Indices.data(), mesh.Indices.size());
+    double bvhMs = MillisecondsSince(start);
+
+    start = Clock::now();
+    SceneCulling culling;
+    culling.Init(&mesh.Vertices[0].Pos.x, sizeof(VertexTextured), mesh.Vertices.size(), mesh.Indices.data(), mesh.SubMeshes);
+    culling.Resize(settings.Width, settings.Height);
+    double cullingSetupMs = MillisecondsSince(start);
+
+    printf("%s: %zu vertices, %zu triangles, %zu submeshes\n", settings.ModelFile.c_str(), mesh.Vertices.size(), mesh.Indices.size() / 3,
+        mesh.SubMeshes.size());
+    printf("load %.1f ms, BVH %.1f ms, occluders %.1f ms\n", loadMs, bvhMs, cullingSetupMs);
+
+    // Frames
+    FrameTimings timings;
+    const size_t updateColumn = timings.AddColumn("update ms");
+    const size_t occlusionColumn = timings.AddColumn("occlusion raster ms");
+    const size_t cullColumn = timings.AddColumn("cull ms");
+    const size_t frameColumn = timings.AddColumn("frame ms");
+    const size_t visibleColumn = timings.AddColumn("visible submeshes");
+    const size_t lightBinningColumn = settings.LightCount ? timings.AddColumn("light binning ms") : 0;
+    const size_t lightIndicesColumn = settings.LightCount ? timings.AddColumn("light indices") : 0;
+    timings.Reserve(settings.Frames);
+
+    Simulation simulation;
+    simulation.SetAspectRatio(static_cast<float>(settings.Width) / settings.Height);
+    simulation.SetLocalLightCount(settings.LightCount);
+    LightClusters lightClusters;
+    FrameState state;
+    std::vector<UINT> visible;
+    visible.reserve(mesh.SubMeshes.size());
+
+    // The frame columns again, published like the renderer publishes its metrics
+    MetricsRegistry metrics;
+    const MetricsRegistry::Handle frameCountMetric = metrics.AddCounter("frame.count");
+    const MetricsRegistry::Handle updateMetric = metrics.AddGauge("frame.update_ms");
+    const MetricsRegistry::Handle occlusionMetric = metrics.AddGauge("culling.occlusion_ms");
+    const MetricsRegistry::Handle cullMetric = metrics.AddGauge("culling.cull_ms");
+    const MetricsRegistry::Handle frameMetric = metrics.AddGauge("frame.ms");
+    const MetricsRegistry::Handle visibleMetric = metrics.AddGauge("culling.visible_submeshes");
+    const MetricsRegistry::Handle lightBinningMetric = metrics.AddGauge("lights.binning_ms");
+    if (settings.PublishMetrics && !metrics.Open(kBenchMetricsName, kBenchMetricSlots))
+        fprintf(stderr, "Cannot create the shared memory %s, metrics are not published\n", kBenchMetricsName);
+    double publishMs = 0.0;
+
+    auto runStart = Clock::now();
+    for (unsigned frame = 0; frame < settings.Frames; frame++)
+    {
+        auto frameStart = Clock::now();
+        simulation.SetOrbit(path.Sample(frame * kTimeStep));
+        simulation.Update(kTimeStep, state);
+        double updateMs = MillisecondsSince(frameStart);
+
+        auto cullStart = Clock::now();
+        XMFLOAT4X4 worldViewProj;
+        XMStoreFloat4x4(&worldViewProj, XMLoadFloat4x4(&state.World) * XMLoadFloat4x4(&state.View) * XMLoadFloat4x4(&state.Proj));
+        culling.Cull(worldViewProj, visible);
+        double cullMs = MillisecondsSince(cullStart);
+
+        if (settings.LightCount)
+        {
+            lightClusters.Bin(state.LocalLights.data(), state.LocalLights.size(), state.View, state.Proj);
+            timings.Add(lightBinningColumn, lightClusters.GetStats().BinMs);
+            timings.Add(lightIndicesColumn, static_cast<double>(lightClusters.GetStats().Indices));
+        }
+
+        timings.Add(updateColumn, updateMs);
+        timings.Add(occlusionColumn, culling.GetStats().RasterMs);
+        timings.Add(cullColumn, cullMs);
+        const double frameMs = MillisecondsSince(frameStart);
+        timings.Add(frameColumn, frameMs);
+        timings.Add(visibleColumn, static_cast<double>(visible.size()));
+
+        if (settings.PublishMetrics)
+        {
+            auto publishStart = Clock::now();
+            metrics.Add(frameCountMetric, 1.0);
+            metrics.Set(updateMetric, updateMs);
+            metrics.Set(occlusionMetric, culling.GetStats().RasterMs);
+            metrics.Set(cullMetric, cullMs);
+            metrics.Set(frameMetric, frameMs);
+            metrics.Set(visibleMetric, static_cast<double>(visible.size()));
+            metrics.Set(lightBinningMetric, settings.LightCount ? lightClusters.GetStats().BinMs : 0.0);
+            metrics.Publish(frame);
+            publishMs += MillisecondsSince(publishStart);
+        }
+    }
+    double runSeconds = MillisecondsSince(runStart) / 1000.0;
+
+    printf("%u frames in %.3f s, %.1f frames/s, camera path %.1f s\n", settings.Frames, runSeconds, settings.Frames / runSeconds,
+        path.GetDuration());
+    printf("%s", timings.Report().c_str());
+    if (settings.PublishMetrics)
+    {
+        printf("Metrics: %zu published to %s every frame, %.3f us per frame\n", metrics.GetMetricCount(),
+            metrics.IsOpen() ? kBenchMetricsName : "nothing", publishMs * 1000.0 / settings.Frames);
+    }
+
+    if (settings.MeasureVertexStreams)
+    {
+        XMFLOAT4X4 worldViewProj;
+        XMStoreFloat4x4(&worldViewProj, XMLoadFloat4x4(&state.World) * XMLoadFloat4x4(&state.View) * XMLoadFloat4x4(&state.Proj));
+        MeasurePositionPasses(mesh.Vertices, worldViewProj);
+    }
+    if (settings.MeasureGeometryPool)
+        MeasureGeometryPool(mesh);
+    if (settings.MeasureSimdMath)
+    {
+        XMFLOAT4X4 worldViewProj;
+        XMStoreFloat4x4(&worldViewProj, XMLoadFloat4x4(&state.World) * XMLoadFloat4x4(&state.View) * XMLoadFloat4x4(&state.Proj));
+        MeasureSimdMath(mesh, worldViewProj);
+    }
+    if (settings.MeasureRenderGraph)
+        MeasureRenderGraph(settings.Width, settings.Height);
+    if (settings.MeasureBvh)
+        MeasureBvh(mesh);
+    if (!settings.EnvironmentSource.empty())
+        MeasureEnvironment(settings.EnvironmentSource, state.Light.Direction);
+    if (!settings.TextureFile.empty())
+        MeasureTextureLoads(settings.TextureFile);
+
+    if (!settings.CsvFile.empty() && !timings.WriteCsv(settings.CsvFile))
+    {
+        fprintf(stderr, "Cannot write %s\n", settings.CsvFile.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+#include <Metrics.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Reader of the metrics a running renderer publishes in shared memory: prints a summary
+// of the frames of every interval, and can append every frame to a CSV file for
+// dashboards. Only reads, the renderer is never slowed down by it.
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Without new frames for that long the ring is looked up again, the writer may
+    // have exited or restarted
+    const double kReopenSeconds = 2.0;
+
+    struct Settings
+    {
+        std::string Name = kMetricsName;
+        std::string CsvFile;
+        unsigned IntervalMs = 1000;
+        unsigned Seconds = 0; // Until stopped
+    };
+
+    // Of one metric over the frames of an interval
+    struct Summary
+    {
+        double Sum;
+        double Max;
+    };
+
+    void PrintUsage()
+    {
+        printf("Usage: DXMetrics [-name <shared memory name>] [-interval <ms>] [-seconds <count>] [-csv <file>]\n"
+            "  -name <name>       shared memory of the writer, default %s, DXBench -metrics uses DXBenchMetrics\n"
+            "  -interval <ms>     summary interval, default 1000; frames older than the ring are lost\n"
+            "  -seconds <count>   stop after that long, default is to run until stopped\n"
+            "  -csv <file>        also write every frame read\n", kMetricsName);
+    }
+
+    double SecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    void WriteCsvHeader(std::ofstream& csv, const MetricsReader& reader)
+    {
+        csv << "index,frame,seconds";
+        for (size_t m = 0; m < reader.GetMetricCount(); m++)
+            csv << ',' << reader.GetName(m);
+        csv << '\n';
+    }
+
+    void WriteCsvRow(std::ofstream& csv, const MetricsReader::Sample& sample)
+    {
+        csv << sample.Index << ',' << sample.Frame << ',' << sample.Seconds;
+        for (double value : sample.Values)
+            csv << ',' << value;
+        csv << '\n';
+    }
+
+    // Gauges as mean and maximum, counters as rates since the previous frame read
+    void PrintSummary(const MetricsReader& reader, const std::vector<Summary>& summaries, size_t frames, uint64_t lost,
+        const MetricsReader::Sample& first, const MetricsReader::Sample& last)
+    {
+        printf("frame %llu: %zu frames read, %llu lost\n", static_cast<unsigned long long>(last.Frame), frames,
+            static_cast<unsigned long long>(lost));
+        const double seconds = last.Seconds - first.Seconds;
+        for (size_t m = 0; m < reader.GetMetricCount(); m++)
+        {
+            if (reader.GetKind(m) == MetricKind::Counter)
+            {
+                const double rate = seconds > 0.0 ? (last.Values[m] - first.Values[m]) / seconds : 0.0;
+                printf("  %-28s %14.6g /s   %14.6g total\n", reader.GetName(m).c_str(), rate, last.Values[m]);
+            }
+            else
+            {
+                printf("  %-28s %14.6g mean %14.6g max\n", reader.GetName(m).c_str(), summaries[m].Sum / frames, summaries[m].Max);
+            }
+        }
+        fflush(stdout);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-name") == 0 && i + 1 < argc)
+        {
+            settings.Name = argv[++i];
+        }
+        else if (strcmp(argv[i], "-interval") == 0 && i + 1 < argc)
+        {
+            settings.IntervalMs = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-seconds") == 0 && i + 1 < argc)
+        {
+            settings.Seconds = static_cast<unsigned>(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "-csv") == 0 && i + 1 < argc)
+        {
+            settings.CsvFile = argv[++i];
+        }
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+    if (settings.IntervalMs == 0)
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    std::ofstream csv;
+    if (!settings.CsvFile.empty())
+    {
+        csv.open(settings.CsvFile);
+        csv.precision(9);
+        if (!csv)
+        {
+            fprintf(stderr, "Cannot write %s\n", settings.CsvFile.c_str());
+            return 1;
+        }
+    }
+
+    MetricsReader reader;
+    MetricsReader::Sample sample;
+    MetricsReader::Sample first;
+    MetricsReader::Sample previous; // Last frame of the previous interval
+    bool hasPrevious = false;
+    std::vector<Summary> summaries;
+    uint64_t next = 0;
+    bool waiting = false;
+    auto runStart = Clock::now();
+    auto lastFrameTime = Clock::now();
+
+    while (settings.Seconds == 0 || SecondsSince(runStart) < settings.Seconds)
+    {
+        if (!reader.IsOpen())
+        {
+            if (!reader.Open(settings.Name.c_str()))
+            {
+                if (!waiting)
+                    printf("Waiting for %s\n", settings.Name.c_str());
+                waiting = true;
+                std::this_thread::sleep_for(std::chrono::milliseconds(settings.IntervalMs));
+                continue;
+            }
+            waiting = false;
+            printf("Reading %zu metrics from %s, %u frames kept\n", reader.GetMetricCount(), settings.Name.c_str(), reader.GetSlotCount());
+            if (csv.is_open())
+                WriteCsvHeader(csv, reader);
+            // From the next frame on, the ring may hold frames of an earlier run
+            next = reader.GetPublished();
+            hasPrevious = false;
+            lastFrameTime = Clock::now();
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(settings.IntervalMs));
+
+        const uint64_t published = reader.GetPublished();
+        if (published < next)
+        {
+            // The writer restarted in the same shared memory
+            reader.Close();
+            continue;
+        }
+
+        uint64_t lost = 0;
+        if (published - next > reader.GetSlotCount())
+        {
+            lost = published - reader.GetSlotCount() - next;
+            next = published - reader.GetSlotCount();
+        }
+
+        summaries.assign(reader.GetMetricCount(), Summary{ 0.0, -HUGE_VAL });
+        size_t frames = 0;
+        for (; next < published; next++)
+        {
+            if (!reader.Read(next, sample))
+            {
+                lost++;
+                continue;
+            }
+            if (frames == 0)
+                first = hasPrevious ? previous : sample;
+            frames++;
+            for (size_t m = 0; m < sample.Values.size(); m++)
+            {
+                summaries[m].Sum += sample.Values[m];
+                summaries[m].Max = (std::max)(summaries[m].Max, sample.Values[m]);
+            }
+            if (csv.is_open())
+                WriteCsvRow(csv, sample);
+            previous = sample;
+            hasPrevious = true;
+        }
+
+        if (frames == 0)
+        {
+            if (SecondsSince(lastFrameTime) > kReopenSeconds)
+            {
+                printf("No frames for %.0f s\n", kReopenSeconds);
+                reader.Close();
+            }
+            continue;
+        }
+        lastFrameTime = Clock::now();
+        PrintSummary(reader, summaries, frames, lost, first, previous);
+    }
+    return 0;
+}
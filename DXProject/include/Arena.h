@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+// Monotonic (bump) allocator for temporary data with a common lifetime.
+// Allocations are never freed individually, Reset() releases everything at once
+// and keeps the memory blocks for the next use, so a reused arena stops touching
+// the heap after warming up.
+class MonotonicArena
+{
+public:
+    explicit MonotonicArena(size_t blockSize = 1 << 20);
+    ~MonotonicArena();
+
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    // Uninitialized storage, only meant for trivial types.
+    template<typename T>
+    T* AllocateArray(size_t count)
+    {
+        return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    // Storage filled with value
+    template<typename T>
+    T* AllocateArray(size_t count, const T& value)
+    {
+        T* p = AllocateArray<T>(count);
+        for (size_t i = 0; i < count; i++)
+            p[i] = value;
+        return p;
+    }
+
+    void Reset();
+
+    // Statistics since the last Reset()
+    size_t GetBytesAllocated() const { return mBytesAllocated; }
+    size_t GetAllocationCount() const { return mAllocationCount; }
+    // Statistics over the lifetime of the arena
+    size_t GetPeakBytes() const { return mPeakBytes; }
+    size_t GetReservedBytes() const { return mReservedBytes; }
+    size_t GetBlockCount() const { return mBlocks.size(); }
+
+private:
+    struct Block
+    {
+        uint8_t* Data;
+        size_t Size;
+    };
+
+    bool AllocateFromBlock(size_t blockIndex, size_t size, size_t alignment, void*& result);
+
+    std::vector<Block> mBlocks;
+    size_t mBlockSize;
+    size_t mCurrentBlock;
+    size_t mOffset;
+
+    size_t mBytesAllocated;
+    size_t mAllocationCount;
+    size_t mPeakBytes;
+    size_t mReservedBytes;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+// Finds a file referenced by a model. Exporters store the absolute path on the
+// artist's machine, so the path relative to the model and the bare file name
+// next to the model are tried as well. Returns an empty string if nothing exists.
+inline std::wstring ResolveAssetPath(const std::filesystem::path& modelFile, const std::string& storedPath, const std::string& relativePath)
+{
+    namespace fs = std::filesystem;
+
+    fs::path modelDir = modelFile.parent_path();
+    fs::path absolutePath = fs::u8path(storedPath);
+    const fs::path candidates[] =
+    {
+        absolutePath,
+        relativePath.empty() ? fs::path() : modelDir / fs::u8path(relativePath),
+        modelDir / absolutePath.filename()
+    };
+
+    std::error_code ec;
+    for (const fs::path& candidate : candidates)
+    {
+        if (!candidate.empty() && fs::is_regular_file(candidate, ec))
+            return candidate.wstring();
+    }
+
+    return std::wstring();
+}
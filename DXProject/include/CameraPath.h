@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Position of the orbit camera around the model: angles in radians, phi from the +y axis.
+struct CameraOrbit
+{
+    float Theta;
+    float Phi;
+    float Radius;
+};
+
+// Orbit camera motion over time, replayed by benchmark runs so that every run renders
+// the same frames. Keys are interpolated with Catmull-Rom splines and the path loops.
+class CameraPath
+{
+public:
+    struct Key
+    {
+        float Time; // Seconds
+        CameraOrbit Orbit;
+    };
+
+    CameraPath();
+
+    // One turn around the model in ten seconds, moving up and down and zooming in and out
+    static CameraPath DefaultOrbit();
+
+    // Text file with one "time theta phi radius" key per line, times increasing. Times
+    // are shifted so that the first key is at 0.
+    bool Load(const std::string& file);
+    bool Save(const std::string& file) const;
+
+    // Keys are appended, time must not decrease. The first key's time becomes 0, later
+    // ones are relative to it.
+    void AddKey(float time, const CameraOrbit& orbit);
+    // Time of the first key before the shift
+    float GetStartTime() const { return mStartTime; }
+
+    bool IsEmpty() const { return mKeys.empty(); }
+    size_t GetKeyCount() const { return mKeys.size(); }
+    float GetDuration() const { return mKeys.empty() ? 0.0f : mKeys.back().Time; }
+
+    // Times past the end wrap around, times before the start give the first key.
+    CameraOrbit Sample(float time) const;
+
+private:
+    std::vector<Key> mKeys;
+    float mStartTime;
+};
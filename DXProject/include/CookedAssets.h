@@ -0,0 +1,54 @@
+#pragma once
+
+#include <RenderDefs.h>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Runtime-ready files written by the asset cooker.
+// A cooked file sits next to its source with an extra extension
+// (model.fbx -> model.fbx.mesh, diffuse.tga -> diffuse.tga.tex) and is used
+// instead of the source as long as it is not older than the source.
+namespace CookedAssets
+{
+    const uint32_t kMeshMagic = 0x48534D43;    // "CMSH"
+    const uint32_t kTextureMagic = 0x58455443; // "CTEX"
+    // Bump when a layout changes, older files are then ignored and cooked again.
+    const uint32_t kFormatVersion = 3;
+    // Mesh header flag, vertices, tangents and indices are stored MeshCodec compressed
+    const uint32_t kMeshCompressed = 1;
+
+    struct Mesh
+    {
+        std::vector<VertexTextured> Vertices;
+        std::vector<DirectX::XMFLOAT4> Tangents; // Empty if not generated
+        std::vector<UINT> Indices;
+        std::vector<SubMesh> SubMeshes;
+        std::vector<MaterialDesc> Materials;
+    };
+
+    struct Texture
+    {
+        uint32_t Width = 0;
+        uint32_t Height = 0;
+        std::vector<uint8_t> Pixels; // R8G8B8A8, rows tightly packed, top row first
+    };
+
+    std::filesystem::path MeshPath(const std::filesystem::path& source);
+    std::filesystem::path TexturePath(const std::filesystem::path& source);
+    // Import of a model by the FBX SDK (model.fbx.ref), the expected output of the
+    // native importers for AssetCooker --check-import. Written by DXProject -import-reference.
+    std::filesystem::path ReferenceMeshPath(const std::filesystem::path& source);
+
+    // True if cooked exists and was written after source was last modified.
+    bool IsUpToDate(const std::filesystem::path& cooked, const std::filesystem::path& source);
+
+    // Texture paths are stored relative to the mesh file, so cooked assets can be moved with their sources.
+    // Compressed meshes are about half the size, and a third for dense regular meshes, and
+    // decode faster than most drives read. Index compression needs vertices in first-use order.
+    bool WriteMesh(const std::filesystem::path& file, const Mesh& mesh, bool compress = true);
+    bool ReadMesh(const std::filesystem::path& file, Mesh& mesh);
+
+    bool WriteTexture(const std::filesystem::path& file, const Texture& texture);
+    bool ReadTexture(const std::filesystem::path& file, Texture& texture);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Image based lighting baked on the CPU from an environment map when it is loaded:
+// - the irradiance as nine L2 spherical harmonics coefficients (Ramamoorthi, Hanrahan,
+//   "An Efficient Representation for Irradiance Environment Maps"), the diffuse ambient
+//   of a normal is then a short polynomial;
+// - a cube map with the mips prefiltered by the GGX lobe for increasing roughness, so a
+//   reflection is one lookup at the level of the roughness (Karis, "Real Shading in
+//   Unreal Engine 4", with the view direction taken as the normal).
+// Both run on the job system over the rows of the cube faces, four texels at a time with
+// SSE. No device needed, the headless benchmark times the same bake.
+//
+// Directions are in world space, y up. Cube faces are in the D3D order +X, -X, +Y, -Y,
+// +Z, -Z with the D3D texture coordinates.
+class EnvironmentLighting
+{
+public:
+    // Linear RGB, alpha 1. The faces one after the other, rows from the top.
+    struct CubeLevel
+    {
+        uint32_t Size;
+        std::vector<DirectX::XMFLOAT4> Texels;
+    };
+
+    struct Stats
+    {
+        double SourceMs;    // Source to the base level and its box-filtered mips
+        double ShMs;
+        double PrefilterMs;
+        uint32_t BaseSize;
+        uint32_t Levels;
+        unsigned Threads;
+    };
+
+    EnvironmentLighting();
+
+    // Latitude-longitude image, R8G8B8A8 sRGB, top row looking up. The base level is
+    // baseSize wide, rounded up to a power of two of at least 4.
+    void SetEquirect(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t baseSize);
+    // TGA file, false if it cannot be read
+    bool LoadEquirect(const std::filesystem::path& file, uint32_t baseSize);
+    // Sky gradient over a dark ground and a sun where the light comes from, for scenes
+    // without an environment map
+    void SetProceduralSky(uint32_t baseSize, const DirectX::XMFLOAT3& lightDirection);
+
+    // SH projection and prefiltering of the source set last. Level m of the prefiltered
+    // cube is for roughness m / (levelCount - 1), at most one level per mip of the base.
+    void Bake(uint32_t levelCount);
+
+    // Irradiance / pi in the order L00, L1-1, L10, L11, L2-2, L2-1, L20, L21, L22, w is 0.
+    // Evaluated with the SH basis at the normal it is the diffuse ambient of a white surface.
+    const DirectX::XMFLOAT4* GetShCoefficients() const { return mSh; }
+    const std::vector<CubeLevel>& GetPrefilteredLevels() const { return mPrefiltered; }
+    const Stats& GetStats() const { return mStats; }
+
+private:
+    void SetBaseSize(uint32_t baseSize);
+    void BuildSourceMips();
+    void ProjectSh();
+    void Prefilter(uint32_t levelCount);
+
+    DirectX::XMFLOAT4 mSh[9];
+    // Base level and its box-filtered mips down to 1 texel, sampled by the prefilter
+    std::vector<CubeLevel> mSource;
+    std::vector<CubeLevel> mPrefiltered;
+    Stats mStats;
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <RenderDefs.h>
+#include <Arena.h>
+#include <MappedFile.h>
+
+// Reads binary FBX 7.x files without the FBX SDK.
+// The file is memory mapped and the node records are walked in place, only the
+// objects we need (geometry, models, materials, textures and their connections)
+// are recorded, with array properties kept as references into the mapping. The
+// compressed arrays of a mesh are inflated in parallel right before the mesh is
+// processed and dropped after it, so only one mesh is decoded at a time.
+//
+// Produces the same vertices, indices, submeshes and materials as FBXReader.
+class FbxBinaryReader
+{
+public:
+    FbxBinaryReader();
+    bool LoadFbxFile(const std::string& filename);
+    void GetVertices(std::vector<VertexTextured>& vertices, std::vector<UINT>& indices);
+    // Indices are grouped by material, each submesh is one mesh's range for one material.
+    void GetVertices(std::vector<VertexTextured>& vertices, std::vector<UINT>& indices, std::vector<SubMesh>& subMeshes);
+    void GetMaterials(std::vector<MaterialDesc>& materials);
+
+    // Largest amount of temporary memory (decoded arrays included) used for one mesh
+    size_t GetPeakTemporaryBytes() const { return mArena.GetPeakBytes(); }
+
+private:
+    // Array property, still compressed
+    struct ArrayRef
+    {
+        char Type = 0;
+        uint32_t Count = 0;
+        uint32_t Encoding = 0;
+        uint32_t ByteSize = 0;
+        const uint8_t* Data = nullptr;
+    };
+
+    // Decoded array, elements may be unaligned inside the mapping
+    struct ArrayView
+    {
+        char Type = 0;
+        uint32_t Count = 0;
+        const uint8_t* Data = nullptr;
+
+        double GetDouble(size_t i) const;
+        int32_t GetInt(size_t i) const;
+    };
+
+    struct LayerElement
+    {
+        bool Present = false;
+        std::string Mapping;
+        std::string Reference;
+        ArrayRef Direct;
+        ArrayRef Index;
+    };
+
+    struct Geometry
+    {
+        ArrayRef Vertices;
+        ArrayRef PolygonVertexIndex;
+        LayerElement Normals;
+        LayerElement UVs;
+        LayerElement Materials;
+    };
+
+    struct Texture
+    {
+        std::string FileName;
+        std::string RelativeFileName;
+    };
+
+    struct Material
+    {
+        std::string Name;
+        std::string ShadingModel;
+        double Ambient[3] = { 0.2, 0.2, 0.2 };
+        double Diffuse[3] = { 0.8, 0.8, 0.8 };
+        double Specular[3] = { 0.2, 0.2, 0.2 };
+        double AmbientFactor = 1.0;
+        double DiffuseFactor = 1.0;
+        double SpecularFactor = 1.0;
+        double Shininess = 20.0;
+        const Texture* ColorMap = nullptr;
+        const Texture* NormalMap = nullptr;
+        const Texture* Bump = nullptr;
+    };
+
+    struct Model
+    {
+        const Geometry* Mesh = nullptr;
+        std::vector<const Material*> Materials;
+        std::vector<const Model*> Children;
+    };
+
+    struct Connection
+    {
+        bool ToProperty;
+        int64_t Child;
+        int64_t Parent;
+        std::string Property;
+    };
+
+    // Triangles of all meshes that use one material
+    struct MaterialBatch
+    {
+        std::vector<UINT> Indices;
+        std::vector<SubMesh> SubMeshes;
+    };
+
+    bool ParseObjects(const uint8_t* begin, const uint8_t* end);
+    bool ParseConnections(const uint8_t* begin, const uint8_t* end, std::vector<Connection>& connections);
+    bool ParseGeometry(const uint8_t* begin, const uint8_t* end, Geometry& geometry);
+    bool ParseLayerElement(const uint8_t* begin, const uint8_t* end, const char* arrayName, const char* indexName, LayerElement& element);
+    bool ParseMaterial(const uint8_t* begin, const uint8_t* end, Material& material);
+    bool ParseTexture(const uint8_t* begin, const uint8_t* end, Texture& texture);
+    void ResolveConnections(const std::vector<Connection>& connections);
+
+    void CollectMeshModels(const Model* pModel, std::vector<const Model*>& meshModels);
+    bool DecodeArrays(const ArrayRef* const* arrays, ArrayView* views, size_t count);
+    void GetMeshData(const Model* pModel, std::vector<VertexTextured>& vertices, std::vector<MaterialBatch>& batches);
+    UINT GetMaterialIndex(const Material* pMaterial);
+    std::wstring ResolveTexturePath(const Texture* pTexture) const;
+
+    MappedFile mFile;
+    std::string mFilename;
+    uint32_t mVersion;
+
+    std::unordered_map<int64_t, Geometry> mGeometries;
+    std::unordered_map<int64_t, Model> mModels;
+    std::unordered_map<int64_t, Material> mMaterialObjects;
+    std::unordered_map<int64_t, Texture> mTextures;
+    Model mRoot;
+
+    std::vector<MaterialDesc> mMaterials;
+    std::unordered_map<const Material*, UINT> mMaterialIndices;
+
+    // Decoded arrays and per-mesh temporaries, reset for every mesh
+    MonotonicArena mArena;
+};
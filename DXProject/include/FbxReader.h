@@ -2,8 +2,10 @@
 
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <fbxsdk.h>
 #include <RenderDefs.h>
+#include <Arena.h>
 
 class FBXReader
 {
@@ -12,13 +14,35 @@ public:
     ~FBXReader();
     bool LoadFbxFile(const std::string& filename);
     void GetVertices(std::vector<VertexTextured>& vertices, std::vector<UINT>& indices);
+    // Indices are grouped by material, each submesh is one mesh's range for one material.
+    void GetVertices(std::vector<VertexTextured>& vertices, std::vector<UINT>& indices, std::vector<SubMesh>& subMeshes);
+    void GetMaterials(std::vector<MaterialDesc>& materials);
 
 private:
+    // Triangles of all meshes that use one material
+    struct MaterialBatch
+    {
+        std::vector<UINT> Indices;
+        std::vector<SubMesh> SubMeshes;
+    };
+
     bool LoadScene(FbxManager* pManager, FbxDocument* pScene, const char* pFilename);
-    void GetMeshData(FbxNode* pNode, UINT shift, std::vector<VertexTextured>& vertices, std::vector<UINT>& indices);
+    void CollectMeshNodes(FbxNode* pNode, std::vector<FbxNode*>& meshNodes);
+    void GetMeshData(FbxNode* pNode, std::vector<VertexTextured>& vertices, std::vector<MaterialBatch>& batches);
     void GetMeshDataOld(FbxNode* pNode, UINT shift, std::vector<VertexTextured>& vertices, std::vector<UINT>& indices);
+    UINT GetMaterialIndex(FbxSurfaceMaterial* pMaterial);
+    std::wstring ResolveTexturePath(FbxSurfaceMaterial* pMaterial, const char* propertyName) const;
 
     FbxManager* mpManager;
     FbxScene* mpScene;
     FbxNode* mpRootNode;
+
+    std::string mFilename;
+    std::vector<MaterialDesc> mMaterials;
+    std::unordered_map<FbxSurfaceMaterial*, UINT> mMaterialIndices;
+
+    // Per-mesh temporaries, reset for every mesh
+    MonotonicArena mArena;
+    size_t mImportArenaBytes;
+    size_t mImportArenaAllocations;
 };
\ No newline at end of file
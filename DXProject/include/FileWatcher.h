@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <memory>
+#endif
+
+// Reports files written in watched directories, through ReadDirectoryChangesW on
+// Windows and inotify on Linux. Editors and exporters write a file in several steps,
+// so a file is only reported once it has not changed for the settle time, and a
+// burst of writes is reported once.
+//
+// Watch and WaitForChanges are called by one thread, Stop by any.
+class FileWatcher
+{
+public:
+    struct Change
+    {
+        std::filesystem::path File;
+        std::chrono::steady_clock::time_point FirstSeen; // First event of the burst
+    };
+
+    explicit FileWatcher(std::chrono::milliseconds settleTime = std::chrono::milliseconds(200));
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Directories already watched are skipped. With recursive, subdirectories created
+    // later are watched as well.
+    bool Watch(const std::filesystem::path& directory, bool recursive = false);
+
+    // Blocks until files changed and settled, or until Stop. Returns false once stopped.
+    bool WaitForChanges(std::vector<Change>& changes);
+    void Stop();
+
+private:
+    // Waits up to timeout for events and adds them to mChanged.
+    void ReadEvents(std::chrono::milliseconds timeout);
+    void AddEvent(const std::filesystem::path& file);
+
+    std::chrono::milliseconds mSettleTime;
+    std::atomic<bool> mbStopped;
+
+    struct PendingChange
+    {
+        std::chrono::steady_clock::time_point FirstSeen;
+        std::chrono::steady_clock::time_point LastSeen;
+    };
+    std::map<std::filesystem::path, PendingChange> mChanged;
+
+#ifdef _WIN32
+    struct Directory
+    {
+        std::filesystem::path Path;
+        HANDLE Handle;
+        OVERLAPPED Overlapped;
+        bool Recursive;
+        std::unique_ptr<DWORD[]> Buffer; // FILE_NOTIFY_INFORMATION records
+    };
+    bool BeginRead(Directory& directory);
+
+    std::vector<std::unique_ptr<Directory>> mDirectories;
+#else
+    struct Directory
+    {
+        std::filesystem::path Path;
+        bool Recursive;
+    };
+    // Watches directory, and with recursive its subdirectories. Files already in them
+    // are reported with reportFiles, for directories created after the watch began.
+    bool AddWatches(const std::filesystem::path& directory, bool recursive, bool reportFiles);
+
+    int mInotify;
+    std::map<int, Directory> mDirectories; // By watch descriptor
+#endif
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <RenderDefs.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Everything the render thread needs from the simulation for one frame. It is a copy,
+// so the simulation can move on to the next frame while this one is drawn.
+struct FrameState
+{
+    uint64_t Frame;
+    float DeltaTime;
+    std::chrono::steady_clock::time_point UpdateStart; // For the latency until the frame is presented
+    DirectX::XMFLOAT4X4 World;
+    DirectX::XMFLOAT4X4 View;
+    DirectX::XMFLOAT4X4 Proj;
+    DirectX::XMFLOAT3 CameraPosition;
+    DIRECTIONAL_LIGHT Light;
+    bool LightChanged;
+    std::vector<LOCAL_LIGHT> LocalLights; // World space, moving every frame
+};
+
+// Double-buffered frame states handed from the simulation thread to the render thread.
+// With two frames in flight the simulation writes frame N into one slot while frame N-1
+// is drawn from the other, and waits before running further ahead, so a frame is at most
+// one frame older when it is presented. With one frame in flight updating and drawing
+// take turns as on a single thread, for comparison.
+class FrameStateExchange
+{
+public:
+    explicit FrameStateExchange(unsigned framesInFlight = 2);
+
+    // 1 or 2, takes effect for the next frame written
+    void SetFramesInFlight(unsigned framesInFlight);
+    unsigned GetFramesInFlight() const { return mFramesInFlight; }
+
+    // Simulation side: the slot of the next frame, once the render thread is done with
+    // it. Null after Stop().
+    FrameState* BeginWrite();
+    void EndWrite();
+    // Whether BeginWrite would return without waiting
+    bool CanWrite();
+
+    // Render side: the oldest frame not drawn yet, waits for it. Null after Stop().
+    const FrameState* BeginRead();
+    void EndRead();
+
+    // Wakes both sides, Begin* return null from now on.
+    void Stop();
+
+private:
+    FrameState mStates[2];
+    uint64_t mWritten; // Frames published by the simulation
+    uint64_t mRead;    // Frames the render thread is done with
+    unsigned mFramesInFlight;
+    bool mbStopped;
+    std::mutex mMutex;
+    std::condition_variable mChanged;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Per-frame samples of named timings in benchmark runs, reported as mean, median,
+// 95th percentile and maximum. Columns are filled independently, so different threads
+// may each record their own columns.
+class FrameTimings
+{
+public:
+    // Before the first sample
+    size_t AddColumn(const std::string& name);
+    void Reserve(size_t frames);
+
+    void Add(size_t column, double value);
+
+    // One row per column
+    std::string Report() const;
+    // One line per frame and one value per column, to compare runs over time
+    bool WriteCsv(const std::string& file) const;
+
+private:
+    struct Column
+    {
+        std::string Name;
+        std::vector<double> Samples;
+    };
+
+    std::vector<Column> mColumns;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <RenderDefs.h>
+#include <RangeAllocator.h>
+#include <StateCache.h>
+#include <d3d11.h>
+#include <vector>
+
+// Vertex and index data of many meshes in a few large buffers: one per vertex stream
+// and one index buffer. The buffers are bound once and every mesh is drawn with its
+// base vertex and start index, so switching meshes needs no binds. All streams share
+// one vertex allocator, a mesh has the same base vertex in each of them.
+//
+// Full buffers grow to twice their size. A mesh that does not fit in any free range
+// while there is enough free space in total first defragments the pool: the meshes are
+// copied, on the GPU, into new buffers without gaps. Handles stay valid when meshes move.
+//
+// Uploads go through the device context, so a pool is used by the thread owning it.
+class GeometryPool
+{
+public:
+    typedef uint32_t Handle;
+    static const Handle kInvalidHandle = 0;
+
+    struct Range
+    {
+        UINT BaseVertex;
+        UINT VertexCount;
+        UINT StartIndex;
+        UINT IndexCount;
+    };
+
+    struct Stats
+    {
+        UINT Meshes;
+        UINT Buffers;             // Buffer objects of the pool
+        UINT BuffersWithoutPool;  // What a buffer per stream and mesh would take
+        UINT BindsPerMeshSwitch;  // Vertex and index buffer binds saved per mesh switch
+        UINT Grows;
+        UINT Defragments;
+        uint64_t UploadedBytes;   // Vertex and index data sent with UpdateSubresource
+        RangeAllocator::Stats Vertices;
+        RangeAllocator::Stats Indices;
+    };
+
+    GeometryPool();
+
+    // Stream i is bound to vertex buffer slot i. Capacities are in vertices and indices.
+    void Init(ComPtr<ID3D11Device> device, ComPtr<ID3D11DeviceContext> context, const std::vector<UINT>& streamStrides,
+        UINT vertexCapacity, UINT indexCapacity);
+
+    // streams holds a pointer per stream to vertexCount vertices, a null pointer leaves
+    // the stream undefined for this mesh. kInvalidHandle if the buffers cannot grow.
+    Handle Add(const void* const* streams, UINT vertexCount, const UINT* indices, UINT indexCount);
+    void Remove(Handle handle);
+    const Range& GetRange(Handle handle) const { return mRanges[handle - 1]; }
+
+    // Packs the meshes to the start of new buffers.
+    void Defragment();
+
+    // Requests the pool buffers, the cache drops them while they stay bound.
+    void Bind(StateCache& stateCache) const;
+
+    Stats GetStats() const;
+    uint64_t GetUploadedBytes() const { return mUploadedBytes; }
+    void LogStats() const;
+
+private:
+    struct Stream
+    {
+        UINT Stride;
+        ComPtr<ID3D11Buffer> Buffer;
+    };
+
+    ComPtr<ID3D11Buffer> CreateBuffer(UINT byteWidth, UINT bindFlags) const;
+    bool Reserve(UINT vertexCount, UINT indexCount);
+    // New buffers of the given capacities with the allocated ranges moved as listed
+    void Rebuild(UINT vertexCapacity, UINT indexCapacity, const std::vector<RangeAllocator::Move>& vertexMoves,
+        const std::vector<RangeAllocator::Move>& indexMoves);
+    void Upload(ID3D11Buffer* buffer, const void* data, UINT offsetBytes, UINT sizeBytes);
+
+    ComPtr<ID3D11Device> mDevice;
+    ComPtr<ID3D11DeviceContext> mContext;
+    std::vector<Stream> mStreams;
+    ComPtr<ID3D11Buffer> mIndexBuffer;
+    RangeAllocator mVertexAllocator;
+    RangeAllocator mIndexAllocator;
+
+    std::vector<Range> mRanges; // By handle - 1, VertexCount 0 for removed meshes
+    std::vector<Handle> mFreeHandles;
+    UINT mMeshCount;
+    UINT mGrows;
+    UINT mDefragments;
+    uint64_t mUploadedBytes;
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// 64-bit non-cryptographic hash of a memory block (xxHash64 algorithm).
+// Used as a content key for caches, so it has to be fast on multi-megabyte inputs.
+namespace Hash
+{
+    namespace detail
+    {
+        const uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+        const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+        const uint64_t kPrime3 = 0x165667B19E3779F9ull;
+        const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+        const uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+        inline uint64_t Rotl(uint64_t x, int r)
+        {
+            return (x << r) | (x >> (64 - r));
+        }
+
+        inline uint64_t Read64(const uint8_t* p)
+        {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint32_t Read32(const uint8_t* p)
+        {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint64_t Round(uint64_t acc, uint64_t input)
+        {
+            acc += input * kPrime2;
+            acc = Rotl(acc, 31);
+            return acc * kPrime1;
+        }
+
+        inline uint64_t MergeRound(uint64_t acc, uint64_t val)
+        {
+            acc ^= Round(0, val);
+            return acc * kPrime1 + kPrime4;
+        }
+    }
+
+    inline uint64_t Bytes(const void* data, size_t size, uint64_t seed = 0)
+    {
+        using namespace detail;
+
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        const uint8_t* end = p + size;
+        uint64_t h;
+
+        if (size >= 32)
+        {
+            uint64_t v1 = seed + kPrime1 + kPrime2;
+            uint64_t v2 = seed + kPrime2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - kPrime1;
+
+            const uint8_t* limit = end - 32;
+            do
+            {
+                v1 = Round(v1, Read64(p));
+                v2 = Round(v2, Read64(p + 8));
+                v3 = Round(v3, Read64(p + 16));
+                v4 = Round(v4, Read64(p + 24));
+                p += 32;
+            } while (p <= limit);
+
+            h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+            h = MergeRound(h, v1);
+            h = MergeRound(h, v2);
+            h = MergeRound(h, v3);
+            h = MergeRound(h, v4);
+        }
+        else
+        {
+            h = seed + kPrime5;
+        }
+
+        h += static_cast<uint64_t>(size);
+
+        for (; p + 8 <= end; p += 8)
+        {
+            h ^= Round(0, Read64(p));
+            h = Rotl(h, 27) * kPrime1 + kPrime4;
+        }
+
+        if (p + 4 <= end)
+        {
+            h ^= static_cast<uint64_t>(Read32(p)) * kPrime1;
+            h = Rotl(h, 23) * kPrime2 + kPrime3;
+            p += 4;
+        }
+
+        for (; p < end; p++)
+        {
+            h ^= (*p) * kPrime5;
+            h = Rotl(h, 11) * kPrime1;
+        }
+
+        h ^= h >> 33;
+        h *= kPrime2;
+        h ^= h >> 29;
+        h *= kPrime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    template<typename T>
+    uint64_t Value(const T& value, uint64_t seed = 0)
+    {
+        return Bytes(&value, sizeof(T), seed);
+    }
+
+    inline uint64_t Combine(uint64_t h, uint64_t value)
+    {
+        return h ^ (value + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2));
+    }
+}
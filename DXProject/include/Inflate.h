@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Minimal zlib/deflate decoder (RFC 1950/1951) for compressed asset arrays.
+// The decompressed size is always known up front in our formats, so the output goes
+// straight into a caller-provided buffer and no allocations are made.
+namespace Inflate
+{
+    // Decodes a raw deflate stream. Returns false on corrupt input or if the
+    // output does not fill dest exactly.
+    bool Raw(const uint8_t* src, size_t srcSize, uint8_t* dest, size_t destSize);
+
+    // Decodes a zlib stream (2-byte header, deflate data, Adler-32 checksum).
+    bool Zlib(const uint8_t* src, size_t srcSize, uint8_t* dest, size_t destSize);
+
+    uint32_t Adler32(const uint8_t* data, size_t size);
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Work-stealing job scheduler. Every worker thread owns a Chase-Lev deque: it pushes
+// and pops its own jobs at the bottom (newest first, which keeps the data warm) and
+// idle workers steal from the top of other deques (oldest first, the largest pieces
+// of a recursive split). Threads that are not workers of the system submit into a
+// shared locked queue.
+//
+// A job started while another job runs on the same thread is its child, and a job
+// only counts as finished when its children are, so waiting for the root of a
+// recursive split waits for the whole tree. Waiting threads run jobs meanwhile, so
+// jobs may start and wait for other jobs without blocking a worker.
+//
+// Standalone and portable, the shared instance is used by the importers, the
+// texture decoder and the per-frame work.
+class JobSystem
+{
+public:
+    // Unfinished jobs of a group, a job is counted until its children are done too.
+    class Counter
+    {
+    public:
+        Counter() : mPending(0) {}
+        bool IsDone() const { return mPending.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class JobSystem;
+        std::atomic<uint32_t> mPending;
+    };
+
+    struct Stats
+    {
+        uint64_t Executed; // Jobs run
+        uint64_t Stolen;   // Jobs taken from the deque of another worker
+    };
+
+    // Thread state that follows a job from the thread that queues it to the thread that
+    // runs it, like the memory tag of MemoryTracker. Capture is called when a job is
+    // queued; Apply sets the value while the job runs and returns the one it replaces,
+    // which is applied again after. Set once, before any job is queued.
+    typedef uint32_t (*CaptureContextFunc)();
+    typedef uint32_t (*ApplyContextFunc)(uint32_t context);
+    static void SetContextHooks(CaptureContextFunc capture, ApplyContextFunc apply);
+
+    // threadCount includes the calling thread, which becomes worker 0.
+    // 0 uses one thread per hardware thread.
+    explicit JobSystem(unsigned threadCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // The shared instance, created on first use by the thread that calls this first
+    static JobSystem& Get();
+    // Thread count of the shared instance, only has an effect before the first Get()
+    static void SetDefaultThreadCount(unsigned threadCount);
+
+    unsigned GetThreadCount() const { return mThreadCount; }
+    Stats GetStats() const;
+
+    // Queues func(). The counter, if any, is counted until the job and its children finish.
+    template<typename Func>
+    void Run(Func&& func, Counter* counter = nullptr);
+
+    // Runs jobs until the counter is done.
+    void Wait(const Counter& counter);
+
+    // Calls func(begin, end) over ranges of at most grainSize items covering [0, count)
+    // and returns when all are done. Ranges are split in halves, so stolen work is large.
+    template<typename Func>
+    void ParallelFor(size_t count, size_t grainSize, const Func& func);
+
+private:
+    static const size_t kJobStorage = 64;
+    static const size_t kDequeSize = 4096;  // Per worker, a full deque runs new jobs inline
+    // Jobs started by one thread, larger than a deque so that a full deque leaves free slots
+    static const size_t kJobPoolSize = 2 * kDequeSize;
+
+    struct alignas(64) Job
+    {
+        void (*Invoke)(Job& job);
+        Job* Parent;
+        Counter* pCounter;
+        std::atomic<uint32_t> Unfinished; // The job itself and its children
+        uint32_t Context;                 // Of the queuing thread, see SetContextHooks
+        alignas(16) unsigned char Storage[kJobStorage];
+    };
+
+    // Chase-Lev deque as in "Correct and Efficient Work-Stealing for Weak Memory Models"
+    // (Le, Pop, Cohen, Zappa Nardelli 2013), with a fixed size.
+    class alignas(64) WorkDeque
+    {
+    public:
+        WorkDeque();
+        bool Push(Job* job);
+        Job* Pop();
+        Job* Steal();
+
+    private:
+        std::atomic<int64_t> mTop;
+        alignas(64) std::atomic<int64_t> mBottom;
+        std::atomic<Job*> mJobs[kDequeSize];
+    };
+
+    struct alignas(64) Worker
+    {
+        WorkDeque Deque;
+        std::atomic<uint64_t> Executed;
+        std::atomic<uint64_t> Stolen;
+        uint32_t RandomState;
+    };
+
+    template<typename Func>
+    struct RangeJob
+    {
+        JobSystem* pSystem;
+        const Func* pFunc;
+        size_t Begin;
+        size_t End;
+        size_t GrainSize;
+
+        void operator()() const
+        {
+            // Hand out the upper halves and keep splitting the lower one.
+            size_t end = End;
+            while (end - Begin > GrainSize)
+            {
+                size_t middle = Begin + (end - Begin) / 2;
+                pSystem->Run(RangeJob{ pSystem, pFunc, middle, end, GrainSize });
+                end = middle;
+            }
+            (*pFunc)(Begin, end);
+        }
+    };
+
+    Job* AllocateJob();
+    void Submit(Job* job, Counter* counter);
+    void Execute(Job* job, int worker);
+    void Finish(Job* job);
+    Job* FindJob(int worker);
+    int CurrentWorker() const;
+    void WorkerLoop(int worker);
+    void Wake();
+
+    unsigned mThreadCount;
+    std::vector<Worker*> mWorkers;
+    std::vector<std::thread> mThreads;
+
+    // Jobs from threads that are not workers
+    std::mutex mQueueMutex;
+    std::deque<Job*> mQueue;
+    std::atomic<size_t> mQueueSize;
+
+    // Idle workers sleep until the signal changes.
+    std::mutex mSleepMutex;
+    std::condition_variable mSleep;
+    std::atomic<uint64_t> mSignal;
+    std::atomic<unsigned> mSleeping;
+    std::atomic<bool> mbQuit;
+
+    // System of the creating thread before this one, restored on destruction
+    const JobSystem* mpPreviousSystem;
+    int mPreviousWorker;
+};
+
+template<typename Func>
+void JobSystem::Run(Func&& func, Counter* counter)
+{
+    using Callable = typename std::decay<Func>::type;
+    static_assert(sizeof(Callable) <= kJobStorage, "Job captures too much, capture a pointer instead");
+    static_assert(alignof(Callable) <= 16, "Job capture alignment is too large");
+
+    Job* job = AllocateJob();
+    new (job->Storage) Callable(std::forward<Func>(func));
+    job->Invoke = [](Job& j)
+    {
+        Callable* callable = reinterpret_cast<Callable*>(j.Storage);
+        (*callable)();
+        callable->~Callable();
+    };
+    Submit(job, counter);
+}
+
+template<typename Func>
+void JobSystem::ParallelFor(size_t count, size_t grainSize, const Func& func)
+{
+    grainSize = grainSize ? grainSize : 1;
+    if (count <= grainSize || mThreadCount == 1)
+    {
+        if (count > 0)
+            func(size_t(0), count);
+        return;
+    }
+
+    Counter counter;
+    Run(RangeJob<Func>{ this, &func, 0, count, grainSize }, &counter);
+    Wait(counter);
+}
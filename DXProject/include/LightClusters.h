@@ -0,0 +1,117 @@
+#pragma once
+
+#include <RenderDefs.h>
+#include <vector>
+
+// Clustered light culling: the view frustum is split into tiles across the screen and
+// slices in depth, exponentially spaced between the near and the far plane, and every
+// point and spot light is listed in the clusters it reaches. The pixel shader looks up
+// the cluster of a pixel and only evaluates those lights.
+//
+// Lights are binned on the CPU every frame. In each depth slice a light is only tested
+// against the tiles under the projected bounds of its slab of the sphere, four clusters
+// at a time with SSE: the sphere against the cluster boxes, and for spot lights the cone
+// against the cluster bounding spheres (Wronski, "Cull that cone!"). Spot lights use the
+// bounding sphere of the cone. No device needed, the headless benchmark runs the same.
+//
+// The projection must be a symmetric perspective one like XMMatrixPerspectiveFovLH, view
+// space looks down +z.
+class LightClusters
+{
+public:
+    // Lights of a cluster in GetLightIndices
+    struct Range
+    {
+        uint32_t Offset;
+        uint32_t Count;
+    };
+
+    struct Stats
+    {
+        double BinMs;           // Of the last Bin
+        size_t Lights;
+        size_t LightsInView;    // In at least one cluster
+        size_t Indices;
+        uint32_t MaxPerCluster;
+    };
+
+    LightClusters();
+
+    // Tiles across and down the viewport, and depth slices. 16 x 9 x 24 by default.
+    void Init(uint32_t tilesX, uint32_t tilesY, uint32_t slices);
+
+    // Lights in world space. The cluster boxes are rebuilt when the projection changes.
+    void Bin(const LOCAL_LIGHT* lights, size_t count, const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& proj);
+
+    // Per cluster, x fastest, then tile rows from the top of the screen, then slices
+    const std::vector<Range>& GetClusters() const { return mClusters; }
+    // Ascending light indices per cluster
+    const std::vector<uint32_t>& GetLightIndices() const { return mLightIndices; }
+    // For a viewport of this size in pixels
+    CLUSTER_CBUFFER GetShaderConstants(float width, float height) const;
+
+    uint32_t GetTilesX() const { return mTilesX; }
+    uint32_t GetTilesY() const { return mTilesY; }
+    uint32_t GetSlices() const { return mSlices; }
+    size_t GetClusterCount() const { return mClusters.size(); }
+    const Stats& GetStats() const { return mStats; }
+
+private:
+    // A light reaching a cluster, before they are grouped per cluster
+    struct Hit
+    {
+        uint32_t Cluster;
+        uint32_t Light;
+    };
+
+    // Inclusive
+    struct TileRange
+    {
+        int X0, X1;
+        int Y0, Y1;
+    };
+
+    void BuildClusterBounds(const DirectX::XMFLOAT4X4& proj);
+    int SliceOf(float viewZ) const;
+    int TileOf(float ndc, uint32_t tiles) const;
+    // Tiles under the projected box around a view space sphere cut to zMin <= z <= zMax,
+    // false if it is off screen
+    bool GetTiles(const DirectX::XMFLOAT3& center, float radius, float zMin, float zMax, TileRange& tiles) const;
+
+    uint32_t mTilesX;
+    uint32_t mTilesY;
+    uint32_t mSlices;
+
+    // Of the cluster bounds
+    DirectX::XMFLOAT4X4 mProj;
+    bool mbBoundsValid;
+    float mNear;
+    float mFar;
+    float mSliceScale;
+    float mSliceBias;
+    float mScaleX; // Projection scale, ndc = view * scale / z
+    float mScaleY;
+
+    // View space range of a cluster on one axis, with the center and squared half size for
+    // the bounding sphere
+    struct Extents
+    {
+        std::vector<float> Min, Max;
+        std::vector<float> Center, HalfSq;
+
+        void Resize(size_t count);
+        void Set(size_t i, float min, float max);
+    };
+
+    // A cluster box is the x range of its column times the y range of its row times the
+    // depth range of its slice, all of which depend on the slice. Columns are padded by 3
+    // so a row of clusters is read in groups of four.
+    Extents mColumns; // [slice * tilesX + x]
+    Extents mRows;    // [slice * tilesY + y]
+    Extents mDepths;  // [slice]
+
+    std::vector<Hit> mHits; // Grown, never shrunk
+    std::vector<Range> mClusters;
+    std::vector<uint32_t> mLightIndices;
+    Stats mStats;
+};
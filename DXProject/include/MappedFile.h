@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// Read-only memory mapping of a whole file.
+// Uses CreateFileMapping on Windows and mmap everywhere else.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::filesystem::path& filename);
+    void Close();
+
+    bool IsOpen() const { return mpData != nullptr; }
+    const uint8_t* Data() const { return mpData; }
+    size_t Size() const { return mSize; }
+
+private:
+    const uint8_t* mpData;
+    size_t mSize;
+
+#ifdef _WIN32
+    void* mFileHandle;
+    void* mMappingHandle;
+#else
+    int mFileDescriptor;
+#endif
+};
@@ -2,6 +2,8 @@
 
 #include <RenderDefs.h>
 #include <d3d11.h>
+#include <TextureCache.h>
+#include <StateCache.h>
 
 class Material
 {
@@ -9,18 +11,20 @@ public:
 	Material();
 	~Material();
 
-	HRESULT LoadTextures(ComPtr<ID3D11Device> device, std::wstring colorMapFile, std::wstring normalMapFile);
-	void AttachToShaders(ComPtr<ID3D11DeviceContext> deviceContext);
+	// Loads the textures referenced by desc and creates the material constant buffer.
+	// Missing textures are logged and left unbound.
+	HRESULT Init(ComPtr<ID3D11Device> device, const MaterialDesc& desc);
+	void AttachToShaders(StateCache& stateCache) const;
 
 private:
-	HRESULT LoadTGATexture(ComPtr<ID3D11Device> device, std::wstring file, ID3D11ShaderResourceView** textureView);
+	HRESULT CreateConstantBuffer(ComPtr<ID3D11Device> device);
 
 	DirectX::XMFLOAT4 mAmbient;
 	DirectX::XMFLOAT4 mDiffuse;
 	DirectX::XMFLOAT4 mSpecular;
 
-    ComPtr<ID3D11Texture2D> mColorMap;
-	ComPtr<ID3D11Texture2D> mNormalMap;
-	ComPtr<ID3D11ShaderResourceView> mColorMapSRV;
-	ComPtr<ID3D11ShaderResourceView> mNormalMapSRV;
+	TextureHandle mColorMap;
+	TextureHandle mNormalMap;
+
+	ComPtr<ID3D11Buffer> mConstantBuffer;
 };
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct ID3D11Resource;
+
+// What memory is used for. CPU tags are taken from the allocating thread's scope, jobs
+// run under the scope of the thread that queued them. GPU tags are given when a
+// resource is created.
+enum class MemoryTag : uint8_t
+{
+    Other,
+    Import,      // Importers, the FBX SDK scene and the arrays they return
+    Scene,       // CPU copies kept for culling, picking and the BVH
+    Textures,    // Decoded pixels
+    GpuBuffers,  // Vertex, index and constant buffers
+    GpuTextures,
+    GpuTargets,  // Render targets and depth buffers
+    Count
+};
+
+// Tagged memory accounting, cheap enough to leave on in release builds. Every operator
+// new in the executable is counted under the tag of the allocating thread's Scope, with
+// a 16 byte header that remembers it for the delete. GPU resources are counted from
+// their description when created and until the device destroys them. Memory allocated
+// outside both, like the FBX SDK's, is measured as the growth of the process.
+//
+// Each thread counts into a slot of its own without atomic read-modify-writes, reads
+// add up the slots. The statistics of a moment are not exactly consistent between tags,
+// and peaks are sampled: after every 256 KB a thread allocates and on every read.
+namespace MemoryTracker
+{
+    struct TagStats
+    {
+        int64_t CurrentBytes;
+        int64_t PeakBytes;
+        int64_t LiveAllocations;
+        uint64_t Allocations; // Since start
+    };
+
+    TagStats GetStats(MemoryTag tag);
+    // All tags together, the peak is the highest sum and not the sum of the peaks.
+    TagStats GetTotalStats();
+    const char* GetTagName(MemoryTag tag);
+
+    // Explicit accounting of memory the hook does not see
+    void Add(MemoryTag tag, size_t bytes);
+    void Remove(MemoryTag tag, size_t bytes);
+
+    // One line per tag to the log
+    void LogStats(const char* when);
+
+    // Allocations of this thread go to tag until the scope ends
+    class Scope
+    {
+    public:
+        explicit Scope(MemoryTag tag);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        MemoryTag mPrevious;
+    };
+
+    // Memory allocated around the tracked heap while it lives: Measure counts the growth
+    // of the process private bytes since construction, minus what the tracked heap grew.
+    // Counted until destruction. Windows only, elsewhere it counts nothing.
+    class ExternalAllocation
+    {
+    public:
+        explicit ExternalAllocation(MemoryTag tag);
+        ~ExternalAllocation();
+
+        ExternalAllocation(const ExternalAllocation&) = delete;
+        ExternalAllocation& operator=(const ExternalAllocation&) = delete;
+
+        void Measure();
+        size_t GetBytes() const { return mBytes; }
+
+    private:
+        MemoryTag mTag;
+        int64_t mStartPrivate;
+        int64_t mStartTracked;
+        size_t mBytes;
+    };
+
+    // Counts the resource's memory under tag until it is destroyed, also when it is only
+    // released later with the objects referencing it.
+    void TrackGpuResource(ID3D11Resource* resource, MemoryTag tag);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bounding volume hierarchy over the triangles of an indexed mesh, for ray queries.
+// A binary tree is built with binned SAH, large subtrees in their own jobs, and then
+// collapsed into 4-wide nodes so that one SSE slab test checks all children of a
+// node. Leaves hold up to four triangles, intersected together.
+//
+// Standalone and portable, positions are read through a byte stride.
+class MeshBvh
+{
+public:
+    struct Hit
+    {
+        uint32_t Triangle; // Triangle number in the index list, its first index / 3
+        float Distance;    // Ray parameter, the hit point is origin + Distance * direction
+        float U, V;        // Barycentrics, point = (1 - U - V) * p0 + U * p1 + V * p2
+    };
+
+    struct BuildStats
+    {
+        double Milliseconds;
+        size_t TriangleCount;
+        size_t NodeCount;
+        size_t LeafCount;
+        unsigned ThreadCount;
+    };
+
+    MeshBvh();
+
+    void Build(const float* positions, size_t positionStride, const uint32_t* indices, size_t indexCount);
+
+    // Closest hit with Distance in (0, maxDistance]. Triangles are hit from both sides.
+    bool Intersect(const float origin[3], const float direction[3], float maxDistance, Hit& hit) const;
+
+    bool IsEmpty() const { return mNodes.empty(); }
+    const BuildStats& GetBuildStats() const { return mStats; }
+
+private:
+    // Children in structure of arrays layout, lanes past ChildCount are unused.
+    struct alignas(16) Node
+    {
+        float MinX[4], MinY[4], MinZ[4];
+        float MaxX[4], MaxY[4], MaxZ[4];
+        int32_t Children[4]; // Node index, or ~block index for leaves
+        int32_t ChildCount;
+    };
+
+    // First vertex and edges of four triangles, one lane each
+    struct alignas(16) TriangleBlock
+    {
+        float V0[3][4];
+        float E1[3][4];
+        float E2[3][4];
+        uint32_t Triangles[4]; // UINT32_MAX in unused lanes
+    };
+
+    struct BuildNode;
+    struct BuildState;
+
+    static void Subdivide(BuildState& state, uint32_t nodeIndex, uint32_t first, uint32_t count, int depth);
+    int32_t Collapse(const BuildState& state, uint32_t buildNode);
+    int32_t AddBlock(const BuildState& state, const BuildNode& leaf);
+
+    std::vector<Node> mNodes;
+    std::vector<TriangleBlock> mBlocks;
+    BuildStats mStats;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lossless compression of vertex and index buffers for asset storage.
+// Vertices are read as rows of 32-bit words. Each word column is delta coded against
+// the previous vertex and split into byte planes, so that the slowly changing sign and
+// exponent bytes of neighbouring vertices end up together. Triangles are coded against
+// a FIFO of recently seen edges and one of recently seen vertices, which works best
+// when vertices are in first-use order. Every stream then goes through an order-0
+// rANS coder with 32 interleaved states, decoded eight per register with AVX2 when
+// SimdMath uses its AVX2 backend.
+//
+// Output is appended to out. Decoding checks every size and index and returns false on
+// damaged data. Large vertex buffers are decoded a column per job on the JobSystem.
+namespace MeshCodec
+{
+    // stride is a multiple of 4 bytes
+    void EncodeVertices(const void* vertices, size_t count, size_t stride, std::vector<uint8_t>& out);
+    bool DecodeVertices(const uint8_t* data, size_t size, void* vertices, size_t count, size_t stride);
+
+    // Triangle lists. Triangles may come back rotated, (a, b, c) as (b, c, a), the winding is kept.
+    void EncodeIndices(const uint32_t* indices, size_t count, std::vector<uint8_t>& out);
+    bool DecodeIndices(const uint8_t* data, size_t size, uint32_t* indices, size_t count, size_t vertexCount);
+
+    // New order of the vertices by first use in the index list, unused vertices last,
+    // so that the index coder finds most vertices as the next new one.
+    // remap[old] = new. Indices are rewritten in place.
+    std::vector<uint32_t> ReorderByFirstUse(uint32_t* indices, size_t indexCount, size_t vertexCount);
+}
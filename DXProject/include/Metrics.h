@@ -0,0 +1,117 @@
+#pragma once
+
+#include <SharedMemory.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class MetricKind : uint32_t
+{
+    Gauge,  // Value of the moment, like the frame time
+    Counter // Total since start, readers take rates from the differences
+};
+
+// Shared memory name of the renderer's metrics
+static const char* const kMetricsName = "DXProjectMetrics";
+
+// Named counters and gauges published every frame into a ring in shared memory, for
+// tools outside the process like DXMetrics. One thread publishes, without locks: each
+// slot has a sequence number that is odd while the slot is written, and a reader keeps
+// its copy of a slot only if the number did not change meanwhile. Readers never hold
+// up the writer, a slow one loses the frames that were overwritten.
+//
+// Values are relaxed atomics, any thread may set a metric as long as each metric has
+// a single writer.
+class MetricsRegistry
+{
+public:
+    typedef uint32_t Handle;
+
+    MetricsRegistry();
+    ~MetricsRegistry();
+
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+    // Before Open, up to 64 metrics. Names must outlive the registry, string literals in
+    // practice; readers see the first 47 characters.
+    Handle AddGauge(const char* name) { return AddMetric(name, MetricKind::Gauge); }
+    Handle AddCounter(const char* name) { return AddMetric(name, MetricKind::Counter); }
+    // Creates the ring in the shared memory of name. Without it the values are still
+    // kept, Publish does nothing.
+    bool Open(const char* name, uint32_t slotCount);
+    void Close();
+    bool IsOpen() const { return mpSlots != nullptr; }
+
+    void Set(Handle metric, double value) { mValues[metric].store(value, std::memory_order_relaxed); }
+    void Add(Handle metric, double value)
+    {
+        mValues[metric].store(mValues[metric].load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+    double Get(Handle metric) const { return mValues[metric].load(std::memory_order_relaxed); }
+
+    // Copies the values into the next slot
+    void Publish(uint64_t frame);
+
+    size_t GetMetricCount() const { return mNames.size(); }
+
+private:
+    static const size_t kMaxMetrics = 64;
+
+    Handle AddMetric(const char* name, MetricKind kind);
+
+    std::vector<const char*> mNames;
+    std::vector<MetricKind> mKinds;
+    std::unique_ptr<std::atomic<double>[]> mValues;
+
+    SharedMemory mMemory;
+    uint8_t* mpSlots;
+    uint32_t mSlotCount;
+    uint32_t mSlotSize;
+    uint64_t mPublished;
+    double mStartSeconds;
+};
+
+// Read side of the ring, in another process
+class MetricsReader
+{
+public:
+    struct Sample
+    {
+        uint64_t Index; // Slots published before this one
+        uint64_t Frame;
+        double Seconds; // Since the registry was opened
+        std::vector<double> Values;
+    };
+
+    MetricsReader();
+
+    // Fails until the writer has created and initialized the ring
+    bool Open(const char* name);
+    void Close();
+    bool IsOpen() const { return mpSlots != nullptr; }
+
+    size_t GetMetricCount() const { return mNames.size(); }
+    const std::string& GetName(size_t metric) const { return mNames[metric]; }
+    MetricKind GetKind(size_t metric) const { return mKinds[metric]; }
+
+    // Slots published so far, the last GetSlotCount of them can be read
+    uint64_t GetPublished() const;
+    uint32_t GetSlotCount() const { return mSlotCount; }
+    // False if the slot is not published yet, or was overwritten before or while it
+    // was copied
+    bool Read(uint64_t index, Sample& sample) const;
+
+private:
+    std::vector<std::string> mNames;
+    std::vector<MetricKind> mKinds;
+
+    SharedMemory mMemory;
+    const uint8_t* mpSlots;
+    uint32_t mSlotCount;
+    uint32_t mSlotSize;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <RenderDefs.h>
+#include <Arena.h>
+
+// Wavefront OBJ importer.
+// The file is memory mapped and split into line-aligned chunks that are parsed
+// in parallel. Chunks are then merged in file order and the corners are welded
+// into unique vertices the same way as the FBX readers do, so the output has the
+// same layout: VertexTextured, absolute indices grouped by material, one submesh
+// per material. Materials come from the referenced .mtl libraries.
+class ObjReader
+{
+public:
+    ObjReader();
+    bool LoadObjFile(const std::string& filename);
+    void GetVertices(std::vector<VertexTextured>& vertices, std::vector<UINT>& indices);
+    void GetVertices(std::vector<VertexTextured>& vertices, std::vector<UINT>& indices, std::vector<SubMesh>& subMeshes);
+    void GetMaterials(std::vector<MaterialDesc>& materials);
+
+private:
+    // Everything parsed from one chunk. Corners hold position, texcoord and normal
+    // indices (zero-based, -1 if absent).
+    struct Chunk
+    {
+        std::vector<float> Positions;
+        std::vector<float> TexCoords;
+        std::vector<float> Normals;
+        std::vector<int> Corners;
+        std::vector<uint32_t> FaceSizes;
+        // Index of the first face using a material
+        std::vector<std::pair<size_t, std::string>> MaterialChanges;
+        std::vector<std::string> MaterialLibraries;
+
+        // Negative (relative) indices can only be resolved once the element
+        // counts of the previous chunks are known.
+        struct RelativeIndex
+        {
+            size_t Corner;   // Position in Corners
+            int LocalIndex;  // Index relative to the start of this chunk
+        };
+        std::vector<RelativeIndex> RelativeIndices;
+    };
+
+    static void ParseChunk(const char* begin, const char* end, Chunk& chunk);
+    void MergeChunks(std::vector<Chunk>& chunks);
+    void LoadMaterialLibrary(const std::string& name);
+    UINT GetMaterialIndex(const std::string& name);
+
+    std::string mFilename;
+
+    std::vector<float> mPositions;
+    std::vector<float> mTexCoords;
+    std::vector<float> mNormals;
+    std::vector<int> mCorners;
+    std::vector<uint32_t> mFaceSizes;
+    std::vector<std::pair<size_t, std::string>> mMaterialChanges;
+
+    // Materials defined in the libraries, by name
+    std::vector<std::string> mLibraries;
+    std::unordered_map<std::string, MaterialDesc> mLibraryMaterials;
+    std::vector<MaterialDesc> mMaterials;
+    std::unordered_map<std::string, UINT> mMaterialIndices;
+
+    // Welding temporaries
+    MonotonicArena mArena;
+};
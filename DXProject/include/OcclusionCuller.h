@@ -0,0 +1,102 @@
+#pragma once
+
+#include <RenderDefs.h>
+#include <vector>
+
+// CPU occlusion culling in the style of Masked Software Occlusion Culling
+// (Hasselgren, Andersson, Akenine-Moller 2016).
+// Occluder triangles are rasterized into a small buffer of 32x4 pixel tiles. A tile
+// keeps no per-pixel depth, only a coverage mask of one bit per pixel and two
+// conservative far depths: one for the whole tile and one for the pixels in the
+// mask, merged with the paper's heuristic. Each tile row is one SSE register of
+// four 32-bit rows. Bounding boxes are then tested against the far depths, so a
+// box is only reported hidden if it is hidden for sure.
+//
+// Depth is the D3D post-projection z/w, 0 at the near plane and 1 at the far plane.
+// Matrices use the DirectXMath row vector convention (v * M) and are not transposed.
+// Triangles facing away (counter-clockwise on screen, as with D3D11_CULL_BACK) or
+// crossing the near plane are not rasterized.
+class OcclusionCuller
+{
+public:
+    struct Stats
+    {
+        double RasterMs;            // Setup and rasterization of all occluders
+        size_t OccluderTriangles;   // Submitted
+        size_t RasterizedTriangles; // Front facing, in front of the near plane and on screen
+        size_t Tested;
+        size_t Culled;
+    };
+
+    OcclusionCuller();
+
+    // Buffer size in pixels, rounded up to whole tiles. Triangles and tile rows are
+    // split into sliceCount slices, run as jobs.
+    void Init(int width, int height, unsigned sliceCount);
+
+    void BeginFrame();
+    // Queues an indexed triangle list, the data must stay valid until EndOccluders.
+    void AddOccluder(const float* positions, size_t positionStride, const uint32_t* indices, size_t indexCount,
+        const DirectX::XMFLOAT4X4& worldViewProj);
+    // Rasterizes the queued occluders
+    void EndOccluders();
+
+    // False if the box is hidden behind the occluders or outside the view.
+    bool IsVisible(const DirectX::XMFLOAT3& boxMin, const DirectX::XMFLOAT3& boxMax, const DirectX::XMFLOAT4X4& worldViewProj);
+
+    const Stats& GetStats() const { return mStats; }
+    int GetWidth() const { return mWidth; }
+    int GetHeight() const { return mHeight; }
+
+    // Conservative depth of every pixel, row by row, for debugging
+    void GetDepth(std::vector<float>& depth) const;
+
+private:
+    struct alignas(16) Tile
+    {
+        uint32_t Mask[4]; // One 32-pixel row per element, bit i is pixel i
+        float ZMax0;      // Far depth of the whole tile
+        float ZMax1;      // Far depth of the pixels in Mask
+    };
+
+    struct Occluder
+    {
+        const float* Positions;
+        size_t PositionStride;
+        const uint32_t* Indices;
+        size_t IndexCount;
+        DirectX::XMFLOAT4X4 WorldViewProj;
+        size_t FirstTriangle;
+    };
+
+    // Screen space triangle ready for rasterization
+    struct TriangleSetup
+    {
+        // Span edges x(y) = X0 + y * Slope, two left and two right ones, unused ones at infinity
+        float LeftX0[2], LeftSlope[2];
+        float RightX0[2], RightSlope[2];
+        // Depth plane z(x, y) = ZA * x + ZB * y + ZC and the farthest vertex depth
+        float ZA, ZB, ZC, ZMax;
+        float MinX, MaxX, MinY, MaxY;
+        int FirstPixelX, EndPixelX;
+        int FirstPixelY, EndPixelY;
+    };
+
+    void SetupTriangles(unsigned slice);
+    void RasterizeTriangles(unsigned slice);
+    void RasterizeTileRow(const TriangleSetup& triangle, int tileRow);
+
+    int mWidth;
+    int mHeight;
+    int mTilesX;
+    int mTilesY;
+    std::vector<Tile> mTiles;
+
+    std::vector<Occluder> mOccluders;
+    size_t mTriangleCount;
+    // Set up triangles of each slice, rasterized in slice order so results do not depend on timing
+    std::vector<std::vector<TriangleSetup>> mSetups;
+    unsigned mSliceCount;
+
+    Stats mStats;
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <RenderDefs.h>
+#include <VertexFormat.h>
+#include <d3d11.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Session-wide cache of input layouts and fixed-function state objects.
+// Objects are created on first request and shared by every later request with
+// the same description, so adding vertex formats or draws does not multiply them.
+class PipelineStateCache
+{
+public:
+    struct Stats
+    {
+        UINT Created;   // Objects created on the device
+        UINT Reused;    // Requests matched to an existing object (creations avoided)
+    };
+
+    PipelineStateCache();
+    ~PipelineStateCache();
+
+    void Init(ComPtr<ID3D11Device> device);
+
+    // Input layouts are keyed by the vertex format and the hash of the shader bytecode.
+    ID3D11InputLayout* GetInputLayout(const VertexFormat& format, const void* shaderBytecode, size_t bytecodeLength);
+    ID3D11RasterizerState* GetRasterizerState(const D3D11_RASTERIZER_DESC& desc);
+    ID3D11BlendState* GetBlendState(const D3D11_BLEND_DESC& desc);
+    ID3D11DepthStencilState* GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc);
+
+    Stats GetStats() const { return mStats; }
+    void LogStats() const;
+
+private:
+    // The element descriptions, with their semantic names copied, and the bytecode
+    // identity are kept so a hash collision cannot return a layout for another format.
+    struct InputLayoutEntry
+    {
+        std::vector<D3D11_INPUT_ELEMENT_DESC> Elements;
+        std::vector<std::string> SemanticNames;
+        uint64_t BytecodeHash;
+        size_t BytecodeLength;
+        ComPtr<ID3D11InputLayout> Object;
+    };
+
+    static bool Matches(const InputLayoutEntry& entry, const VertexFormat& format, uint64_t bytecodeHash, size_t bytecodeLength);
+
+    template<typename Desc, typename State>
+    struct StateEntry
+    {
+        Desc Description;
+        ComPtr<State> Object;
+    };
+
+    template<typename Desc, typename State, typename CreateFunc>
+    State* GetState(std::unordered_multimap<uint64_t, StateEntry<Desc, State>>& cache, const Desc& desc, CreateFunc create);
+
+    ComPtr<ID3D11Device> mDevice;
+
+    std::unordered_multimap<uint64_t, InputLayoutEntry> mInputLayouts;
+    std::unordered_multimap<uint64_t, StateEntry<D3D11_RASTERIZER_DESC, ID3D11RasterizerState>> mRasterizerStates;
+    std::unordered_multimap<uint64_t, StateEntry<D3D11_BLEND_DESC, ID3D11BlendState>> mBlendStates;
+    std::unordered_multimap<uint64_t, StateEntry<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState>> mDepthStencilStates;
+
+    Stats mStats;
+};
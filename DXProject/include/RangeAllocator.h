@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Suballocator for ranges of [0, capacity), in whatever unit the caller counts (vertices,
+// indices). Free ranges are kept by offset, so a freed range merges with its free
+// neighbours, and by size, so an allocation takes the smallest free range that fits.
+// Only offsets are handed out, the memory itself belongs to the caller.
+class RangeAllocator
+{
+public:
+    static const uint32_t kInvalidOffset = UINT32_MAX;
+
+    explicit RangeAllocator(uint32_t capacity = 0);
+
+    // kInvalidOffset if size is 0 or no free range is large enough
+    uint32_t Allocate(uint32_t size);
+    void Free(uint32_t offset);
+    void Clear();
+
+    // Adds [old capacity, capacity) to the free ranges, capacity can only grow.
+    void Grow(uint32_t capacity);
+
+    // Moves every allocation to the front, in offset order, so the free space is one
+    // range at the end. The caller applies the moves to its data, every move goes to a
+    // lower offset and the moves are in increasing order.
+    struct Move
+    {
+        uint32_t From;
+        uint32_t To;
+        uint32_t Size;
+    };
+    std::vector<Move> Compact();
+
+    struct Stats
+    {
+        uint32_t Capacity;
+        uint32_t Used;
+        uint32_t Allocations;
+        uint32_t FreeRanges;
+        uint32_t LargestFree;
+        // 1 - largest free range / all free space: 0 when the free space is in one
+        // piece, close to 1 when it is scattered in small ranges.
+        float Fragmentation;
+    };
+    Stats GetStats() const;
+
+    uint32_t GetCapacity() const { return mCapacity; }
+    uint32_t GetFreeSize() const { return mCapacity - mUsed; }
+
+private:
+    void AddFreeRange(uint32_t offset, uint32_t size);
+    void RemoveFreeRange(std::map<uint32_t, uint32_t>::iterator range);
+
+    uint32_t mCapacity;
+    uint32_t mUsed;
+    std::map<uint32_t, uint32_t> mFreeByOffset;    // Offset -> size
+    std::multimap<uint32_t, uint32_t> mFreeBySize; // Size -> offset
+    std::map<uint32_t, uint32_t> mAllocations;     // Offset -> size
+};
@@ -1,11 +1,20 @@
 #pragma once
 
 #include <DirectXMath.h>
-#include <windows.h>
 #include <LogWriter.h>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
 #include <wrl/client.h>
 
 using Microsoft::WRL::ComPtr;
+#else
+// Import and other CPU-side code is also built on Linux.
+#include <cstdint>
+
+typedef uint32_t UINT;
+#endif
 
 struct Vertex
 {
@@ -27,6 +36,25 @@ struct CubeVertex
     DirectX::XMFLOAT4 Color;
 };
 
+// Contiguous index range drawn with one material.
+struct SubMesh
+{
+    UINT StartIndex;
+    UINT IndexCount;
+    UINT MaterialIndex;
+};
+
+// Material parameters as imported from the model file.
+struct MaterialDesc
+{
+    std::string Name;
+    std::wstring ColorMapFile;
+    std::wstring NormalMapFile;
+    DirectX::XMFLOAT4 Ambient;
+    DirectX::XMFLOAT4 Diffuse;
+    DirectX::XMFLOAT4 Specular; // w = SpecPower
+};
+
 struct PER_FRAME_CBUFFER
 {
     DirectX::XMFLOAT4X4 mWorldViewProj;
@@ -48,3 +76,46 @@ struct LIGHTS_CBUFFER
 {
     DIRECTIONAL_LIGHT DirLight;
 };
+
+// Point or spot light in world space, read by the pixel shader from a structured buffer.
+// A point light has SpotCosOuter = -2, a spot light fades out between the cosines of its
+// inner and outer cone angles around Direction.
+struct LOCAL_LIGHT
+{
+    DirectX::XMFLOAT3 Position;
+    float Range; // No light beyond it
+    DirectX::XMFLOAT3 Color;
+    float SpotCosOuter;
+    DirectX::XMFLOAT3 Direction;
+    float SpotCosInner;
+};
+
+// Maps a pixel to its light cluster, see LightClusters
+struct CLUSTER_CBUFFER
+{
+    DirectX::XMFLOAT2 TileScale; // Tiles per pixel
+    float SliceScale;            // Slice = log(view depth) * SliceScale + SliceBias
+    float SliceBias;
+    UINT TilesX;
+    UINT TilesY;
+    UINT Slices;
+    UINT LightCount;
+};
+
+// Image based lighting baked from the environment map, see EnvironmentLighting
+struct ENVIRONMENT_CBUFFER
+{
+    DirectX::XMFLOAT4 AmbientSh[9]; // Irradiance / pi as L2 spherical harmonics
+    float PrefilteredLevels;        // Mips of the environment map, for roughness 0 to 1
+    DirectX::XMFLOAT3 Pad;
+};
+
+struct MATERIAL_CBUFFER
+{
+    DirectX::XMFLOAT4 Ambient;
+    DirectX::XMFLOAT4 Diffuse;
+    DirectX::XMFLOAT4 Specular;
+    UINT HasColorMap;
+    UINT HasNormalMap;
+    UINT Pad[2];
+};
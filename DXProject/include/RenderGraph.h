@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Frame graph of render passes and the textures they read and write. Every frame the
+// passes are declared with their accesses, then Compile:
+// - culls the passes whose results reach neither an output nor a pass with side effects;
+// - orders the rest, each pass as late as the passes that need its results allow, so
+//   transient textures are alive for a shorter time;
+// - computes the lifetime of each transient texture in that order and assigns it a
+//   physical texture. Transient textures with the same description whose lifetimes do
+//   not overlap share one physical texture; D3D11 has no placed resources, so memory is
+//   only shared between textures that could be the same one.
+// Execute then runs the passes in order. The graph knows nothing about the device: the
+// physical textures are created by RenderTargetPool, the headless benchmark compiles
+// graphs without one.
+//
+// A handle names one version of a texture. Writing a texture gives a new version, which
+// is how readers and writers of the same texture are ordered.
+class RenderGraph
+{
+public:
+    typedef uint32_t TextureHandle;
+    static const TextureHandle kInvalidTexture = 0xFFFFFFFF;
+
+    enum class TextureFormat : uint8_t
+    {
+        RGBA8,
+        RGBA16F,
+        RG16F,
+        R32F,
+        D24S8,
+        D32F
+    };
+
+    struct TextureDesc
+    {
+        uint32_t Width;
+        uint32_t Height;
+        TextureFormat Format;
+        uint32_t SampleCount;
+    };
+
+    // How a physical texture is used by the passes, for the bind flags
+    enum Usage : uint32_t
+    {
+        UsageRenderTarget = 1,
+        UsageDepthStencil = 2,
+        UsageShaderResource = 4
+    };
+
+    struct PhysicalTexture
+    {
+        TextureDesc Desc;
+        uint32_t Usage;
+        bool Imported;
+    };
+
+    struct Stats
+    {
+        double CompileMs;
+        uint32_t Passes;
+        uint32_t CulledPasses;
+        uint32_t Textures;         // Transient textures used by the passes left
+        uint32_t PhysicalTextures; // Transient ones after aliasing
+        uint64_t RequestedBytes;   // Of the transient textures
+        uint64_t AllocatedBytes;   // Of the physical textures they share
+    };
+
+    typedef std::function<void(const RenderGraph& graph)> ExecuteFunc;
+
+    // Declares the accesses of the pass added last
+    class PassBuilder
+    {
+    public:
+        // New transient texture, written by this pass
+        TextureHandle Create(const char* name, const TextureDesc& desc);
+        // Render target or depth stencil after the previous version, returns the new version
+        TextureHandle Write(TextureHandle texture);
+        // Shader resource
+        void Read(TextureHandle texture);
+        // Never culled, for passes that write outside the graph
+        void SetSideEffects();
+        // Run by Execute if the pass is not culled
+        void Execute(ExecuteFunc func);
+
+    private:
+        friend class RenderGraph;
+        PassBuilder(RenderGraph& graph, uint32_t pass) : mGraph(graph), mPass(pass) {}
+
+        RenderGraph& mGraph;
+        uint32_t mPass;
+    };
+
+    RenderGraph();
+
+    // Drops the passes and textures, keeping the memory for the next frame
+    void Reset();
+    // Texture owned outside the graph, like the back buffer. Never aliased.
+    TextureHandle Import(const char* name, const TextureDesc& desc);
+    // Names must outlive the graph, string literals in practice
+    PassBuilder AddPass(const char* name);
+    // The passes this version depends on are kept
+    void MarkOutput(TextureHandle texture);
+
+    void Compile();
+    void Execute() const;
+
+    // After Compile
+    uint32_t GetPhysicalTexture(TextureHandle texture) const;
+    const std::vector<PhysicalTexture>& GetPhysicalTextures() const { return mPhysicalTextures; }
+    // Passes left, in execution order
+    const std::vector<uint32_t>& GetPassOrder() const { return mOrder; }
+    const char* GetPassName(uint32_t pass) const { return mPasses[pass].Name; }
+    const Stats& GetStats() const { return mStats; }
+
+    static uint64_t GetTextureBytes(const TextureDesc& desc);
+    static bool IsDepthFormat(TextureFormat format) { return format == TextureFormat::D24S8 || format == TextureFormat::D32F; }
+
+private:
+    static const uint32_t kNone = 0xFFFFFFFF;
+
+    struct Texture
+    {
+        const char* Name;
+        TextureDesc Desc;
+        bool Imported;
+        uint32_t Usage;
+        uint32_t FirstUse; // Positions in mOrder
+        uint32_t LastUse;
+        uint32_t Physical;
+    };
+
+    struct Version
+    {
+        uint32_t Texture;
+        uint32_t Producer; // Pass, kNone for imports
+    };
+
+    // Input is the version read, or overwritten by a write; Output the version written
+    struct Access
+    {
+        uint32_t Input;
+        uint32_t Output;
+    };
+
+    struct Pass
+    {
+        const char* Name;
+        ExecuteFunc Execute;
+        uint32_t FirstAccess;
+        uint32_t AccessCount;
+        bool SideEffects;
+        bool Live;
+    };
+
+    TextureHandle AddVersion(uint32_t texture, uint32_t producer);
+    void AddAccess(uint32_t pass, uint32_t input, uint32_t output);
+    void CullPasses();
+    void OrderPasses();
+    void AssignPhysicalTextures();
+
+    std::vector<Texture> mTextures;
+    std::vector<Version> mVersions;
+    std::vector<Access> mAccesses;
+    std::vector<Pass> mPasses;
+    std::vector<TextureHandle> mOutputs;
+
+    // Compile results and scratch, kept between frames
+    std::vector<uint32_t> mOrder;
+    std::vector<PhysicalTexture> mPhysicalTextures;
+    std::vector<uint32_t> mPhysicalLastUse;
+    std::vector<uint32_t> mWorklist;
+    std::vector<uint32_t> mReaderOffsets;  // Per version into mReaders
+    std::vector<uint32_t> mReaders;        // Live passes reading a version
+    std::vector<uint32_t> mDependentCount; // Per pass, live passes that must run after it
+    std::vector<uint64_t> mReady;
+    Stats mStats;
+};
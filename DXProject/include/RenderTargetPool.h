@@ -0,0 +1,57 @@
+#pragma once
+
+#include <RenderDefs.h>
+#include <RenderGraph.h>
+#include <d3d11.h>
+#include <vector>
+
+// D3D11 textures and views for the physical textures of a compiled RenderGraph. Textures
+// are kept between frames and handed to the next compile that asks for the same
+// description and usage, so a graph rebuilt every frame creates nothing once it is warm;
+// the ones a frame does not use are released. Imported textures, like the back buffer,
+// are set from outside for every frame.
+class RenderTargetPool
+{
+public:
+    RenderTargetPool();
+
+    // Multisampled textures use the highest quality level below msaaQuality
+    void Init(ComPtr<ID3D11Device> device, UINT msaaQuality);
+    // After Compile, before Execute
+    void Realize(const RenderGraph& graph);
+    void SetImported(const RenderGraph& graph, RenderGraph::TextureHandle texture, ID3D11RenderTargetView* renderTarget,
+        ID3D11DepthStencilView* depthStencil, ID3D11ShaderResourceView* shaderResource);
+    void Clear();
+
+    ID3D11RenderTargetView* GetRenderTargetView(const RenderGraph& graph, RenderGraph::TextureHandle texture) const;
+    ID3D11DepthStencilView* GetDepthStencilView(const RenderGraph& graph, RenderGraph::TextureHandle texture) const;
+    ID3D11ShaderResourceView* GetShaderResourceView(const RenderGraph& graph, RenderGraph::TextureHandle texture) const;
+
+private:
+    struct Target
+    {
+        RenderGraph::TextureDesc Desc;
+        uint32_t Usage;
+        ComPtr<ID3D11Texture2D> Texture;
+        ComPtr<ID3D11RenderTargetView> RenderTarget;
+        ComPtr<ID3D11DepthStencilView> DepthStencil;
+        ComPtr<ID3D11ShaderResourceView> ShaderResource;
+        bool Used;
+    };
+
+    // Views of a physical texture for this frame, owned by a target or imported
+    struct Views
+    {
+        ID3D11RenderTargetView* RenderTarget;
+        ID3D11DepthStencilView* DepthStencil;
+        ID3D11ShaderResourceView* ShaderResource;
+    };
+
+    void CreateTarget(Target& target);
+
+    ComPtr<ID3D11Device> mDevice;
+    UINT mMsaaQuality;
+    std::vector<Target> mTargets;
+    std::vector<Views> mViews; // Per physical texture of the last Realize
+    std::vector<uint32_t> mTargetIndices;
+};
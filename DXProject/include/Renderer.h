@@ -1,9 +1,29 @@
 #pragma once
 
 #include <d3d11.h>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include <RenderDefs.h>
+#include <FrameState.h>
+#include <FrameTimings.h>
+#include <Simulation.h>
 #include <Material.h>
+#include <PipelineStateCache.h>
+#include <StateCache.h>
+#include <SceneCulling.h>
+#include <LightClusters.h>
+#include <Metrics.h>
+#include <RenderGraph.h>
+#include <RenderTargetPool.h>
+#include <MeshBvh.h>
+#include <GeometryPool.h>
+#include <VertexStreams.h>
+#include <FileWatcher.h>
 #include <Utils.h>
 #include <GameTimer.h>
 
@@ -16,9 +36,26 @@ public:
     ~Renderer();
 
     bool Init(HWND mhMainWnd);
+    // Imports the model with the FBX SDK and stores the result next to it, the expected
+    // output of the native importers for AssetCooker --check-import
+    static bool WriteImportReference();
     bool IsInitialized() const { return mbInitialized; }
+    // Runs the simulation for one frame and hands it to the render thread, which
+    // draws it while the next one is updated.
     void UpdateScene(float dt);
-    void DrawScene();
+    // Waits until UpdateScene can start without blocking, or until a window message
+    // arrives, then returns false and the caller handles it first. Present and
+    // ResizeBuffers on the render thread may wait for the window's messages, so the
+    // message thread must not block on the render thread.
+    bool WaitForFrameSlot();
+    // Before the window goes away, stops the hot reload too
+    void StopRenderThread();
+
+    // Camera of the next update, for replaying and recording camera paths
+    void SetCameraOrbit(const CameraOrbit& orbit) { mSimulation.SetOrbit(orbit); }
+    const CameraOrbit& GetCameraOrbit() const { return mSimulation.GetOrbit(); }
+    // Adds per-frame timing columns and fills them until called with null
+    void RecordTimings(FrameTimings* timings);
     void CalculateFrameStats(const GameTimer& timer, std::wstring& mMainWndCaption, HWND mhMainWnd);
 
     void OnResize(int width, int height);
@@ -26,14 +63,99 @@ public:
     void OnMouseDown(WPARAM btnState, int x, int y);
     void OnMouseMove(WPARAM btnState, int x, int y);
 
+    // Mesh triangle under a client area position
+    struct PickResult
+    {
+        UINT SubMesh;
+        UINT Triangle;     // Triangle number in the mesh index buffer
+        float U, V;        // Barycentrics of the second and third vertex
+        XMFLOAT3 Position; // Model space
+    };
+    bool Pick(int x, int y, PickResult& result) const;
+
 private:
+    // Everything created from the model file. Loaded at init, and again off the render
+    // thread when the file changes.
+    struct LoadedModel
+    {
+        // Uploaded to the geometry pool by the render thread
+        VertexStreams Streams;                // Split streams only
+        std::vector<VertexTextured> Vertices; // Interleaved only
+        std::vector<XMFLOAT4> Tangents;       // Empty without normal mapping
+        std::vector<UINT> Indices;
+        std::vector<SubMesh> SubMeshes;
+        std::vector<MaterialDesc> MaterialDescs; // With the fallback maps filled in
+        std::vector<Material> Materials;
+        SceneCulling Culling;
+        MeshBvh Bvh;
+    };
+
+    enum class AssetType
+    {
+        Model,
+        Texture,
+        VertexShader,
+        PixelShader
+    };
+
+    // A changed asset file, imported again by the reload thread and swapped in by the render thread
+    struct AssetReload
+    {
+        AssetType Type;
+        std::filesystem::path Source;                  // The cooked file may be the one that changed
+        std::chrono::steady_clock::time_point Changed; // First write the watcher saw
+        double ImportMs;
+        bool Succeeded;
+
+        std::unique_ptr<LoadedModel> Model;
+        // Textures: the materials using the file, for the model they were loaded for
+        uint64_t ModelGeneration;
+        std::vector<std::pair<size_t, MaterialDesc>> MaterialDescs;
+        std::vector<Material> Materials;
+        // Shaders
+        std::vector<char> ShaderCode;
+        ComPtr<ID3D11VertexShader> VertexShader;
+        ComPtr<ID3D11PixelShader> PixelShader;
+    };
+
     bool InitDirect3D(HWND mhMainWnd);
     void CreateShaders();
-    void CreateMesh();
-    void CreateCubeMesh();
+    void CreateRenderStates();
+    bool LoadModel(const std::string& modelFile, LoadedModel& model);
+    bool CreateMesh(const std::string& modelFile, LoadedModel& model);
+    // Generates the tangents from the attributes unless they were cooked
+    void CreateTangents(std::vector<VertexTextured>& vertices, std::vector<UINT>& indices, std::vector<XMFLOAT4>& tangents);
+    void CreateGeometryPool();
     void CreateConstantBuffers();
-    void CreateMaterial();
-    void SetupLights();
+    // Dynamic structured buffer read by the pixel shader, recreated larger when the data does not fit
+    struct ShaderBuffer
+    {
+        ComPtr<ID3D11Buffer> Buffer;
+        ComPtr<ID3D11ShaderResourceView> View;
+        UINT Capacity = 0; // Elements
+    };
+    void UploadShaderBuffer(ShaderBuffer& buffer, const void* data, UINT stride, UINT count);
+    // Bakes the ambient SH and the prefiltered cube map from the environment map
+    void CreateEnvironmentLighting();
+    void CreateMaterials(LoadedModel& model);
+    // Takes the resources of model, which gets the replaced ones
+    void SwapInModel(LoadedModel& model);
+
+    void WatchAssetDirectories(const std::vector<MaterialDesc>& materialDescs);
+    void ReloadLoop();
+    void ReloadAsset(AssetReload& reload);
+    void ApplyReloads();
+
+    // Registers the metrics published every frame and creates their shared memory
+    void CreateMetrics();
+    void RenderLoop();
+    // Sets the metrics of the frame just presented and publishes them
+    void PublishMetrics(uint64_t frame, double drawMs, double latencyMs);
+    void DrawScene(const FrameState& state);
+    void UploadFrameConstants(const FrameState& state);
+    // Bins the local lights and uploads them with the cluster lists
+    void UploadLightClusters(const FrameState& state);
+    void ResizeBuffers(int width, int height);
 
     float AspectRatio() const;
 
@@ -43,34 +165,151 @@ private:
     ComPtr<ID3D11Device> md3dDevice;
     ComPtr<ID3D11DeviceContext> md3dImmediateContext;
     ComPtr<IDXGISwapChain> mSwapChain;
-    ComPtr<ID3D11Texture2D> mDepthStencilBuffer;
 
     ComPtr<ID3D11RenderTargetView> mRenderTargetView;
-    ComPtr<ID3D11DepthStencilView> mDepthStencilView;
     D3D11_VIEWPORT mScreenViewport;
 
+    // Passes of a frame, rebuilt every frame; the depth buffer and the other targets
+    // are created by the pool for the compiled graph
+    RenderGraph mRenderGraph;
+    RenderTargetPool mRenderTargetPool;
+
     ComPtr<ID3D11VertexShader> mVertexShader;
     ComPtr<ID3D11PixelShader> mPixelShader;
+    ComPtr<ID3D11VertexShader> mDepthVertexShader;
+
+    // Vertex and index buffers of every mesh, bound once per frame
+    GeometryPool mGeometryPool;
+    GeometryPool::Handle mModelGeometry;
 
-    Material mMaterial;
+    std::vector<MaterialDesc> mMaterialDescs;
+    std::vector<Material> mMaterials;
+    std::vector<SubMesh> mSubMeshes;
 
+    // Submeshes hidden behind the largest ones are not drawn
+    SceneCulling mSceneCulling;
+    std::vector<UINT> mVisibleSubMeshes;
+    // Model space triangles for picking and other ray queries
+    MeshBvh mBvh;
+
+    PipelineStateCache mPipelineStateCache;
+    // All binds of the render thread go through it
+    StateCache mStateCache;
     ComPtr<ID3D11InputLayout> mInputLayout;
+    ComPtr<ID3D11InputLayout> mDepthInputLayout; // Position only
+    ComPtr<ID3D11RasterizerState> mRasterizerState;
+    ComPtr<ID3D11DepthStencilState> mDepthStencilState;
+    ComPtr<ID3D11DepthStencilState> mDepthEqualState; // Main pass after the depth prepass
+    ComPtr<ID3D11BlendState> mBlendState;
     ComPtr<ID3D11Buffer> mPerFrameCbuffer;
     ComPtr<ID3D11Buffer> mDirectionalLightBuffer;
 
+    // Point and spot lights, binned into clusters of the view frustum every frame
+    LightClusters mLightClusters;
+    ComPtr<ID3D11Buffer> mClusterCbuffer;
+    ShaderBuffer mLocalLightBuffer;
+    ShaderBuffer mClusterBuffer;
+    ShaderBuffer mClusterLightIndexBuffer;
+
+    // Ambient SH and the prefiltered environment, baked once at init
+    ComPtr<ID3D11Buffer> mEnvironmentCbuffer;
+    ComPtr<ID3D11ShaderResourceView> mEnvironmentMap;
+
     UINT m4xMsaaQuality;
     bool mEnable4xMsaa;
+    bool mEnableNormalMapping;
+    bool mEnableOcclusionCulling;
+    bool mEnableFramePipelining; // Update the next frame while this one is drawn
+    bool mEnableHotReload;       // Import changed asset files again while running
+    bool mEnableSplitStreams;    // Separate position, normal and UV vertex buffers
+    bool mEnableDepthPrepass;    // Depth from the positions alone before shading
+    bool mEnableLocalLights;     // Point and spot lights through the light clusters
 
     int mClientWidth;
     int mClientHeight;
 
-    XMFLOAT4X4 mWorld;
-    XMFLOAT4X4 mView;
-    XMFLOAT4X4 mProj;
-    float mTheta;
-    float mPhi;
-    float mRadius;
-    POINT mLastMousePos;
+    // The message loop thread runs the simulation, the render thread owns the
+    // device context once Init is done.
+    Simulation mSimulation;
+    FrameStateExchange mFrameStates;
+    std::thread mRenderThread;
+    HANDLE mhFrameReleased; // Set by the render thread after each frame
+
+    // Resize requested by the message loop, applied by the render thread before its next frame
+    std::mutex mResizeMutex;
+    bool mbResizePending;
+    int mPendingWidth;
+    int mPendingHeight;
 
-    UINT mIndexCount;
+    // The reload thread waits for changed asset files and imports them again with the
+    // job system, the render thread swaps the results in before its next frame.
+    FileWatcher mFileWatcher;
+    std::thread mReloadThread;
+    std::mutex mReloadMutex;
+    std::vector<std::unique_ptr<AssetReload>> mPendingReloads;
+    // Held by the render thread while it swaps in a model, and by readers of the
+    // model on other threads
+    mutable std::mutex mModelMutex;
+    uint64_t mModelGeneration;
+
+    // Accumulated by the render thread, taken by CalculateFrameStats
+    struct RenderStats
+    {
+        uint64_t Frames;
+        double DrawMs;    // Constant upload to Present
+        double LatencyMs; // Start of the update to the end of Present
+        OcclusionCuller::Stats Occlusion;
+        LightClusters::Stats Lights;
+        RenderGraph::Stats Graph;
+        StateCache::Stats StateChanges; // Of the last frame
+    };
+    std::mutex mRenderStatsMutex;
+    RenderStats mRenderStats;
+    // Simulation thread time, split in updating and waiting for the render thread
+    double mUpdateMs;
+    double mUpdateWaitMs;
+    double mSlotWaitMs; // In WaitForFrameSlot since the last update
+
+    // Per-frame samples of a benchmark run, the render thread's under mRenderStatsMutex
+    FrameTimings* mpTimings;
+    struct TimingColumns
+    {
+        size_t Update;
+        size_t UpdateWait;
+        size_t Draw;
+        size_t Occlusion;
+        size_t LightBinning;
+        size_t Latency;
+    };
+    TimingColumns mTimingColumns;
+
+    // Published by the render thread after every Present, for DXMetrics and dashboards
+    MetricsRegistry mMetrics;
+    struct MetricIds
+    {
+        MetricsRegistry::Handle UpdateMs;
+        MetricsRegistry::Handle UpdateWaitMs;
+        MetricsRegistry::Handle DrawMs;
+        MetricsRegistry::Handle LatencyMs;
+        MetricsRegistry::Handle Frames;
+        MetricsRegistry::Handle Draws;
+        MetricsRegistry::Handle Triangles;
+        MetricsRegistry::Handle StateCalls;
+        MetricsRegistry::Handle UploadBytes;
+        MetricsRegistry::Handle VisibleSubMeshes;
+        MetricsRegistry::Handle OcclusionMs;
+        MetricsRegistry::Handle LightsInView;
+        MetricsRegistry::Handle LightBinningMs;
+        MetricsRegistry::Handle GraphCompileMs;
+        MetricsRegistry::Handle CpuBytes;
+        MetricsRegistry::Handle GpuBytes;
+        MetricsRegistry::Handle ModelImportMs;
+        MetricsRegistry::Handle Reloads;
+        MetricsRegistry::Handle ReloadImportMs;
+    };
+    MetricIds mMetricIds;
+    // Geometry pool and texture cache uploads already added to UploadBytes
+    uint64_t mLoadUploadBytes;
+
+    POINT mLastMousePos;
 };
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <OcclusionCuller.h>
+#include <RenderDefs.h>
+#include <vector>
+
+// Occlusion culling of the submeshes of a model: the largest submeshes are picked as
+// occluders, rasterized with the OcclusionCuller every frame, and the bounding box of
+// every submesh inside the view frustum is tested against them. No device needed, the headless benchmark runs
+// the same culling as the renderer.
+class SceneCulling
+{
+public:
+    // Model space
+    struct Bounds
+    {
+        DirectX::XMFLOAT3 Min;
+        DirectX::XMFLOAT3 Max;
+    };
+
+    // Computes the submesh bounds and copies the occluder triangles.
+    void Init(const float* positions, size_t positionStride, size_t vertexCount, const uint32_t* indices,
+        const std::vector<SubMesh>& subMeshes);
+    // Occlusion buffer for a viewport of this size
+    void Resize(int width, int height);
+
+    // Indices of the submeshes that are not hidden behind the occluders, in submesh order
+    void Cull(const DirectX::XMFLOAT4X4& worldViewProj, std::vector<UINT>& visible);
+
+    const std::vector<Bounds>& GetSubMeshBounds() const { return mSubMeshBounds; }
+    const OcclusionCuller::Stats& GetStats() const { return mOcclusionCuller.GetStats(); }
+
+private:
+    std::vector<Bounds> mSubMeshBounds;
+    std::vector<uint8_t> mInFrustum; // Per submesh, of the last Cull
+    // Triangles of the submeshes used as occluders, with their own compact positions
+    std::vector<DirectX::XMFLOAT3> mOccluderPositions;
+    std::vector<uint32_t> mOccluderIndices;
+    OcclusionCuller mOcclusionCuller;
+};
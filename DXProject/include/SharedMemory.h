@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Named memory shared between processes, read-write.
+// Uses a file mapping of the paging file on Windows and shm_open everywhere else.
+class SharedMemory
+{
+public:
+    SharedMemory();
+    ~SharedMemory();
+
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+    // Zero-filled when new. A name still mapped by another process is reused on Windows,
+    // if large enough, and replaced elsewhere. The creator removes the name when it
+    // closes, mappings opened meanwhile stay valid.
+    bool Create(const char* name, size_t size);
+    // Maps the whole memory created by another process
+    bool Open(const char* name);
+    void Close();
+
+    bool IsOpen() const { return mpData != nullptr; }
+    uint8_t* Data() const { return mpData; }
+    size_t Size() const { return mSize; }
+
+private:
+    uint8_t* mpData;
+    size_t mSize;
+
+#ifdef _WIN32
+    void* mMappingHandle;
+#else
+    char mName[64];
+    bool mCreated;
+#endif
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Batch math kernels with scalar, SSE4.1 and AVX2 + FMA versions, picked at startup
+// from what the CPU supports. The types only need standard headers and have the
+// layout of the DirectXMath ones (Float3 of XMFLOAT3, Matrix4 of XMFLOAT4X4), so
+// arrays of either can be passed through. Matrices are row-major and multiply row
+// vectors, p * M, like DirectXMath.
+//
+// The SIMD versions may differ from the scalar ones in the last bits, FMA rounds once
+// where the scalar code rounds twice.
+namespace SimdMath
+{
+    struct Float3
+    {
+        float x, y, z;
+    };
+
+    struct Float4
+    {
+        float x, y, z, w;
+    };
+
+    struct Matrix4
+    {
+        float m[4][4];
+    };
+
+    struct Aabb
+    {
+        Float3 Min;
+        Float3 Max;
+    };
+
+    // Points p with a x + b y + c z + d >= 0 for every plane are inside
+    struct Frustum
+    {
+        Float4 Planes[6];
+
+        // Of a view-projection matrix with D3D clip space, 0 <= z <= w. The planes of a
+        // world-view-projection matrix are in model space.
+        static Frustum FromMatrix(const Matrix4& viewProj);
+    };
+
+    enum class Backend
+    {
+        Scalar,
+        SSE4,
+        AVX2
+    };
+
+    // The fastest one the CPU supports unless changed with SetBackend
+    Backend GetBackend();
+    // For benchmarks. Returns false and keeps the current one if the CPU does not support
+    // it. Not thread safe with kernels running.
+    bool SetBackend(Backend backend);
+    bool IsSupported(Backend backend);
+    const char* GetBackendName(Backend backend);
+
+    // out[i] = (points[i], 1) * m
+    void TransformPoints(const Float3* points, size_t count, const Matrix4& m, Float4* out);
+    // out[i] = a[i] * b. out may be a.
+    void MultiplyMatrices(const Matrix4* a, size_t count, const Matrix4& b, Matrix4* out);
+    // visible[i] is 1 unless boxes[i] is entirely outside one of the planes. Boxes that
+    // are outside only across a frustum corner count as visible.
+    void TestFrustum(const Aabb* boxes, size_t count, const Frustum& frustum, uint8_t* visible);
+    // In place. Vectors with a squared length that rounds to zero are left as they are.
+    void NormalizeVectors(Float3* vectors, size_t count);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <CameraPath.h>
+#include <FrameState.h>
+
+// Scene state owned by the simulation thread: the orbit camera moved by the mouse, the
+// model transform and the lights. Every update writes a FrameState for the renderer.
+class Simulation
+{
+public:
+    Simulation();
+
+    void SetAspectRatio(float aspectRatio);
+    // Radians, phi is kept away from the poles
+    void RotateCamera(float dTheta, float dPhi);
+    void ZoomCamera(float dRadius);
+    // For replaying and recording camera paths, limited like the mouse controls
+    void SetOrbit(const CameraOrbit& orbit);
+    const CameraOrbit& GetOrbit() const { return mOrbit; }
+    const DIRECTIONAL_LIGHT& GetLight() const { return mLight; }
+    // Point and spot lights circling the model, every fourth one a spot light. The same
+    // count always gives the same lights.
+    void SetLocalLightCount(size_t count);
+
+    void Update(float dt, FrameState& state);
+    // State written by the last update, for picking on the simulation thread
+    const FrameState& GetState() const { return mState; }
+
+private:
+    CameraOrbit mOrbit;
+    float mAspectRatio;
+    DirectX::XMFLOAT4X4 mWorld;
+    DIRECTIONAL_LIGHT mLight;
+    bool mbLightChanged;
+    // Local lights move on circles around the y axis
+    struct LightOrbit
+    {
+        float Radius;
+        float Height;
+        float Angle;
+        float Speed; // Radians per second
+    };
+    std::vector<LightOrbit> mLightOrbits;
+    std::vector<LOCAL_LIGHT> mLocalLights;
+    FrameState mState;
+};
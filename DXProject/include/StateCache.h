@@ -0,0 +1,150 @@
+#pragma once
+
+#include <RenderDefs.h>
+#include <d3d11.h>
+#include <cstdint>
+
+// Filter in front of the device context for the state set per draw. Binds are recorded
+// and applied by the next draw, a bind that matches what the context already has (or
+// what is already pending) is dropped. Slot arrays keep a dirty mask, and each run of
+// dirty slots is bound with one call.
+//
+// Objects are compared by pointer and not referenced, they must stay alive while bound.
+// Call Invalidate after binding state behind the cache's back or ClearState.
+class StateCache
+{
+public:
+    static const UINT kMaxVertexBuffers = 8;
+    static const UINT kMaxConstantBuffers = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+    static const UINT kMaxShaderResources = 32; // Of the 128 D3D11 slots, for the dirty mask
+    static const UINT kMaxSamplers = D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT;
+
+    // Counted from BeginFrame
+    struct Stats
+    {
+        UINT Requested; // Set calls
+        UINT Filtered;  // Set calls that matched the bound or pending state
+        UINT Issued;    // Calls made on the device context, a run of slots counts once
+        UINT Draws;
+        UINT Vertices;  // Indices of the indexed draws and vertices of the others
+    };
+
+    StateCache();
+
+    void Init(ComPtr<ID3D11DeviceContext> context);
+    // Resets the counters, the bound state is kept.
+    void BeginFrame();
+    // Forgets the bound state, every slot is bound again on the next request.
+    void Invalidate();
+
+    void SetInputLayout(ID3D11InputLayout* layout);
+    void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+    void SetVertexBuffer(UINT slot, ID3D11Buffer* buffer, UINT stride, UINT offset);
+    void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset);
+
+    void SetVertexShader(ID3D11VertexShader* shader);
+    void SetPixelShader(ID3D11PixelShader* shader);
+    void SetVSConstantBuffer(UINT slot, ID3D11Buffer* buffer);
+    void SetPSConstantBuffer(UINT slot, ID3D11Buffer* buffer);
+    void SetPSShaderResource(UINT slot, ID3D11ShaderResourceView* view);
+    void SetPSSampler(UINT slot, ID3D11SamplerState* sampler);
+
+    void SetRasterizerState(ID3D11RasterizerState* state);
+    void SetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef);
+    // Default blend factor and sample mask
+    void SetBlendState(ID3D11BlendState* state);
+
+    // Apply the pending binds first.
+    void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex);
+    void Draw(UINT vertexCount, UINT startVertex);
+    // Applies the pending binds, for work other than draws.
+    void Flush();
+
+    const Stats& GetStats() const { return mStats; }
+
+private:
+    struct VertexBufferBinding
+    {
+        ID3D11Buffer* Buffer;
+        UINT Stride;
+        UINT Offset;
+        bool operator==(const VertexBufferBinding& other) const
+        {
+            return Buffer == other.Buffer && Stride == other.Stride && Offset == other.Offset;
+        }
+    };
+
+    struct IndexBufferBinding
+    {
+        ID3D11Buffer* Buffer;
+        DXGI_FORMAT Format;
+        UINT Offset;
+        bool operator==(const IndexBufferBinding& other) const
+        {
+            return Buffer == other.Buffer && Format == other.Format && Offset == other.Offset;
+        }
+    };
+
+    struct DepthStencilBinding
+    {
+        ID3D11DepthStencilState* State;
+        UINT StencilRef;
+        bool operator==(const DepthStencilBinding& other) const
+        {
+            return State == other.State && StencilRef == other.StencilRef;
+        }
+    };
+
+    // One piece of state. The pending value is only valid while dirty, the bound one while valid.
+    template<typename T>
+    struct Slot
+    {
+        T Bound;
+        T Pending;
+        bool Valid = false;
+        bool Dirty = false;
+
+        bool Set(const T& value);
+        // True if the context has to be called
+        bool Resolve();
+    };
+
+    template<typename T, UINT N>
+    struct SlotArray
+    {
+        static_assert(N <= 32, "The masks have one bit per slot");
+
+        T Bound[N];
+        T Pending[N];
+        uint32_t ValidMask = 0;
+        uint32_t DirtyMask = 0;
+
+        bool Set(UINT slot, const T& value);
+        // Calls bind(first, count, values) once per run of changed slots, returns the number of calls.
+        template<typename BindFunc>
+        UINT Flush(BindFunc bind);
+    };
+
+    template<typename T>
+    void Request(Slot<T>& slot, const T& value);
+    template<typename T, UINT N>
+    void Request(SlotArray<T, N>& slots, UINT slot, const T& value);
+
+    ComPtr<ID3D11DeviceContext> mContext;
+
+    Slot<ID3D11InputLayout*> mInputLayout;
+    Slot<D3D11_PRIMITIVE_TOPOLOGY> mTopology;
+    SlotArray<VertexBufferBinding, kMaxVertexBuffers> mVertexBuffers;
+    Slot<IndexBufferBinding> mIndexBuffer;
+    Slot<ID3D11VertexShader*> mVertexShader;
+    Slot<ID3D11PixelShader*> mPixelShader;
+    SlotArray<ID3D11Buffer*, kMaxConstantBuffers> mVSConstantBuffers;
+    SlotArray<ID3D11Buffer*, kMaxConstantBuffers> mPSConstantBuffers;
+    SlotArray<ID3D11ShaderResourceView*, kMaxShaderResources> mPSShaderResources;
+    SlotArray<ID3D11SamplerState*, kMaxSamplers> mPSSamplers;
+    Slot<ID3D11RasterizerState*> mRasterizerState;
+    Slot<DepthStencilBinding> mDepthStencilState;
+    Slot<ID3D11BlendState*> mBlendState;
+
+    Stats mStats;
+};
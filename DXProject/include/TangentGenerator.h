@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Per-vertex tangent frames for normal mapping, computed along the lines of MikkTSpace:
+// per-corner tangents from the UV gradients, projected onto the vertex normal plane,
+// weighted by the corner angle and accumulated per vertex. The output is a float4
+// per vertex, xyz = tangent, w = bitangent sign, so that
+//     bitangent = w * cross(normal, tangent).
+// Like MikkTSpace, the corners of a vertex are grouped by the UV winding of their
+// triangle, and a vertex shared by mirrored and unmirrored triangles is split into one
+// vertex per group. Unlike MikkTSpace, vertices with equal attributes are not welded
+// first, vertices the importer kept apart stay apart.
+//
+// Standalone and portable, attribute arrays are read through byte strides so both
+// interleaved and split vertex streams can be passed in.
+namespace TangentGenerator
+{
+    struct Input
+    {
+        const float* Positions;
+        size_t PositionStride;
+        const float* Normals;
+        size_t NormalStride;
+        const float* TexCoords;
+        size_t TexCoordStride;
+        size_t VertexCount;
+
+        const uint32_t* Indices; // Triangle list
+        size_t IndexCount;
+    };
+
+    // A copy of an input vertex for the corners of its smaller UV winding group
+    struct SplitVertex
+    {
+        uint32_t Source; // Input vertex whose attributes the copy has
+        float Tangent[4];
+    };
+
+    // tangents must hold 4 * VertexCount floats. Split vertex k is vertex VertexCount + k,
+    // indices (IndexCount of them, usually the array of input.Indices) are rewritten to
+    // point the corners of the split groups at their copies.
+    // Work is split across threads when the mesh is large enough.
+    void Generate(const Input& input, float* tangents, uint32_t* indices, std::vector<SplitVertex>& splits);
+}
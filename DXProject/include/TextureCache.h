@@ -0,0 +1,80 @@
+#pragma once
+
+#include <RenderDefs.h>
+#include <d3d11.h>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct CachedTexture
+{
+    ComPtr<ID3D11Texture2D> Texture;
+    ComPtr<ID3D11ShaderResourceView> SRV;
+    uint64_t ContentHash;
+    uint64_t CheckHash; // Independently seeded hash of the pixels, compared on a ContentHash match
+    D3D11_TEXTURE2D_DESC Desc;
+    size_t SizeBytes;
+};
+
+// Reference-counted handle. The GPU resource is released when the last handle goes away.
+using TextureHandle = std::shared_ptr<const CachedTexture>;
+
+// Process-wide texture cache shared by all materials.
+// Textures are keyed by a hash of the decoded pixels and their format, so identical
+// images referenced through different files share one GPU resource. A second index
+// by file path lets repeated loads of an unchanged file skip decoding entirely.
+class TextureCache
+{
+public:
+    struct Stats
+    {
+        uint64_t Hits;          // Loads served by an existing resource
+        uint64_t Misses;        // Loads that created a new resource
+        uint64_t DecodesSkipped; // Hits found by path, without decoding the file
+        uint64_t BytesSaved;    // GPU memory not allocated thanks to hits
+        uint64_t UploadedBytes; // Pixel data of the textures created
+    };
+
+    static TextureCache& getInstance() {
+        static TextureCache instance;
+        return instance;
+    }
+
+    HRESULT LoadTGA(ComPtr<ID3D11Device> device, const std::wstring& file, TextureHandle& handle);
+
+    Stats GetStats() const;
+    void LogStats() const;
+
+private:
+    TextureCache();
+    ~TextureCache();
+
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    struct LoadResult
+    {
+        HRESULT Result;
+        TextureHandle Handle;
+    };
+
+    LoadResult DecodeAndCreate(ComPtr<ID3D11Device> device, const std::wstring& file);
+    // Content entry that holds the same image, null if none or on a hash collision
+    TextureHandle FindByContent(uint64_t contentHash, uint64_t checkHash);
+    static std::wstring MakePathKey(ID3D11Device* device, const std::wstring& file);
+
+    mutable std::mutex mMutex;
+    std::unordered_map<uint64_t, std::weak_ptr<const CachedTexture>> mByContent;
+    std::unordered_map<std::wstring, std::weak_ptr<const CachedTexture>> mByPath;
+    // Loads in progress, so concurrent requests for the same file wait for one decode.
+    std::unordered_map<std::wstring, std::shared_future<LoadResult>> mPending;
+
+    std::atomic<uint64_t> mHits;
+    std::atomic<uint64_t> mMisses;
+    std::atomic<uint64_t> mDecodesSkipped;
+    std::atomic<uint64_t> mBytesSaved;
+    std::atomic<uint64_t> mUploadedBytes;
+};
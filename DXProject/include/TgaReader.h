@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <MappedFile.h>
+
+// Standalone TGA decoder. The file is memory-mapped and decoded straight into
+// a caller-provided R8G8B8A8 surface, so there is no intermediate image copy.
+// Supports uncompressed and RLE true-color (15/16/24/32 bpp) and grayscale (8 bpp).
+class TGAReader
+{
+public:
+    TGAReader();
+    ~TGAReader();
+
+    bool Open(const std::filesystem::path& filename);
+    void Close();
+
+    uint32_t GetWidth() const { return mWidth; }
+    uint32_t GetHeight() const { return mHeight; }
+
+    // Decodes the whole image as R8G8B8A8. Rows are written rowPitch bytes apart,
+    // top row first, so dest can be a mapped texture as well as a plain array.
+    bool Decode(uint8_t* dest, size_t rowPitch) const;
+
+private:
+    bool ParseHeader();
+    bool DecodeUncompressed(uint8_t* dest, size_t rowPitch) const;
+    bool DecodeRLE(uint8_t* dest, size_t rowPitch) const;
+    uint8_t* DestRow(uint8_t* dest, size_t rowPitch, uint32_t fileRow) const;
+
+    MappedFile mFile;
+    const uint8_t* mpPixels;
+    const uint8_t* mpEnd;
+
+    uint32_t mWidth;
+    uint32_t mHeight;
+    uint32_t mBytesPerPixel;
+    bool mbRLE;
+    bool mbGrayscale;
+    bool mbTopDown;
+};
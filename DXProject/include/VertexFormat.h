@@ -0,0 +1,33 @@
+#pragma once
+
+#include <d3d11.h>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+// Description of a vertex layout, shared by every input layout created for it.
+// The hash covers semantics, formats, slots and offsets and is computed once.
+class VertexFormat
+{
+public:
+    VertexFormat(std::initializer_list<D3D11_INPUT_ELEMENT_DESC> elements);
+
+    const D3D11_INPUT_ELEMENT_DESC* GetElements() const { return mElements.data(); }
+    UINT GetElementCount() const { return static_cast<UINT>(mElements.size()); }
+    uint64_t GetHash() const { return mHash; }
+
+    // Formats for the vertex structures in RenderDefs.h
+    static const VertexFormat& Textured();
+    // VertexTextured in slot 0 plus the optional tangent stream (XMFLOAT4) in slot 1
+    static const VertexFormat& TexturedTangent();
+    // Split streams (VertexStreams.h): position in slot 0, normal in 1, UV in 2, tangent in 3
+    static const VertexFormat& SplitTangent();
+    // Position alone at offset 0 of slot 0, for depth-only passes. Matches both the
+    // interleaved VertexTextured buffer and the position stream, only the stride differs.
+    static const VertexFormat& Position();
+    static const VertexFormat& Cube();
+
+private:
+    std::vector<D3D11_INPUT_ELEMENT_DESC> mElements;
+    uint64_t mHash;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <RenderDefs.h>
+#include <cstddef>
+#include <vector>
+
+// Mesh vertices with one array per attribute instead of interleaved VertexTextured.
+// A pass that only needs positions then reads 12 bytes per vertex instead of 32, on
+// the GPU with the position stream bound alone and on the CPU with the positions
+// packed together (stride sizeof(XMFLOAT3)).
+struct VertexStreams
+{
+    std::vector<DirectX::XMFLOAT3> Positions;
+    std::vector<DirectX::XMFLOAT3> Normals;
+    std::vector<DirectX::XMFLOAT2> TexCoords;
+
+    static VertexStreams Split(const std::vector<VertexTextured>& vertices);
+
+    size_t GetVertexCount() const { return Positions.size(); }
+};
+
+// Positions with x, y and z in separate arrays so SSE code works on four vertices at
+// once. The arrays are padded to a multiple of four with copies of the last position,
+// which leaves bounds unchanged.
+class PositionsSoA
+{
+public:
+    PositionsSoA();
+
+    // Positions read through a byte stride, from interleaved vertices or a position stream
+    void Assign(const float* positions, size_t stride, size_t count);
+
+    size_t GetCount() const { return mCount; }
+    size_t GetPaddedCount() const { return mX.size(); }
+    const float* GetX() const { return mX.data(); }
+    const float* GetY() const { return mY.data(); }
+    const float* GetZ() const { return mZ.data(); }
+
+private:
+    std::vector<float> mX, mY, mZ;
+    size_t mCount;
+};
+
+// Position-only passes over a mesh, for each layout, to compare what the layout costs.
+// The strided versions take interleaved vertices or a position stream.
+namespace PositionPass
+{
+    void ComputeBounds(const float* positions, size_t stride, size_t count, DirectX::XMFLOAT3& min, DirectX::XMFLOAT3& max);
+    void ComputeBounds(const PositionsSoA& positions, DirectX::XMFLOAT3& min, DirectX::XMFLOAT3& max);
+
+    // Post-projection depth z / w per vertex, what a depth-only vertex shader computes.
+    // depths holds count floats, or GetPaddedCount floats for the SoA version.
+    void ProjectDepth(const float* positions, size_t stride, size_t count, const DirectX::XMFLOAT4X4& worldViewProj, float* depths);
+    void ProjectDepth(const PositionsSoA& positions, const DirectX::XMFLOAT4X4& worldViewProj, float* depths);
+}
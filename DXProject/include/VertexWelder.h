@@ -0,0 +1,77 @@
+#pragma once
+
+#include <RenderDefs.h>
+#include <Arena.h>
+#include <vector>
+
+// Merges mesh corners into unique vertices. Corners referencing the same control
+// point are welded when normal and UV match exactly. The copies of each control
+// point are kept in a flat CSR array sized from a counting pass, so welding does
+// no per-control-point allocations.
+//
+// Usage: Begin, CountCorner for every corner, Finalize, then Weld for every corner.
+class VertexWelder
+{
+public:
+    VertexWelder()
+        : mpArena(nullptr),
+        mCopyOffsets(nullptr),
+        mCopyCounts(nullptr),
+        mCopies(nullptr),
+        mControlPointCount(0)
+    {
+    }
+
+    void Begin(MonotonicArena& arena, int controlPointCount)
+    {
+        mpArena = &arena;
+        mControlPointCount = controlPointCount;
+        mCopyOffsets = arena.AllocateArray<int>(controlPointCount + 1, 0);
+    }
+
+    void CountCorner(int controlPoint)
+    {
+        mCopyOffsets[controlPoint + 1]++;
+    }
+
+    void Finalize()
+    {
+        // A control point can not have more distinct copies than corners referencing it.
+        for (int i = 0; i < mControlPointCount; i++)
+            mCopyOffsets[i + 1] += mCopyOffsets[i];
+
+        mCopies = mpArena->AllocateArray<UINT>(mCopyOffsets[mControlPointCount]);
+        mCopyCounts = mpArena->AllocateArray<int>(mControlPointCount, 0);
+    }
+
+    // Returns the index of the vertex in vertices, appending it if it is new.
+    UINT Weld(int controlPoint, const VertexTextured& vertex, std::vector<VertexTextured>& vertices)
+    {
+        UINT* pointCopies = mCopies + mCopyOffsets[controlPoint];
+        int& pointCopyCount = mCopyCounts[controlPoint];
+        for (int j = 0; j < pointCopyCount; j++)
+        {
+            const VertexTextured& usedVertex = vertices[pointCopies[j]];
+            if (usedVertex.Normal.x == vertex.Normal.x &&
+                usedVertex.Normal.y == vertex.Normal.y &&
+                usedVertex.Normal.z == vertex.Normal.z &&
+                usedVertex.Tex.x == vertex.Tex.x &&
+                usedVertex.Tex.y == vertex.Tex.y)
+            {
+                return pointCopies[j];
+            }
+        }
+
+        vertices.push_back(vertex);
+        UINT newIndex = static_cast<UINT>(vertices.size() - 1);
+        pointCopies[pointCopyCount++] = newIndex;
+        return newIndex;
+    }
+
+private:
+    MonotonicArena* mpArena;
+    int* mCopyOffsets;
+    int* mCopyCounts;
+    UINT* mCopies;
+    int mControlPointCount;
+};
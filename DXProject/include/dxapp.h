@@ -7,12 +7,27 @@
 
 #include "Utils.h"
 #include "Renderer.h"
+#include "CameraPath.h"
 
+// Command line options
+struct LaunchOptions
+{
+    // Frames of a benchmark run, 0 runs interactively
+    unsigned BenchmarkFrames = 0;
+    // Camera path replayed by the benchmark, the default orbit if empty
+    std::string CameraPathFile;
+    // Interactive runs save the camera motion here, to replay it as a benchmark
+    std::string RecordFile;
+    // Per-frame timings of the benchmark
+    std::string CsvFile;
+    // Only writes the FBX SDK import of the model, see Renderer::WriteImportReference
+    bool WriteImportReference = false;
+};
 
 class DXApp
 {
 public:
-    DXApp(HINSTANCE hInstance);
+    DXApp(HINSTANCE hInstance, const LaunchOptions& options);
     ~DXApp();
 
     HINSTANCE AppInst() const;
@@ -33,6 +48,8 @@ public:
 
 protected:
     bool InitMainWindow();
+    // Replays the camera path at a fixed timestep without input, then logs the timings and quits.
+    int RunBenchmark();
 
     HINSTANCE mhAppInst; // application instance handle
     HWND      mhMainWnd; // main window handle
@@ -46,6 +63,9 @@ protected:
     GameTimer mTimer;
     Renderer mRenderer;
 
+    LaunchOptions mOptions;
+    CameraPath mRecordedPath;
+
     std::wstring mMainWndCaption;
 };
 
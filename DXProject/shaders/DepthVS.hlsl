@@ -0,0 +1,15 @@
+cbuffer cbPerFrame : register(b0)
+{
+    float4x4 gWorldViewProj;
+    float4x4 gWorld;
+    float4x4 gWorldInvTranspose;
+    float4 gCamPos;
+};
+
+// Depth prepass: only the position stream is read. The position is computed exactly
+// like in VertexShader.hlsl, so the main pass can test depth with LESS_EQUAL.
+float4 main(float3 pos : POSITION) : SV_POSITION
+{
+    precise float4 posH = mul(float4(pos, 1.0f), gWorldViewProj);
+    return posH;
+}
@@ -20,12 +20,56 @@ cbuffer cbLightsBuffer : register(b1)
     DirLight gDirLight;
 };
 
+cbuffer cbMaterial : register(b2)
+{
+    float4 gMatAmbient;
+    float4 gMatDiffuse;
+    float4 gMatSpecular; // w = SpecPower
+    uint gHasColorMap;
+    uint gHasNormalMap;
+};
+
+// Point and spot lights binned into clusters of the view frustum on the CPU, see LightClusters
+struct LocalLight
+{
+    float3 Position;
+    float Range;
+    float3 Color;
+    float SpotCosOuter; // -2 for point lights
+    float3 Direction;
+    float SpotCosInner;
+};
+
+cbuffer cbClusters : register(b3)
+{
+    float2 gTileScale; // Tiles per pixel
+    float gSliceScale; // Slice = log(view depth) * gSliceScale + gSliceBias
+    float gSliceBias;
+    uint3 gClusterCounts;
+    uint gLocalLightCount;
+};
+
+StructuredBuffer<LocalLight> gLocalLights : register(t2);
+StructuredBuffer<uint2> gClusters : register(t3); // Offset and count in gClusterLightIndices
+StructuredBuffer<uint> gClusterLightIndices : register(t4);
+
+// Baked from the environment map on the CPU, see EnvironmentLighting
+cbuffer cbEnvironment : register(b4)
+{
+    float4 gAmbientSH[9]; // Irradiance / pi as L2 spherical harmonics
+    float gPrefilteredLevels;
+};
+
+// Mip m is prefiltered for roughness m / (gPrefilteredLevels - 1)
+TextureCube gEnvironmentMap : register(t5);
+
 struct VertexOut
 {
     float4 PosH : SV_POSITION;
     float4 PosW : POSITION;
     float3 NormalW : NORMAL;
     float2 TexUV : TEXCOORD;
+    float4 TangentW : TANGENT;
 };
 
 struct Material
@@ -44,6 +88,25 @@ SamplerState gSamplerAnisotropic
     MaxAnisotropy = 4;
 };
 
+float3 EvaluateAmbientSH(float3 n)
+{
+    float3 irradiance = 0.282095f * gAmbientSH[0].rgb
+        + 0.488603f * (n.y * gAmbientSH[1].rgb + n.z * gAmbientSH[2].rgb + n.x * gAmbientSH[3].rgb)
+        + 1.092548f * (n.x * n.y * gAmbientSH[4].rgb + n.y * n.z * gAmbientSH[5].rgb + n.x * n.z * gAmbientSH[7].rgb)
+        + 0.315392f * (3.0f * n.z * n.z - 1.0f) * gAmbientSH[6].rgb
+        + 0.546274f * (n.x * n.x - n.y * n.y) * gAmbientSH[8].rgb;
+    return max(irradiance, 0.0f);
+}
+
+// Reflection of the environment at the roughness matching the specular power
+float4 ComputeEnvironmentSpecular(Material mat, float3 normal, float3 toEye)
+{
+    float roughness = sqrt(2.0f / (mat.Specular.w + 2.0f));
+    float3 r = reflect(-toEye, normal);
+    float3 radiance = gEnvironmentMap.SampleLevel(gSamplerAnisotropic, r, roughness * (gPrefilteredLevels - 1.0f)).rgb;
+    return float4(radiance * mat.Specular.rgb, 0.0f);
+}
+
 void ComputeDirectionalLight(Material mat,
 float3 normal, float3 toEye,
 out float4 ambient,
@@ -56,8 +119,8 @@ out float4 spec)
     spec = float4(0.0f, 0.0f, 0.0f, 0.0f);
     // The light vector aims opposite the direction the light rays travel.
     float3 lightVec = -gDirLight.Direction;
-    // Add ambient term.
-    ambient = mat.Ambient * gDirLight.Ambient;
+    // Add ambient term, the irradiance of the environment.
+    ambient = mat.Ambient * float4(EvaluateAmbientSH(normal), 1.0f);
     // Add diffuse and specular term, provided the surface is in
     // the line of site of the light.
     float diffuseFactor = dot(lightVec, normal);
@@ -73,6 +136,47 @@ out float4 spec)
     }
 }
 
+// Adds to diffuse and spec
+void ComputeLocalLight(Material mat, LocalLight light,
+float3 pos, float3 normal, float3 toEye,
+inout float4 diffuse,
+inout float4 spec)
+{
+    float3 lightVec = light.Position - pos;
+    float distance = length(lightVec);
+    if (distance >= light.Range)
+        return;
+    lightVec /= distance;
+
+    float diffuseFactor = dot(lightVec, normal);
+    if (diffuseFactor <= 0.0f)
+        return;
+
+    // Inverse square falloff, windowed to reach zero at the range
+    float window = saturate(1.0f - pow(distance / light.Range, 4.0f));
+    float attenuation = window * window / (distance * distance + 1.0f);
+    if (light.SpotCosOuter > -1.0f)
+        attenuation *= smoothstep(light.SpotCosOuter, light.SpotCosInner, dot(-lightVec, light.Direction));
+
+    float3 v = reflect(-lightVec, normal);
+    float specFactor = pow(max(dot(v, toEye), 0.0f), mat.Specular.w);
+    float4 color = float4(attenuation * light.Color, 1.0f);
+    diffuse += diffuseFactor * mat.Diffuse * color;
+    spec += specFactor * mat.Specular * color;
+}
+
+float3 ApplyNormalMap(float3 normal, float4 tangent, float2 uv)
+{
+    // No tangent stream bound, keep the interpolated normal.
+    if (!gHasNormalMap || tangent.w == 0.0f)
+        return normal;
+
+    float3 t = normalize(tangent.xyz - dot(tangent.xyz, normal) * normal);
+    float3 b = (tangent.w < 0.0f ? -1.0f : 1.0f) * cross(normal, t);
+    float3 sampled = 2.0f * gNormalMap.Sample(gSamplerAnisotropic, uv).xyz - 1.0f;
+    return normalize(sampled.x * t + sampled.y * b + sampled.z * normal);
+}
+
 float4 main(VertexOut pin) : SV_Target
 {
     float4 ambient, diffuse, spec;
@@ -82,15 +186,33 @@ float4 main(VertexOut pin) : SV_Target
     toEye /= distToEye;
 
     Material mat;
-    mat.Ambient = float4(1.0f, 1.0f, 1.0f, 1.0f),
-    mat.Diffuse = float4(1.0f, 1.0f, 1.0f, 1.0f),
-    mat.Specular = float4(0.5f, 0.5f, 0.5f, 5.0f);
+    mat.Ambient = gMatAmbient;
+    mat.Diffuse = gMatDiffuse;
+    mat.Specular = gMatSpecular;
     
-    float4 texColor = gColorsMap.Sample(gSamplerAnisotropic, pin.TexUV);
+    float4 texColor = float4(1.0f, 1.0f, 1.0f, 1.0f);
+    if (gHasColorMap)
+        texColor = gColorsMap.Sample(gSamplerAnisotropic, pin.TexUV);
     
-    ComputeDirectionalLight(mat, normalize(pin.NormalW),
+    float3 normal = ApplyNormalMap(normalize(pin.NormalW), pin.TangentW, pin.TexUV);
+
+    ComputeDirectionalLight(mat, normal,
         toEye, ambient, diffuse, spec
     );
+    spec += ComputeEnvironmentSpecular(mat, normal, toEye);
+
+    // SV_POSITION.w is the view space depth
+    if (gLocalLightCount > 0)
+    {
+        uint2 tile = min(uint2(pin.PosH.xy * gTileScale), gClusterCounts.xy - 1);
+        uint slice = (uint) clamp(log(pin.PosH.w) * gSliceScale + gSliceBias, 0.0f, (float) (gClusterCounts.z - 1));
+        uint2 cluster = gClusters[(slice * gClusterCounts.y + tile.y) * gClusterCounts.x + tile.x];
+        for (uint i = 0; i < cluster.y; ++i)
+        {
+            LocalLight light = gLocalLights[gClusterLightIndices[cluster.x + i]];
+            ComputeLocalLight(mat, light, (float3) pin.PosW, normal, toEye, diffuse, spec);
+        }
+    }
 
     float4 litColor = texColor * (ambient + diffuse) + spec;
     litColor.a = 1.0f;
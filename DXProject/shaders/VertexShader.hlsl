@@ -11,6 +11,7 @@ struct VertexIn
     float3 Pos : POSITION;
     float3 Normal : NORMAL;
     float2 TexUV : TEXCOORD;
+    float4 Tangent : TANGENT; // w = bitangent sign, zero if the stream is not bound
 };
 
 struct VertexOut
@@ -19,6 +20,7 @@ struct VertexOut
     float4 PosW : POSITION;
     float3 NormalW : NORMAL;
     float2 TexUV : TEXCOORD;
+    float4 TangentW : TANGENT;
 };
 
 VertexOut main(VertexIn vin)
@@ -26,9 +28,12 @@ VertexOut main(VertexIn vin)
     VertexOut vout;
 
     //vout.PosH = float4(vin.Pos, 1.0f);
-    vout.PosH = mul(float4(vin.Pos, 1.0f), gWorldViewProj);
+    // Same as DepthVS.hlsl, the depth prepass relies on identical results
+    precise float4 posH = mul(float4(vin.Pos, 1.0f), gWorldViewProj);
+    vout.PosH = posH;
     vout.PosW = mul(float4(vin.Pos, 1.0f), gWorld);
     vout.NormalW = mul(vin.Normal, (float3x3) gWorldInvTranspose);
     vout.TexUV = vin.TexUV;
+    vout.TangentW = float4(mul(vin.Tangent.xyz, (float3x3) gWorld), vin.Tangent.w);
     return vout;
 }
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include <Arena.h>
+
+#include <algorithm>
+
+MonotonicArena::MonotonicArena(size_t blockSize)
+    : mBlockSize(blockSize),
+    mCurrentBlock(0),
+    mOffset(0),
+    mBytesAllocated(0),
+    mAllocationCount(0),
+    mPeakBytes(0),
+    mReservedBytes(0)
+{
+}
+
+MonotonicArena::~MonotonicArena()
+{
+    for (Block& block : mBlocks)
+        ::operator delete(block.Data);
+}
+
+bool MonotonicArena::AllocateFromBlock(size_t blockIndex, size_t size, size_t alignment, void*& result)
+{
+    const Block& block = mBlocks[blockIndex];
+    size_t offset = blockIndex == mCurrentBlock ? mOffset : 0;
+
+    uintptr_t address = reinterpret_cast<uintptr_t>(block.Data) + offset;
+    uintptr_t aligned = (address + alignment - 1) & ~(uintptr_t(alignment) - 1);
+    size_t end = (aligned - reinterpret_cast<uintptr_t>(block.Data)) + size;
+    if (end > block.Size)
+        return false;
+
+    mCurrentBlock = blockIndex;
+    mOffset = end;
+    result = reinterpret_cast<void*>(aligned);
+    return true;
+}
+
+void* MonotonicArena::Allocate(size_t size, size_t alignment)
+{
+    if (size == 0)
+        size = 1;
+
+    mBytesAllocated += size;
+    mAllocationCount++;
+    mPeakBytes = std::max(mPeakBytes, mBytesAllocated);
+
+    // Try the current block, then blocks kept from before the last reset.
+    void* result = nullptr;
+    for (size_t i = mCurrentBlock; i < mBlocks.size(); i++)
+    {
+        if (AllocateFromBlock(i, size, alignment, result))
+            return result;
+    }
+
+    // Oversized requests get a block of their own.
+    Block block;
+    block.Size = std::max(mBlockSize, size + alignment);
+    block.Data = static_cast<uint8_t*>(::operator new(block.Size));
+    mReservedBytes += block.Size;
+    mBlocks.push_back(block);
+
+    AllocateFromBlock(mBlocks.size() - 1, size, alignment, result);
+    return result;
+}
+
+void MonotonicArena::Reset()
+{
+    mCurrentBlock = 0;
+    mOffset = 0;
+    mBytesAllocated = 0;
+    mAllocationCount = 0;
+}
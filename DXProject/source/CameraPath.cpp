@@ -0,0 +1,129 @@
+#include <CameraPath.h>
+#include <LogWriter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+namespace
+{
+    const float kPi = 3.14159265f;
+
+    float CatmullRom(float p0, float p1, float p2, float p3, float t)
+    {
+        float t2 = t * t;
+        float t3 = t2 * t;
+        return 0.5f * (2.0f * p1 + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+    }
+}
+
+CameraPath::CameraPath()
+    : mStartTime(0.0f)
+{
+}
+
+CameraPath CameraPath::DefaultOrbit()
+{
+    // Phi and radius stay inside the limits of the mouse controls.
+    const int keyCount = 17;
+    const float duration = 10.0f;
+    CameraPath path;
+    for (int i = 0; i < keyCount; i++)
+    {
+        float s = static_cast<float>(i) / (keyCount - 1);
+        CameraOrbit orbit;
+        orbit.Theta = 2.0f * kPi * s;
+        orbit.Phi = 0.5f * kPi + 0.6f * sinf(4.0f * kPi * s);
+        orbit.Radius = 7.0f - 3.0f * cosf(2.0f * kPi * s);
+        path.AddKey(duration * s, orbit);
+    }
+    return path;
+}
+
+bool CameraPath::Load(const std::string& file)
+{
+    std::ifstream in(file);
+    if (!in)
+    {
+        LOG("Camera path ", file, ": cannot open");
+        return false;
+    }
+
+    mKeys.clear();
+    mStartTime = 0.0f;
+    Key key;
+    while (in >> key.Time >> key.Orbit.Theta >> key.Orbit.Phi >> key.Orbit.Radius)
+    {
+        if (!mKeys.empty() && key.Time < mKeys.back().Time)
+        {
+            LOG("Camera path ", file, ": key times must not decrease");
+            mKeys.clear();
+            return false;
+        }
+        mKeys.push_back(key);
+    }
+
+    if (!mKeys.empty())
+    {
+        mStartTime = mKeys.front().Time;
+        for (Key& k : mKeys)
+            k.Time -= mStartTime;
+    }
+
+    LOG("Camera path ", file, ": ", mKeys.size(), " keys, ", GetDuration(), " s");
+    return !mKeys.empty();
+}
+
+bool CameraPath::Save(const std::string& file) const
+{
+    std::ofstream out(file);
+    if (!out)
+        return false;
+
+    out.precision(7);
+    for (const Key& key : mKeys)
+        out << key.Time << ' ' << key.Orbit.Theta << ' ' << key.Orbit.Phi << ' ' << key.Orbit.Radius << '\n';
+    return static_cast<bool>(out);
+}
+
+void CameraPath::AddKey(float time, const CameraOrbit& orbit)
+{
+    if (mKeys.empty())
+        mStartTime = time;
+    mKeys.push_back(Key{ time - mStartTime, orbit });
+}
+
+CameraOrbit CameraPath::Sample(float time) const
+{
+    if (mKeys.empty())
+        return CameraOrbit{ 0.0f, 0.5f * kPi, 5.0f };
+    if (mKeys.size() == 1 || GetDuration() <= 0.0f)
+        return mKeys.front().Orbit;
+
+    time = fmodf(time, GetDuration());
+    if (time < 0.0f)
+        time += GetDuration();
+    if (time <= mKeys.front().Time)
+        return mKeys.front().Orbit;
+
+    // Segment [i, i + 1] contains the time, its neighbours are clamped at the ends.
+    auto next = std::upper_bound(mKeys.begin(), mKeys.end(), time, [](float t, const Key& key) { return t < key.Time; });
+    size_t i2 = (std::min)(static_cast<size_t>(next - mKeys.begin()), mKeys.size() - 1);
+    i2 = (std::max)(i2, size_t(1));
+    size_t i1 = i2 - 1;
+    size_t i0 = i1 > 0 ? i1 - 1 : i1;
+    size_t i3 = (std::min)(i2 + 1, mKeys.size() - 1);
+
+    float length = mKeys[i2].Time - mKeys[i1].Time;
+    float t = length > 0.0f ? (time - mKeys[i1].Time) / length : 0.0f;
+
+    const CameraOrbit& o0 = mKeys[i0].Orbit;
+    const CameraOrbit& o1 = mKeys[i1].Orbit;
+    const CameraOrbit& o2 = mKeys[i2].Orbit;
+    const CameraOrbit& o3 = mKeys[i3].Orbit;
+    CameraOrbit orbit;
+    orbit.Theta = CatmullRom(o0.Theta, o1.Theta, o2.Theta, o3.Theta, t);
+    orbit.Phi = CatmullRom(o0.Phi, o1.Phi, o2.Phi, o3.Phi, t);
+    orbit.Radius = CatmullRom(o0.Radius, o1.Radius, o2.Radius, o3.Radius, t);
+    return orbit;
+}
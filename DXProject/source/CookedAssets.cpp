@@ -0,0 +1,395 @@
+#include <CookedAssets.h>
+#include <MappedFile.h>
+#include <MeshCodec.h>
+
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+    struct MeshHeader
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t VertexCount;
+        uint32_t TangentCount;
+        uint32_t IndexCount;
+        uint32_t SubMeshCount;
+        uint32_t MaterialCount;
+        uint32_t Flags;
+    };
+
+    struct TextureHeader
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t Width;
+        uint32_t Height;
+    };
+
+    class Writer
+    {
+    public:
+        void Bytes(const void* data, size_t size)
+        {
+            const uint8_t* p = static_cast<const uint8_t*>(data);
+            mBuffer.insert(mBuffer.end(), p, p + size);
+        }
+
+        template<typename T>
+        void Value(const T& value) { Bytes(&value, sizeof(T)); }
+
+        template<typename T>
+        void Array(const std::vector<T>& values) { Bytes(values.data(), sizeof(T) * values.size()); }
+
+        // Size prefixed, so the reader can find the end without decoding
+        void Block(const std::vector<uint8_t>& block)
+        {
+            Value(static_cast<uint32_t>(block.size()));
+            Array(block);
+        }
+
+        void String(const std::string& value)
+        {
+            Value(static_cast<uint32_t>(value.size()));
+            Bytes(value.data(), value.size());
+        }
+
+        // Writes to a temporary file first, so readers never see a partial file.
+        bool Save(const std::filesystem::path& file) const
+        {
+            std::filesystem::path temp = file;
+            temp += ".tmp";
+
+            FILE* f = nullptr;
+#ifdef _WIN32
+            _wfopen_s(&f, temp.c_str(), L"wb");
+#else
+            f = fopen(temp.c_str(), "wb");
+#endif
+            if (!f)
+                return false;
+
+            bool ok = fwrite(mBuffer.data(), 1, mBuffer.size(), f) == mBuffer.size();
+            ok = (fclose(f) == 0) && ok;
+
+            std::error_code ec;
+            if (ok)
+                std::filesystem::rename(temp, file, ec);
+            if (!ok || ec)
+            {
+                std::filesystem::remove(temp, ec);
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        std::vector<uint8_t> mBuffer;
+    };
+
+    class Reader
+    {
+    public:
+        Reader(const uint8_t* data, size_t size)
+            : mpNext(data),
+            mpEnd(data + size),
+            mbFailed(false)
+        {
+        }
+
+        bool Bytes(void* dest, size_t size)
+        {
+            if (mbFailed || size > static_cast<size_t>(mpEnd - mpNext))
+            {
+                mbFailed = true;
+                return false;
+            }
+            memcpy(dest, mpNext, size);
+            mpNext += size;
+            return true;
+        }
+
+        template<typename T>
+        bool Value(T& value) { return Bytes(&value, sizeof(T)); }
+
+        template<typename T>
+        bool Array(std::vector<T>& values, uint32_t count)
+        {
+            if (mbFailed || count > static_cast<size_t>(mpEnd - mpNext) / sizeof(T))
+            {
+                mbFailed = true;
+                return false;
+            }
+            values.resize(count);
+            return Bytes(values.data(), sizeof(T) * count);
+        }
+
+        bool Block(const uint8_t*& data, uint32_t& size)
+        {
+            if (!Value(size) || size > static_cast<size_t>(mpEnd - mpNext))
+            {
+                mbFailed = true;
+                return false;
+            }
+            data = mpNext;
+            mpNext += size;
+            return true;
+        }
+
+        bool String(std::string& value)
+        {
+            uint32_t size = 0;
+            if (!Value(size) || size > static_cast<size_t>(mpEnd - mpNext))
+            {
+                mbFailed = true;
+                return false;
+            }
+            value.assign(reinterpret_cast<const char*>(mpNext), size);
+            mpNext += size;
+            return true;
+        }
+
+        void Fail() { mbFailed = true; }
+        bool Failed() const { return mbFailed; }
+        bool AtEnd() const { return mpNext == mpEnd; }
+
+    private:
+        const uint8_t* mpNext;
+        const uint8_t* mpEnd;
+        bool mbFailed;
+    };
+
+    // The UTF-8 conversions throw on text that does not convert (unpaired surrogates
+    // on the way in, invalid UTF-8 from a damaged file on the way out), which fails
+    // the file instead.
+    bool ToStoredPath(const std::wstring& path, const std::filesystem::path& baseDir, std::string& stored)
+    {
+        stored.clear();
+        if (path.empty())
+            return true;
+
+        try
+        {
+            std::error_code ec;
+            std::filesystem::path relative = std::filesystem::relative(path, baseDir, ec);
+            stored = ((ec || relative.empty()) ? std::filesystem::path(path) : relative).generic_u8string();
+            return true;
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+
+    bool FromStoredPath(const std::string& path, const std::filesystem::path& baseDir, std::wstring& resolved)
+    {
+        resolved.clear();
+        if (path.empty())
+            return true;
+
+        try
+        {
+            resolved = (baseDir / std::filesystem::u8path(path)).lexically_normal().wstring();
+            return true;
+        }
+        catch (const std::exception&)
+        {
+            return false;
+        }
+    }
+}
+
+std::filesystem::path CookedAssets::MeshPath(const std::filesystem::path& source)
+{
+    std::filesystem::path path = source;
+    path += ".mesh";
+    return path;
+}
+
+std::filesystem::path CookedAssets::TexturePath(const std::filesystem::path& source)
+{
+    std::filesystem::path path = source;
+    path += ".tex";
+    return path;
+}
+
+std::filesystem::path CookedAssets::ReferenceMeshPath(const std::filesystem::path& source)
+{
+    std::filesystem::path path = source;
+    path += ".ref";
+    return path;
+}
+
+bool CookedAssets::IsUpToDate(const std::filesystem::path& cooked, const std::filesystem::path& source)
+{
+    std::error_code ec;
+    auto cookedTime = std::filesystem::last_write_time(cooked, ec);
+    if (ec)
+        return false;
+
+    auto sourceTime = std::filesystem::last_write_time(source, ec);
+    return !ec && cookedTime >= sourceTime;
+}
+
+bool CookedAssets::WriteMesh(const std::filesystem::path& file, const Mesh& mesh, bool compress)
+{
+    MeshHeader header;
+    header.Magic = kMeshMagic;
+    header.Version = kFormatVersion;
+    header.VertexCount = static_cast<uint32_t>(mesh.Vertices.size());
+    header.TangentCount = static_cast<uint32_t>(mesh.Tangents.size());
+    header.IndexCount = static_cast<uint32_t>(mesh.Indices.size());
+    header.SubMeshCount = static_cast<uint32_t>(mesh.SubMeshes.size());
+    header.MaterialCount = static_cast<uint32_t>(mesh.Materials.size());
+    header.Flags = compress ? kMeshCompressed : 0;
+
+    std::filesystem::path baseDir = file.parent_path();
+
+    Writer writer;
+    writer.Value(header);
+    if (compress)
+    {
+        std::vector<uint8_t> block;
+        MeshCodec::EncodeVertices(mesh.Vertices.data(), mesh.Vertices.size(), sizeof(VertexTextured), block);
+        writer.Block(block);
+        block.clear();
+        MeshCodec::EncodeVertices(mesh.Tangents.data(), mesh.Tangents.size(), sizeof(DirectX::XMFLOAT4), block);
+        writer.Block(block);
+        block.clear();
+        MeshCodec::EncodeIndices(mesh.Indices.data(), mesh.Indices.size(), block);
+        writer.Block(block);
+    }
+    else
+    {
+        writer.Array(mesh.Vertices);
+        writer.Array(mesh.Tangents);
+        writer.Array(mesh.Indices);
+    }
+    writer.Array(mesh.SubMeshes);
+    std::string colorMap, normalMap;
+    for (const MaterialDesc& material : mesh.Materials)
+    {
+        if (!ToStoredPath(material.ColorMapFile, baseDir, colorMap) || !ToStoredPath(material.NormalMapFile, baseDir, normalMap))
+            return false;
+        writer.String(material.Name);
+        writer.String(colorMap);
+        writer.String(normalMap);
+        writer.Value(material.Ambient);
+        writer.Value(material.Diffuse);
+        writer.Value(material.Specular);
+    }
+
+    return writer.Save(file);
+}
+
+bool CookedAssets::ReadMesh(const std::filesystem::path& file, Mesh& mesh)
+{
+    MappedFile mapped;
+    if (!mapped.Open(file))
+        return false;
+
+    Reader reader(mapped.Data(), mapped.Size());
+    MeshHeader header;
+    if (!reader.Value(header) || header.Magic != kMeshMagic || header.Version != kFormatVersion)
+        return false;
+
+    if (header.TangentCount != 0 && header.TangentCount != header.VertexCount)
+        return false;
+
+    if (header.Flags & kMeshCompressed)
+    {
+        const uint8_t* blocks[3] = {};
+        uint32_t blockSizes[3] = {};
+        for (int i = 0; i < 3; i++)
+            reader.Block(blocks[i], blockSizes[i]);
+        // The header counts are not bounded by the file size here, so damaged counts are
+        // caught before allocating. Real meshes compress far less than 1024x.
+        const uint64_t limit = uint64_t(mapped.Size()) * 1024;
+        if (reader.Failed() || uint64_t(header.VertexCount) * sizeof(VertexTextured) > limit || uint64_t(header.IndexCount) * 4 > limit)
+            return false;
+
+        mesh.Vertices.resize(header.VertexCount);
+        mesh.Tangents.resize(header.TangentCount);
+        mesh.Indices.resize(header.IndexCount);
+        if (!MeshCodec::DecodeVertices(blocks[0], blockSizes[0], mesh.Vertices.data(), mesh.Vertices.size(), sizeof(VertexTextured)) ||
+            !MeshCodec::DecodeVertices(blocks[1], blockSizes[1], mesh.Tangents.data(), mesh.Tangents.size(), sizeof(DirectX::XMFLOAT4)) ||
+            !MeshCodec::DecodeIndices(blocks[2], blockSizes[2], mesh.Indices.data(), mesh.Indices.size(), mesh.Vertices.size()))
+            reader.Fail();
+    }
+    else
+    {
+        reader.Array(mesh.Vertices, header.VertexCount);
+        reader.Array(mesh.Tangents, header.TangentCount);
+        reader.Array(mesh.Indices, header.IndexCount);
+    }
+    reader.Array(mesh.SubMeshes, header.SubMeshCount);
+
+    std::filesystem::path baseDir = file.parent_path();
+    mesh.Materials.clear();
+    for (uint32_t i = 0; i < header.MaterialCount && !reader.Failed(); i++)
+    {
+        MaterialDesc material;
+        std::string colorMap, normalMap;
+        reader.String(material.Name);
+        reader.String(colorMap);
+        reader.String(normalMap);
+        reader.Value(material.Ambient);
+        reader.Value(material.Diffuse);
+        reader.Value(material.Specular);
+        if (!FromStoredPath(colorMap, baseDir, material.ColorMapFile) || !FromStoredPath(normalMap, baseDir, material.NormalMapFile))
+            reader.Fail();
+        mesh.Materials.push_back(material);
+    }
+
+    if (reader.Failed() || !reader.AtEnd())
+        return false;
+
+    // Reject files whose ranges would read outside the buffers.
+    for (const SubMesh& subMesh : mesh.SubMeshes)
+    {
+        if (uint64_t(subMesh.StartIndex) + subMesh.IndexCount > mesh.Indices.size() || subMesh.MaterialIndex >= mesh.Materials.size())
+            return false;
+    }
+    for (UINT index : mesh.Indices)
+    {
+        if (index >= mesh.Vertices.size())
+            return false;
+    }
+
+    return true;
+}
+
+bool CookedAssets::WriteTexture(const std::filesystem::path& file, const Texture& texture)
+{
+    TextureHeader header;
+    header.Magic = kTextureMagic;
+    header.Version = kFormatVersion;
+    header.Width = texture.Width;
+    header.Height = texture.Height;
+
+    Writer writer;
+    writer.Value(header);
+    writer.Array(texture.Pixels);
+    return writer.Save(file);
+}
+
+bool CookedAssets::ReadTexture(const std::filesystem::path& file, Texture& texture)
+{
+    MappedFile mapped;
+    if (!mapped.Open(file))
+        return false;
+
+    Reader reader(mapped.Data(), mapped.Size());
+    TextureHeader header;
+    if (!reader.Value(header) || header.Magic != kTextureMagic || header.Version != kFormatVersion)
+        return false;
+
+    uint64_t size = uint64_t(header.Width) * header.Height * 4;
+    if (size == 0 || size != mapped.Size() - sizeof(TextureHeader))
+        return false;
+
+    texture.Width = header.Width;
+    texture.Height = header.Height;
+    return reader.Array(texture.Pixels, static_cast<uint32_t>(size));
+}
@@ -0,0 +1,608 @@
+#include <EnvironmentLighting.h>
+#include <JobSystem.h>
+#include <TgaReader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <emmintrin.h>
+
+using namespace DirectX;
+
+namespace
+{
+    const float kPi = 3.14159265358979f;
+    const uint32_t kMinBaseSize = 4;
+    // GGX samples per prefiltered texel. Every sample reads the source mip matching its
+    // solid angle (filtered importance sampling), so few are needed without noise.
+    const uint32_t kPrefilterSamples = 64;
+
+    double MsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Not normalized, (u, v) in [-1, 1] with v down the face
+    void FaceDirection(uint32_t face, float u, float v, float& x, float& y, float& z)
+    {
+        switch (face)
+        {
+        case 0:  x = 1.0f;  y = -v;    z = -u;    break;
+        case 1:  x = -1.0f; y = -v;    z = u;     break;
+        case 2:  x = u;     y = 1.0f;  z = v;     break;
+        case 3:  x = u;     y = -1.0f; z = -v;    break;
+        case 4:  x = u;     y = -v;    z = 1.0f;  break;
+        default: x = -u;    y = -v;    z = -1.0f; break;
+        }
+    }
+
+    void FaceDirections(uint32_t face, __m128 u, __m128 v, __m128& x, __m128& y, __m128& z)
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 minusOne = _mm_set1_ps(-1.0f);
+        const __m128 signBit = _mm_set1_ps(-0.0f);
+        const __m128 nu = _mm_xor_ps(u, signBit);
+        const __m128 nv = _mm_xor_ps(v, signBit);
+        switch (face)
+        {
+        case 0:  x = one;      y = nv;       z = nu;       break;
+        case 1:  x = minusOne; y = nv;       z = u;        break;
+        case 2:  x = u;        y = one;      z = v;        break;
+        case 3:  x = u;        y = minusOne; z = nv;       break;
+        case 4:  x = u;        y = nv;       z = one;      break;
+        default: x = nu;       y = nv;       z = minusOne; break;
+        }
+    }
+
+    // Texel center on [-1, 1]
+    float TexelCoord(uint32_t i, uint32_t size)
+    {
+        return (2.0f * i + 1.0f) / size - 1.0f;
+    }
+
+    __m128 Select(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    // Bilinear lookups within the face, clamped at its edges, of four directions: the face
+    // and the texel footprints in SSE, then four texel loads per lane. Adds the samples
+    // times weight to sums.
+    void SampleCube(const EnvironmentLighting::CubeLevel& level, __m128 x, __m128 y, __m128 z, __m128 weight, __m128 sums[4])
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 signBit = _mm_set1_ps(-0.0f);
+        const float size = float(level.Size);
+        const __m128 sizeV = _mm_set1_ps(size);
+        const __m128 maxCoord = _mm_set1_ps(size - 1.0f);
+
+        // The major axis picks the face, as in FaceDirection
+        const __m128 ax = _mm_andnot_ps(signBit, x);
+        const __m128 ay = _mm_andnot_ps(signBit, y);
+        const __m128 az = _mm_andnot_ps(signBit, z);
+        const __m128 xMajor = _mm_and_ps(_mm_cmpge_ps(ax, ay), _mm_cmpge_ps(ax, az));
+        const __m128 yMajor = _mm_andnot_ps(xMajor, _mm_cmpge_ps(ay, az));
+        const __m128 major = Select(xMajor, ax, Select(yMajor, ay, az));
+        const __m128 u = Select(xMajor, _mm_xor_ps(_mm_xor_ps(z, signBit), _mm_and_ps(x, signBit)),
+            Select(yMajor, x, _mm_xor_ps(x, _mm_and_ps(z, signBit))));
+        const __m128 v = Select(yMajor, _mm_xor_ps(z, _mm_and_ps(y, signBit)), _mm_xor_ps(y, signBit));
+        const __m128 negative = _mm_cmplt_ps(Select(xMajor, x, Select(yMajor, y, z)), zero);
+        const __m128 face = _mm_add_ps(Select(xMajor, zero, Select(yMajor, _mm_set1_ps(2.0f), _mm_set1_ps(4.0f))), _mm_and_ps(negative, one));
+
+        // Texel coordinates, (u / major * 0.5 + 0.5) * size - 0.5
+        const __m128 scale = _mm_div_ps(_mm_set1_ps(0.5f * size), major);
+        const __m128 bias = _mm_set1_ps(0.5f * size - 0.5f);
+        const __m128 fx = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(u, scale), bias), zero), maxCoord);
+        const __m128 fy = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(v, scale), bias), zero), maxCoord);
+        const __m128 x0 = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+        const __m128 y0 = _mm_cvtepi32_ps(_mm_cvttps_epi32(fy));
+        const __m128 wx = _mm_sub_ps(fx, x0);
+        const __m128 wy = _mm_sub_ps(fy, y0);
+
+        // Texel indices are exact in floats
+        alignas(16) int32_t index[4], stepX[4], stepY[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(index),
+            _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(face, sizeV), y0), sizeV), x0)));
+        _mm_store_si128(reinterpret_cast<__m128i*>(stepX), _mm_cvtps_epi32(_mm_and_ps(_mm_cmplt_ps(x0, maxCoord), one)));
+        _mm_store_si128(reinterpret_cast<__m128i*>(stepY), _mm_cvtps_epi32(_mm_and_ps(_mm_cmplt_ps(y0, maxCoord), sizeV)));
+
+        alignas(16) float w00[4], w01[4], w10[4], w11[4];
+        const __m128 bottom = _mm_mul_ps(wy, weight);
+        const __m128 top = _mm_sub_ps(weight, bottom);
+        _mm_store_ps(w00, _mm_sub_ps(top, _mm_mul_ps(top, wx)));
+        _mm_store_ps(w01, _mm_mul_ps(top, wx));
+        _mm_store_ps(w10, _mm_sub_ps(bottom, _mm_mul_ps(bottom, wx)));
+        _mm_store_ps(w11, _mm_mul_ps(bottom, wx));
+
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            const XMFLOAT4* t = level.Texels.data() + index[lane];
+            const __m128 sum = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&t[0].x), _mm_set1_ps(w00[lane])), _mm_mul_ps(_mm_loadu_ps(&t[stepX[lane]].x), _mm_set1_ps(w01[lane]))),
+                _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&t[stepY[lane]].x), _mm_set1_ps(w10[lane])),
+                    _mm_mul_ps(_mm_loadu_ps(&t[stepX[lane] + stepY[lane]].x), _mm_set1_ps(w11[lane]))));
+            sums[lane] = _mm_add_ps(sums[lane], sum);
+        }
+    }
+
+    // Solid angle of the face rectangle from the center to (x, y), for the texel solid
+    // angles (Driscoll, "Cubemap texel solid angle")
+    float AreaElement(float x, float y)
+    {
+        return std::atan2(x * y, std::sqrt(x * x + y * y + 1.0f));
+    }
+
+    float SrgbToLinear(float c)
+    {
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float SmoothStep(float edge0, float edge1, float x)
+    {
+        const float t = (std::min)((std::max)((x - edge0) / (edge1 - edge0), 0.0f), 1.0f);
+        return t * t * (3.0f - 2.0f * t);
+    }
+
+    uint32_t RadicalInverse(uint32_t bits)
+    {
+        bits = (bits << 16) | (bits >> 16);
+        bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+        bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+        bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+        bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+        return bits;
+    }
+
+    // Light direction in the tangent frame of the normal, with its weight and the source
+    // mip to read. The same for every texel of a level.
+    struct PrefilterSample
+    {
+        float X, Y, Z;
+        float Weight;
+        uint32_t SourceLevel;
+    };
+
+    std::vector<PrefilterSample> BuildPrefilterSamples(float roughness, uint32_t baseSize, uint32_t sourceLevels)
+    {
+        const float alpha = roughness * roughness;
+        const float alphaSq = alpha * alpha;
+        const float texelSolidAngle = 4.0f * kPi / (6.0f * baseSize * baseSize);
+
+        std::vector<PrefilterSample> samples;
+        samples.reserve(kPrefilterSamples);
+        float totalWeight = 0.0f;
+        for (uint32_t i = 0; i < kPrefilterSamples; ++i)
+        {
+            // Hammersley point to a half vector of the GGX distribution
+            const float e1 = (i + 0.5f) / kPrefilterSamples;
+            const float e2 = RadicalInverse(i) * 2.3283064365386963e-10f;
+            const float phi = 2.0f * kPi * e1;
+            const float cosTheta = std::sqrt((1.0f - e2) / (1.0f + (alphaSq - 1.0f) * e2));
+            const float sinTheta = std::sqrt((std::max)(1.0f - cosTheta * cosTheta, 0.0f));
+
+            // Reflected around the half vector, with N = V = (0, 0, 1)
+            PrefilterSample sample;
+            sample.X = 2.0f * cosTheta * sinTheta * std::cos(phi);
+            sample.Y = 2.0f * cosTheta * sinTheta * std::sin(phi);
+            sample.Z = 2.0f * cosTheta * cosTheta - 1.0f;
+            if (sample.Z <= 0.0f)
+                continue;
+
+            // pdf of the light direction is D(h) / 4 when N = V; the mip whose texels cover
+            // about the solid angle of one sample
+            const float d = cosTheta * cosTheta * (alphaSq - 1.0f) + 1.0f;
+            const float pdf = alphaSq / (4.0f * kPi * d * d);
+            const float sampleSolidAngle = 1.0f / (kPrefilterSamples * pdf + 1e-6f);
+            const float lod = (std::max)(0.5f * std::log2(sampleSolidAngle / texelSolidAngle) + 1.0f, 0.0f);
+            sample.SourceLevel = (std::min)(uint32_t(lod + 0.5f), sourceLevels - 1);
+            sample.Weight = sample.Z;
+            totalWeight += sample.Weight;
+            samples.push_back(sample);
+        }
+
+        for (PrefilterSample& sample : samples)
+            sample.Weight /= totalWeight;
+        return samples;
+    }
+}
+
+EnvironmentLighting::EnvironmentLighting()
+    : mSh()
+    , mStats()
+{
+}
+
+void EnvironmentLighting::SetBaseSize(uint32_t baseSize)
+{
+    uint32_t size = kMinBaseSize;
+    while (size < baseSize)
+        size *= 2;
+
+    mSource.clear();
+    for (uint32_t levelSize = size; levelSize >= 1; levelSize /= 2)
+        mSource.push_back(CubeLevel{ levelSize, std::vector<XMFLOAT4>(6 * size_t(levelSize) * levelSize) });
+    mPrefiltered.clear();
+    mStats.BaseSize = size;
+}
+
+void EnvironmentLighting::SetEquirect(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t baseSize)
+{
+    auto start = std::chrono::steady_clock::now();
+    SetBaseSize(baseSize);
+
+    float toLinear[256];
+    for (int i = 0; i < 256; ++i)
+        toLinear[i] = SrgbToLinear(i / 255.0f);
+
+    CubeLevel& base = mSource[0];
+    const uint32_t size = base.Size;
+    JobSystem::Get().ParallelFor(6 * size_t(size), 4, [&](size_t begin, size_t end)
+    {
+        for (size_t item = begin; item < end; ++item)
+        {
+            const uint32_t face = uint32_t(item / size);
+            const uint32_t row = uint32_t(item % size);
+            XMFLOAT4* texel = base.Texels.data() + item * size;
+            for (uint32_t i = 0; i < size; ++i, ++texel)
+            {
+                float x, y, z;
+                FaceDirection(face, TexelCoord(i, size), TexelCoord(row, size), x, y, z);
+                const float invLength = 1.0f / std::sqrt(x * x + y * y + z * z);
+
+                // Longitude from +z around +y, latitude from the top row
+                const float u = 0.5f + std::atan2(x, z) / (2.0f * kPi);
+                const float v = std::acos((std::min)((std::max)(y * invLength, -1.0f), 1.0f)) / kPi;
+                const float fx = u * width - 0.5f;
+                const float fy = (std::min)((std::max)(v * height - 0.5f, 0.0f), float(height - 1));
+                const float floorX = std::floor(fx);
+                const uint32_t x0 = uint32_t(int(floorX) + int(width)) % width;
+                const uint32_t x1 = (x0 + 1) % width;
+                const uint32_t y0 = uint32_t(fy);
+                const uint32_t y1 = (std::min)(y0 + 1, height - 1);
+                const float wx = fx - floorX;
+                const float wy = fy - y0;
+
+                float color[3];
+                for (int c = 0; c < 3; ++c)
+                {
+                    const float t00 = toLinear[rgba[(size_t(y0) * width + x0) * 4 + c]];
+                    const float t01 = toLinear[rgba[(size_t(y0) * width + x1) * 4 + c]];
+                    const float t10 = toLinear[rgba[(size_t(y1) * width + x0) * 4 + c]];
+                    const float t11 = toLinear[rgba[(size_t(y1) * width + x1) * 4 + c]];
+                    const float top = t00 + (t01 - t00) * wx;
+                    const float bottom = t10 + (t11 - t10) * wx;
+                    color[c] = top + (bottom - top) * wy;
+                }
+                *texel = XMFLOAT4(color[0], color[1], color[2], 1.0f);
+            }
+        }
+    });
+
+    BuildSourceMips();
+    mStats.SourceMs = MsSince(start);
+}
+
+bool EnvironmentLighting::LoadEquirect(const std::filesystem::path& file, uint32_t baseSize)
+{
+    TGAReader reader;
+    if (!reader.Open(file))
+        return false;
+
+    const uint32_t width = reader.GetWidth();
+    const uint32_t height = reader.GetHeight();
+    std::vector<uint8_t> rgba(size_t(width) * height * 4);
+    if (width == 0 || height == 0 || !reader.Decode(rgba.data(), size_t(width) * 4))
+        return false;
+
+    SetEquirect(rgba.data(), width, height, baseSize);
+    return true;
+}
+
+void EnvironmentLighting::SetProceduralSky(uint32_t baseSize, const XMFLOAT3& lightDirection)
+{
+    auto start = std::chrono::steady_clock::now();
+    SetBaseSize(baseSize);
+
+    // Towards the sun
+    const float lightLength = std::sqrt(lightDirection.x * lightDirection.x + lightDirection.y * lightDirection.y + lightDirection.z * lightDirection.z);
+    const float sunX = -lightDirection.x / lightLength;
+    const float sunY = -lightDirection.y / lightLength;
+    const float sunZ = -lightDirection.z / lightLength;
+
+    const float zenith[3] = { 0.18f, 0.35f, 0.75f };
+    const float horizon[3] = { 0.65f, 0.72f, 0.8f };
+    const float ground[3] = { 0.12f, 0.1f, 0.09f };
+    const float sun[3] = { 1.0f, 0.9f, 0.75f };
+
+    CubeLevel& base = mSource[0];
+    const uint32_t size = base.Size;
+    JobSystem::Get().ParallelFor(6 * size_t(size), 4, [&](size_t begin, size_t end)
+    {
+        for (size_t item = begin; item < end; ++item)
+        {
+            const uint32_t face = uint32_t(item / size);
+            const uint32_t row = uint32_t(item % size);
+            XMFLOAT4* texel = base.Texels.data() + item * size;
+            for (uint32_t i = 0; i < size; ++i, ++texel)
+            {
+                float x, y, z;
+                FaceDirection(face, TexelCoord(i, size), TexelCoord(row, size), x, y, z);
+                const float invLength = 1.0f / std::sqrt(x * x + y * y + z * z);
+                x *= invLength;
+                y *= invLength;
+                z *= invLength;
+
+                const float skyBlend = std::sqrt((std::max)(y, 0.0f));
+                const float groundBlend = SmoothStep(0.0f, 0.15f, -y);
+                const float cosSun = (std::max)(x * sunX + y * sunY + z * sunZ, 0.0f);
+                const float cosSun2 = cosSun * cosSun;
+                const float cosSun16 = cosSun2 * cosSun2 * cosSun2 * cosSun2 * cosSun2 * cosSun2 * cosSun2 * cosSun2;
+                const float sunDisk = SmoothStep(0.9995f, 0.9998f, cosSun);
+                const float sunAmount = 0.4f * cosSun16 + 20.0f * sunDisk;
+
+                float color[3];
+                for (int c = 0; c < 3; ++c)
+                {
+                    const float sky = horizon[c] + (zenith[c] - horizon[c]) * skyBlend;
+                    color[c] = sky + (ground[c] - sky) * groundBlend + sun[c] * sunAmount * (1.0f - groundBlend);
+                }
+                *texel = XMFLOAT4(color[0], color[1], color[2], 1.0f);
+            }
+        }
+    });
+
+    BuildSourceMips();
+    mStats.SourceMs = MsSince(start);
+}
+
+void EnvironmentLighting::BuildSourceMips()
+{
+    for (size_t level = 1; level < mSource.size(); ++level)
+    {
+        const CubeLevel& src = mSource[level - 1];
+        CubeLevel& dst = mSource[level];
+        const uint32_t size = dst.Size;
+        JobSystem::Get().ParallelFor(6 * size_t(size), 8, [&](size_t begin, size_t end)
+        {
+            const __m128 quarter = _mm_set1_ps(0.25f);
+            for (size_t item = begin; item < end; ++item)
+            {
+                const size_t face = item / size;
+                const size_t row = item % size;
+                const XMFLOAT4* srcRow = src.Texels.data() + (face * src.Size + 2 * row) * src.Size;
+                XMFLOAT4* dstTexel = dst.Texels.data() + item * size;
+                for (uint32_t i = 0; i < size; ++i)
+                {
+                    const __m128 sum = _mm_add_ps(
+                        _mm_add_ps(_mm_loadu_ps(&srcRow[2 * i].x), _mm_loadu_ps(&srcRow[2 * i + 1].x)),
+                        _mm_add_ps(_mm_loadu_ps(&srcRow[src.Size + 2 * i].x), _mm_loadu_ps(&srcRow[src.Size + 2 * i + 1].x)));
+                    _mm_storeu_ps(&dstTexel[i].x, _mm_mul_ps(sum, quarter));
+                }
+            }
+        });
+    }
+}
+
+void EnvironmentLighting::Bake(uint32_t levelCount)
+{
+    mStats.Threads = JobSystem::Get().GetThreadCount();
+    if (mSource.empty())
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+    ProjectSh();
+    mStats.ShMs = MsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    Prefilter(levelCount);
+    mStats.PrefilterMs = MsSince(start);
+}
+
+void EnvironmentLighting::ProjectSh()
+{
+    const CubeLevel& base = mSource[0];
+    const uint32_t size = base.Size;
+
+    // Texel solid angles, the same on every face, from the area elements at the texel corners
+    const uint32_t corners = size + 1;
+    std::vector<float> areaElements(size_t(corners) * corners);
+    for (uint32_t y = 0; y < corners; ++y)
+    {
+        for (uint32_t x = 0; x < corners; ++x)
+            areaElements[y * corners + x] = AreaElement(2.0f * x / size - 1.0f, 2.0f * y / size - 1.0f);
+    }
+    std::vector<float> solidAngles(size_t(size) * size);
+    for (uint32_t row = 0; row < size; ++row)
+    {
+        const float* top = areaElements.data() + row * corners;
+        const float* bottom = top + corners;
+        for (uint32_t i = 0; i < size; ++i)
+            solidAngles[row * size + i] = top[i] - bottom[i] - top[i + 1] + bottom[i + 1];
+    }
+
+    // Per row sums of the 9 coefficients times RGB, added up in row order afterwards so
+    // the result does not depend on the thread count
+    const size_t rowCount = 6 * size_t(size);
+    std::vector<float> rowSums(rowCount * 27);
+    JobSystem::Get().ParallelFor(rowCount, 4, [&](size_t begin, size_t end)
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 three = _mm_set1_ps(3.0f);
+        const __m128 c0 = _mm_set1_ps(0.282095f);
+        const __m128 c1 = _mm_set1_ps(0.488603f);
+        const __m128 c2 = _mm_set1_ps(1.092548f);
+        const __m128 c3 = _mm_set1_ps(0.315392f);
+        const __m128 c4 = _mm_set1_ps(0.546274f);
+        const __m128 laneOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        const __m128 texelScale = _mm_set1_ps(2.0f / size);
+        const __m128 texelBias = _mm_set1_ps(1.0f / size - 1.0f);
+
+        for (size_t item = begin; item < end; ++item)
+        {
+            const uint32_t face = uint32_t(item / size);
+            const uint32_t row = uint32_t(item % size);
+            const __m128 v = _mm_set1_ps(TexelCoord(row, size));
+            const XMFLOAT4* texels = base.Texels.data() + item * size;
+            const float* weights = solidAngles.data() + size_t(row) * size;
+
+            __m128 sums[27];
+            for (__m128& sum : sums)
+                sum = _mm_setzero_ps();
+
+            for (uint32_t i = 0; i < size; i += 4)
+            {
+                const __m128 u = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(float(i)), laneOffsets), texelScale), texelBias);
+                __m128 x, y, z;
+                FaceDirections(face, u, v, x, y, z);
+                const __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z))));
+                x = _mm_mul_ps(x, invLength);
+                y = _mm_mul_ps(y, invLength);
+                z = _mm_mul_ps(z, invLength);
+
+                __m128 r = _mm_loadu_ps(&texels[i].x);
+                __m128 g = _mm_loadu_ps(&texels[i + 1].x);
+                __m128 b = _mm_loadu_ps(&texels[i + 2].x);
+                __m128 a = _mm_loadu_ps(&texels[i + 3].x);
+                _MM_TRANSPOSE4_PS(r, g, b, a);
+                const __m128 weight = _mm_loadu_ps(weights + i);
+                const __m128 color[3] = { _mm_mul_ps(r, weight), _mm_mul_ps(g, weight), _mm_mul_ps(b, weight) };
+
+                const __m128 basis[9] = {
+                    c0,
+                    _mm_mul_ps(c1, y),
+                    _mm_mul_ps(c1, z),
+                    _mm_mul_ps(c1, x),
+                    _mm_mul_ps(c2, _mm_mul_ps(x, y)),
+                    _mm_mul_ps(c2, _mm_mul_ps(y, z)),
+                    _mm_mul_ps(c3, _mm_sub_ps(_mm_mul_ps(three, _mm_mul_ps(z, z)), one)),
+                    _mm_mul_ps(c2, _mm_mul_ps(x, z)),
+                    _mm_mul_ps(c4, _mm_sub_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)))
+                };
+                for (int k = 0; k < 9; ++k)
+                {
+                    for (int c = 0; c < 3; ++c)
+                        sums[k * 3 + c] = _mm_add_ps(sums[k * 3 + c], _mm_mul_ps(basis[k], color[c]));
+                }
+            }
+
+            float* rowSum = rowSums.data() + item * 27;
+            for (int k = 0; k < 27; ++k)
+            {
+                alignas(16) float lanes[4];
+                _mm_store_ps(lanes, sums[k]);
+                rowSum[k] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+            }
+        }
+    });
+
+    double total[27] = {};
+    for (size_t item = 0; item < rowCount; ++item)
+    {
+        for (int k = 0; k < 27; ++k)
+            total[k] += rowSums[item * 27 + k];
+    }
+
+    // Convolution with the clamped cosine, A_l = pi, 2 pi / 3, pi / 4, divided by pi
+    const float bandFactors[3] = { 1.0f, 2.0f / 3.0f, 0.25f };
+    for (int k = 0; k < 9; ++k)
+    {
+        const float factor = bandFactors[k == 0 ? 0 : (k < 4 ? 1 : 2)];
+        mSh[k] = XMFLOAT4(float(total[k * 3]) * factor, float(total[k * 3 + 1]) * factor, float(total[k * 3 + 2]) * factor, 0.0f);
+    }
+}
+
+void EnvironmentLighting::Prefilter(uint32_t levelCount)
+{
+    const uint32_t sourceLevels = uint32_t(mSource.size());
+    levelCount = (std::min)((std::max)(levelCount, 1u), sourceLevels);
+    mStats.Levels = levelCount;
+
+    // The mirror level is the source itself
+    mPrefiltered.assign(1, mSource[0]);
+
+    struct RowItem
+    {
+        uint32_t Level;
+        uint32_t Face;
+        uint32_t Row;
+    };
+    std::vector<RowItem> items;
+    std::vector<std::vector<PrefilterSample>> levelSamples(levelCount);
+    for (uint32_t level = 1; level < levelCount; ++level)
+    {
+        const uint32_t size = mSource[level].Size;
+        mPrefiltered.push_back(CubeLevel{ size, std::vector<XMFLOAT4>(6 * size_t(size) * size) });
+        levelSamples[level] = BuildPrefilterSamples(float(level) / (levelCount - 1), mSource[0].Size, sourceLevels);
+        for (uint32_t face = 0; face < 6; ++face)
+        {
+            for (uint32_t row = 0; row < size; ++row)
+                items.push_back(RowItem{ level, face, row });
+        }
+    }
+
+    // Four texels of a row at a time, their tangent frames and sample directions in SSE
+    // registers
+    JobSystem::Get().ParallelFor(items.size(), 1, [&](size_t begin, size_t end)
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 laneOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        const __m128 poleLimit = _mm_set1_ps(0.999f);
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+        for (size_t item = begin; item < end; ++item)
+        {
+            const RowItem& rowItem = items[item];
+            CubeLevel& dst = mPrefiltered[rowItem.Level];
+            const std::vector<PrefilterSample>& samples = levelSamples[rowItem.Level];
+            const uint32_t size = dst.Size;
+            const __m128 texelScale = _mm_set1_ps(2.0f / size);
+            const __m128 texelBias = _mm_set1_ps(1.0f / size - 1.0f);
+            const __m128 v = _mm_set1_ps(TexelCoord(rowItem.Row, size));
+            XMFLOAT4* dstRow = dst.Texels.data() + (size_t(rowItem.Face) * size + rowItem.Row) * size;
+
+            for (uint32_t i = 0; i < size; i += 4)
+            {
+                const __m128 u = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(float(i)), laneOffsets), texelScale), texelBias);
+                __m128 nx, ny, nz;
+                FaceDirections(rowItem.Face, u, v, nx, ny, nz);
+                const __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz))));
+                nx = _mm_mul_ps(nx, invLength);
+                ny = _mm_mul_ps(ny, invLength);
+                nz = _mm_mul_ps(nz, invLength);
+
+                // T = normalize(cross(up, N)) with up = +z, or +x near the poles; B = cross(N, T)
+                const __m128 nearPole = _mm_cmpgt_ps(_mm_and_ps(nz, absMask), poleLimit);
+                __m128 tx = _mm_andnot_ps(nearPole, _mm_sub_ps(_mm_setzero_ps(), ny));
+                __m128 ty = _mm_or_ps(_mm_and_ps(nearPole, _mm_sub_ps(_mm_setzero_ps(), nz)), _mm_andnot_ps(nearPole, nx));
+                __m128 tz = _mm_and_ps(nearPole, ny);
+                const __m128 invTangentLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz))));
+                tx = _mm_mul_ps(tx, invTangentLength);
+                ty = _mm_mul_ps(ty, invTangentLength);
+                tz = _mm_mul_ps(tz, invTangentLength);
+                const __m128 bx = _mm_sub_ps(_mm_mul_ps(ny, tz), _mm_mul_ps(nz, ty));
+                const __m128 by = _mm_sub_ps(_mm_mul_ps(nz, tx), _mm_mul_ps(nx, tz));
+                const __m128 bz = _mm_sub_ps(_mm_mul_ps(nx, ty), _mm_mul_ps(ny, tx));
+
+                __m128 sums[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+                for (const PrefilterSample& sample : samples)
+                {
+                    const __m128 sx = _mm_set1_ps(sample.X);
+                    const __m128 sy = _mm_set1_ps(sample.Y);
+                    const __m128 sz = _mm_set1_ps(sample.Z);
+                    const __m128 lx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, sx), _mm_mul_ps(bx, sy)), _mm_mul_ps(nx, sz));
+                    const __m128 ly = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ty, sx), _mm_mul_ps(by, sy)), _mm_mul_ps(ny, sz));
+                    const __m128 lz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tz, sx), _mm_mul_ps(bz, sy)), _mm_mul_ps(nz, sz));
+                    SampleCube(mSource[sample.SourceLevel], lx, ly, lz, _mm_set1_ps(sample.Weight), sums);
+                }
+
+                // Rows narrower than four texels compute the missing lanes off the face
+                for (uint32_t lane = 0; lane < 4 && i + lane < size; ++lane)
+                {
+                    _mm_storeu_ps(&dstRow[i + lane].x, sums[lane]);
+                    dstRow[i + lane].w = 1.0f;
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,1007 @@
+#include <FbxBinaryReader.h>
+#include <Inflate.h>
+#include <JobSystem.h>
+#include <VertexWelder.h>
+#include <AssetPaths.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string_view>
+#include <unordered_set>
+
+namespace
+{
+    const char kMagic[] = "Kaydara FBX Binary  ";
+    const size_t kHeaderSize = 27;
+
+    // Files from version 7.5 use 64-bit offsets in the node records.
+    const uint32_t kWideRecordVersion = 7500;
+
+    // Meshes with less compressed data are inflated on the calling thread.
+    const size_t kParallelThreshold = 256 * 1024;
+
+    template<typename T>
+    T ReadValue(const uint8_t* p)
+    {
+        T value;
+        memcpy(&value, p, sizeof(T));
+        return value;
+    }
+
+    size_t ArrayElementSize(char type)
+    {
+        switch (type)
+        {
+        case 'd': case 'l': return 8;
+        case 'f': case 'i': return 4;
+        case 'b': return 1;
+        default: return 0;
+        }
+    }
+
+    // One node record, its nested records are in [Children, End).
+    struct Node
+    {
+        std::string_view Name;
+        uint64_t PropertyCount;
+        const uint8_t* Properties;
+        const uint8_t* Children;
+        const uint8_t* End;
+    };
+
+    // Walks the sibling records in [begin, end) without looking at their contents.
+    class NodeIterator
+    {
+    public:
+        NodeIterator(const uint8_t* file, size_t fileSize, uint32_t version, const uint8_t* begin, const uint8_t* end)
+            : mpFile(file),
+            mFileSize(fileSize),
+            mbWide(version >= kWideRecordVersion),
+            mpNext(begin),
+            mpEnd(end),
+            mbFailed(false)
+        {
+        }
+
+        bool Next(Node& node)
+        {
+            const size_t headerSize = mbWide ? 25 : 13;
+            if (mbFailed || static_cast<size_t>(mpEnd - mpNext) < headerSize)
+                return false;
+
+            uint64_t endOffset, propertyCount, propertyListLength;
+            if (mbWide)
+            {
+                endOffset = ReadValue<uint64_t>(mpNext);
+                propertyCount = ReadValue<uint64_t>(mpNext + 8);
+                propertyListLength = ReadValue<uint64_t>(mpNext + 16);
+            }
+            else
+            {
+                endOffset = ReadValue<uint32_t>(mpNext);
+                propertyCount = ReadValue<uint32_t>(mpNext + 4);
+                propertyListLength = ReadValue<uint32_t>(mpNext + 8);
+            }
+
+            // A zeroed record terminates a list of nested records.
+            if (endOffset == 0)
+                return false;
+
+            uint8_t nameLength = mpNext[headerSize - 1];
+            const uint8_t* name = mpNext + headerSize;
+            const uint8_t* nodeEnd = endOffset <= mFileSize ? mpFile + endOffset : nullptr;
+            if (!nodeEnd || nodeEnd > mpEnd || nodeEnd < name ||
+                nameLength > static_cast<size_t>(nodeEnd - name) ||
+                propertyListLength > static_cast<size_t>(nodeEnd - name) - nameLength)
+            {
+                mbFailed = true;
+                return false;
+            }
+
+            node.Name = std::string_view(reinterpret_cast<const char*>(name), nameLength);
+            node.PropertyCount = propertyCount;
+            node.Properties = name + nameLength;
+            node.Children = node.Properties + propertyListLength;
+            node.End = nodeEnd;
+
+            mpNext = nodeEnd;
+            return true;
+        }
+
+        bool Failed() const { return mbFailed; }
+
+    private:
+        const uint8_t* mpFile;
+        size_t mFileSize;
+        bool mbWide;
+        const uint8_t* mpNext;
+        const uint8_t* mpEnd;
+        bool mbFailed;
+    };
+
+    struct Property
+    {
+        char Type;
+        const uint8_t* Data;
+        uint32_t Length;        // Strings and raw data
+        uint32_t Count;         // Arrays
+        uint32_t Encoding;      // Arrays, 1 = zlib
+        uint32_t ByteSize;      // Arrays, stored size
+    };
+
+    // Reads the properties of one node in order.
+    class PropertyIterator
+    {
+    public:
+        explicit PropertyIterator(const Node& node)
+            : mpNext(node.Properties),
+            mpEnd(node.Children),
+            mRemaining(node.PropertyCount)
+        {
+        }
+
+        bool Next(Property& property)
+        {
+            if (mRemaining == 0 || mpNext >= mpEnd)
+                return false;
+            mRemaining--;
+
+            property = Property();
+            property.Type = static_cast<char>(*mpNext++);
+            property.Data = mpNext;
+
+            size_t size = 0;
+            switch (property.Type)
+            {
+            case 'C': size = 1; break;
+            case 'Y': size = 2; break;
+            case 'I': case 'F': size = 4; break;
+            case 'D': case 'L': size = 8; break;
+            case 'S': case 'R':
+                if (mpEnd - mpNext < 4)
+                    return Fail();
+                property.Length = ReadValue<uint32_t>(mpNext);
+                property.Data = mpNext + 4;
+                size = 4 + size_t(property.Length);
+                break;
+            case 'd': case 'l': case 'f': case 'i': case 'b':
+                if (mpEnd - mpNext < 12)
+                    return Fail();
+                property.Count = ReadValue<uint32_t>(mpNext);
+                property.Encoding = ReadValue<uint32_t>(mpNext + 4);
+                property.ByteSize = ReadValue<uint32_t>(mpNext + 8);
+                property.Data = mpNext + 12;
+                size = 12 + size_t(property.ByteSize);
+                if (property.Encoding == 0 && property.ByteSize != uint64_t(property.Count) * ArrayElementSize(property.Type))
+                    return Fail();
+                break;
+            default:
+                return Fail();
+            }
+
+            if (size > static_cast<size_t>(mpEnd - mpNext))
+                return Fail();
+            mpNext += size;
+            return true;
+        }
+
+    private:
+        bool Fail()
+        {
+            mRemaining = 0;
+            return false;
+        }
+
+        const uint8_t* mpNext;
+        const uint8_t* mpEnd;
+        uint64_t mRemaining;
+    };
+
+    int64_t AsInt(const Property& property)
+    {
+        switch (property.Type)
+        {
+        case 'C': return *property.Data;
+        case 'Y': return ReadValue<int16_t>(property.Data);
+        case 'I': return ReadValue<int32_t>(property.Data);
+        case 'L': return ReadValue<int64_t>(property.Data);
+        default: return 0;
+        }
+    }
+
+    double AsDouble(const Property& property)
+    {
+        switch (property.Type)
+        {
+        case 'F': return ReadValue<float>(property.Data);
+        case 'D': return ReadValue<double>(property.Data);
+        default: return static_cast<double>(AsInt(property));
+        }
+    }
+
+    std::string_view AsString(const Property& property)
+    {
+        if (property.Type != 'S')
+            return std::string_view();
+        return std::string_view(reinterpret_cast<const char*>(property.Data), property.Length);
+    }
+
+    // Object names are stored as "Name\x00\x01Class".
+    std::string ObjectName(const Property& property)
+    {
+        std::string_view name = AsString(property);
+        size_t separator = name.find(std::string_view("\x00\x01", 2));
+        return std::string(name.substr(0, separator));
+    }
+
+    // The first property of a node as a string, for nodes like MappingInformationType
+    std::string_view FirstString(const Node& node)
+    {
+        PropertyIterator properties(node);
+        Property property{};
+        return properties.Next(property) ? AsString(property) : std::string_view();
+    }
+
+    bool IsByControlPoint(const std::string& mapping)
+    {
+        return mapping == "ByVertice" || mapping == "ByVertex" || mapping == "ByControlPoint";
+    }
+}
+
+double FbxBinaryReader::ArrayView::GetDouble(size_t i) const
+{
+    switch (Type)
+    {
+    case 'd': return ReadValue<double>(Data + i * 8);
+    case 'f': return ReadValue<float>(Data + i * 4);
+    default: return static_cast<double>(GetInt(i));
+    }
+}
+
+int32_t FbxBinaryReader::ArrayView::GetInt(size_t i) const
+{
+    switch (Type)
+    {
+    case 'i': return ReadValue<int32_t>(Data + i * 4);
+    case 'l': return static_cast<int32_t>(ReadValue<int64_t>(Data + i * 8));
+    case 'b': return Data[i];
+    default: return 0;
+    }
+}
+
+FbxBinaryReader::FbxBinaryReader()
+    : mVersion(0)
+{
+}
+
+bool FbxBinaryReader::LoadFbxFile(const std::string& filename)
+{
+    mFilename = filename;
+
+    if (!mFile.Open(std::filesystem::u8path(filename)))
+    {
+        LOG("FBX: can not open ", filename);
+        return false;
+    }
+
+    const uint8_t* data = mFile.Data();
+    const size_t size = mFile.Size();
+    if (size < kHeaderSize || memcmp(data, kMagic, sizeof(kMagic)) != 0)
+    {
+        LOG("FBX: ", filename, " is not a binary FBX file");
+        return false;
+    }
+
+    mVersion = ReadValue<uint32_t>(data + 23);
+    if (mVersion < 7000)
+    {
+        LOG("FBX: unsupported version ", mVersion);
+        return false;
+    }
+
+    std::vector<Connection> connections;
+    NodeIterator nodes(data, size, mVersion, data + kHeaderSize, data + size);
+    Node node;
+    while (nodes.Next(node))
+    {
+        bool ok = true;
+        if (node.Name == "Objects")
+            ok = ParseObjects(node.Children, node.End);
+        else if (node.Name == "Connections")
+            ok = ParseConnections(node.Children, node.End, connections);
+
+        if (!ok)
+        {
+            LOG("FBX: malformed ", std::string(node.Name), " section in ", filename);
+            return false;
+        }
+    }
+
+    if (nodes.Failed())
+    {
+        LOG("FBX: malformed node record in ", filename);
+        return false;
+    }
+
+    ResolveConnections(connections);
+
+    LOG("FBX ", mVersion, ": ", mGeometries.size(), " geometries, ", mModels.size(), " models, ",
+        mMaterialObjects.size(), " materials, ", mTextures.size(), " textures");
+    return true;
+}
+
+bool FbxBinaryReader::ParseObjects(const uint8_t* begin, const uint8_t* end)
+{
+    NodeIterator objects(mFile.Data(), mFile.Size(), mVersion, begin, end);
+    Node object;
+    while (objects.Next(object))
+    {
+        // Every object starts with its id, name and class
+        PropertyIterator properties(object);
+        Property id{}, name{}, type{};
+        if (!properties.Next(id) || !properties.Next(name) || !properties.Next(type))
+            continue;
+
+        if (object.Name == "Geometry")
+        {
+            // Shapes (blend shape targets) are geometry too, but not meshes
+            if (AsString(type) == "Mesh" && !ParseGeometry(object.Children, object.End, mGeometries[AsInt(id)]))
+                return false;
+        }
+        else if (object.Name == "Model")
+        {
+            mModels[AsInt(id)];
+        }
+        else if (object.Name == "Material")
+        {
+            Material& material = mMaterialObjects[AsInt(id)];
+            material.Name = ObjectName(name);
+            if (!ParseMaterial(object.Children, object.End, material))
+                return false;
+        }
+        else if (object.Name == "Texture")
+        {
+            if (!ParseTexture(object.Children, object.End, mTextures[AsInt(id)]))
+                return false;
+        }
+    }
+
+    return !objects.Failed();
+}
+
+bool FbxBinaryReader::ParseGeometry(const uint8_t* begin, const uint8_t* end, Geometry& geometry)
+{
+    auto readArray = [](const Node& node, ArrayRef& array)
+    {
+        PropertyIterator properties(node);
+        Property property{};
+        if (!properties.Next(property) || ArrayElementSize(property.Type) == 0)
+            return false;
+
+        array.Type = property.Type;
+        array.Count = property.Count;
+        array.Encoding = property.Encoding;
+        array.ByteSize = property.ByteSize;
+        array.Data = property.Data;
+        return true;
+    };
+
+    NodeIterator children(mFile.Data(), mFile.Size(), mVersion, begin, end);
+    Node child;
+    while (children.Next(child))
+    {
+        bool ok = true;
+        if (child.Name == "Vertices")
+            ok = readArray(child, geometry.Vertices);
+        else if (child.Name == "PolygonVertexIndex")
+            ok = readArray(child, geometry.PolygonVertexIndex);
+        else if (child.Name == "LayerElementNormal")
+            ok = ParseLayerElement(child.Children, child.End, "Normals", "NormalsIndex", geometry.Normals);
+        else if (child.Name == "LayerElementUV")
+            ok = ParseLayerElement(child.Children, child.End, "UV", "UVIndex", geometry.UVs);
+        else if (child.Name == "LayerElementMaterial")
+            ok = ParseLayerElement(child.Children, child.End, "Materials", nullptr, geometry.Materials);
+
+        if (!ok)
+            return false;
+    }
+
+    return !children.Failed();
+}
+
+bool FbxBinaryReader::ParseLayerElement(const uint8_t* begin, const uint8_t* end, const char* arrayName, const char* indexName, LayerElement& element)
+{
+    // Only the first element of each kind is used, like FbxMesh::GetElementNormal().
+    if (element.Present)
+        return true;
+    element.Present = true;
+
+    NodeIterator children(mFile.Data(), mFile.Size(), mVersion, begin, end);
+    Node child;
+    while (children.Next(child))
+    {
+        ArrayRef* array = nullptr;
+        if (child.Name == "MappingInformationType")
+            element.Mapping = std::string(FirstString(child));
+        else if (child.Name == "ReferenceInformationType")
+            element.Reference = std::string(FirstString(child));
+        else if (child.Name == arrayName)
+            array = &element.Direct;
+        else if (indexName && child.Name == indexName)
+            array = &element.Index;
+
+        if (array)
+        {
+            PropertyIterator properties(child);
+            Property property{};
+            if (!properties.Next(property) || ArrayElementSize(property.Type) == 0)
+                return false;
+
+            array->Type = property.Type;
+            array->Count = property.Count;
+            array->Encoding = property.Encoding;
+            array->ByteSize = property.ByteSize;
+            array->Data = property.Data;
+        }
+    }
+
+    return !children.Failed();
+}
+
+bool FbxBinaryReader::ParseMaterial(const uint8_t* begin, const uint8_t* end, Material& material)
+{
+    bool hasShininessExponent = false;
+
+    NodeIterator children(mFile.Data(), mFile.Size(), mVersion, begin, end);
+    Node child;
+    while (children.Next(child))
+    {
+        if (child.Name == "ShadingModel")
+        {
+            material.ShadingModel = std::string(FirstString(child));
+            std::transform(material.ShadingModel.begin(), material.ShadingModel.end(), material.ShadingModel.begin(),
+                [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+            continue;
+        }
+
+        if (child.Name != "Properties70")
+            continue;
+
+        // P: name, type, label, flags, values...
+        NodeIterator entries(mFile.Data(), mFile.Size(), mVersion, child.Children, child.End);
+        Node entry;
+        while (entries.Next(entry))
+        {
+            PropertyIterator properties(entry);
+            Property name{}, skipped{}, values[3]{};
+            if (entry.Name != "P" || !properties.Next(name))
+                continue;
+            for (int i = 0; i < 3; i++)
+                properties.Next(skipped);
+            int valueCount = 0;
+            while (valueCount < 3 && properties.Next(values[valueCount]))
+                valueCount++;
+
+            std::string_view propertyName = AsString(name);
+            double* color = nullptr;
+            double* factor = nullptr;
+            if (propertyName == "AmbientColor")
+                color = material.Ambient;
+            else if (propertyName == "DiffuseColor")
+                color = material.Diffuse;
+            else if (propertyName == "SpecularColor")
+                color = material.Specular;
+            else if (propertyName == "AmbientFactor")
+                factor = &material.AmbientFactor;
+            else if (propertyName == "DiffuseFactor")
+                factor = &material.DiffuseFactor;
+            else if (propertyName == "SpecularFactor")
+                factor = &material.SpecularFactor;
+            else if (propertyName == "ShininessExponent")
+            {
+                factor = &material.Shininess;
+                hasShininessExponent = true;
+            }
+            else if (propertyName == "Shininess" && !hasShininessExponent)
+                factor = &material.Shininess;
+
+            if (color && valueCount == 3)
+            {
+                for (int i = 0; i < 3; i++)
+                    color[i] = AsDouble(values[i]);
+            }
+            else if (factor && valueCount >= 1)
+            {
+                *factor = AsDouble(values[0]);
+            }
+        }
+
+        if (entries.Failed())
+            return false;
+    }
+
+    return !children.Failed();
+}
+
+bool FbxBinaryReader::ParseTexture(const uint8_t* begin, const uint8_t* end, Texture& texture)
+{
+    NodeIterator children(mFile.Data(), mFile.Size(), mVersion, begin, end);
+    Node child;
+    while (children.Next(child))
+    {
+        if (child.Name == "FileName")
+            texture.FileName = std::string(FirstString(child));
+        else if (child.Name == "RelativeFilename")
+            texture.RelativeFileName = std::string(FirstString(child));
+    }
+
+    return !children.Failed();
+}
+
+bool FbxBinaryReader::ParseConnections(const uint8_t* begin, const uint8_t* end, std::vector<Connection>& connections)
+{
+    NodeIterator records(mFile.Data(), mFile.Size(), mVersion, begin, end);
+    Node record;
+    while (records.Next(record))
+    {
+        // C: type, child id, parent id[, parent property]
+        PropertyIterator properties(record);
+        Property type{}, child{}, parent{}, property{};
+        if (record.Name != "C" || !properties.Next(type) || !properties.Next(child) || !properties.Next(parent))
+            continue;
+
+        Connection connection;
+        connection.ToProperty = AsString(type) == "OP";
+        connection.Child = AsInt(child);
+        connection.Parent = AsInt(parent);
+        if (properties.Next(property))
+            connection.Property = std::string(AsString(property));
+        connections.push_back(connection);
+    }
+
+    return !records.Failed();
+}
+
+void FbxBinaryReader::ResolveConnections(const std::vector<Connection>& connections)
+{
+    // Connections are applied in file order, which is also the order the SDK
+    // gives to node children and materials.
+    for (const Connection& connection : connections)
+    {
+        auto parentModel = connection.Parent == 0 ? &mRoot : nullptr;
+        if (!parentModel)
+        {
+            auto it = mModels.find(connection.Parent);
+            if (it != mModels.end())
+                parentModel = &it->second;
+        }
+
+        if (parentModel && !connection.ToProperty)
+        {
+            auto model = mModels.find(connection.Child);
+            if (model != mModels.end())
+            {
+                parentModel->Children.push_back(&model->second);
+                continue;
+            }
+
+            if (parentModel == &mRoot)
+                continue;
+
+            auto geometry = mGeometries.find(connection.Child);
+            if (geometry != mGeometries.end())
+            {
+                if (!parentModel->Mesh)
+                    parentModel->Mesh = &geometry->second;
+                continue;
+            }
+
+            auto material = mMaterialObjects.find(connection.Child);
+            if (material != mMaterialObjects.end())
+                parentModel->Materials.push_back(&material->second);
+            continue;
+        }
+
+        auto material = mMaterialObjects.find(connection.Parent);
+        auto texture = mTextures.find(connection.Child);
+        if (connection.ToProperty && material != mMaterialObjects.end() && texture != mTextures.end())
+        {
+            const Texture** slot = nullptr;
+            if (connection.Property == "DiffuseColor")
+                slot = &material->second.ColorMap;
+            else if (connection.Property == "NormalMap")
+                slot = &material->second.NormalMap;
+            else if (connection.Property == "Bump")
+                slot = &material->second.Bump;
+
+            if (slot && !*slot)
+                *slot = &texture->second;
+        }
+    }
+}
+
+void FbxBinaryReader::CollectMeshModels(const Model* pModel, std::vector<const Model*>& meshModels)
+{
+    // Depth first in child order, like the SDK's node tree. Connections come from the
+    // file and may form cycles, each model is visited once and without recursion.
+    std::unordered_set<const Model*> visited;
+    std::vector<const Model*> pending(1, pModel);
+    while (!pending.empty())
+    {
+        const Model* model = pending.back();
+        pending.pop_back();
+        if (!visited.insert(model).second)
+            continue;
+
+        if (model->Mesh)
+            meshModels.push_back(model);
+
+        for (auto child = model->Children.rbegin(); child != model->Children.rend(); ++child)
+        {
+            pending.push_back(*child);
+        }
+    }
+}
+
+UINT FbxBinaryReader::GetMaterialIndex(const Material* pMaterial)
+{
+    // Same defaults and conversions as FBXReader::GetMaterialIndex
+    auto it = mMaterialIndices.find(pMaterial);
+    if (it != mMaterialIndices.end())
+        return it->second;
+
+    MaterialDesc desc;
+    desc.Ambient = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+    desc.Diffuse = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+    desc.Specular = DirectX::XMFLOAT4(0.5f, 0.5f, 0.5f, 5.0f);
+
+    if (pMaterial)
+    {
+        desc.Name = pMaterial->Name;
+
+        bool phong = pMaterial->ShadingModel == "phong";
+        if (phong || pMaterial->ShadingModel == "lambert")
+        {
+            float ambientFactor = static_cast<float>(pMaterial->AmbientFactor);
+            float diffuseFactor = static_cast<float>(pMaterial->DiffuseFactor);
+            const double* ambient = pMaterial->Ambient;
+            const double* diffuse = pMaterial->Diffuse;
+            desc.Ambient = DirectX::XMFLOAT4(ambient[0] * ambientFactor, ambient[1] * ambientFactor, ambient[2] * ambientFactor, 1.0f);
+            desc.Diffuse = DirectX::XMFLOAT4(diffuse[0] * diffuseFactor, diffuse[1] * diffuseFactor, diffuse[2] * diffuseFactor, 1.0f);
+        }
+
+        if (phong)
+        {
+            float specularFactor = static_cast<float>(pMaterial->SpecularFactor);
+            const double* specular = pMaterial->Specular;
+            desc.Specular = DirectX::XMFLOAT4(specular[0] * specularFactor, specular[1] * specularFactor, specular[2] * specularFactor,
+                static_cast<float>(pMaterial->Shininess));
+        }
+
+        desc.ColorMapFile = ResolveTexturePath(pMaterial->ColorMap);
+        desc.NormalMapFile = ResolveTexturePath(pMaterial->NormalMap);
+        if (desc.NormalMapFile.empty())
+            desc.NormalMapFile = ResolveTexturePath(pMaterial->Bump);
+    }
+    else
+    {
+        desc.Name = "Default";
+    }
+
+    UINT index = static_cast<UINT>(mMaterials.size());
+    mMaterials.push_back(desc);
+    mMaterialIndices.emplace(pMaterial, index);
+
+    LOG("Material ", index, ": ", desc.Name);
+    return index;
+}
+
+std::wstring FbxBinaryReader::ResolveTexturePath(const Texture* pTexture) const
+{
+    if (!pTexture)
+        return std::wstring();
+
+    std::wstring path = ResolveAssetPath(std::filesystem::u8path(mFilename), pTexture->FileName, pTexture->RelativeFileName);
+    if (path.empty())
+        LOG("Texture not found: ", pTexture->FileName);
+    return path;
+}
+
+bool FbxBinaryReader::DecodeArrays(const ArrayRef* const* arrays, ArrayView* views, size_t count)
+{
+    // Output buffers come from the arena up front, only the inflating runs on other threads.
+    struct Job
+    {
+        const ArrayRef* Source;
+        uint8_t* Dest;
+        size_t Size;
+    };
+
+    std::vector<Job> jobs;
+    size_t compressedBytes = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const ArrayRef& array = *arrays[i];
+        views[i].Type = array.Type;
+        views[i].Count = array.Data ? array.Count : 0;
+        views[i].Data = array.Data;
+
+        if (array.Data && array.Encoding != 0)
+        {
+            if (array.Encoding != 1)
+                return false;
+
+            // Deflate can not expand data more than ~1032:1, a larger count is corrupt.
+            size_t size = size_t(array.Count) * ArrayElementSize(array.Type);
+            if (size > size_t(array.ByteSize) * 1032 + 64)
+                return false;
+
+            uint8_t* dest = mArena.AllocateArray<uint8_t>(size);
+            views[i].Data = dest;
+            jobs.push_back({ &array, dest, size });
+            compressedBytes += array.ByteSize;
+        }
+    }
+
+    std::atomic<bool> ok(true);
+    auto inflate = [&](size_t first, size_t end)
+    {
+        for (size_t i = first; i < end; i++)
+        {
+            const Job& job = jobs[i];
+            if (!Inflate::Zlib(job.Source->Data, job.Source->ByteSize, job.Dest, job.Size))
+                ok = false;
+        }
+    };
+
+    if (compressedBytes >= kParallelThreshold)
+        JobSystem::Get().ParallelFor(jobs.size(), 1, inflate);
+    else
+        inflate(0, jobs.size());
+
+    return ok;
+}
+
+void FbxBinaryReader::GetMeshData(const Model* pModel, std::vector<VertexTextured>& vertices, std::vector<MaterialBatch>& batches)
+{
+    static std::atomic<int> meshNum(0);
+
+    const Geometry& mesh = *pModel->Mesh;
+    LOG("Mesh ", meshNum++);
+
+    // Decoded arrays and all temporary data of this mesh live in the arena.
+    mArena.Reset();
+
+    enum { kPositions, kPolygonVertices, kNormals, kNormalIndices, kUVs, kUVIndices, kMaterials, kArrayCount };
+    const ArrayRef* arrays[kArrayCount] =
+    {
+        &mesh.Vertices, &mesh.PolygonVertexIndex,
+        &mesh.Normals.Direct, &mesh.Normals.Index,
+        &mesh.UVs.Direct, &mesh.UVs.Index,
+        &mesh.Materials.Direct
+    };
+    ArrayView views[kArrayCount];
+    if (!DecodeArrays(arrays, views, kArrayCount))
+    {
+        LOG("FBX: corrupt compressed array, mesh skipped");
+        return;
+    }
+
+    const ArrayView& positions = views[kPositions];
+    const ArrayView& polygonVertices = views[kPolygonVertices];
+    const int numControlPoints = static_cast<int>(positions.Count / 3);
+    const int numCorners = static_cast<int>(polygonVertices.Count);
+
+    // The last corner of each polygon is stored as ~index.
+    auto controlPointOf = [&](int corner)
+    {
+        int32_t index = polygonVertices.GetInt(corner);
+        return index < 0 ? ~index : index;
+    };
+
+    // Node material slots, the last local slot is used by polygons without a material.
+    const int slotCount = static_cast<int>(pModel->Materials.size());
+    const int defaultSlot = slotCount;
+    const LayerElement& materialElement = mesh.Materials;
+    const ArrayView& polygonMaterials = views[kMaterials];
+
+    int numPolygons = 0;
+    for (int corner = 0; corner < numCorners; corner++)
+    {
+        if (polygonVertices.GetInt(corner) < 0 || corner == numCorners - 1)
+            numPolygons++;
+    }
+
+    // Counting pass: corners per control point and triangles per material slot
+    int* polygonSlots = mArena.AllocateArray<int>(numPolygons);
+    UINT* slotIndexCounts = mArena.AllocateArray<UINT>(slotCount + 1, 0);
+    VertexWelder welder;
+    welder.Begin(mArena, numControlPoints);
+    int maxPolygonSize = 0;
+
+    for (int polygonIndex = 0, polygonStart = 0; polygonIndex < numPolygons; polygonIndex++)
+    {
+        int polygonEnd = polygonStart;
+        while (polygonVertices.GetInt(polygonEnd) >= 0 && polygonEnd < numCorners - 1)
+            polygonEnd++;
+        polygonEnd++;
+
+        int polygonSize = polygonEnd - polygonStart;
+        for (int corner = polygonStart; corner < polygonEnd; corner++)
+        {
+            int controlPoint = controlPointOf(corner);
+            if (controlPoint >= numControlPoints)
+            {
+                LOG("FBX: control point index out of range, mesh skipped");
+                return;
+            }
+            welder.CountCorner(controlPoint);
+        }
+        maxPolygonSize = (std::max)(maxPolygonSize, polygonSize);
+
+        int slot = -1;
+        if (materialElement.Present && polygonMaterials.Count > 0)
+        {
+            if (materialElement.Mapping == "AllSame")
+                slot = polygonMaterials.GetInt(0);
+            else if (materialElement.Mapping == "ByPolygon" && static_cast<uint32_t>(polygonIndex) < polygonMaterials.Count)
+                slot = polygonMaterials.GetInt(polygonIndex);
+        }
+        else if (!materialElement.Present && slotCount > 0)
+        {
+            slot = 0;
+        }
+        polygonSlots[polygonIndex] = (slot >= 0 && slot < slotCount) ? slot : defaultSlot;
+
+        if (polygonSize >= 3)
+            slotIndexCounts[polygonSlots[polygonIndex]] += 3 * (polygonSize - 2);
+        polygonStart = polygonEnd;
+    }
+
+    welder.Finalize();
+
+    // Triangles of this mesh split by material slot
+    UINT* slotCursors = mArena.AllocateArray<UINT>(slotCount + 1);
+    UINT meshIndexCount = 0;
+    for (int slot = 0; slot <= slotCount; slot++)
+    {
+        slotCursors[slot] = meshIndexCount;
+        meshIndexCount += slotIndexCounts[slot];
+    }
+    UINT* meshIndices = mArena.AllocateArray<UINT>(meshIndexCount);
+
+    // Attribute lookup, mirrors GetNormal/GetUV in FBXReader. Missing data reads as zero.
+    auto elementIndex = [](const LayerElement& element, const ArrayView& indexArray, int corner, int controlPoint)
+    {
+        if (!element.Present)
+            return -1;
+
+        int index;
+        if (element.Mapping == "ByPolygonVertex")
+            index = corner;
+        else if (IsByControlPoint(element.Mapping))
+            index = controlPoint;
+        else
+            return -1;
+
+        if (element.Reference != "Direct")
+            index = static_cast<uint32_t>(index) < indexArray.Count ? indexArray.GetInt(index) : -1;
+        return index;
+    };
+
+    const ArrayView& normals = views[kNormals];
+    const ArrayView& uvs = views[kUVs];
+
+    UINT* tempIndices = mArena.AllocateArray<UINT>(maxPolygonSize); // Indices for one polygon
+
+    for (int polygonIndex = 0, corner = 0; polygonIndex < numPolygons; polygonIndex++)
+    {
+        int polygonSize = 0;
+        for (bool last = false; !last; corner++)
+        {
+            last = polygonVertices.GetInt(corner) < 0 || corner == numCorners - 1;
+            int controlPointId = controlPointOf(corner);
+
+            VertexTextured vertex;
+            vertex.Pos.x = static_cast<float>(positions.GetDouble(controlPointId * 3));
+            vertex.Pos.y = static_cast<float>(positions.GetDouble(controlPointId * 3 + 1));
+            vertex.Pos.z = static_cast<float>(positions.GetDouble(controlPointId * 3 + 2));
+
+            int normalIndex = elementIndex(mesh.Normals, views[kNormalIndices], corner, controlPointId);
+            bool hasNormal = normalIndex >= 0 && static_cast<size_t>(normalIndex) * 3 + 2 < normals.Count;
+            vertex.Normal.x = hasNormal ? static_cast<float>(normals.GetDouble(normalIndex * 3)) : 0.0f;
+            vertex.Normal.y = hasNormal ? static_cast<float>(normals.GetDouble(normalIndex * 3 + 1)) : 0.0f;
+            vertex.Normal.z = hasNormal ? static_cast<float>(normals.GetDouble(normalIndex * 3 + 2)) : 0.0f;
+
+            int uvIndex = elementIndex(mesh.UVs, views[kUVIndices], corner, controlPointId);
+            bool hasUV = uvIndex >= 0 && static_cast<size_t>(uvIndex) * 2 + 1 < uvs.Count;
+            vertex.Tex.x = hasUV ? static_cast<float>(uvs.GetDouble(uvIndex * 2)) : 0.0f;
+            vertex.Tex.y = hasUV ? static_cast<float>(uvs.GetDouble(uvIndex * 2 + 1)) : 0.0f;
+
+            // Reuse the vertex if this control point was already used with the same attributes,
+            // indices are absolute in the vertices array
+            tempIndices[polygonSize++] = welder.Weld(controlPointId, vertex, vertices);
+        }
+
+        // Split into triangles
+        UINT& cursor = slotCursors[polygonSlots[polygonIndex]];
+        for (int i = 2; i < polygonSize; ++i)
+        {
+            meshIndices[cursor++] = tempIndices[0];
+            meshIndices[cursor++] = tempIndices[i - 1];
+            meshIndices[cursor++] = tempIndices[i];
+        }
+    }
+
+    UINT slotStart = 0;
+    for (int slot = 0; slot <= slotCount; slot++)
+    {
+        UINT count = slotIndexCounts[slot];
+        if (count > 0)
+        {
+            UINT materialIndex = GetMaterialIndex(slot < slotCount ? pModel->Materials[slot] : nullptr);
+            if (batches.size() <= materialIndex)
+                batches.resize(materialIndex + 1);
+
+            MaterialBatch& batch = batches[materialIndex];
+            SubMesh subMesh;
+            subMesh.StartIndex = static_cast<UINT>(batch.Indices.size());
+            subMesh.IndexCount = count;
+            subMesh.MaterialIndex = materialIndex;
+            batch.SubMeshes.push_back(subMesh);
+            batch.Indices.insert(batch.Indices.end(), meshIndices + slotStart, meshIndices + slotStart + count);
+        }
+        slotStart += count;
+    }
+
+    LOG("vertices size = ", vertices.size());
+}
+
+void FbxBinaryReader::GetVertices(std::vector<VertexTextured>& vertices, std::vector<UINT>& indices)
+{
+    std::vector<SubMesh> subMeshes;
+    GetVertices(vertices, indices, subMeshes);
+}
+
+void FbxBinaryReader::GetVertices(std::vector<VertexTextured>& vertices, std::vector<UINT>& indices, std::vector<SubMesh>& subMeshes)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<const Model*> meshModels;
+    CollectMeshModels(&mRoot, meshModels);
+
+    // Every control point produces at least one vertex, seams and hard edges add more.
+    size_t controlPointCount = 0;
+    for (const Model* model : meshModels)
+        controlPointCount += model->Mesh->Vertices.Count / 3;
+    vertices.reserve(vertices.size() + controlPointCount);
+
+    std::vector<MaterialBatch> batches;
+    for (const Model* model : meshModels)
+    {
+        GetMeshData(model, vertices, batches);
+    }
+
+    // Concatenate the batches so that all ranges of a material are adjacent.
+    for (MaterialBatch& batch : batches)
+    {
+        UINT base = static_cast<UINT>(indices.size());
+        for (SubMesh subMesh : batch.SubMeshes)
+        {
+            subMesh.StartIndex += base;
+            subMeshes.push_back(subMesh);
+        }
+        indices.insert(indices.end(), batch.Indices.begin(), batch.Indices.end());
+    }
+
+    LOG("FBX native import: ", meshModels.size(), " meshes, ", vertices.size(), " vertices, ", indices.size(), " indices in ",
+        std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count(), " ms, peak temporary ",
+        GetPeakTemporaryBytes() / 1024, " KB");
+}
+
+void FbxBinaryReader::GetMaterials(std::vector<MaterialDesc>& materials)
+{
+    materials = mMaterials;
+}
@@ -1,9 +1,14 @@
 #include "FbxReader.h"
+#include <VertexWelder.h>
+#include <AssetPaths.h>
 
 #include <assert.h>
 #include <Utils.h>
 #include <DirectXColors.h>
 #include <random>
+#include <filesystem>
+#include <chrono>
+#include <algorithm>
 
 DirectX::XMFLOAT4 randomColors[] =
 {
@@ -20,7 +25,9 @@ DirectX::XMFLOAT4 randomColors[] =
 FBXReader::FBXReader()
     : mpManager(nullptr),
     mpScene(nullptr),
-    mpRootNode(nullptr)
+    mpRootNode(nullptr),
+    mImportArenaBytes(0),
+    mImportArenaAllocations(0)
 {
     mpManager = FbxManager::Create();
     assert(mpManager);
@@ -97,6 +104,7 @@ bool FBXReader::LoadFbxFile(const std::string& filename)
 {
     bool result = false;
 
+    mFilename = filename;
     result = LoadScene(mpManager, mpScene, filename.c_str());
 
     ASSERT(result, "An error occurred while loading the scene.");
@@ -355,136 +363,290 @@ FbxVector2 GetUV(FbxMesh* mesh, int polygonIndex, int positionInPolygon, int con
     return uv;
 }
 
-void FBXReader::GetMeshData(FbxNode* pNode, UINT shift, std::vector<VertexTextured>& vertices, std::vector<UINT>& indices)
+UINT FBXReader::GetMaterialIndex(FbxSurfaceMaterial* pMaterial)
+{
+    // Polygons without a material share one default material.
+    auto it = mMaterialIndices.find(pMaterial);
+    if (it != mMaterialIndices.end())
+        return it->second;
+
+    MaterialDesc desc;
+    desc.Ambient = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+    desc.Diffuse = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+    desc.Specular = DirectX::XMFLOAT4(0.5f, 0.5f, 0.5f, 5.0f);
+
+    if (pMaterial)
+    {
+        desc.Name = pMaterial->GetName();
+
+        if (pMaterial->GetClassId().Is(FbxSurfaceLambert::ClassId))
+        {
+            FbxSurfaceLambert* lambert = static_cast<FbxSurfaceLambert*>(pMaterial);
+            FbxDouble3 ambient = lambert->Ambient.Get();
+            FbxDouble3 diffuse = lambert->Diffuse.Get();
+            float ambientFactor = static_cast<float>(lambert->AmbientFactor.Get());
+            float diffuseFactor = static_cast<float>(lambert->DiffuseFactor.Get());
+            desc.Ambient = DirectX::XMFLOAT4(ambient[0] * ambientFactor, ambient[1] * ambientFactor, ambient[2] * ambientFactor, 1.0f);
+            desc.Diffuse = DirectX::XMFLOAT4(diffuse[0] * diffuseFactor, diffuse[1] * diffuseFactor, diffuse[2] * diffuseFactor, 1.0f);
+        }
+
+        if (pMaterial->GetClassId().Is(FbxSurfacePhong::ClassId))
+        {
+            FbxSurfacePhong* phong = static_cast<FbxSurfacePhong*>(pMaterial);
+            FbxDouble3 specular = phong->Specular.Get();
+            float specularFactor = static_cast<float>(phong->SpecularFactor.Get());
+            desc.Specular = DirectX::XMFLOAT4(specular[0] * specularFactor, specular[1] * specularFactor, specular[2] * specularFactor,
+                static_cast<float>(phong->Shininess.Get()));
+        }
+
+        desc.ColorMapFile = ResolveTexturePath(pMaterial, FbxSurfaceMaterial::sDiffuse);
+        desc.NormalMapFile = ResolveTexturePath(pMaterial, FbxSurfaceMaterial::sNormalMap);
+        if (desc.NormalMapFile.empty())
+            desc.NormalMapFile = ResolveTexturePath(pMaterial, FbxSurfaceMaterial::sBump);
+    }
+    else
+    {
+        desc.Name = "Default";
+    }
+
+    UINT index = static_cast<UINT>(mMaterials.size());
+    mMaterials.push_back(desc);
+    mMaterialIndices.emplace(pMaterial, index);
+
+    LOG("Material ", index, ": ", desc.Name);
+    return index;
+}
+
+std::wstring FBXReader::ResolveTexturePath(FbxSurfaceMaterial* pMaterial, const char* propertyName) const
+{
+    FbxProperty property = pMaterial->FindProperty(propertyName);
+    if (!property.IsValid())
+        return std::wstring();
+
+    FbxFileTexture* texture = property.GetSrcObject<FbxFileTexture>(0);
+    if (!texture)
+        return std::wstring();
+
+    std::wstring path = ResolveAssetPath(std::filesystem::u8path(mFilename), texture->GetFileName(), texture->GetRelativeFileName());
+    if (path.empty())
+        LOG("Texture not found: ", texture->GetFileName());
+    return path;
+}
+
+void FBXReader::CollectMeshNodes(FbxNode* pNode, std::vector<FbxNode*>& meshNodes)
 {
     if (!pNode)
         return;
 
-    static int meshNum = 0;
+    if (pNode->GetMesh())
+        meshNodes.push_back(pNode);
 
-    //std::random_device dev;
-    //std::mt19937 rng(dev());
-    //std::uniform_int_distribution<std::mt19937::result_type> dist6(0, 7); // distribution in range [0, 7]
+    for (int i = 0; i < pNode->GetChildCount(); i++)
+    {
+        CollectMeshNodes(pNode->GetChild(i), meshNodes);
+    }
+}
 
-    FbxMesh* mesh = pNode->GetMesh();
-    if (mesh)
+// Material slot of the node used by a polygon, or -1 if it has none.
+static int GetPolygonMaterialSlot(FbxGeometryElementMaterial* materialElement, int slotCount, int polygonIndex)
+{
+    int slot = -1;
+    if (materialElement)
     {
-        LOG("Mesh ", meshNum++);
+        if (materialElement->GetMappingMode() == FbxGeometryElement::eAllSame)
+            slot = materialElement->GetIndexArray().GetAt(0);
+        else if (materialElement->GetMappingMode() == FbxGeometryElement::eByPolygon)
+            slot = materialElement->GetIndexArray().GetAt(polygonIndex);
+    }
+    else if (slotCount > 0)
+    {
+        slot = 0;
+    }
 
-        // Extract vertex positions (control points)
-        int numControlPoints = mesh->GetControlPointsCount();
-        FbxVector4* controlPoints = mesh->GetControlPoints();
+    return (slot >= 0 && slot < slotCount) ? slot : -1;
+}
+
+void FBXReader::GetMeshData(FbxNode* pNode, std::vector<VertexTextured>& vertices, std::vector<MaterialBatch>& batches)
+{
+    static int meshNum = 0;
+
+    FbxMesh* mesh = pNode->GetMesh();
+    LOG("Mesh ", meshNum++);
+
+    // All temporary data of this mesh lives in the arena.
+    mArena.Reset();
+
+    // Extract vertex positions (control points)
+    int numControlPoints = mesh->GetControlPointsCount();
+    FbxVector4* controlPoints = mesh->GetControlPoints();
+    int numPolygons = mesh->GetPolygonCount();
+
+    // Node material slots, the last local slot is used by polygons without a material.
+    const int slotCount = pNode->GetMaterialCount();
+    const int defaultSlot = slotCount;
+    FbxGeometryElementMaterial* materialElement = mesh->GetElementMaterial();
 
-        // Each element keeps indices to the vertices array where this control point is used
-        std::vector< std::vector<int> > controlPointsCopies(numControlPoints);
-        for (auto& vec : controlPointsCopies)
+    // Counting pass: corners per control point and triangles per material slot
+    int* polygonSlots = mArena.AllocateArray<int>(numPolygons);
+    UINT* slotIndexCounts = mArena.AllocateArray<UINT>(slotCount + 1, 0);
+    VertexWelder welder;
+    welder.Begin(mArena, numControlPoints);
+    int maxPolygonSize = 0;
+
+    for (int polygonIndex = 0; polygonIndex < numPolygons; polygonIndex++)
+    {
+        int polygonSize = mesh->GetPolygonSize(polygonIndex);
+        for (int i = 0; i < polygonSize; i++)
         {
-            vec.reserve(10);
+            welder.CountCorner(mesh->GetPolygonVertex(polygonIndex, i));
         }
+        maxPolygonSize = (std::max)(maxPolygonSize, polygonSize);
 
-        std::vector<int> tempIndices;
-        tempIndices.reserve(8);
-        int indexByPolygonVertex = 0;
-        int numPolygons = mesh->GetPolygonCount();
+        int slot = GetPolygonMaterialSlot(materialElement, slotCount, polygonIndex);
+        polygonSlots[polygonIndex] = slot >= 0 ? slot : defaultSlot;
+        if (polygonSize >= 3)
+            slotIndexCounts[polygonSlots[polygonIndex]] += 3 * (polygonSize - 2);
+    }
+
+    welder.Finalize();
+
+    // Triangles of this mesh split by material slot
+    UINT* slotCursors = mArena.AllocateArray<UINT>(slotCount + 1);
+    UINT meshIndexCount = 0;
+    for (int slot = 0; slot <= slotCount; slot++)
+    {
+        slotCursors[slot] = meshIndexCount;
+        meshIndexCount += slotIndexCounts[slot];
+    }
+    UINT* meshIndices = mArena.AllocateArray<UINT>(meshIndexCount);
+
+    UINT* tempIndices = mArena.AllocateArray<UINT>(maxPolygonSize); // Indices for one polygon
+    int indexByPolygonVertex = 0;
 
-        for (int polygonIndex = 0; polygonIndex < numPolygons; polygonIndex++)
+    for (int polygonIndex = 0; polygonIndex < numPolygons; polygonIndex++)
+    {
+        int polygonSize = mesh->GetPolygonSize(polygonIndex);
+
+        for (int i = 0; i < polygonSize; i++)
         {
-            //LOG(" Polygon ", polygonIndex);
-            tempIndices.clear(); // Indices for this polygon
-            int polygonSize = mesh->GetPolygonSize(polygonIndex);
+            VertexTextured vertex;
+            int controlPointId = mesh->GetPolygonVertex(polygonIndex, i);
 
-            for (int i = 0; i < polygonSize; i++)
-            {
-                VertexTextured vertex;
-                int controlPointId = mesh->GetPolygonVertex(polygonIndex, i);
-
-                vertex.Pos.x = controlPoints[controlPointId][0];
-                vertex.Pos.y = controlPoints[controlPointId][1];
-                vertex.Pos.z = controlPoints[controlPointId][2];
-                
-                const FbxVector4& normal = GetNormal(mesh, controlPointId, indexByPolygonVertex);
-                //LOG("  Vertex ", controlPointId, " - Normal (", normal[0], ", ", normal[1], ", ", normal[2], ")");
-                vertex.Normal.x = static_cast<float>(normal[0]);
-                vertex.Normal.y = static_cast<float>(normal[1]);
-                vertex.Normal.z = static_cast<float>(normal[2]);
-
-                const FbxVector2& uv = GetUV(mesh, polygonIndex, i, controlPointId);
-                //LOG("  Vertex ", controlPointId + shift,
-                // " - Pos (", vertices[controlPointId + shift].Pos.x, ", ", vertices[controlPointId + shift].Pos.y, ", ", vertices[controlPointId + shift].Pos.z,
-                // ") - UV (", uv[0], ", ", uv[1], ")");
-                vertex.Tex.x = static_cast<float>(uv[0]);
-                vertex.Tex.y = static_cast<float>(uv[1]);
-
-                indexByPolygonVertex++;
-
-                // Check if this control point was already used for this combination of attributes
-                bool found = false;
-                const auto& pointCopies = controlPointsCopies[controlPointId];
-                if (!pointCopies.empty())
-                {
-                    for (int j = 0; j < pointCopies.size(); j++)
-                    {
-                        const VertexTextured& usedVertex = vertices[pointCopies[j]];
-                        if (usedVertex.Normal.x == vertex.Normal.x &&
-                            usedVertex.Normal.y == vertex.Normal.y &&
-                            usedVertex.Normal.z == vertex.Normal.z &&
-                            usedVertex.Tex.x == vertex.Tex.x &&
-                            usedVertex.Tex.y == vertex.Tex.y)
-                        {
-                            // Reuse existing vertex
-                            tempIndices.push_back(static_cast<UINT>(pointCopies[j]));
-                            found = true;
-                            break;
-                        }
-                    }
-                }
+            vertex.Pos.x = controlPoints[controlPointId][0];
+            vertex.Pos.y = controlPoints[controlPointId][1];
+            vertex.Pos.z = controlPoints[controlPointId][2];
+            
+            const FbxVector4& normal = GetNormal(mesh, controlPointId, indexByPolygonVertex);
+            vertex.Normal.x = static_cast<float>(normal[0]);
+            vertex.Normal.y = static_cast<float>(normal[1]);
+            vertex.Normal.z = static_cast<float>(normal[2]);
 
-                if (!found)
-                {
-                    // Create a new vertex
-                    vertices.push_back(vertex);
-                    UINT newIndex = static_cast<UINT>(vertices.size() - 1);
-                    tempIndices.push_back(newIndex);
-                    controlPointsCopies[controlPointId].push_back(newIndex + shift);
-                }
+            const FbxVector2& uv = GetUV(mesh, polygonIndex, i, controlPointId);
+            vertex.Tex.x = static_cast<float>(uv[0]);
+            vertex.Tex.y = static_cast<float>(uv[1]);
 
+            indexByPolygonVertex++;
 
-            }
+            // Reuse the vertex if this control point was already used with the same attributes,
+            // indices are absolute in the vertices array
+            tempIndices[i] = welder.Weld(controlPointId, vertex, vertices);
+        }
 
-            if (tempIndices.size() == 3)
-            {
-                indices.push_back(static_cast<UINT>(tempIndices[0] + shift));
-                indices.push_back(static_cast<UINT>(tempIndices[1] + shift));
-                indices.push_back(static_cast<UINT>(tempIndices[2] + shift));
-            }
-            else
-            {
-                // Split into triangles
-                for (int i = 2; i < tempIndices.size(); ++i)
-                {
-                    indices.push_back(static_cast<UINT>(tempIndices[0] + shift));
-                    indices.push_back(static_cast<UINT>(tempIndices[i - 1] + shift));
-                    indices.push_back(static_cast<UINT>(tempIndices[i] + shift));
-                }
-            }
+        // Split into triangles
+        UINT& cursor = slotCursors[polygonSlots[polygonIndex]];
+        for (int i = 2; i < polygonSize; ++i)
+        {
+            meshIndices[cursor++] = tempIndices[0];
+            meshIndices[cursor++] = tempIndices[i - 1];
+            meshIndices[cursor++] = tempIndices[i];
+        }
+    }
+
+    UINT slotStart = 0;
+    for (int slot = 0; slot <= slotCount; slot++)
+    {
+        UINT count = slotIndexCounts[slot];
+        if (count > 0)
+        {
+            UINT materialIndex = GetMaterialIndex(slot < slotCount ? pNode->GetMaterial(slot) : nullptr);
+            if (batches.size() <= materialIndex)
+                batches.resize(materialIndex + 1);
+
+            MaterialBatch& batch = batches[materialIndex];
+            SubMesh subMesh;
+            subMesh.StartIndex = static_cast<UINT>(batch.Indices.size());
+            subMesh.IndexCount = count;
+            subMesh.MaterialIndex = materialIndex;
+            batch.SubMeshes.push_back(subMesh);
+            batch.Indices.insert(batch.Indices.end(), meshIndices + slotStart, meshIndices + slotStart + count);
         }
+        slotStart += count;
     }
 
+    mImportArenaBytes += mArena.GetBytesAllocated();
+    mImportArenaAllocations += mArena.GetAllocationCount();
+
     LOG("vertices size = ", vertices.size());
-    for (int i =0 ; i < vertices.size(); i++)
+}
+
+void FBXReader::GetVertices(std::vector<VertexTextured>& vertices, std::vector<UINT>& indices)
+{
+    std::vector<SubMesh> subMeshes;
+    GetVertices(vertices, indices, subMeshes);
+}
+
+void FBXReader::GetVertices(std::vector<VertexTextured>& vertices, std::vector<UINT>& indices, std::vector<SubMesh>& subMeshes)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    mImportArenaBytes = 0;
+    mImportArenaAllocations = 0;
+
+    std::vector<FbxNode*> meshNodes;
+    CollectMeshNodes(mpRootNode, meshNodes);
+
+    // Counting pre-pass, so the output grows without reallocations. Every control point
+    // produces at least one vertex, seams and hard edges add more.
+    size_t controlPointCount = 0;
+    size_t indexCount = 0;
+    for (FbxNode* node : meshNodes)
     {
-        LOG(" Vertex ", i, ": Pos(", vertices[i].Pos.x, ", ", vertices[i].Pos.y, ", ", vertices[i].Pos.z,
-            ") Tex(", vertices[i].Tex.x, ", ", vertices[i].Tex.y, ")");
+        FbxMesh* mesh = node->GetMesh();
+        controlPointCount += mesh->GetControlPointsCount();
+        for (int i = 0; i < mesh->GetPolygonCount(); i++)
+        {
+            int polygonSize = mesh->GetPolygonSize(i);
+            if (polygonSize >= 3)
+                indexCount += 3 * (polygonSize - 2);
+        }
     }
+    vertices.reserve(vertices.size() + controlPointCount);
+    indices.reserve(indices.size() + indexCount);
 
-    int i, count = pNode->GetChildCount();
-    for (i = 0; i < count; i++)
+    std::vector<MaterialBatch> batches;
+    for (FbxNode* node : meshNodes)
     {
-        GetMeshData(pNode->GetChild(i), vertices.size(), vertices, indices);
+        GetMeshData(node, vertices, batches);
     }
+
+    // Concatenate the batches so that all ranges of a material are adjacent.
+    for (MaterialBatch& batch : batches)
+    {
+        UINT base = static_cast<UINT>(indices.size());
+        for (SubMesh subMesh : batch.SubMeshes)
+        {
+            subMesh.StartIndex += base;
+            subMeshes.push_back(subMesh);
+        }
+        indices.insert(indices.end(), batch.Indices.begin(), batch.Indices.end());
+    }
+
+    LOG("FBX import: ", meshNodes.size(), " meshes, ", vertices.size(), " vertices, ", indices.size(), " indices in ",
+        std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count(), " ms");
+    LOG("FBX import arena: ", mImportArenaBytes / 1024, " KB in ", mImportArenaAllocations, " allocations, peak ",
+        mArena.GetPeakBytes() / 1024, " KB, ", mArena.GetBlockCount(), " blocks (", mArena.GetReservedBytes() / 1024, " KB reserved)");
 }
 
-void FBXReader::GetVertices(std::vector<VertexTextured>& vertices, std::vector<UINT>& indices)
+void FBXReader::GetMaterials(std::vector<MaterialDesc>& materials)
 {
-    GetMeshData(mpRootNode, 0, vertices, indices);
-}
\ No newline at end of file
+    materials = mMaterials;
+}
@@ -0,0 +1,299 @@
+#include <FileWatcher.h>
+#include <LogWriter.h>
+
+#include <algorithm>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Longest wait for events, Stop takes effect within it.
+    const std::chrono::milliseconds kPollInterval(50);
+
+#ifdef _WIN32
+    const DWORD kBufferSize = 64 * 1024;
+    const DWORD kNotifyFilter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+#else
+    // Written and closed, or renamed into place: editors that save to a temporary file do the latter.
+    // Created for new subdirectories of recursive watches.
+    const uint32_t kEventMask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+#endif
+
+    std::filesystem::path MakeAbsolute(const std::filesystem::path& path)
+    {
+        std::error_code ec;
+        std::filesystem::path absolute = std::filesystem::weakly_canonical(std::filesystem::absolute(path, ec), ec);
+        return ec ? path : absolute;
+    }
+}
+
+FileWatcher::FileWatcher(std::chrono::milliseconds settleTime)
+    : mSettleTime(settleTime),
+    mbStopped(false)
+{
+#ifndef _WIN32
+    mInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (mInotify < 0)
+        LOG("File watcher: inotify is not available");
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef _WIN32
+    for (std::unique_ptr<Directory>& directory : mDirectories)
+    {
+        // The read has to be finished before its buffer goes away.
+        DWORD bytes = 0;
+        CancelIoEx(directory->Handle, &directory->Overlapped);
+        GetOverlappedResult(directory->Handle, &directory->Overlapped, &bytes, TRUE);
+        CloseHandle(directory->Overlapped.hEvent);
+        CloseHandle(directory->Handle);
+    }
+#else
+    if (mInotify >= 0)
+        close(mInotify);
+#endif
+}
+
+#ifdef _WIN32
+
+bool FileWatcher::Watch(const std::filesystem::path& directory, bool recursive)
+{
+    const std::filesystem::path path = MakeAbsolute(directory);
+    for (const std::unique_ptr<Directory>& watched : mDirectories)
+    {
+        std::error_code ec;
+        if (std::filesystem::equivalent(watched->Path, path, ec))
+            return true;
+    }
+
+    // One event per directory, WaitForMultipleObjects takes at most 64.
+    if (mDirectories.size() >= MAXIMUM_WAIT_OBJECTS)
+    {
+        LOG("File watcher: too many directories, ", path.string(), " is not watched");
+        return false;
+    }
+
+    HANDLE handle = CreateFileW(path.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        LOG("File watcher: cannot open ", path.string());
+        return false;
+    }
+
+    auto watched = std::make_unique<Directory>();
+    watched->Path = path;
+    watched->Handle = handle;
+    ZeroMemory(&watched->Overlapped, sizeof(OVERLAPPED));
+    watched->Overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    watched->Recursive = recursive;
+    watched->Buffer.reset(new DWORD[kBufferSize / sizeof(DWORD)]);
+    if (!BeginRead(*watched))
+    {
+        CloseHandle(watched->Overlapped.hEvent);
+        CloseHandle(handle);
+        LOG("File watcher: cannot watch ", path.string());
+        return false;
+    }
+
+    mDirectories.push_back(std::move(watched));
+    return true;
+}
+
+bool FileWatcher::BeginRead(Directory& directory)
+{
+    ResetEvent(directory.Overlapped.hEvent);
+    return ReadDirectoryChangesW(directory.Handle, directory.Buffer.get(), kBufferSize, directory.Recursive ? TRUE : FALSE,
+        kNotifyFilter, nullptr, &directory.Overlapped, nullptr) != FALSE;
+}
+
+void FileWatcher::ReadEvents(std::chrono::milliseconds timeout)
+{
+    if (mDirectories.empty())
+    {
+        Sleep(static_cast<DWORD>(timeout.count()));
+        return;
+    }
+
+    HANDLE events[MAXIMUM_WAIT_OBJECTS];
+    for (size_t i = 0; i < mDirectories.size(); i++)
+        events[i] = mDirectories[i]->Overlapped.hEvent;
+
+    DWORD result = WaitForMultipleObjects(static_cast<DWORD>(mDirectories.size()), events, FALSE, static_cast<DWORD>(timeout.count()));
+    if (result < WAIT_OBJECT_0 || result >= WAIT_OBJECT_0 + mDirectories.size())
+        return;
+
+    Directory& directory = *mDirectories[result - WAIT_OBJECT_0];
+    DWORD bytes = 0;
+    if (GetOverlappedResult(directory.Handle, &directory.Overlapped, &bytes, FALSE))
+    {
+        // No bytes means the buffer overflowed and the changes are lost.
+        if (bytes == 0)
+            LOG("File watcher: too many changes in ", directory.Path.string(), ", some were missed");
+
+        const BYTE* record = reinterpret_cast<const BYTE*>(directory.Buffer.get());
+        while (bytes != 0)
+        {
+            const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(record);
+            if (info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+                AddEvent(directory.Path / std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR)));
+
+            if (info->NextEntryOffset == 0)
+                break;
+            record += info->NextEntryOffset;
+        }
+    }
+
+    if (!BeginRead(directory))
+        LOG("File watcher: stopped watching ", directory.Path.string());
+}
+
+#else
+
+bool FileWatcher::Watch(const std::filesystem::path& directory, bool recursive)
+{
+    if (mInotify < 0)
+        return false;
+
+    return AddWatches(MakeAbsolute(directory), recursive, false);
+}
+
+bool FileWatcher::AddWatches(const std::filesystem::path& directory, bool recursive, bool reportFiles)
+{
+    std::vector<std::filesystem::path> paths = { directory };
+    std::error_code ec;
+    if (recursive)
+    {
+        for (auto it = std::filesystem::recursive_directory_iterator(paths[0], std::filesystem::directory_options::skip_permission_denied, ec);
+             !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+        {
+            if (it->is_directory(ec))
+                paths.push_back(it->path());
+        }
+    }
+
+    // A directory that is already watched gets its existing descriptor back.
+    for (const std::filesystem::path& path : paths)
+    {
+        int descriptor = inotify_add_watch(mInotify, path.c_str(), kEventMask);
+        if (descriptor < 0)
+        {
+            LOG("File watcher: cannot watch ", path.string());
+            return false;
+        }
+        auto inserted = mDirectories.emplace(descriptor, Directory{ path, recursive });
+        inserted.first->second.Recursive = inserted.first->second.Recursive || recursive;
+    }
+
+    // Files written between the creation of a directory and its watch have no event
+    if (reportFiles)
+    {
+        for (const std::filesystem::path& path : paths)
+        {
+            for (std::filesystem::directory_iterator it(path, ec), end; !ec && it != end; it.increment(ec))
+            {
+                if (it->is_regular_file(ec))
+                    AddEvent(it->path());
+            }
+        }
+    }
+    return true;
+}
+
+void FileWatcher::ReadEvents(std::chrono::milliseconds timeout)
+{
+    if (mInotify < 0)
+    {
+        usleep(static_cast<useconds_t>(timeout.count() * 1000));
+        return;
+    }
+
+    pollfd descriptor = { mInotify, POLLIN, 0 };
+    if (poll(&descriptor, 1, static_cast<int>(timeout.count())) <= 0)
+        return;
+
+    alignas(inotify_event) char buffer[16 * 1024];
+    for (;;)
+    {
+        ssize_t bytes = read(mInotify, buffer, sizeof(buffer));
+        if (bytes <= 0)
+            break;
+
+        for (const char* record = buffer; record < buffer + bytes;)
+        {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(record);
+            if (event->mask & IN_Q_OVERFLOW)
+                LOG("File watcher: too many changes, some were missed");
+
+            auto directory = mDirectories.find(event->wd);
+            if (event->len > 0 && directory != mDirectories.end())
+            {
+                const std::filesystem::path path = directory->second.Path / event->name;
+                if (event->mask & IN_ISDIR)
+                {
+                    // Created or moved in, with whatever it already contains
+                    if (directory->second.Recursive)
+                        AddWatches(path, true, true);
+                }
+                else if (!(event->mask & IN_CREATE))
+                {
+                    AddEvent(path);
+                }
+            }
+            // The directory was removed, its descriptor may be reused
+            if (event->mask & IN_IGNORED)
+                mDirectories.erase(event->wd);
+
+            record += sizeof(inotify_event) + event->len;
+        }
+    }
+}
+
+#endif
+
+void FileWatcher::AddEvent(const std::filesystem::path& file)
+{
+    auto now = std::chrono::steady_clock::now();
+    auto inserted = mChanged.emplace(file, PendingChange{ now, now });
+    if (!inserted.second)
+        inserted.first->second.LastSeen = now;
+}
+
+bool FileWatcher::WaitForChanges(std::vector<Change>& changes)
+{
+    changes.clear();
+    while (!mbStopped.load(std::memory_order_acquire))
+    {
+        // Files removed again, or directories, are dropped.
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = mChanged.begin(); it != mChanged.end();)
+        {
+            if (now - it->second.LastSeen < mSettleTime)
+            {
+                ++it;
+                continue;
+            }
+
+            std::error_code ec;
+            if (std::filesystem::is_regular_file(it->first, ec))
+                changes.push_back(Change{ it->first, it->second.FirstSeen });
+            it = mChanged.erase(it);
+        }
+        if (!changes.empty())
+            return true;
+
+        ReadEvents(mChanged.empty() ? kPollInterval : (std::min)(kPollInterval, mSettleTime));
+    }
+    return false;
+}
+
+void FileWatcher::Stop()
+{
+    mbStopped.store(true, std::memory_order_release);
+}
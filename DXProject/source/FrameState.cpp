@@ -0,0 +1,62 @@
+#include <FrameState.h>
+
+FrameStateExchange::FrameStateExchange(unsigned framesInFlight)
+    : mWritten(0),
+    mRead(0),
+    mFramesInFlight(framesInFlight),
+    mbStopped(false)
+{
+}
+
+void FrameStateExchange::SetFramesInFlight(unsigned framesInFlight)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mFramesInFlight = framesInFlight < 1 ? 1 : (framesInFlight > 2 ? 2 : framesInFlight);
+}
+
+FrameState* FrameStateExchange::BeginWrite()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mChanged.wait(lock, [&]() { return mbStopped || mWritten - mRead < mFramesInFlight; });
+    return mbStopped ? nullptr : &mStates[mWritten & 1];
+}
+
+bool FrameStateExchange::CanWrite()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mbStopped || mWritten - mRead < mFramesInFlight;
+}
+
+void FrameStateExchange::EndWrite()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mWritten++;
+    }
+    mChanged.notify_all();
+}
+
+const FrameState* FrameStateExchange::BeginRead()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mChanged.wait(lock, [&]() { return mbStopped || mRead < mWritten; });
+    return mbStopped ? nullptr : &mStates[mRead & 1];
+}
+
+void FrameStateExchange::EndRead()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRead++;
+    }
+    mChanged.notify_all();
+}
+
+void FrameStateExchange::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mbStopped = true;
+    }
+    mChanged.notify_all();
+}
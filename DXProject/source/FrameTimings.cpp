@@ -0,0 +1,80 @@
+#include <FrameTimings.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+
+size_t FrameTimings::AddColumn(const std::string& name)
+{
+    mColumns.push_back(Column{ name, {} });
+    return mColumns.size() - 1;
+}
+
+void FrameTimings::Reserve(size_t frames)
+{
+    for (Column& column : mColumns)
+        column.Samples.reserve(frames);
+}
+
+void FrameTimings::Add(size_t column, double value)
+{
+    mColumns[column].Samples.push_back(value);
+}
+
+std::string FrameTimings::Report() const
+{
+    size_t nameWidth = 6;
+    for (const Column& column : mColumns)
+        nameWidth = (std::max)(nameWidth, column.Name.size());
+
+    char line[256];
+    snprintf(line, sizeof(line), "%-*s  %7s  %10s  %10s  %10s  %10s\n", static_cast<int>(nameWidth), "timing", "frames", "mean", "median", "p95", "max");
+    std::string report = line;
+    for (const Column& column : mColumns)
+    {
+        std::vector<double> sorted = column.Samples;
+        std::sort(sorted.begin(), sorted.end());
+        double mean = 0.0, median = 0.0, p95 = 0.0, max = 0.0;
+        if (!sorted.empty())
+        {
+            mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+            median = sorted[sorted.size() / 2];
+            p95 = sorted[(sorted.size() * 95) / 100];
+            max = sorted.back();
+        }
+        snprintf(line, sizeof(line), "%-*s  %7zu  %10.4f  %10.4f  %10.4f  %10.4f\n", static_cast<int>(nameWidth), column.Name.c_str(),
+            sorted.size(), mean, median, p95, max);
+        report += line;
+    }
+    return report;
+}
+
+bool FrameTimings::WriteCsv(const std::string& file) const
+{
+    std::ofstream out(file);
+    if (!out)
+        return false;
+
+    size_t frames = 0;
+    for (size_t i = 0; i < mColumns.size(); i++)
+    {
+        out << (i ? "," : "") << mColumns[i].Name;
+        frames = (std::max)(frames, mColumns[i].Samples.size());
+    }
+    out << '\n';
+
+    // Columns without a sample for a frame are left empty.
+    for (size_t frame = 0; frame < frames; frame++)
+    {
+        for (size_t i = 0; i < mColumns.size(); i++)
+        {
+            if (i)
+                out << ',';
+            if (frame < mColumns[i].Samples.size())
+                out << mColumns[i].Samples[frame];
+        }
+        out << '\n';
+    }
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,232 @@
+#include <GeometryPool.h>
+#include <MemoryTracker.h>
+#include <Utils.h>
+
+#include <algorithm>
+
+GeometryPool::GeometryPool()
+    : mMeshCount(0),
+    mGrows(0),
+    mDefragments(0),
+    mUploadedBytes(0)
+{
+}
+
+void GeometryPool::Init(ComPtr<ID3D11Device> device, ComPtr<ID3D11DeviceContext> context, const std::vector<UINT>& streamStrides,
+    UINT vertexCapacity, UINT indexCapacity)
+{
+    mDevice = device;
+    mContext = context;
+    mStreams.clear();
+    for (UINT stride : streamStrides)
+        mStreams.push_back(Stream{ stride, CreateBuffer(stride * vertexCapacity, D3D11_BIND_VERTEX_BUFFER) });
+    mIndexBuffer = CreateBuffer(sizeof(UINT) * indexCapacity, D3D11_BIND_INDEX_BUFFER);
+
+    mVertexAllocator = RangeAllocator(vertexCapacity);
+    mIndexAllocator = RangeAllocator(indexCapacity);
+    mRanges.clear();
+    mFreeHandles.clear();
+    mMeshCount = 0;
+}
+
+GeometryPool::Handle GeometryPool::Add(const void* const* streams, UINT vertexCount, const UINT* indices, UINT indexCount)
+{
+    if (vertexCount == 0 || indexCount == 0 || !Reserve(vertexCount, indexCount))
+        return kInvalidHandle;
+
+    Range range;
+    range.BaseVertex = mVertexAllocator.Allocate(vertexCount);
+    range.VertexCount = vertexCount;
+    range.StartIndex = mIndexAllocator.Allocate(indexCount);
+    range.IndexCount = indexCount;
+
+    for (size_t i = 0; i < mStreams.size(); i++)
+    {
+        if (streams[i])
+            Upload(mStreams[i].Buffer.Get(), streams[i], range.BaseVertex * mStreams[i].Stride, vertexCount * mStreams[i].Stride);
+    }
+    Upload(mIndexBuffer.Get(), indices, range.StartIndex * sizeof(UINT), indexCount * sizeof(UINT));
+
+    Handle handle;
+    if (!mFreeHandles.empty())
+    {
+        handle = mFreeHandles.back();
+        mFreeHandles.pop_back();
+        mRanges[handle - 1] = range;
+    }
+    else
+    {
+        mRanges.push_back(range);
+        handle = static_cast<Handle>(mRanges.size());
+    }
+    mMeshCount++;
+    return handle;
+}
+
+void GeometryPool::Remove(Handle handle)
+{
+    if (handle == kInvalidHandle)
+        return;
+
+    // D3D11 orders the copies into a freed range after the draws still reading it.
+    Range& range = mRanges[handle - 1];
+    mVertexAllocator.Free(range.BaseVertex);
+    mIndexAllocator.Free(range.StartIndex);
+    range.VertexCount = 0;
+    mFreeHandles.push_back(handle);
+    mMeshCount--;
+}
+
+void GeometryPool::Defragment()
+{
+    std::vector<RangeAllocator::Move> vertexMoves = mVertexAllocator.Compact();
+    std::vector<RangeAllocator::Move> indexMoves = mIndexAllocator.Compact();
+    if (vertexMoves.empty() && indexMoves.empty())
+        return;
+
+    Rebuild(mVertexAllocator.GetCapacity(), mIndexAllocator.GetCapacity(), vertexMoves, indexMoves);
+    mDefragments++;
+}
+
+void GeometryPool::Bind(StateCache& stateCache) const
+{
+    for (size_t i = 0; i < mStreams.size(); i++)
+        stateCache.SetVertexBuffer(static_cast<UINT>(i), mStreams[i].Buffer.Get(), mStreams[i].Stride, 0);
+    stateCache.SetIndexBuffer(mIndexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+}
+
+GeometryPool::Stats GeometryPool::GetStats() const
+{
+    Stats stats;
+    stats.Meshes = mMeshCount;
+    stats.Buffers = static_cast<UINT>(mStreams.size()) + 1;
+    stats.BuffersWithoutPool = mMeshCount * stats.Buffers;
+    stats.BindsPerMeshSwitch = stats.Buffers;
+    stats.Grows = mGrows;
+    stats.Defragments = mDefragments;
+    stats.UploadedBytes = mUploadedBytes;
+    stats.Vertices = mVertexAllocator.GetStats();
+    stats.Indices = mIndexAllocator.GetStats();
+    return stats;
+}
+
+void GeometryPool::LogStats() const
+{
+    const Stats stats = GetStats();
+    LOG("Geometry pool: ", stats.Meshes, " meshes in ", stats.Buffers, " buffers (", stats.BuffersWithoutPool, " without the pool), ",
+        stats.Vertices.Used, "/", stats.Vertices.Capacity, " vertices, ", stats.Indices.Used, "/", stats.Indices.Capacity, " indices, ",
+        "fragmentation ", stats.Vertices.Fragmentation * 100.0f, "% vertices, ", stats.Indices.Fragmentation * 100.0f, "% indices, ",
+        stats.Grows, " grows, ", stats.Defragments, " defragments, ", stats.UploadedBytes / 1024, " KB uploaded");
+}
+
+ComPtr<ID3D11Buffer> GeometryPool::CreateBuffer(UINT byteWidth, UINT bindFlags) const
+{
+    D3D11_BUFFER_DESC desc;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.ByteWidth = (std::max)(byteWidth, 16u);
+    desc.BindFlags = bindFlags;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+    desc.StructureByteStride = 0;
+
+    ComPtr<ID3D11Buffer> buffer;
+    HR(mDevice->CreateBuffer(&desc, nullptr, buffer.GetAddressOf()));
+    MemoryTracker::TrackGpuResource(buffer.Get(), MemoryTag::GpuBuffers);
+    return buffer;
+}
+
+bool GeometryPool::Reserve(UINT vertexCount, UINT indexCount)
+{
+    const RangeAllocator::Stats vertices = mVertexAllocator.GetStats();
+    const RangeAllocator::Stats indices = mIndexAllocator.GetStats();
+    if (vertices.LargestFree >= vertexCount && indices.LargestFree >= indexCount)
+        return true;
+
+    // Enough space in pieces: packing the meshes leaves it in one range
+    if (mVertexAllocator.GetFreeSize() >= vertexCount && mIndexAllocator.GetFreeSize() >= indexCount)
+    {
+        Defragment();
+        return true;
+    }
+
+    uint64_t vertexCapacity = vertices.Capacity;
+    while (vertexCapacity - vertices.Used < vertexCount)
+        vertexCapacity = (std::max)(vertexCapacity * 2, uint64_t(1024));
+    uint64_t indexCapacity = indices.Capacity;
+    while (indexCapacity - indices.Used < indexCount)
+        indexCapacity = (std::max)(indexCapacity * 2, uint64_t(1024));
+
+    // Buffer sizes are 32-bit byte counts
+    uint64_t largestStride = sizeof(UINT);
+    for (const Stream& stream : mStreams)
+        largestStride = (std::max)(largestStride, uint64_t(stream.Stride));
+    if ((std::max)(vertexCapacity, indexCapacity) * largestStride > UINT32_MAX)
+        return false;
+
+    // Growing packs the meshes at the same time
+    std::vector<RangeAllocator::Move> vertexMoves = mVertexAllocator.Compact();
+    std::vector<RangeAllocator::Move> indexMoves = mIndexAllocator.Compact();
+    mVertexAllocator.Grow(static_cast<uint32_t>(vertexCapacity));
+    mIndexAllocator.Grow(static_cast<uint32_t>(indexCapacity));
+    Rebuild(static_cast<UINT>(vertexCapacity), static_cast<UINT>(indexCapacity), vertexMoves, indexMoves);
+    mGrows++;
+    return true;
+}
+
+void GeometryPool::Rebuild(UINT vertexCapacity, UINT indexCapacity, const std::vector<RangeAllocator::Move>& vertexMoves,
+    const std::vector<RangeAllocator::Move>& indexMoves)
+{
+    // Compact left every range in order at the front, so whatever did not move is copied
+    // as one block: from 0 to the first move, or everything without moves.
+    auto copyRanges = [this](ID3D11Buffer* dest, ID3D11Buffer* source, UINT stride, UINT used,
+        const std::vector<RangeAllocator::Move>& moves)
+    {
+        const UINT unmoved = moves.empty() ? used : moves.front().To;
+        D3D11_BOX box = { 0, 0, 0, 0, 1, 1 };
+        if (unmoved > 0)
+        {
+            box.right = unmoved * stride;
+            mContext->CopySubresourceRegion(dest, 0, 0, 0, 0, source, 0, &box);
+        }
+        for (const RangeAllocator::Move& move : moves)
+        {
+            box.left = move.From * stride;
+            box.right = (move.From + move.Size) * stride;
+            mContext->CopySubresourceRegion(dest, 0, move.To * stride, 0, 0, source, 0, &box);
+        }
+    };
+
+    const UINT usedVertices = mVertexAllocator.GetCapacity() - mVertexAllocator.GetFreeSize();
+    for (Stream& stream : mStreams)
+    {
+        ComPtr<ID3D11Buffer> buffer = CreateBuffer(stream.Stride * vertexCapacity, D3D11_BIND_VERTEX_BUFFER);
+        copyRanges(buffer.Get(), stream.Buffer.Get(), stream.Stride, usedVertices, vertexMoves);
+        stream.Buffer.Swap(buffer);
+    }
+    ComPtr<ID3D11Buffer> indexBuffer = CreateBuffer(sizeof(UINT) * indexCapacity, D3D11_BIND_INDEX_BUFFER);
+    const UINT usedIndices = mIndexAllocator.GetCapacity() - mIndexAllocator.GetFreeSize();
+    copyRanges(indexBuffer.Get(), mIndexBuffer.Get(), sizeof(UINT), usedIndices, indexMoves);
+    mIndexBuffer.Swap(indexBuffer);
+
+    // The handles keep their slots, only the offsets change.
+    auto remap = [](UINT offset, const std::vector<RangeAllocator::Move>& moves)
+    {
+        auto move = std::lower_bound(moves.begin(), moves.end(), offset,
+            [](const RangeAllocator::Move& m, UINT value) { return m.From < value; });
+        return move != moves.end() && move->From == offset ? move->To : offset;
+    };
+    for (Range& range : mRanges)
+    {
+        if (range.VertexCount == 0)
+            continue;
+        range.BaseVertex = remap(range.BaseVertex, vertexMoves);
+        range.StartIndex = remap(range.StartIndex, indexMoves);
+    }
+}
+
+void GeometryPool::Upload(ID3D11Buffer* buffer, const void* data, UINT offsetBytes, UINT sizeBytes)
+{
+    D3D11_BOX box = { offsetBytes, 0, 0, offsetBytes + sizeBytes, 1, 1 };
+    mContext->UpdateSubresource(buffer, 0, &box, data, 0, 0);
+    mUploadedBytes += sizeBytes;
+}
@@ -0,0 +1,433 @@
+#include <Inflate.h>
+
+#include <cstring>
+
+namespace
+{
+    const int kMaxCodeBits = 15;
+    // Codes up to this length are decoded with a single table lookup.
+    const int kFastBits = 10;
+
+    const uint16_t kLengthBase[29] =
+    {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    const uint8_t kLengthExtra[29] =
+    {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+    const uint16_t kDistanceBase[30] =
+    {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+    };
+    const uint8_t kDistanceExtra[30] =
+    {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+    const uint8_t kCodeLengthOrder[19] =
+    {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+    };
+
+    // Little-endian bit buffer. Reads past the end of the input return zeros and
+    // are counted, so a truncated stream is detected once decoding finishes.
+    class BitReader
+    {
+    public:
+        BitReader(const uint8_t* src, size_t size)
+            : mpNext(src),
+            mpEnd(src + size),
+            mBits(0),
+            mCount(0),
+            mOverrun(0)
+        {
+        }
+
+        // Guarantees at least 56 buffered bits.
+        void Refill()
+        {
+            if (mpEnd - mpNext >= 8)
+            {
+                uint64_t word;
+                memcpy(&word, mpNext, sizeof(word));
+                mBits |= word << mCount;
+                mpNext += (63 - mCount) >> 3;
+                mCount |= 56;
+                return;
+            }
+
+            while (mCount <= 56)
+            {
+                uint64_t byte = 0;
+                if (mpNext < mpEnd)
+                    byte = *mpNext++;
+                else
+                    mOverrun++;
+                mBits |= byte << mCount;
+                mCount += 8;
+            }
+        }
+
+        uint32_t Peek(int count) const { return static_cast<uint32_t>(mBits & ((uint64_t(1) << count) - 1)); }
+
+        void Consume(int count)
+        {
+            mBits >>= count;
+            mCount -= count;
+        }
+
+        uint32_t Read(int count)
+        {
+            uint32_t value = Peek(count);
+            Consume(count);
+            return value;
+        }
+
+        // Drops the bits up to the next byte boundary and hands the remaining
+        // buffered bytes back to the input, for stored blocks.
+        void AlignToByte()
+        {
+            Consume(mCount & 7);
+            size_t bytes = mCount >> 3;
+            size_t padding = bytes < mOverrun ? bytes : mOverrun;
+            mOverrun -= padding;
+            mpNext -= bytes - padding;
+            mBits = 0;
+            mCount = 0;
+        }
+
+        const uint8_t* Position() const { return mpNext; }
+        size_t Remaining() const { return mpEnd - mpNext; }
+        void Skip(size_t bytes) { mpNext += bytes; }
+
+        bool Overrun() const { return mOverrun * 8 > static_cast<size_t>(mCount); }
+
+    private:
+        const uint8_t* mpNext;
+        const uint8_t* mpEnd;
+        uint64_t mBits;
+        int mCount;
+        size_t mOverrun;
+    };
+
+    // Canonical Huffman decoder
+    struct Huffman
+    {
+        uint16_t Fast[1 << kFastBits]; // symbol << 4 | code length, 0 for longer codes
+        uint16_t Counts[kMaxCodeBits + 1];
+        uint16_t Symbols[288];
+
+        bool Build(const uint8_t* lengths, int count)
+        {
+            memset(Counts, 0, sizeof(Counts));
+            for (int i = 0; i < count; i++)
+                Counts[lengths[i]]++;
+            Counts[0] = 0;
+
+            // Over-subscribed sets are invalid, incomplete ones are allowed (single distance code).
+            int left = 1;
+            for (int len = 1; len <= kMaxCodeBits; len++)
+            {
+                left = (left << 1) - Counts[len];
+                if (left < 0)
+                    return false;
+            }
+
+            uint16_t offsets[kMaxCodeBits + 2];
+            offsets[1] = 0;
+            for (int len = 1; len <= kMaxCodeBits; len++)
+                offsets[len + 1] = offsets[len] + Counts[len];
+            for (int symbol = 0; symbol < count; symbol++)
+            {
+                if (lengths[symbol])
+                    Symbols[offsets[lengths[symbol]]++] = static_cast<uint16_t>(symbol);
+            }
+
+            // Deflate sends codes starting from the most significant bit,
+            // so the table is indexed by the bit-reversed code.
+            memset(Fast, 0, sizeof(Fast));
+            uint32_t code = 0;
+            int symbolIndex = 0;
+            for (int len = 1; len <= kFastBits; len++)
+            {
+                for (int i = 0; i < Counts[len]; i++, code++)
+                {
+                    uint32_t reversed = 0;
+                    for (int bit = 0; bit < len; bit++)
+                        reversed |= ((code >> bit) & 1) << (len - 1 - bit);
+
+                    uint16_t entry = static_cast<uint16_t>((Symbols[symbolIndex++] << 4) | len);
+                    for (uint32_t j = reversed; j < (1u << kFastBits); j += 1u << len)
+                        Fast[j] = entry;
+                }
+                code <<= 1;
+            }
+            return true;
+        }
+
+        // Needs kMaxCodeBits buffered bits. Returns -1 for an invalid code.
+        int Decode(BitReader& reader) const
+        {
+            uint16_t entry = Fast[reader.Peek(kFastBits)];
+            if (entry)
+            {
+                reader.Consume(entry & 15);
+                return entry >> 4;
+            }
+
+            uint32_t bits = reader.Peek(kMaxCodeBits);
+            int code = 0;
+            int first = 0;
+            int index = 0;
+            for (int len = 1; len <= kMaxCodeBits; len++)
+            {
+                code |= (bits >> (len - 1)) & 1;
+                int count = Counts[len];
+                if (code - first < count)
+                {
+                    reader.Consume(len);
+                    return Symbols[index + code - first];
+                }
+                index += count;
+                first = (first + count) << 1;
+                code <<= 1;
+            }
+            return -1;
+        }
+    };
+
+    struct FixedTables
+    {
+        Huffman Literals;
+        Huffman Distances;
+
+        FixedTables()
+        {
+            uint8_t lengths[288];
+            for (int i = 0; i < 144; i++) lengths[i] = 8;
+            for (int i = 144; i < 256; i++) lengths[i] = 9;
+            for (int i = 256; i < 280; i++) lengths[i] = 7;
+            for (int i = 280; i < 288; i++) lengths[i] = 8;
+            Literals.Build(lengths, 288);
+
+            for (int i = 0; i < 30; i++) lengths[i] = 5;
+            Distances.Build(lengths, 30);
+        }
+    };
+
+    bool ReadDynamicTables(BitReader& reader, Huffman& literals, Huffman& distances)
+    {
+        reader.Refill();
+        int literalCount = reader.Read(5) + 257;
+        int distanceCount = reader.Read(5) + 1;
+        int codeLengthCount = reader.Read(4) + 4;
+        if (literalCount > 286 || distanceCount > 30)
+            return false;
+
+        uint8_t lengths[286 + 30] = {};
+        for (int i = 0; i < codeLengthCount; i++)
+        {
+            reader.Refill();
+            lengths[kCodeLengthOrder[i]] = static_cast<uint8_t>(reader.Read(3));
+        }
+
+        Huffman codeLengths;
+        if (!codeLengths.Build(lengths, 19))
+            return false;
+
+        memset(lengths, 0, 19);
+        int total = literalCount + distanceCount;
+        for (int i = 0; i < total;)
+        {
+            reader.Refill();
+            int symbol = codeLengths.Decode(reader);
+            if (symbol < 0)
+                return false;
+
+            if (symbol < 16)
+            {
+                lengths[i++] = static_cast<uint8_t>(symbol);
+                continue;
+            }
+
+            uint8_t value = 0;
+            int repeat;
+            if (symbol == 16)
+            {
+                if (i == 0)
+                    return false;
+                value = lengths[i - 1];
+                repeat = 3 + reader.Read(2);
+            }
+            else if (symbol == 17)
+            {
+                repeat = 3 + reader.Read(3);
+            }
+            else
+            {
+                repeat = 11 + reader.Read(7);
+            }
+
+            if (i + repeat > total)
+                return false;
+            while (repeat--)
+                lengths[i++] = value;
+        }
+
+        // A block without an end-of-block code can not be terminated.
+        if (lengths[256] == 0)
+            return false;
+
+        return literals.Build(lengths, literalCount) && distances.Build(lengths + literalCount, distanceCount);
+    }
+
+    bool InflateBlock(BitReader& reader, const Huffman& literals, const Huffman& distances,
+        uint8_t* dest, uint8_t*& out, uint8_t* outEnd)
+    {
+        for (;;)
+        {
+            // One refill covers the longest literal/length + distance sequence (48 bits).
+            reader.Refill();
+            int symbol = literals.Decode(reader);
+            if (symbol < 256)
+            {
+                if (symbol < 0 || out == outEnd)
+                    return false;
+                *out++ = static_cast<uint8_t>(symbol);
+                continue;
+            }
+
+            if (symbol == 256)
+                return true;
+
+            symbol -= 257;
+            if (symbol >= 29)
+                return false;
+            size_t length = kLengthBase[symbol] + reader.Read(kLengthExtra[symbol]);
+
+            int distanceSymbol = distances.Decode(reader);
+            if (distanceSymbol < 0 || distanceSymbol >= 30)
+                return false;
+            size_t distance = kDistanceBase[distanceSymbol] + reader.Read(kDistanceExtra[distanceSymbol]);
+
+            if (distance > static_cast<size_t>(out - dest) || length > static_cast<size_t>(outEnd - out))
+                return false;
+
+            const uint8_t* from = out - distance;
+            if (distance >= 8 && outEnd - out >= static_cast<ptrdiff_t>(length + 8))
+            {
+                // Non-overlapping 8-byte chunks, may write up to 7 bytes past the match.
+                uint8_t* copyEnd = out + length;
+                while (out < copyEnd)
+                {
+                    memcpy(out, from, 8);
+                    out += 8;
+                    from += 8;
+                }
+                out = copyEnd;
+            }
+            else
+            {
+                while (length--)
+                    *out++ = *from++;
+            }
+        }
+    }
+}
+
+bool Inflate::Raw(const uint8_t* src, size_t srcSize, uint8_t* dest, size_t destSize)
+{
+    static const FixedTables fixedTables;
+
+    BitReader reader(src, srcSize);
+    uint8_t* out = dest;
+    uint8_t* outEnd = dest + destSize;
+
+    Huffman literals;
+    Huffman distances;
+
+    bool last = false;
+    while (!last)
+    {
+        reader.Refill();
+        last = reader.Read(1) != 0;
+        uint32_t type = reader.Read(2);
+
+        if (type == 0)
+        {
+            reader.AlignToByte();
+            if (reader.Remaining() < 4)
+                return false;
+
+            const uint8_t* header = reader.Position();
+            size_t length = header[0] | (header[1] << 8);
+            size_t lengthComplement = header[2] | (header[3] << 8);
+            reader.Skip(4);
+            if ((length ^ 0xFFFF) != lengthComplement ||
+                length > reader.Remaining() || length > static_cast<size_t>(outEnd - out))
+                return false;
+
+            memcpy(out, reader.Position(), length);
+            reader.Skip(length);
+            out += length;
+        }
+        else if (type == 1)
+        {
+            if (!InflateBlock(reader, fixedTables.Literals, fixedTables.Distances, dest, out, outEnd))
+                return false;
+        }
+        else if (type == 2)
+        {
+            if (!ReadDynamicTables(reader, literals, distances) ||
+                !InflateBlock(reader, literals, distances, dest, out, outEnd))
+                return false;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return out == outEnd && !reader.Overrun();
+}
+
+bool Inflate::Zlib(const uint8_t* src, size_t srcSize, uint8_t* dest, size_t destSize)
+{
+    // CMF/FLG header: deflate method, no preset dictionary, header checksum
+    if (srcSize < 6 || (src[0] & 15) != 8 || (src[1] & 0x20) || ((src[0] << 8) | src[1]) % 31 != 0)
+        return false;
+
+    if (!Raw(src + 2, srcSize - 6, dest, destSize))
+        return false;
+
+    const uint8_t* trailer = src + srcSize - 4;
+    uint32_t checksum = (uint32_t(trailer[0]) << 24) | (trailer[1] << 16) | (trailer[2] << 8) | trailer[3];
+    return checksum == Adler32(dest, destSize);
+}
+
+uint32_t Inflate::Adler32(const uint8_t* data, size_t size)
+{
+    const uint32_t kModulus = 65521;
+    // Largest block that can be summed without overflowing 32 bits
+    const size_t kBlock = 5552;
+
+    uint32_t a = 1;
+    uint32_t b = 0;
+    while (size > 0)
+    {
+        size_t block = size < kBlock ? size : kBlock;
+        size -= block;
+        while (block--)
+        {
+            a += *data++;
+            b += a;
+        }
+        a %= kModulus;
+        b %= kModulus;
+    }
+    return (b << 16) | a;
+}
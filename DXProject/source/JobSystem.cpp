@@ -0,0 +1,355 @@
+#include <JobSystem.h>
+
+#include <algorithm>
+#include <memory>
+
+namespace
+{
+    // Rounds of looking for work before an idle worker sleeps
+    const int kSpinCount = 64;
+
+    std::atomic<unsigned> gDefaultThreadCount(0);
+
+    // Worker index of this thread in the system it belongs to, if any
+    struct ThreadContext
+    {
+        const JobSystem* pSystem = nullptr;
+        int Worker = -1;
+    };
+    thread_local ThreadContext tContext;
+    // Job running on this thread, the parent of jobs it starts
+    thread_local void* tpCurrentJob = nullptr;
+
+    JobSystem::CaptureContextFunc gCaptureContext = nullptr;
+    JobSystem::ApplyContextFunc gApplyContext = nullptr;
+}
+
+JobSystem::WorkDeque::WorkDeque()
+    : mTop(0),
+    mBottom(0)
+{
+    for (auto& job : mJobs)
+        job.store(nullptr, std::memory_order_relaxed);
+}
+
+bool JobSystem::WorkDeque::Push(Job* job)
+{
+    int64_t bottom = mBottom.load(std::memory_order_relaxed);
+    int64_t top = mTop.load(std::memory_order_acquire);
+    if (bottom - top >= static_cast<int64_t>(kDequeSize))
+        return false;
+
+    mJobs[bottom & (kDequeSize - 1)].store(job, std::memory_order_relaxed);
+    mBottom.store(bottom + 1, std::memory_order_release);
+    return true;
+}
+
+JobSystem::Job* JobSystem::WorkDeque::Pop()
+{
+    int64_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+    mBottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = mTop.load(std::memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = mJobs[bottom & (kDequeSize - 1)].load(std::memory_order_relaxed);
+    if (top == bottom)
+    {
+        // Last job, race the thieves for it.
+        if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+JobSystem::Job* JobSystem::WorkDeque::Steal()
+{
+    int64_t top = mTop.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = mBottom.load(std::memory_order_acquire);
+    if (top >= bottom)
+        return nullptr;
+
+    Job* job = mJobs[top & (kDequeSize - 1)].load(std::memory_order_relaxed);
+    if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return job;
+}
+
+JobSystem::JobSystem(unsigned threadCount)
+    : mThreadCount(threadCount ? threadCount : (std::max)(1u, std::thread::hardware_concurrency())),
+    mQueueSize(0),
+    mSignal(0),
+    mSleeping(0),
+    mbQuit(false),
+    mpPreviousSystem(tContext.pSystem),
+    mPreviousWorker(tContext.Worker)
+{
+    for (unsigned i = 0; i < mThreadCount; i++)
+    {
+        Worker* worker = new Worker();
+        worker->Executed = 0;
+        worker->Stolen = 0;
+        worker->RandomState = 0x9E3779B9u * (i + 1);
+        mWorkers.push_back(worker);
+    }
+
+    tContext.pSystem = this;
+    tContext.Worker = 0;
+
+    for (unsigned i = 1; i < mThreadCount; i++)
+        mThreads.emplace_back(&JobSystem::WorkerLoop, this, static_cast<int>(i));
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mbQuit = true;
+    }
+    mSleep.notify_all();
+
+    for (auto& thread : mThreads)
+        thread.join();
+
+    for (Worker* worker : mWorkers)
+        delete worker;
+
+    if (tContext.pSystem == this)
+    {
+        tContext.pSystem = mpPreviousSystem;
+        tContext.Worker = mPreviousWorker;
+    }
+}
+
+JobSystem& JobSystem::Get()
+{
+    static JobSystem instance(gDefaultThreadCount);
+    return instance;
+}
+
+void JobSystem::SetDefaultThreadCount(unsigned threadCount)
+{
+    gDefaultThreadCount = threadCount;
+}
+
+void JobSystem::SetContextHooks(CaptureContextFunc capture, ApplyContextFunc apply)
+{
+    gCaptureContext = capture;
+    gApplyContext = apply;
+}
+
+JobSystem::Stats JobSystem::GetStats() const
+{
+    Stats stats = {};
+    for (const Worker* worker : mWorkers)
+    {
+        stats.Executed += worker->Executed.load(std::memory_order_relaxed);
+        stats.Stolen += worker->Stolen.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+JobSystem::Job* JobSystem::AllocateJob()
+{
+    // Each thread recycles its own ring of jobs. Busy slots are skipped: a parent
+    // holds its slot until all its children are done, which can take a while.
+    thread_local std::unique_ptr<Job[]> pool;
+    thread_local size_t next = 0;
+    if (!pool)
+    {
+        pool.reset(new Job[kJobPoolSize]);
+        for (size_t i = 0; i < kJobPoolSize; i++)
+            pool[i].Unfinished.store(0, std::memory_order_relaxed);
+    }
+
+    for (;;)
+    {
+        for (size_t i = 0; i < kJobPoolSize; i++)
+        {
+            Job* job = &pool[next++ & (kJobPoolSize - 1)];
+            if (job->Unfinished.load(std::memory_order_acquire) == 0)
+                return job;
+        }
+
+        // All jobs of this thread are in flight, run some of them.
+        int worker = CurrentWorker();
+        if (Job* other = FindJob(worker))
+            Execute(other, worker);
+        else
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::Submit(Job* job, Counter* counter)
+{
+    Job* parent = static_cast<Job*>(tpCurrentJob);
+    job->Parent = parent;
+    job->pCounter = counter;
+    job->Context = gCaptureContext ? gCaptureContext() : 0;
+    job->Unfinished.store(1, std::memory_order_relaxed);
+    if (parent)
+        parent->Unfinished.fetch_add(1, std::memory_order_relaxed);
+    if (counter)
+        counter->mPending.fetch_add(1, std::memory_order_relaxed);
+
+    int worker = CurrentWorker();
+    if (worker >= 0)
+    {
+        if (!mWorkers[worker]->Deque.Push(job))
+        {
+            Execute(job, worker);
+            return;
+        }
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(mQueueMutex);
+        mQueue.push_back(job);
+        mQueueSize.fetch_add(1, std::memory_order_release);
+    }
+    Wake();
+}
+
+void JobSystem::Execute(Job* job, int worker)
+{
+    void* previous = tpCurrentJob;
+    tpCurrentJob = job;
+    if (gApplyContext)
+    {
+        const uint32_t previousContext = gApplyContext(job->Context);
+        job->Invoke(*job);
+        gApplyContext(previousContext);
+    }
+    else
+    {
+        job->Invoke(*job);
+    }
+    tpCurrentJob = previous;
+
+    if (worker >= 0)
+        mWorkers[worker]->Executed.fetch_add(1, std::memory_order_relaxed);
+    Finish(job);
+}
+
+void JobSystem::Finish(Job* job)
+{
+    // Read before the decrement, the slot may be reused right after it.
+    Job* parent = job->Parent;
+    Counter* counter = job->pCounter;
+    if (job->Unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    if (counter)
+        counter->mPending.fetch_sub(1, std::memory_order_release);
+    if (parent)
+        Finish(parent);
+}
+
+JobSystem::Job* JobSystem::FindJob(int worker)
+{
+    if (worker >= 0)
+    {
+        if (Job* job = mWorkers[worker]->Deque.Pop())
+            return job;
+    }
+
+    if (mQueueSize.load(std::memory_order_acquire) > 0)
+    {
+        std::lock_guard<std::mutex> lock(mQueueMutex);
+        if (!mQueue.empty())
+        {
+            Job* job = mQueue.front();
+            mQueue.pop_front();
+            mQueueSize.fetch_sub(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+
+    // Steal, starting at a random victim so thieves spread out.
+    unsigned start = 0;
+    if (worker >= 0)
+    {
+        uint32_t& state = mWorkers[worker]->RandomState;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        start = state % mThreadCount;
+    }
+    for (unsigned i = 0; i < mThreadCount; i++)
+    {
+        unsigned victim = (start + i) % mThreadCount;
+        if (static_cast<int>(victim) == worker)
+            continue;
+        if (Job* job = mWorkers[victim]->Deque.Steal())
+        {
+            if (worker >= 0)
+                mWorkers[worker]->Stolen.fetch_add(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+int JobSystem::CurrentWorker() const
+{
+    return tContext.pSystem == this ? tContext.Worker : -1;
+}
+
+void JobSystem::Wait(const Counter& counter)
+{
+    int worker = CurrentWorker();
+    while (!counter.IsDone())
+    {
+        if (Job* job = FindJob(worker))
+            Execute(job, worker);
+        else
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::WorkerLoop(int worker)
+{
+    tContext.pSystem = this;
+    tContext.Worker = worker;
+
+    while (!mbQuit.load(std::memory_order_relaxed))
+    {
+        uint64_t signal = mSignal.load();
+
+        Job* job = nullptr;
+        for (int i = 0; i < kSpinCount && !job; i++)
+        {
+            job = FindJob(worker);
+            if (!job)
+                std::this_thread::yield();
+        }
+        if (job)
+        {
+            Execute(job, worker);
+            continue;
+        }
+
+        // Nothing was submitted since the signal was read, sleep until something is.
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mSleeping++;
+        mSleep.wait(lock, [&]() { return mbQuit.load() || mSignal.load() != signal; });
+        mSleeping--;
+    }
+}
+
+void JobSystem::Wake()
+{
+    mSignal.fetch_add(1);
+    if (mSleeping.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mSleep.notify_one();
+    }
+}
@@ -0,0 +1,350 @@
+#include <LightClusters.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+
+using namespace DirectX;
+
+namespace
+{
+    const uint32_t kDefaultTilesX = 16;
+    const uint32_t kDefaultTilesY = 9;
+    const uint32_t kDefaultSlices = 24;
+
+    // Set lanes of a 4-bit mask packed to the front, and how many there are, so the hits
+    // of four clusters are written without branches
+    struct LaneList
+    {
+        uint8_t Lanes[4];
+        uint32_t Count;
+    };
+
+    const LaneList kLaneLists[16] = {
+        { { 0, 0, 0, 0 }, 0 }, { { 0, 0, 0, 0 }, 1 }, { { 1, 0, 0, 0 }, 1 }, { { 0, 1, 0, 0 }, 2 },
+        { { 2, 0, 0, 0 }, 1 }, { { 0, 2, 0, 0 }, 2 }, { { 1, 2, 0, 0 }, 2 }, { { 0, 1, 2, 0 }, 3 },
+        { { 3, 0, 0, 0 }, 1 }, { { 0, 3, 0, 0 }, 2 }, { { 1, 3, 0, 0 }, 2 }, { { 0, 1, 3, 0 }, 3 },
+        { { 2, 3, 0, 0 }, 2 }, { { 0, 2, 3, 0 }, 3 }, { { 1, 2, 3, 0 }, 3 }, { { 0, 1, 2, 3 }, 4 }
+    };
+
+    XMFLOAT3 TransformPoint(const XMFLOAT3& p, const XMFLOAT4X4& m)
+    {
+        return XMFLOAT3(
+            p.x * m.m[0][0] + p.y * m.m[1][0] + p.z * m.m[2][0] + m.m[3][0],
+            p.x * m.m[0][1] + p.y * m.m[1][1] + p.z * m.m[2][1] + m.m[3][1],
+            p.x * m.m[0][2] + p.y * m.m[1][2] + p.z * m.m[2][2] + m.m[3][2]);
+    }
+
+    XMFLOAT3 TransformVector(const XMFLOAT3& v, const XMFLOAT4X4& m)
+    {
+        return XMFLOAT3(
+            v.x * m.m[0][0] + v.y * m.m[1][0] + v.z * m.m[2][0],
+            v.x * m.m[0][1] + v.y * m.m[1][1] + v.z * m.m[2][1],
+            v.x * m.m[0][2] + v.y * m.m[1][2] + v.z * m.m[2][2]);
+    }
+
+    inline __m128 Dot3(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+    }
+
+    // Distance of the centers to the boxes on one axis, 0 inside
+    inline __m128 AxisDistance(__m128 center, const float* boxMin, const float* boxMax)
+    {
+        __m128 below = _mm_sub_ps(_mm_loadu_ps(boxMin), center);
+        __m128 above = _mm_sub_ps(center, _mm_loadu_ps(boxMax));
+        return _mm_max_ps(_mm_max_ps(below, above), _mm_setzero_ps());
+    }
+
+    // Spot light cone in view space, broadcast for the tests against four clusters
+    struct Cone
+    {
+        __m128 ApexX, ApexY, ApexZ;
+        __m128 DirX, DirY, DirZ;
+        __m128 Cos, Sin;
+        __m128 Range;
+    };
+
+    // All bits set where the cone may reach into the bounding spheres
+    inline __m128 ConeOverlaps(const Cone& cone, __m128 centerX, __m128 centerY, __m128 centerZ, __m128 radius)
+    {
+        __m128 vx = _mm_sub_ps(centerX, cone.ApexX);
+        __m128 vy = _mm_sub_ps(centerY, cone.ApexY);
+        __m128 vz = _mm_sub_ps(centerZ, cone.ApexZ);
+        __m128 lengthSq = Dot3(vx, vy, vz, vx, vy, vz);
+        __m128 along = Dot3(vx, vy, vz, cone.DirX, cone.DirY, cone.DirZ);
+        __m128 across = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(lengthSq, _mm_mul_ps(along, along)), _mm_setzero_ps()));
+        // Distance from the center to the cone surface, beyond it by more than the radius is outside
+        __m128 distance = _mm_sub_ps(_mm_mul_ps(cone.Cos, across), _mm_mul_ps(along, cone.Sin));
+        __m128 inAngle = _mm_cmple_ps(distance, radius);
+        __m128 inFront = _mm_cmpge_ps(along, _mm_sub_ps(_mm_setzero_ps(), radius));
+        __m128 inRange = _mm_cmple_ps(along, _mm_add_ps(cone.Range, radius));
+        return _mm_and_ps(_mm_and_ps(inAngle, inFront), inRange);
+    }
+}
+
+LightClusters::LightClusters()
+    : mTilesX(0),
+    mTilesY(0),
+    mSlices(0),
+    mbBoundsValid(false),
+    mNear(1.0f),
+    mFar(1000.0f),
+    mSliceScale(0.0f),
+    mSliceBias(0.0f),
+    mScaleX(1.0f),
+    mScaleY(1.0f),
+    mStats()
+{
+    Init(kDefaultTilesX, kDefaultTilesY, kDefaultSlices);
+}
+
+void LightClusters::Init(uint32_t tilesX, uint32_t tilesY, uint32_t slices)
+{
+    mTilesX = (std::max)(tilesX, 1u);
+    mTilesY = (std::max)(tilesY, 1u);
+    mSlices = (std::max)(slices, 1u);
+    mbBoundsValid = false;
+
+    const size_t count = size_t(mTilesX) * mTilesY * mSlices;
+    mColumns.Resize(size_t(mSlices) * mTilesX + 3);
+    mRows.Resize(size_t(mSlices) * mTilesY);
+    mDepths.Resize(mSlices);
+    mClusters.assign(count, Range{ 0, 0 });
+    mLightIndices.clear();
+}
+
+void LightClusters::Extents::Resize(size_t count)
+{
+    Min.assign(count, 0.0f);
+    Max.assign(count, 0.0f);
+    Center.assign(count, 0.0f);
+    HalfSq.assign(count, 0.0f);
+}
+
+void LightClusters::Extents::Set(size_t i, float min, float max)
+{
+    Min[i] = min;
+    Max[i] = max;
+    Center[i] = 0.5f * (min + max);
+    HalfSq[i] = 0.25f * (max - min) * (max - min);
+}
+
+int LightClusters::SliceOf(float viewZ) const
+{
+    int slice = static_cast<int>(std::floor(std::log(viewZ) * mSliceScale + mSliceBias));
+    return (std::min)((std::max)(slice, 0), int(mSlices) - 1);
+}
+
+int LightClusters::TileOf(float ndc, uint32_t tiles) const
+{
+    int tile = static_cast<int>(std::floor((ndc + 1.0f) * 0.5f * tiles));
+    return (std::min)((std::max)(tile, 0), int(tiles) - 1);
+}
+
+bool LightClusters::GetTiles(const XMFLOAT3& c, float r, float zMin, float zMax, TileRange& tiles) const
+{
+    // x / z over the box is largest and smallest at its corners
+    const float left = (std::min)((c.x - r) / zMin, (c.x - r) / zMax) * mScaleX;
+    const float right = (std::max)((c.x + r) / zMin, (c.x + r) / zMax) * mScaleX;
+    const float bottom = (std::min)((c.y - r) / zMin, (c.y - r) / zMax) * mScaleY;
+    const float top = (std::max)((c.y + r) / zMin, (c.y + r) / zMax) * mScaleY;
+    if (left >= 1.0f || right <= -1.0f || bottom >= 1.0f || top <= -1.0f)
+        return false;
+
+    tiles.X0 = TileOf(left, mTilesX);
+    tiles.X1 = TileOf(right, mTilesX);
+    tiles.Y0 = TileOf(-top, mTilesY);
+    tiles.Y1 = TileOf(-bottom, mTilesY);
+    return true;
+}
+
+void LightClusters::BuildClusterBounds(const XMFLOAT4X4& proj)
+{
+    // z' = z * A + B with A = f / (f - n) and B = -n f / (f - n)
+    const float p00 = proj.m[0][0];
+    const float p11 = proj.m[1][1];
+    mScaleX = p00;
+    mScaleY = p11;
+    mNear = -proj.m[3][2] / proj.m[2][2];
+    mFar = proj.m[3][2] / (1.0f - proj.m[2][2]);
+
+    const float logRatio = std::log(mFar / mNear);
+    mSliceScale = mSlices / logRatio;
+    mSliceBias = -(mSlices * std::log(mNear)) / logRatio;
+    for (uint32_t s = 0; s < mSlices; s++)
+    {
+        const float zNear = mNear * std::pow(mFar / mNear, float(s) / mSlices);
+        const float zFar = mNear * std::pow(mFar / mNear, float(s + 1) / mSlices);
+        mDepths.Set(s, zNear, zFar);
+
+        // Rows from the top, view space y = ndc * z / p11
+        for (uint32_t ty = 0; ty < mTilesY; ty++)
+        {
+            const float top = 1.0f - 2.0f * ty / mTilesY;
+            const float bottom = 1.0f - 2.0f * (ty + 1) / mTilesY;
+            mRows.Set(size_t(s) * mTilesY + ty, (std::min)(bottom * zNear, bottom * zFar) / p11, (std::max)(top * zNear, top * zFar) / p11);
+        }
+        for (uint32_t tx = 0; tx < mTilesX; tx++)
+        {
+            const float left = -1.0f + 2.0f * tx / mTilesX;
+            const float right = -1.0f + 2.0f * (tx + 1) / mTilesX;
+            mColumns.Set(size_t(s) * mTilesX + tx, (std::min)(left * zNear, left * zFar) / p00, (std::max)(right * zNear, right * zFar) / p00);
+        }
+    }
+
+    mProj = proj;
+    mbBoundsValid = true;
+}
+
+void LightClusters::Bin(const LOCAL_LIGHT* lights, size_t count, const XMFLOAT4X4& view, const XMFLOAT4X4& proj)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    if (!mbBoundsValid || memcmp(&mProj, &proj, sizeof(proj)) != 0)
+        BuildClusterBounds(proj);
+
+    // Room for four more hits is made before every group of clusters
+    size_t lightsInView = 0;
+    size_t hitCount = 0;
+    if (mHits.size() < 1024)
+        mHits.resize(1024);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const LOCAL_LIGHT& light = lights[i];
+        const XMFLOAT3 position = TransformPoint(light.Position, view);
+        if (!(light.Range > 0.0f))
+            continue;
+
+        // A spot light is bounded by the sphere around its cone: through the apex and the
+        // rim for narrow cones, around the rim disc for wide ones.
+        const bool spot = light.SpotCosOuter > -1.0f;
+        XMFLOAT3 c = position;
+        float r = light.Range;
+        Cone cone = {};
+        if (spot)
+        {
+            const XMFLOAT3 d = TransformVector(light.Direction, view);
+            const float cosAngle = (std::max)(light.SpotCosOuter, 0.0f);
+            const float sinAngle = std::sqrt(1.0f - cosAngle * cosAngle);
+            const float offset = cosAngle > 0.7071f ? light.Range / (2.0f * cosAngle) : light.Range * cosAngle;
+            r = cosAngle > 0.7071f ? offset : light.Range * sinAngle;
+            c = XMFLOAT3(position.x + d.x * offset, position.y + d.y * offset, position.z + d.z * offset);
+
+            cone.ApexX = _mm_set1_ps(position.x);
+            cone.ApexY = _mm_set1_ps(position.y);
+            cone.ApexZ = _mm_set1_ps(position.z);
+            cone.DirX = _mm_set1_ps(d.x);
+            cone.DirY = _mm_set1_ps(d.y);
+            cone.DirZ = _mm_set1_ps(d.z);
+            cone.Cos = _mm_set1_ps(cosAngle);
+            cone.Sin = _mm_set1_ps(sinAngle);
+            cone.Range = _mm_set1_ps(light.Range);
+        }
+        if (c.z + r <= mNear || c.z - r >= mFar)
+            continue;
+
+        const float zMin = (std::max)(c.z - r, mNear);
+        const float zMax = (std::min)(c.z + r, mFar);
+        const int s0 = SliceOf(zMin);
+        const int s1 = SliceOf(zMax);
+
+        const __m128 centerX = _mm_set1_ps(c.x);
+        const __m128 radiusSq = _mm_set1_ps(r * r);
+
+        const size_t hitsBefore = hitCount;
+        for (int s = s0; s <= s1; s++)
+        {
+            // The slab of the sphere in this slice is narrower than the sphere unless it has the center
+            const float slabMin = (std::max)(zMin, mDepths.Min[s]);
+            const float slabMax = (std::min)(zMax, mDepths.Max[s]);
+            const float gapZ = c.z < slabMin ? slabMin - c.z : (c.z > slabMax ? c.z - slabMax : 0.0f);
+            TileRange tiles;
+            if (!GetTiles(c, std::sqrt((std::max)(r * r - gapZ * gapZ, 0.0f)), slabMin, slabMax, tiles))
+                continue;
+
+            const size_t columns = size_t(s) * mTilesX;
+            for (int ty = tiles.Y0; ty <= tiles.Y1; ty++)
+            {
+                // y and z are the same for the whole row of clusters
+                const size_t rowIndex = size_t(s) * mTilesY + ty;
+                const float gapY = (std::max)((std::max)(mRows.Min[rowIndex] - c.y, c.y - mRows.Max[rowIndex]), 0.0f);
+                const float rowDistanceSq = gapY * gapY + gapZ * gapZ;
+                if (rowDistanceSq > r * r)
+                    continue;
+                const __m128 rowDistance = _mm_set1_ps(rowDistanceSq);
+                const __m128 rowCenterY = _mm_set1_ps(mRows.Center[rowIndex]);
+                const __m128 rowCenterZ = _mm_set1_ps(mDepths.Center[s]);
+                const __m128 rowHalfSq = _mm_set1_ps(mRows.HalfSq[rowIndex] + mDepths.HalfSq[s]);
+
+                const size_t row = rowIndex * mTilesX;
+                for (int tx = tiles.X0; tx <= tiles.X1; tx += 4)
+                {
+                    const size_t column = columns + tx;
+                    __m128 dx = AxisDistance(centerX, &mColumns.Min[column], &mColumns.Max[column]);
+                    __m128 overlaps = _mm_cmple_ps(_mm_add_ps(_mm_mul_ps(dx, dx), rowDistance), radiusSq);
+                    if (spot)
+                    {
+                        __m128 radius = _mm_sqrt_ps(_mm_add_ps(_mm_loadu_ps(&mColumns.HalfSq[column]), rowHalfSq));
+                        overlaps = _mm_and_ps(overlaps, ConeOverlaps(cone, _mm_loadu_ps(&mColumns.Center[column]), rowCenterY, rowCenterZ, radius));
+                    }
+
+                    // Lanes past the end of the range belong to other tiles
+                    const LaneList& list = kLaneLists[_mm_movemask_ps(overlaps) & ((1 << (std::min)(tiles.X1 - tx + 1, 4)) - 1)];
+                    if (hitCount + 4 > mHits.size())
+                        mHits.resize(2 * mHits.size());
+                    Hit* hits = &mHits[hitCount];
+                    for (int lane = 0; lane < 4; lane++)
+                        hits[lane] = Hit{ uint32_t(row + tx + list.Lanes[lane]), uint32_t(i) };
+                    hitCount += list.Count;
+                }
+            }
+        }
+        if (hitCount > hitsBefore)
+            lightsInView++;
+    }
+
+    // Group the hits per cluster, they are in light order so each list stays sorted
+    for (Range& range : mClusters)
+        range.Count = 0;
+    for (size_t h = 0; h < hitCount; h++)
+        mClusters[mHits[h].Cluster].Count++;
+
+    uint32_t offset = 0;
+    uint32_t maxPerCluster = 0;
+    for (Range& range : mClusters)
+    {
+        range.Offset = offset;
+        offset += range.Count;
+        maxPerCluster = (std::max)(maxPerCluster, range.Count);
+        range.Count = 0;
+    }
+    mLightIndices.resize(hitCount);
+    for (size_t h = 0; h < hitCount; h++)
+    {
+        Range& range = mClusters[mHits[h].Cluster];
+        mLightIndices[range.Offset + range.Count++] = mHits[h].Light;
+    }
+
+    mStats.BinMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    mStats.Lights = count;
+    mStats.LightsInView = lightsInView;
+    mStats.Indices = mLightIndices.size();
+    mStats.MaxPerCluster = maxPerCluster;
+}
+
+CLUSTER_CBUFFER LightClusters::GetShaderConstants(float width, float height) const
+{
+    CLUSTER_CBUFFER constants;
+    constants.TileScale = XMFLOAT2(mTilesX / width, mTilesY / height);
+    constants.SliceScale = mSliceScale;
+    constants.SliceBias = mSliceBias;
+    constants.TilesX = mTilesX;
+    constants.TilesY = mTilesY;
+    constants.Slices = mSlices;
+    constants.LightCount = static_cast<UINT>(mStats.Lights);
+    return constants;
+}
@@ -0,0 +1,137 @@
+#include <MappedFile.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+    : mpData(nullptr),
+    mSize(0),
+#ifdef _WIN32
+    mFileHandle(INVALID_HANDLE_VALUE),
+    mMappingHandle(nullptr)
+#else
+    mFileDescriptor(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::filesystem::path& filename)
+{
+    Close();
+
+    mFileHandle = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (mFileHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(mFileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        Close();
+        return false;
+    }
+
+    mMappingHandle = CreateFileMappingW(mFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mMappingHandle)
+    {
+        Close();
+        return false;
+    }
+
+    mpData = static_cast<const uint8_t*>(MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (!mpData)
+    {
+        Close();
+        return false;
+    }
+
+    mSize = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (mpData)
+    {
+        UnmapViewOfFile(mpData);
+        mpData = nullptr;
+    }
+
+    if (mMappingHandle)
+    {
+        CloseHandle(mMappingHandle);
+        mMappingHandle = nullptr;
+    }
+
+    if (mFileHandle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(mFileHandle);
+        mFileHandle = INVALID_HANDLE_VALUE;
+    }
+
+    mSize = 0;
+}
+
+#else
+
+bool MappedFile::Open(const std::filesystem::path& filename)
+{
+    Close();
+
+    mFileDescriptor = open(filename.c_str(), O_RDONLY);
+    if (mFileDescriptor < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(mFileDescriptor, &st) != 0 || st.st_size == 0)
+    {
+        Close();
+        return false;
+    }
+
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, mFileDescriptor, 0);
+    if (data == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+
+    // The file is read front to back by every consumer.
+    madvise(data, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    mpData = static_cast<const uint8_t*>(data);
+    mSize = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (mpData)
+    {
+        munmap(const_cast<uint8_t*>(mpData), mSize);
+        mpData = nullptr;
+    }
+
+    if (mFileDescriptor >= 0)
+    {
+        close(mFileDescriptor);
+        mFileDescriptor = -1;
+    }
+
+    mSize = 0;
+}
+
+#endif
@@ -1,5 +1,6 @@
 ﻿#include <Material.h>
-#include <DirectXTex\DirectXTex.h>
+#include <MemoryTracker.h>
+#include <TextureCache.h>
 
 Material::Material()
     : mAmbient(0.0f, 0.0f, 0.0f, 0.0f),
@@ -7,8 +8,7 @@ Material::Material()
     mSpecular(0.0f, 0.0f, 0.0f, 0.0f),
     mColorMap(nullptr),
     mNormalMap(nullptr),
-    mColorMapSRV(nullptr),
-    mNormalMapSRV(nullptr)
+    mConstantBuffer(nullptr)
 {
 }
 
@@ -16,45 +16,55 @@ Material::~Material()
 {
 }
 
-HRESULT Material::LoadTextures(ComPtr<ID3D11Device> device, std::wstring colorMapFile, std::wstring normalMapFile)
+HRESULT Material::Init(ComPtr<ID3D11Device> device, const MaterialDesc& desc)
 {
-    HRESULT hr = LoadTGATexture(device, colorMapFile, mColorMapSRV.GetAddressOf());
-    if (FAILED(hr))
-        return hr;
-
-    hr = LoadTGATexture(device, normalMapFile, mNormalMapSRV.GetAddressOf());
-    if (FAILED(hr))
-        return hr;
-    
-    return S_OK;
+    mAmbient = desc.Ambient;
+    mDiffuse = desc.Diffuse;
+    mSpecular = desc.Specular;
+
+    // Textures are shared with every other material that references the same image.
+    if (!desc.ColorMapFile.empty() && FAILED(TextureCache::getInstance().LoadTGA(device, desc.ColorMapFile, mColorMap)))
+        LOG("Material ", desc.Name, ": failed to load color map");
+
+    if (!desc.NormalMapFile.empty() && FAILED(TextureCache::getInstance().LoadTGA(device, desc.NormalMapFile, mNormalMap)))
+        LOG("Material ", desc.Name, ": failed to load normal map");
+
+    return CreateConstantBuffer(device);
 }
 
-void Material::AttachToShaders(ComPtr<ID3D11DeviceContext> deviceContext)
+HRESULT Material::CreateConstantBuffer(ComPtr<ID3D11Device> device)
 {
-    deviceContext->PSSetShaderResources(0, 1, mColorMapSRV.GetAddressOf());
-    deviceContext->PSSetShaderResources(1, 1, mNormalMapSRV.GetAddressOf());
+    MATERIAL_CBUFFER data;
+    data.Ambient = mAmbient;
+    data.Diffuse = mDiffuse;
+    data.Specular = mSpecular;
+    data.HasColorMap = mColorMap ? 1 : 0;
+    data.HasNormalMap = mNormalMap ? 1 : 0;
+    data.Pad[0] = data.Pad[1] = 0;
+
+    D3D11_BUFFER_DESC cbDesc;
+    cbDesc.ByteWidth = sizeof(MATERIAL_CBUFFER);
+    cbDesc.Usage = D3D11_USAGE_IMMUTABLE;
+    cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    cbDesc.CPUAccessFlags = 0;
+    cbDesc.MiscFlags = 0;
+    cbDesc.StructureByteStride = 0;
+
+    D3D11_SUBRESOURCE_DATA initData;
+    initData.pSysMem = &data;
+    initData.SysMemPitch = 0;
+    initData.SysMemSlicePitch = 0;
+
+    mConstantBuffer.Reset();
+    HRESULT hr = device->CreateBuffer(&cbDesc, &initData, mConstantBuffer.GetAddressOf());
+    if (SUCCEEDED(hr))
+        MemoryTracker::TrackGpuResource(mConstantBuffer.Get(), MemoryTag::GpuBuffers);
+    return hr;
 }
 
-HRESULT Material::LoadTGATexture(ComPtr<ID3D11Device> device, std::wstring file, ID3D11ShaderResourceView** textureView)
+void Material::AttachToShaders(StateCache& stateCache) const
 {
-    DirectX::ScratchImage image;
-    HRESULT hr = LoadFromTGAFile(file.c_str(), nullptr, image);
-    if (FAILED(hr))
-        return hr;
-
-    const DirectX::Image* img = image.GetImage(0, 0, 0);
-    if (!img)
-        return E_FAIL;
-
-    ID3D11Resource* texResource;
-    hr = CreateTexture(device.Get(), image.GetImages(), image.GetImageCount(), image.GetMetadata(), &texResource);
-    if (FAILED(hr))
-        return hr;
-
-    hr = CreateShaderResourceView(device.Get(), img, 1, image.GetMetadata(), textureView);
-    if (FAILED(hr))
-        return hr;
-
-    return S_OK;
-    
-}
\ No newline at end of file
+    stateCache.SetPSShaderResource(0, mColorMap ? mColorMap->SRV.Get() : nullptr);
+    stateCache.SetPSShaderResource(1, mNormalMap ? mNormalMap->SRV.Get() : nullptr);
+    stateCache.SetPSConstantBuffer(2, mConstantBuffer.Get());
+}
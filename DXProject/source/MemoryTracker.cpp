@@ -0,0 +1,654 @@
+#include <MemoryTracker.h>
+#include <JobSystem.h>
+#include <LogWriter.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#include <d3d11.h>
+#include <wrl/client.h>
+#endif
+
+// Comment out to leave operator new alone, only the GPU resources and the explicit
+// accounting are tracked then.
+#define MEMORY_TRACKER_HOOK_NEW
+
+namespace
+{
+    const size_t kTagCount = static_cast<size_t>(MemoryTag::Count);
+
+    const char* const kTagNames[kTagCount] =
+    {
+        "other",
+        "import",
+        "scene",
+        "textures",
+        "GPU buffers",
+        "GPU textures",
+        "GPU targets"
+    };
+
+    // Threads with a slot of their own, later ones share slot 0
+    const size_t kMaxThreads = 64;
+    // Peaks are updated after a thread allocated this much, and whenever stats are read
+    const int64_t kPeakSampleBytes = 256 * 1024;
+
+    // Counts of one thread. Only the owner writes, with a load and a store instead of an
+    // atomic add, readers sum all slots. Allocations and frees are counted separately,
+    // the frees of a block may be on another thread. Aligned so owners never share a line.
+    struct alignas(64) ThreadCounters
+    {
+        std::atomic<int64_t> Current[kTagCount];
+        std::atomic<uint64_t> Allocations[kTagCount];
+        std::atomic<uint64_t> Frees[kTagCount];
+        std::atomic<bool> InUse;
+        int64_t UnsampledBytes; // Owner only
+    };
+
+    // Zero before any constructor runs, operator new can be called from static initializers.
+    ThreadCounters gThreadCounters[kMaxThreads];
+    // Slots handed out so far, readers sum slot 0 to this one
+    std::atomic<size_t> gLastSlot;
+    std::atomic<int64_t> gPeaks[kTagCount];
+    // All tags, for the peak of the sum
+    std::atomic<int64_t> gTotalPeak;
+
+    ThreadCounters& gSharedCounters = gThreadCounters[0];
+
+    thread_local MemoryTag tCurrentTag = MemoryTag::Other;
+    thread_local ThreadCounters* tpCounters = nullptr;
+
+    // Frees the thread's slot when it exits. The counts stay in the slot, the next owner
+    // adds to them; what the thread frees after this goes to the shared slot.
+    struct CountersOwner
+    {
+        ~CountersOwner()
+        {
+            ThreadCounters* counters = tpCounters;
+            tpCounters = &gSharedCounters;
+            if (counters && counters != &gSharedCounters)
+                counters->InUse.store(false, std::memory_order_release);
+        }
+    };
+    thread_local CountersOwner tCountersOwner;
+
+    // Jobs allocate under the tag of the thread that queued them
+    uint32_t CaptureJobTag()
+    {
+        return static_cast<uint32_t>(tCurrentTag);
+    }
+
+    uint32_t ApplyJobTag(uint32_t tag)
+    {
+        const MemoryTag previous = tCurrentTag;
+        tCurrentTag = static_cast<MemoryTag>(tag);
+        return static_cast<uint32_t>(previous);
+    }
+
+    struct JobTagHooks
+    {
+        JobTagHooks() { JobSystem::SetContextHooks(CaptureJobTag, ApplyJobTag); }
+    } gJobTagHooks;
+
+    size_t GetSlotCount()
+    {
+        return (std::min)(gLastSlot.load(std::memory_order_acquire) + 1, kMaxThreads);
+    }
+
+    ThreadCounters* ClaimCounters()
+    {
+        // A slot left by a thread that exited, a new one, or the shared one
+        ThreadCounters* counters = &gSharedCounters;
+        const size_t slotCount = GetSlotCount();
+        for (size_t i = 1; i < slotCount && counters == &gSharedCounters; i++)
+        {
+            bool inUse = false;
+            if (!gThreadCounters[i].InUse.load(std::memory_order_relaxed) &&
+                gThreadCounters[i].InUse.compare_exchange_strong(inUse, true, std::memory_order_acquire))
+            {
+                counters = &gThreadCounters[i];
+            }
+        }
+        if (counters == &gSharedCounters && gLastSlot.load(std::memory_order_relaxed) + 1 < kMaxThreads)
+        {
+            const size_t slot = gLastSlot.fetch_add(1, std::memory_order_acq_rel) + 1;
+            if (slot < kMaxThreads)
+            {
+                counters = &gThreadCounters[slot];
+                counters->InUse.store(true, std::memory_order_relaxed);
+            }
+        }
+
+        // Registers the release at thread exit
+        (void)&tCountersOwner;
+        return counters;
+    }
+
+    void UpdatePeak(std::atomic<int64_t>& peak, int64_t current)
+    {
+        int64_t previous = peak.load(std::memory_order_relaxed);
+        while (current > previous && !peak.compare_exchange_weak(previous, current, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // Sums the slots into the current bytes per tag and updates the peaks
+    void SamplePeaks(int64_t* current)
+    {
+        int64_t total = 0;
+        const size_t slotCount = GetSlotCount();
+        for (size_t tag = 0; tag < kTagCount; tag++)
+        {
+            current[tag] = 0;
+            for (size_t i = 0; i < slotCount; i++)
+                current[tag] += gThreadCounters[i].Current[tag].load(std::memory_order_relaxed);
+            UpdatePeak(gPeaks[tag], current[tag]);
+            total += current[tag];
+        }
+        UpdatePeak(gTotalPeak, total);
+    }
+
+    MemoryTracker::TagStats SumCounters(size_t tag, const int64_t* current)
+    {
+        uint64_t frees = 0;
+        MemoryTracker::TagStats stats = {};
+        const size_t slotCount = GetSlotCount();
+        for (size_t i = 0; i < slotCount; i++)
+        {
+            stats.Allocations += gThreadCounters[i].Allocations[tag].load(std::memory_order_relaxed);
+            frees += gThreadCounters[i].Frees[tag].load(std::memory_order_relaxed);
+        }
+        stats.CurrentBytes = current[tag];
+        stats.PeakBytes = gPeaks[tag].load(std::memory_order_relaxed);
+        stats.LiveAllocations = static_cast<int64_t>(stats.Allocations - frees);
+        return stats;
+    }
+
+    template<class T>
+    void AddToCounter(ThreadCounters& counters, std::atomic<T>& counter, T value)
+    {
+        if (&counters == &gSharedCounters)
+            counter.fetch_add(value, std::memory_order_relaxed);
+        else
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    void CountAllocation(MemoryTag tag, int64_t bytes)
+    {
+        if (!tpCounters)
+            tpCounters = ClaimCounters();
+        ThreadCounters& counters = *tpCounters;
+        const size_t index = static_cast<size_t>(tag);
+        AddToCounter(counters, counters.Allocations[index], uint64_t(1));
+        AddToCounter(counters, counters.Current[index], bytes);
+
+        // The shared slot has no owner to keep the unsampled bytes, it samples large blocks only
+        int64_t unsampled = bytes;
+        if (&counters != &gSharedCounters)
+        {
+            unsampled = counters.UnsampledBytes + bytes;
+            counters.UnsampledBytes = unsampled < kPeakSampleBytes ? unsampled : 0;
+        }
+        if (unsampled >= kPeakSampleBytes)
+        {
+            int64_t current[kTagCount];
+            SamplePeaks(current);
+        }
+    }
+
+    void CountFree(MemoryTag tag, int64_t bytes)
+    {
+        if (!tpCounters)
+            tpCounters = ClaimCounters();
+        ThreadCounters& counters = *tpCounters;
+        const size_t index = static_cast<size_t>(tag);
+        AddToCounter(counters, counters.Frees[index], uint64_t(1));
+        AddToCounter(counters, counters.Current[index], -bytes);
+    }
+
+#ifdef MEMORY_TRACKER_HOOK_NEW
+    // In front of every block operator new returns
+    struct Header
+    {
+        uint64_t Size;
+        uint32_t Offset; // From the start of the malloc block to the returned pointer
+        MemoryTag Tag;
+        uint8_t Pad[3];
+    };
+    static_assert(sizeof(Header) == 16, "The header keeps 16 byte alignment");
+
+    void* Allocate(size_t size, size_t alignment)
+    {
+        // malloc alignment covers everything but over-aligned types
+        const size_t extra = alignment > alignof(std::max_align_t) ? alignment : 0;
+        uint8_t* block = static_cast<uint8_t*>(malloc(size + sizeof(Header) + extra));
+        if (!block)
+            return nullptr;
+
+        uintptr_t address = reinterpret_cast<uintptr_t>(block) + sizeof(Header);
+        if (extra)
+            address = (address + alignment - 1) & ~uintptr_t(alignment - 1);
+        uint8_t* p = reinterpret_cast<uint8_t*>(address);
+
+        Header* header = reinterpret_cast<Header*>(p) - 1;
+        header->Size = size;
+        header->Offset = static_cast<uint32_t>(p - block);
+        header->Tag = tCurrentTag;
+        CountAllocation(header->Tag, static_cast<int64_t>(size));
+        return p;
+    }
+
+    void Free(void* p)
+    {
+        if (!p)
+            return;
+
+        const Header* header = static_cast<const Header*>(p) - 1;
+        CountFree(header->Tag, static_cast<int64_t>(header->Size));
+        free(static_cast<uint8_t*>(p) - header->Offset);
+    }
+
+    void* AllocateOrThrow(size_t size, size_t alignment)
+    {
+        for (;;)
+        {
+            if (void* p = Allocate(size, alignment))
+                return p;
+            std::new_handler handler = std::get_new_handler();
+            if (!handler)
+                throw std::bad_alloc();
+            handler();
+        }
+    }
+#endif
+
+#ifdef _WIN32
+    int64_t GetPrivateBytes()
+    {
+        PROCESS_MEMORY_COUNTERS_EX counters = {};
+        GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters));
+        return static_cast<int64_t>(counters.PrivateUsage);
+    }
+
+    // {5C1E9A27-3B4D-4F0E-9A61-2D87C4105EB3}
+    const GUID kGpuAllocationGuid = { 0x5c1e9a27, 0x3b4d, 0x4f0e, { 0x9a, 0x61, 0x2d, 0x87, 0xc4, 0x10, 0x5e, 0xb3 } };
+
+    // Attached to a resource as private data, the device releases it with the resource.
+    class GpuAllocation final : public IUnknown
+    {
+    public:
+        GpuAllocation(MemoryTag tag, uint64_t bytes)
+            : mRefs(1),
+            mTag(tag),
+            mBytes(bytes)
+        {
+            MemoryTracker::Add(mTag, static_cast<size_t>(mBytes));
+        }
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** object) override
+        {
+            if (!object)
+                return E_POINTER;
+            if (riid != __uuidof(IUnknown))
+            {
+                *object = nullptr;
+                return E_NOINTERFACE;
+            }
+            *object = static_cast<IUnknown*>(this);
+            AddRef();
+            return S_OK;
+        }
+
+        ULONG STDMETHODCALLTYPE AddRef() override
+        {
+            return InterlockedIncrement(&mRefs);
+        }
+
+        ULONG STDMETHODCALLTYPE Release() override
+        {
+            const ULONG refs = InterlockedDecrement(&mRefs);
+            if (refs == 0)
+            {
+                MemoryTracker::Remove(mTag, static_cast<size_t>(mBytes));
+                delete this;
+            }
+            return refs;
+        }
+
+    private:
+        ~GpuAllocation() = default;
+
+        volatile LONG mRefs;
+        MemoryTag mTag;
+        uint64_t mBytes;
+    };
+
+    UINT BitsPerPixel(DXGI_FORMAT format)
+    {
+        switch (format)
+        {
+        case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+        case DXGI_FORMAT_R32G32B32A32_FLOAT:
+        case DXGI_FORMAT_R32G32B32A32_UINT:
+        case DXGI_FORMAT_R32G32B32A32_SINT:
+            return 128;
+        case DXGI_FORMAT_R32G32B32_TYPELESS:
+        case DXGI_FORMAT_R32G32B32_FLOAT:
+        case DXGI_FORMAT_R32G32B32_UINT:
+        case DXGI_FORMAT_R32G32B32_SINT:
+            return 96;
+        case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+        case DXGI_FORMAT_R16G16B16A16_FLOAT:
+        case DXGI_FORMAT_R16G16B16A16_UNORM:
+        case DXGI_FORMAT_R16G16B16A16_UINT:
+        case DXGI_FORMAT_R16G16B16A16_SNORM:
+        case DXGI_FORMAT_R16G16B16A16_SINT:
+        case DXGI_FORMAT_R32G32_TYPELESS:
+        case DXGI_FORMAT_R32G32_FLOAT:
+        case DXGI_FORMAT_R32G32_UINT:
+        case DXGI_FORMAT_R32G32_SINT:
+        case DXGI_FORMAT_R32G8X24_TYPELESS:
+        case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+            return 64;
+        case DXGI_FORMAT_R16_TYPELESS:
+        case DXGI_FORMAT_R16_FLOAT:
+        case DXGI_FORMAT_D16_UNORM:
+        case DXGI_FORMAT_R16_UNORM:
+        case DXGI_FORMAT_R16_UINT:
+        case DXGI_FORMAT_R16_SNORM:
+        case DXGI_FORMAT_R16_SINT:
+        case DXGI_FORMAT_R8G8_TYPELESS:
+        case DXGI_FORMAT_R8G8_UNORM:
+        case DXGI_FORMAT_R8G8_UINT:
+        case DXGI_FORMAT_R8G8_SNORM:
+        case DXGI_FORMAT_R8G8_SINT:
+        case DXGI_FORMAT_B5G6R5_UNORM:
+        case DXGI_FORMAT_B5G5R5A1_UNORM:
+            return 16;
+        case DXGI_FORMAT_R8_TYPELESS:
+        case DXGI_FORMAT_R8_UNORM:
+        case DXGI_FORMAT_R8_UINT:
+        case DXGI_FORMAT_R8_SNORM:
+        case DXGI_FORMAT_R8_SINT:
+        case DXGI_FORMAT_A8_UNORM:
+            return 8;
+        default:
+            return 32;
+        }
+    }
+
+    // Block compressed formats in 4x4 blocks of 8 or 16 bytes
+    uint64_t SurfaceBytes(DXGI_FORMAT format, UINT width, UINT height)
+    {
+        const uint64_t blocks = uint64_t((width + 3) / 4) * ((height + 3) / 4);
+        switch (format)
+        {
+        case DXGI_FORMAT_BC1_TYPELESS:
+        case DXGI_FORMAT_BC1_UNORM:
+        case DXGI_FORMAT_BC1_UNORM_SRGB:
+        case DXGI_FORMAT_BC4_TYPELESS:
+        case DXGI_FORMAT_BC4_UNORM:
+        case DXGI_FORMAT_BC4_SNORM:
+            return blocks * 8;
+        case DXGI_FORMAT_BC2_TYPELESS:
+        case DXGI_FORMAT_BC2_UNORM:
+        case DXGI_FORMAT_BC2_UNORM_SRGB:
+        case DXGI_FORMAT_BC3_TYPELESS:
+        case DXGI_FORMAT_BC3_UNORM:
+        case DXGI_FORMAT_BC3_UNORM_SRGB:
+        case DXGI_FORMAT_BC5_TYPELESS:
+        case DXGI_FORMAT_BC5_UNORM:
+        case DXGI_FORMAT_BC5_SNORM:
+        case DXGI_FORMAT_BC6H_TYPELESS:
+        case DXGI_FORMAT_BC6H_UF16:
+        case DXGI_FORMAT_BC6H_SF16:
+        case DXGI_FORMAT_BC7_TYPELESS:
+        case DXGI_FORMAT_BC7_UNORM:
+        case DXGI_FORMAT_BC7_UNORM_SRGB:
+            return blocks * 16;
+        default:
+            return uint64_t(width) * height * BitsPerPixel(format) / 8;
+        }
+    }
+
+    // What the description asks for, drivers add alignment and metadata on top.
+    uint64_t ResourceBytes(ID3D11Resource* resource)
+    {
+        D3D11_RESOURCE_DIMENSION dimension;
+        resource->GetType(&dimension);
+
+        uint64_t bytes = 0;
+        switch (dimension)
+        {
+        case D3D11_RESOURCE_DIMENSION_BUFFER:
+        {
+            Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+            if (SUCCEEDED(resource->QueryInterface(buffer.GetAddressOf())))
+            {
+                D3D11_BUFFER_DESC desc;
+                buffer->GetDesc(&desc);
+                bytes = desc.ByteWidth;
+            }
+            break;
+        }
+        case D3D11_RESOURCE_DIMENSION_TEXTURE1D:
+        {
+            Microsoft::WRL::ComPtr<ID3D11Texture1D> texture;
+            if (SUCCEEDED(resource->QueryInterface(texture.GetAddressOf())))
+            {
+                D3D11_TEXTURE1D_DESC desc;
+                texture->GetDesc(&desc);
+                for (UINT mip = 0; mip < desc.MipLevels; mip++)
+                    bytes += SurfaceBytes(desc.Format, (std::max)(desc.Width >> mip, 1u), 1);
+                bytes *= desc.ArraySize;
+            }
+            break;
+        }
+        case D3D11_RESOURCE_DIMENSION_TEXTURE2D:
+        {
+            Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+            if (SUCCEEDED(resource->QueryInterface(texture.GetAddressOf())))
+            {
+                D3D11_TEXTURE2D_DESC desc;
+                texture->GetDesc(&desc);
+                for (UINT mip = 0; mip < desc.MipLevels; mip++)
+                    bytes += SurfaceBytes(desc.Format, (std::max)(desc.Width >> mip, 1u), (std::max)(desc.Height >> mip, 1u));
+                bytes *= uint64_t(desc.ArraySize) * desc.SampleDesc.Count;
+            }
+            break;
+        }
+        case D3D11_RESOURCE_DIMENSION_TEXTURE3D:
+        {
+            Microsoft::WRL::ComPtr<ID3D11Texture3D> texture;
+            if (SUCCEEDED(resource->QueryInterface(texture.GetAddressOf())))
+            {
+                D3D11_TEXTURE3D_DESC desc;
+                texture->GetDesc(&desc);
+                for (UINT mip = 0; mip < desc.MipLevels; mip++)
+                {
+                    bytes += SurfaceBytes(desc.Format, (std::max)(desc.Width >> mip, 1u), (std::max)(desc.Height >> mip, 1u)) *
+                        (std::max)(desc.Depth >> mip, 1u);
+                }
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        return bytes;
+    }
+#else
+    int64_t GetPrivateBytes()
+    {
+        return 0;
+    }
+#endif
+}
+
+#ifdef MEMORY_TRACKER_HOOK_NEW
+void* operator new(size_t size)
+{
+    return AllocateOrThrow(size, alignof(std::max_align_t));
+}
+
+void* operator new[](size_t size)
+{
+    return AllocateOrThrow(size, alignof(std::max_align_t));
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return Allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return Allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return AllocateOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return AllocateOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return Allocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return Allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* p) noexcept { Free(p); }
+void operator delete[](void* p) noexcept { Free(p); }
+void operator delete(void* p, size_t) noexcept { Free(p); }
+void operator delete[](void* p, size_t) noexcept { Free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { Free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { Free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { Free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { Free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { Free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { Free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { Free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { Free(p); }
+#endif
+
+MemoryTracker::TagStats MemoryTracker::GetStats(MemoryTag tag)
+{
+    int64_t current[kTagCount];
+    SamplePeaks(current);
+    return SumCounters(static_cast<size_t>(tag), current);
+}
+
+MemoryTracker::TagStats MemoryTracker::GetTotalStats()
+{
+    int64_t current[kTagCount];
+    SamplePeaks(current);
+
+    TagStats total = {};
+    for (size_t i = 0; i < kTagCount; i++)
+    {
+        const TagStats stats = SumCounters(i, current);
+        total.CurrentBytes += stats.CurrentBytes;
+        total.LiveAllocations += stats.LiveAllocations;
+        total.Allocations += stats.Allocations;
+    }
+    total.PeakBytes = gTotalPeak.load(std::memory_order_relaxed);
+    return total;
+}
+
+const char* MemoryTracker::GetTagName(MemoryTag tag)
+{
+    return tag < MemoryTag::Count ? kTagNames[static_cast<size_t>(tag)] : "invalid";
+}
+
+void MemoryTracker::Add(MemoryTag tag, size_t bytes)
+{
+    CountAllocation(tag, static_cast<int64_t>(bytes));
+}
+
+void MemoryTracker::Remove(MemoryTag tag, size_t bytes)
+{
+    CountFree(tag, static_cast<int64_t>(bytes));
+}
+
+void MemoryTracker::LogStats(const char* when)
+{
+    LOG("Memory ", when, ":");
+    for (size_t i = 0; i < kTagCount; i++)
+    {
+        const MemoryTag tag = static_cast<MemoryTag>(i);
+        const TagStats stats = GetStats(tag);
+        LOG("  ", GetTagName(tag), ": ", stats.CurrentBytes / 1024, " KB, peak ", stats.PeakBytes / 1024, " KB, ", stats.LiveAllocations,
+            " live of ", stats.Allocations, " allocations");
+    }
+    const TagStats total = GetTotalStats();
+    LOG("  total: ", total.CurrentBytes / 1024, " KB, peak ", total.PeakBytes / 1024, " KB, ", total.LiveAllocations, " live of ",
+        total.Allocations, " allocations");
+}
+
+MemoryTracker::Scope::Scope(MemoryTag tag)
+    : mPrevious(tCurrentTag)
+{
+    tCurrentTag = tag;
+}
+
+MemoryTracker::Scope::~Scope()
+{
+    tCurrentTag = mPrevious;
+}
+
+MemoryTracker::ExternalAllocation::ExternalAllocation(MemoryTag tag)
+    : mTag(tag),
+    mStartPrivate(GetPrivateBytes()),
+    mStartTracked(GetTotalStats().CurrentBytes),
+    mBytes(0)
+{
+}
+
+MemoryTracker::ExternalAllocation::~ExternalAllocation()
+{
+    if (mBytes)
+        Remove(mTag, mBytes);
+}
+
+void MemoryTracker::ExternalAllocation::Measure()
+{
+    if (mBytes)
+        Remove(mTag, mBytes);
+
+    // Other threads allocating meanwhile make this an estimate
+    const int64_t tracked = GetTotalStats().CurrentBytes - mStartTracked;
+    const int64_t external = GetPrivateBytes() - mStartPrivate - tracked;
+    mBytes = external > 0 ? static_cast<size_t>(external) : 0;
+    if (mBytes)
+        Add(mTag, mBytes);
+}
+
+void MemoryTracker::TrackGpuResource(ID3D11Resource* resource, MemoryTag tag)
+{
+#ifdef _WIN32
+    if (!resource)
+        return;
+
+    // Replacing earlier private data releases it, so tracking twice moves the resource to tag.
+    GpuAllocation* allocation = new GpuAllocation(tag, ResourceBytes(resource));
+    resource->SetPrivateDataInterface(kGpuAllocationGuid, allocation);
+    allocation->Release();
+#else
+    (void)resource;
+    (void)tag;
+#endif
+}
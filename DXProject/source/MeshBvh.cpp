@@ -0,0 +1,510 @@
+#include <MeshBvh.h>
+#include <JobSystem.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <emmintrin.h>
+
+namespace
+{
+    const int kBinCount = 16;
+    const uint32_t kMaxLeafSize = 4;
+    // Subtrees with more triangles than this are built in their own job.
+    const uint32_t kParallelThreshold = 16 * 1024;
+    // Deeper nodes are split at the object median, which bounds the tree depth and so
+    // the traversal stack: every 4-wide level pushes at most four entries.
+    const int kMaxSahDepth = 48;
+    const int kStackSize = 256;
+
+    const float kInfinity = std::numeric_limits<float>::infinity();
+
+    struct Aabb
+    {
+        float Min[3];
+        float Max[3];
+
+        void Reset()
+        {
+            Min[0] = Min[1] = Min[2] = kInfinity;
+            Max[0] = Max[1] = Max[2] = -kInfinity;
+        }
+
+        void Grow(const float* p)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                Min[i] = (std::min)(Min[i], p[i]);
+                Max[i] = (std::max)(Max[i], p[i]);
+            }
+        }
+
+        void Grow(const Aabb& box)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                Min[i] = (std::min)(Min[i], box.Min[i]);
+                Max[i] = (std::max)(Max[i], box.Max[i]);
+            }
+        }
+
+        // Half the surface area, only used in ratios
+        float Area() const
+        {
+            float x = Max[0] - Min[0], y = Max[1] - Min[1], z = Max[2] - Min[2];
+            return x < 0.0f ? 0.0f : x * y + y * z + z * x;
+        }
+    };
+
+    // Triangle bounds with the centroid, moved around by the partitions so that the
+    // triangles of a node are contiguous in memory.
+    struct Reference
+    {
+        Aabb Box;
+        float Centroid[3];
+        uint32_t Triangle;
+    };
+
+    inline const float* Position(const float* positions, size_t stride, uint32_t index)
+    {
+        return reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + stride * index);
+    }
+}
+
+struct MeshBvh::BuildNode
+{
+    Aabb Box;
+    int32_t Left; // The right child follows the left one, -1 for leaves
+    uint32_t First;
+    uint32_t Count;
+};
+
+struct MeshBvh::BuildState
+{
+    const float* Positions;
+    size_t PositionStride;
+    const uint32_t* Indices;
+
+    std::vector<Reference> References; // Every node owns a range
+
+    // Preallocated for the worst case, children are taken in pairs from all threads.
+    std::vector<BuildNode> Nodes;
+    std::atomic<uint32_t> NodeCount;
+};
+
+MeshBvh::MeshBvh()
+    : mStats()
+{
+}
+
+void MeshBvh::Build(const float* positions, size_t positionStride, const uint32_t* indices, size_t indexCount)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    mNodes.clear();
+    mBlocks.clear();
+    mStats = BuildStats();
+
+    const uint32_t triangleCount = static_cast<uint32_t>(indexCount / 3);
+    mStats.TriangleCount = triangleCount;
+    if (triangleCount == 0)
+        return;
+
+    BuildState state;
+    state.Positions = positions;
+    state.PositionStride = positionStride;
+    state.Indices = indices;
+    state.References.resize(triangleCount);
+    state.Nodes.resize(size_t(triangleCount) * 2);
+    state.NodeCount = 1;
+
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        Reference& reference = state.References[t];
+        reference.Box.Reset();
+        for (int i = 0; i < 3; i++)
+            reference.Box.Grow(Position(positions, positionStride, indices[t * 3 + i]));
+        for (int i = 0; i < 3; i++)
+            reference.Centroid[i] = 0.5f * (reference.Box.Min[i] + reference.Box.Max[i]);
+        reference.Triangle = t;
+    }
+
+    Subdivide(state, 0, 0, triangleCount, 0);
+
+    // Collapse into 4-wide nodes, a root leaf still gets a node.
+    const BuildNode& root = state.Nodes[0];
+    mNodes.reserve(state.NodeCount / 2 + 1);
+    mBlocks.reserve(state.NodeCount / 2 + 1);
+    if (root.Left < 0)
+    {
+        mNodes.emplace_back();
+        int32_t block = AddBlock(state, root);
+        Node& node = mNodes[0];
+        node.ChildCount = 1;
+        node.Children[0] = ~block;
+        node.MinX[0] = root.Box.Min[0]; node.MinY[0] = root.Box.Min[1]; node.MinZ[0] = root.Box.Min[2];
+        node.MaxX[0] = root.Box.Max[0]; node.MaxY[0] = root.Box.Max[1]; node.MaxZ[0] = root.Box.Max[2];
+    }
+    else
+    {
+        Collapse(state, 0);
+    }
+
+    mStats.NodeCount = mNodes.size();
+    mStats.LeafCount = mBlocks.size();
+    mStats.ThreadCount = JobSystem::Get().GetThreadCount();
+    mStats.Milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void MeshBvh::Subdivide(BuildState& state, uint32_t nodeIndex, uint32_t first, uint32_t count, int depth)
+{
+    BuildNode& node = state.Nodes[nodeIndex];
+    Reference* references = state.References.data() + first;
+
+    Aabb centroidBox;
+    node.Box.Reset();
+    centroidBox.Reset();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        node.Box.Grow(references[i].Box);
+        centroidBox.Grow(references[i].Centroid);
+    }
+    node.Left = -1;
+    node.First = first;
+    node.Count = count;
+
+    if (count <= kMaxLeafSize)
+        return;
+
+    // Binned SAH over the centroid bounds on all three axes
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = kInfinity;
+    if (depth < kMaxSahDepth)
+    {
+        // One pass over the triangles fills the bins of all axes.
+        float scale[3];
+        Aabb binBoxes[3][kBinCount];
+        uint32_t binCounts[3][kBinCount] = {};
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float extent = centroidBox.Max[axis] - centroidBox.Min[axis];
+            scale[axis] = extent > 0.0f ? kBinCount / extent : 0.0f;
+            for (Aabb& box : binBoxes[axis])
+                box.Reset();
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const Reference& reference = references[i];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                int bin = (std::min)(kBinCount - 1, static_cast<int>((reference.Centroid[axis] - centroidBox.Min[axis]) * scale[axis]));
+                binCounts[axis][bin]++;
+                binBoxes[axis][bin].Grow(reference.Box);
+            }
+        }
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (scale[axis] == 0.0f)
+                continue;
+
+            // Cost of splitting after bin i is area * count of both sides.
+            float leftCost[kBinCount - 1];
+            Aabb box;
+            box.Reset();
+            uint32_t leftCount = 0;
+            for (int i = 0; i < kBinCount - 1; i++)
+            {
+                box.Grow(binBoxes[axis][i]);
+                leftCount += binCounts[axis][i];
+                leftCost[i] = box.Area() * leftCount;
+            }
+
+            box.Reset();
+            uint32_t rightCount = 0;
+            for (int i = kBinCount - 1; i > 0; i--)
+            {
+                box.Grow(binBoxes[axis][i]);
+                rightCount += binCounts[axis][i];
+                float cost = leftCost[i - 1] + box.Area() * rightCount;
+                if (rightCount < count && rightCount > 0 && cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i - 1;
+                }
+            }
+        }
+    }
+
+    uint32_t leftCount = 0;
+    if (bestAxis >= 0)
+    {
+        const float scale = kBinCount / (centroidBox.Max[bestAxis] - centroidBox.Min[bestAxis]);
+        const float minimum = centroidBox.Min[bestAxis];
+        Reference* middle = std::partition(references, references + count, [&](const Reference& reference)
+        {
+            return (std::min)(kBinCount - 1, static_cast<int>((reference.Centroid[bestAxis] - minimum) * scale)) <= bestSplit;
+        });
+        leftCount = static_cast<uint32_t>(middle - references);
+    }
+
+    if (leftCount == 0 || leftCount == count)
+    {
+        // Object median on the longest axis, for deep nodes and centroids that can not be binned
+        int axis = 0;
+        for (int i = 1; i < 3; i++)
+        {
+            if (centroidBox.Max[i] - centroidBox.Min[i] > centroidBox.Max[axis] - centroidBox.Min[axis])
+                axis = i;
+        }
+        leftCount = count / 2;
+        std::nth_element(references, references + leftCount, references + count, [&](const Reference& a, const Reference& b)
+        {
+            return a.Centroid[axis] < b.Centroid[axis];
+        });
+    }
+
+    const uint32_t left = state.NodeCount.fetch_add(2);
+    node.Left = static_cast<int32_t>(left);
+
+    if (count >= kParallelThreshold)
+    {
+        JobSystem& jobs = JobSystem::Get();
+        JobSystem::Counter counter;
+        BuildState* pState = &state;
+        jobs.Run([=]() { Subdivide(*pState, left, first, leftCount, depth + 1); }, &counter);
+        Subdivide(state, left + 1, first + leftCount, count - leftCount, depth + 1);
+        jobs.Wait(counter);
+    }
+    else
+    {
+        Subdivide(state, left, first, leftCount, depth + 1);
+        Subdivide(state, left + 1, first + leftCount, count - leftCount, depth + 1);
+    }
+}
+
+int32_t MeshBvh::Collapse(const BuildState& state, uint32_t buildNode)
+{
+    const BuildNode& source = state.Nodes[buildNode];
+
+    // Open the largest interior children until there are four.
+    uint32_t children[4] = { uint32_t(source.Left), uint32_t(source.Left + 1) };
+    int childCount = 2;
+    while (childCount < 4)
+    {
+        int largest = -1;
+        for (int i = 0; i < childCount; i++)
+        {
+            const BuildNode& child = state.Nodes[children[i]];
+            if (child.Left >= 0 && (largest < 0 || child.Box.Area() > state.Nodes[children[largest]].Box.Area()))
+                largest = i;
+        }
+        if (largest < 0)
+            break;
+
+        uint32_t opened = children[largest];
+        children[largest] = uint32_t(state.Nodes[opened].Left);
+        children[childCount++] = uint32_t(state.Nodes[opened].Left + 1);
+    }
+
+    const int32_t nodeIndex = static_cast<int32_t>(mNodes.size());
+    mNodes.emplace_back();
+
+    for (int i = 0; i < childCount; i++)
+    {
+        const BuildNode& child = state.Nodes[children[i]];
+        int32_t value = child.Left >= 0 ? Collapse(state, children[i]) : ~AddBlock(state, child);
+
+        // Recursion grows mNodes, the node is looked up again.
+        Node& node = mNodes[nodeIndex];
+        node.Children[i] = value;
+        node.MinX[i] = child.Box.Min[0];
+        node.MinY[i] = child.Box.Min[1];
+        node.MinZ[i] = child.Box.Min[2];
+        node.MaxX[i] = child.Box.Max[0];
+        node.MaxY[i] = child.Box.Max[1];
+        node.MaxZ[i] = child.Box.Max[2];
+    }
+
+    Node& node = mNodes[nodeIndex];
+    node.ChildCount = childCount;
+    for (int i = childCount; i < 4; i++)
+    {
+        node.Children[i] = 0;
+        node.MinX[i] = node.MinY[i] = node.MinZ[i] = 0.0f;
+        node.MaxX[i] = node.MaxY[i] = node.MaxZ[i] = 0.0f;
+    }
+    return nodeIndex;
+}
+
+int32_t MeshBvh::AddBlock(const BuildState& state, const BuildNode& leaf)
+{
+    TriangleBlock block = {};
+    for (uint32_t lane = 0; lane < 4; lane++)
+    {
+        if (lane >= leaf.Count)
+        {
+            // Zero edges never pass the determinant test.
+            block.Triangles[lane] = UINT32_MAX;
+            continue;
+        }
+
+        uint32_t t = state.References[leaf.First + lane].Triangle;
+        const float* p0 = Position(state.Positions, state.PositionStride, state.Indices[t * 3]);
+        const float* p1 = Position(state.Positions, state.PositionStride, state.Indices[t * 3 + 1]);
+        const float* p2 = Position(state.Positions, state.PositionStride, state.Indices[t * 3 + 2]);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            block.V0[axis][lane] = p0[axis];
+            block.E1[axis][lane] = p1[axis] - p0[axis];
+            block.E2[axis][lane] = p2[axis] - p0[axis];
+        }
+        block.Triangles[lane] = t;
+    }
+
+    mBlocks.push_back(block);
+    return static_cast<int32_t>(mBlocks.size() - 1);
+}
+
+bool MeshBvh::Intersect(const float origin[3], const float direction[3], float maxDistance, Hit& hit) const
+{
+    if (mNodes.empty())
+        return false;
+
+    // Zero direction components would give 0 * inf in the slab test.
+    float inverse[3];
+    for (int i = 0; i < 3; i++)
+    {
+        float d = std::fabs(direction[i]) < 1e-30f ? (direction[i] < 0.0f ? -1e-30f : 1e-30f) : direction[i];
+        inverse[i] = 1.0f / d;
+    }
+
+    const __m128 ox = _mm_set1_ps(origin[0]), oy = _mm_set1_ps(origin[1]), oz = _mm_set1_ps(origin[2]);
+    const __m128 dx = _mm_set1_ps(direction[0]), dy = _mm_set1_ps(direction[1]), dz = _mm_set1_ps(direction[2]);
+    const __m128 ix = _mm_set1_ps(inverse[0]), iy = _mm_set1_ps(inverse[1]), iz = _mm_set1_ps(inverse[2]);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    float best = maxDistance;
+    bool found = false;
+
+    struct Entry
+    {
+        int32_t Node;
+        float Distance;
+    };
+    Entry stack[kStackSize];
+    int stackSize = 0;
+    stack[stackSize++] = { 0, 0.0f };
+
+    while (stackSize > 0)
+    {
+        const Entry entry = stack[--stackSize];
+        if (entry.Distance > best)
+            continue;
+
+        if (entry.Node < 0)
+        {
+            // Moller-Trumbore on four triangles
+            const TriangleBlock& block = mBlocks[~entry.Node];
+            const __m128 e1x = _mm_load_ps(block.E1[0]), e1y = _mm_load_ps(block.E1[1]), e1z = _mm_load_ps(block.E1[2]);
+            const __m128 e2x = _mm_load_ps(block.E2[0]), e2y = _mm_load_ps(block.E2[1]), e2z = _mm_load_ps(block.E2[2]);
+
+            __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+            __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+            __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+            __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+            __m128 invDet = _mm_div_ps(one, det);
+
+            __m128 tx = _mm_sub_ps(ox, _mm_load_ps(block.V0[0]));
+            __m128 ty = _mm_sub_ps(oy, _mm_load_ps(block.V0[1]));
+            __m128 tz = _mm_sub_ps(oz, _mm_load_ps(block.V0[2]));
+            __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+
+            __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+            __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+            __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+            __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+            __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+            __m128 valid = _mm_cmpneq_ps(det, zero);
+            valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+            valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+            valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+            valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, zero));
+            valid = _mm_and_ps(valid, _mm_cmple_ps(t, _mm_set1_ps(best)));
+
+            int mask = _mm_movemask_ps(valid);
+            if (mask)
+            {
+                alignas(16) float ts[4], us[4], vs[4];
+                _mm_store_ps(ts, t);
+                _mm_store_ps(us, u);
+                _mm_store_ps(vs, v);
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    if ((mask & (1 << lane)) && ts[lane] <= best)
+                    {
+                        best = ts[lane];
+                        hit.Triangle = block.Triangles[lane];
+                        hit.Distance = ts[lane];
+                        hit.U = us[lane];
+                        hit.V = vs[lane];
+                        found = true;
+                    }
+                }
+            }
+            continue;
+        }
+
+        // Slab test of the four children
+        const Node& node = mNodes[entry.Node];
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MinX), ox), ix);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MaxX), ox), ix);
+        __m128 tNear = _mm_min_ps(t0, t1);
+        __m128 tFar = _mm_max_ps(t0, t1);
+
+        t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MinY), oy), iy);
+        t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MaxY), oy), iy);
+        tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+        tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+
+        t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MinZ), oz), iz);
+        t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MaxZ), oz), iz);
+        tNear = _mm_max_ps(_mm_max_ps(tNear, _mm_min_ps(t0, t1)), zero);
+        tFar = _mm_min_ps(_mm_min_ps(tFar, _mm_max_ps(t0, t1)), _mm_set1_ps(best));
+
+        int mask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) & ((1 << node.ChildCount) - 1);
+        if (!mask)
+            continue;
+
+        alignas(16) float distances[4];
+        _mm_store_ps(distances, tNear);
+
+        // Push the farthest child first so the nearest one is visited next.
+        Entry hits[4];
+        int hitCount = 0;
+        for (int lane = 0; lane < 4; lane++)
+        {
+            if (!(mask & (1 << lane)))
+                continue;
+            Entry child = { node.Children[lane], distances[lane] };
+            int i = hitCount++;
+            for (; i > 0 && hits[i - 1].Distance < child.Distance; i--)
+                hits[i] = hits[i - 1];
+            hits[i] = child;
+        }
+
+        assert(stackSize + hitCount <= kStackSize);
+        for (int i = 0; i < hitCount; i++)
+            stack[stackSize++] = hits[i];
+    }
+
+    return found;
+}
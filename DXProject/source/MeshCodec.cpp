@@ -0,0 +1,839 @@
+#include <MeshCodec.h>
+#include <JobSystem.h>
+#include <SimdMath.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define MESH_CODEC_X86 1
+#include <immintrin.h>
+#endif
+
+// MSVC compiles the intrinsics of any instruction set, GCC and Clang only in functions
+// that target it.
+#if defined(MESH_CODEC_X86) && defined(__GNUC__)
+#define MESH_CODEC_TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#else
+#define MESH_CODEC_TARGET_AVX2
+#endif
+
+namespace
+{
+    // Probabilities are scaled to 2^12. States stay in [2^16, 2^32) and are renormalized
+    // 16 bits at a time, so one renormalization step is always enough. 32 states give the
+    // AVX2 decoder four independent registers of eight, enough to hide the gather latency.
+    const uint32_t kProbBits = 12;
+    const uint32_t kProbScale = 1u << kProbBits;
+    const uint32_t kRansLow = 1u << 16;
+    const int kRansStates = 32;
+
+    // Streams this small are stored as they are, the frequency table and the states would
+    // cost more.
+    const size_t kMinRansSize = 256;
+    // Nearly random planes, the low mantissa bytes, decode many times faster when stored
+    // as they are. Coding has to save at least 1/kMinRansSaving of the size.
+    const size_t kMinRansSaving = 16;
+
+    // Vertex data at least this large is decoded on the job system, a column per job
+    const size_t kParallelDecodeSize = 256 * 1024;
+    const size_t kInterleaveGrainSize = 16 * 1024;
+
+    enum StreamMode : uint8_t
+    {
+        kStreamRaw,
+        kStreamConstant, // One symbol repeated
+        kStreamRans
+    };
+
+    // Index coding. Codes 0x00-0xEF are triangles with an edge from the edge FIFO:
+    // high nibble = edge FIFO slot, low nibble = how the third vertex is coded.
+    // 0xF0 is a triangle without a known edge, followed by one vertex code per vertex.
+    const int kEdgeFifoSize = 16;
+    const int kEdgeFifoSearch = 15;
+    const int kVertexFifoSize = 16;
+    const uint8_t kVertexNext = 0;      // The next vertex not used so far
+    const uint8_t kVertexFifoFirst = 1; // 1..14: vertex FIFO slot + 1
+    const int kVertexFifoSearch = 14;
+    const uint8_t kVertexExplicit = 15; // Delta to the previous explicit index follows
+    const uint8_t kFreeTriangle = 0xF0;
+
+    void PutU32(std::vector<uint8_t>& out, uint32_t value)
+    {
+        uint8_t bytes[4];
+        memcpy(bytes, &value, 4);
+        out.insert(out.end(), bytes, bytes + 4);
+    }
+
+    void PutVarint(std::vector<uint8_t>& out, uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    uint32_t ZigZag(uint32_t delta)
+    {
+        return (delta << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+    }
+
+    uint32_t UnZigZag(uint32_t value)
+    {
+        return (value >> 1) ^ (0u - (value & 1));
+    }
+
+    class Reader
+    {
+    public:
+        Reader(const uint8_t* data, size_t size)
+            : mpNext(data),
+            mpEnd(data + size)
+        {
+        }
+
+        bool U32(uint32_t& value)
+        {
+            if (Remaining() < 4)
+                return false;
+            memcpy(&value, mpNext, 4);
+            mpNext += 4;
+            return true;
+        }
+
+        bool Byte(uint8_t& value)
+        {
+            if (mpNext == mpEnd)
+                return false;
+            value = *mpNext++;
+            return true;
+        }
+
+        bool Varint(uint32_t& value)
+        {
+            value = 0;
+            for (int shift = 0; shift < 35; shift += 7)
+            {
+                uint8_t byte;
+                if (!Byte(byte))
+                    return false;
+                value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80))
+                    return true;
+            }
+            return false;
+        }
+
+        bool Skip(size_t size, const uint8_t*& data)
+        {
+            if (Remaining() < size)
+                return false;
+            data = mpNext;
+            mpNext += size;
+            return true;
+        }
+
+        size_t Remaining() const { return static_cast<size_t>(mpEnd - mpNext); }
+
+    private:
+        const uint8_t* mpNext;
+        const uint8_t* mpEnd;
+    };
+
+    // Counts scaled to kProbScale, every symbol that occurs keeps at least 1.
+    void NormalizeFrequencies(const uint32_t counts[256], size_t total, uint32_t freqs[256])
+    {
+        uint32_t sum = 0;
+        for (int s = 0; s < 256; s++)
+        {
+            freqs[s] = counts[s] ? (std::max)(1u, static_cast<uint32_t>((uint64_t(counts[s]) * kProbScale) / total)) : 0;
+            sum += freqs[s];
+        }
+
+        // Rounding leaves the sum off by less than the symbol count. The difference goes to
+        // or comes from the most frequent symbols, where it costs the least.
+        while (sum != kProbScale)
+        {
+            int largest = 0;
+            for (int s = 1; s < 256; s++)
+            {
+                if (freqs[s] > freqs[largest])
+                    largest = s;
+            }
+            if (sum < kProbScale)
+            {
+                freqs[largest] += kProbScale - sum;
+                sum = kProbScale;
+            }
+            else
+            {
+                uint32_t take = (std::min)(sum - kProbScale, freqs[largest] - 1);
+                if (take == 0)
+                    take = 1; // Cannot happen with fewer than kProbScale symbols
+                freqs[largest] -= take;
+                sum -= take;
+            }
+        }
+    }
+
+    // <u32 encoded size> <u32 raw size> <u8 mode> <payload>
+    void EncodeStream(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+    {
+        const size_t sizeOffset = out.size();
+        PutU32(out, 0);
+        PutU32(out, static_cast<uint32_t>(size));
+
+        uint32_t counts[256] = {};
+        for (size_t i = 0; i < size; i++)
+            counts[data[i]]++;
+
+        if (size > 0 && counts[data[0]] == size)
+        {
+            out.push_back(kStreamConstant);
+            out.push_back(data[0]);
+        }
+        else if (size < kMinRansSize)
+        {
+            out.push_back(kStreamRaw);
+            out.insert(out.end(), data, data + size);
+        }
+        else
+        {
+            uint32_t freqs[256], starts[256];
+            NormalizeFrequencies(counts, size, freqs);
+            uint32_t start = 0;
+            for (int s = 0; s < 256; s++)
+            {
+                starts[s] = start;
+                start += freqs[s];
+            }
+
+            // Encoded backwards so the decoder runs forwards. Symbol i belongs to state
+            // i % kRansStates.
+            std::vector<uint16_t> words;
+            words.reserve(size / 2 + 16);
+            uint32_t states[kRansStates];
+            std::fill(states, states + kRansStates, kRansLow);
+            for (size_t i = size; i-- > 0;)
+            {
+                uint32_t& x = states[i % kRansStates];
+                const uint32_t freq = freqs[data[i]];
+                const uint32_t xMax = ((kRansLow >> kProbBits) << 16) * freq;
+                if (x >= xMax)
+                {
+                    words.push_back(static_cast<uint16_t>(x));
+                    x >>= 16;
+                }
+                x = ((x / freq) << kProbBits) + (x % freq) + starts[data[i]];
+            }
+            std::reverse(words.begin(), words.end());
+
+            std::vector<uint8_t> payload;
+            payload.reserve(64 + words.size() * 2);
+            uint8_t present[32] = {};
+            for (int s = 0; s < 256; s++)
+            {
+                if (freqs[s])
+                    present[s >> 3] |= static_cast<uint8_t>(1 << (s & 7));
+            }
+            payload.insert(payload.end(), present, present + 32);
+            for (int s = 0; s < 256; s++)
+            {
+                if (freqs[s])
+                    PutVarint(payload, freqs[s] - 1);
+            }
+            for (int k = 0; k < kRansStates; k++)
+                PutU32(payload, states[k]);
+            const uint8_t* wordBytes = reinterpret_cast<const uint8_t*>(words.data());
+            payload.insert(payload.end(), wordBytes, wordBytes + words.size() * 2);
+
+            if (payload.size() < size - size / kMinRansSaving)
+            {
+                out.push_back(kStreamRans);
+                out.insert(out.end(), payload.begin(), payload.end());
+            }
+            else
+            {
+                out.push_back(kStreamRaw);
+                out.insert(out.end(), data, data + size);
+            }
+        }
+
+        const uint32_t encodedSize = static_cast<uint32_t>(out.size() - sizeOffset - 4);
+        memcpy(&out[sizeOffset], &encodedSize, 4);
+    }
+
+    uint32_t RansAdvance(uint32_t entry, uint32_t x)
+    {
+        return ((entry >> 8) & 0xFFF) * (x >> kProbBits) + (entry >> 20);
+    }
+
+    uint32_t LoadWord(const uint8_t* words, uint32_t index)
+    {
+        uint16_t word;
+        memcpy(&word, words + 2 * index, 2);
+        return word;
+    }
+
+    // The bulk of a stream, as long as at least one word per state is left so that the
+    // reads need no checks. Returns the number of symbols decoded. States are kept in a
+    // local array, stores to dest could alias the caller's, and advanced four at a time.
+    size_t DecodeRansFast(const uint32_t* table, uint32_t states[kRansStates], const uint8_t*& words, const uint8_t* wordsEnd,
+        uint8_t* dest, size_t size)
+    {
+        static_assert(kRansStates % 4 == 0, "The loop is unrolled for four states");
+        uint32_t x[kRansStates];
+        std::copy(states, states + kRansStates, x);
+        const uint8_t* next = words;
+
+        size_t i = 0;
+        for (; i + kRansStates <= size && static_cast<size_t>(wordsEnd - next) >= 2 * kRansStates; i += kRansStates)
+        {
+            for (int k = 0; k < kRansStates; k += 4)
+            {
+                uint32_t x0 = x[k], x1 = x[k + 1], x2 = x[k + 2], x3 = x[k + 3];
+                const uint32_t e0 = table[x0 & (kProbScale - 1)];
+                const uint32_t e1 = table[x1 & (kProbScale - 1)];
+                const uint32_t e2 = table[x2 & (kProbScale - 1)];
+                const uint32_t e3 = table[x3 & (kProbScale - 1)];
+                x0 = RansAdvance(e0, x0);
+                x1 = RansAdvance(e1, x1);
+                x2 = RansAdvance(e2, x2);
+                x3 = RansAdvance(e3, x3);
+                // Each state takes the word after the ones taken by the states before it. The
+                // offsets come from the comparisons alone, so the four loads do not wait on each
+                // other, and the refills are selects, branches would be mispredicted often.
+                const uint32_t n0 = x0 < kRansLow, n1 = x1 < kRansLow, n2 = x2 < kRansLow, n3 = x3 < kRansLow;
+                const uint32_t w0 = LoadWord(next, 0), w1 = LoadWord(next, n0), w2 = LoadWord(next, n0 + n1), w3 = LoadWord(next, n0 + n1 + n2);
+                x[k] = n0 ? (x0 << 16) | w0 : x0;
+                x[k + 1] = n1 ? (x1 << 16) | w1 : x1;
+                x[k + 2] = n2 ? (x2 << 16) | w2 : x2;
+                x[k + 3] = n3 ? (x3 << 16) | w3 : x3;
+                next += 2 * (n0 + n1 + n2 + n3);
+                const uint32_t symbols = (e0 & 0xFF) | ((e1 & 0xFF) << 8) | ((e2 & 0xFF) << 16) | (e3 << 24);
+                memcpy(dest + i + k, &symbols, 4);
+            }
+        }
+
+        std::copy(x, x + kRansStates, states);
+        words = next;
+        return i;
+    }
+
+#ifdef MESH_CODEC_X86
+    // For each mask of the lanes that refill, the word each lane takes: the one after the
+    // words taken by the lanes before it. Lanes that do not refill ignore theirs.
+    struct RefillOffsets
+    {
+        uint8_t Lanes[256][8];
+
+        RefillOffsets()
+        {
+            for (int mask = 0; mask < 256; mask++)
+            {
+                uint8_t offset = 0;
+                for (int lane = 0; lane < 8; lane++)
+                {
+                    Lanes[mask][lane] = offset;
+                    offset += (mask >> lane) & 1;
+                }
+            }
+        }
+    };
+    const RefillOffsets kRefillOffsets;
+
+    // DecodeRansFast with eight states per register. The table entries are gathered, and
+    // each register refills from one load of the next eight words, permuted into the
+    // lanes that need them.
+    MESH_CODEC_TARGET_AVX2 size_t DecodeRansAVX2(const uint32_t* table, uint32_t states[kRansStates], const uint8_t*& words,
+        const uint8_t* wordsEnd, uint8_t* dest, size_t size)
+    {
+        static_assert(kRansStates == 32, "The loop is unrolled for four registers");
+        const __m256i slotMask = _mm256_set1_epi32(kProbScale - 1);
+        const __m256i freqMask = _mm256_set1_epi32(0xFFF);
+        const __m256i lowMinusOne = _mm256_set1_epi32(kRansLow - 1);
+        // The symbols, the low bytes of the entries, to the first four bytes of each half
+        const __m256i symbolBytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+
+        __m256i x[4];
+        for (int r = 0; r < 4; r++)
+            x[r] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(states + 8 * r));
+        const uint8_t* next = words;
+
+        size_t i = 0;
+        for (; i + kRansStates <= size && static_cast<size_t>(wordsEnd - next) >= 2 * kRansStates; i += kRansStates)
+        {
+            __m256i entries[4], refill[4];
+            for (int r = 0; r < 4; r++)
+                entries[r] = _mm256_i32gather_epi32(reinterpret_cast<const int*>(table), _mm256_and_si256(x[r], slotMask), 4);
+            for (int r = 0; r < 4; r++)
+            {
+                const __m256i freq = _mm256_and_si256(_mm256_srli_epi32(entries[r], 8), freqMask);
+                x[r] = _mm256_add_epi32(_mm256_mullo_epi32(freq, _mm256_srli_epi32(x[r], kProbBits)), _mm256_srli_epi32(entries[r], 20));
+                // Unsigned x < kRansLow
+                refill[r] = _mm256_cmpeq_epi32(_mm256_min_epu32(x[r], lowMinusOne), x[r]);
+            }
+            for (int r = 0; r < 4; r++)
+            {
+                const int mask = _mm256_movemask_ps(_mm256_castsi256_ps(refill[r]));
+                const __m256i offsets = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(kRefillOffsets.Lanes[mask])));
+                const __m256i nextWords = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(next)));
+                const __m256i refilled = _mm256_or_si256(_mm256_slli_epi32(x[r], 16), _mm256_permutevar8x32_epi32(nextWords, offsets));
+                x[r] = _mm256_blendv_epi8(x[r], refilled, refill[r]);
+                next += 2 * _mm_popcnt_u32(static_cast<unsigned>(mask));
+
+                const __m256i symbols = _mm256_shuffle_epi8(entries[r], symbolBytes);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dest + i + 8 * r),
+                    _mm_unpacklo_epi32(_mm256_castsi256_si128(symbols), _mm256_extracti128_si256(symbols, 1)));
+            }
+        }
+
+        for (int r = 0; r < 4; r++)
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(states + 8 * r), x[r]);
+        words = next;
+        return i;
+    }
+#endif
+
+    bool DecodeRans(Reader& reader, uint8_t* dest, size_t size)
+    {
+        uint8_t present[32];
+        for (int i = 0; i < 32; i++)
+        {
+            if (!reader.Byte(present[i]))
+                return false;
+        }
+
+        // One entry per slot: symbol in bits 0-7, frequency in 8-19, slot - start in 20-31.
+        // A symbol with the whole range would be a constant stream.
+        uint32_t table[kProbScale];
+        uint32_t start = 0;
+        for (int s = 0; s < 256; s++)
+        {
+            if (!(present[s >> 3] & (1 << (s & 7))))
+                continue;
+            uint32_t freq;
+            if (!reader.Varint(freq) || ++freq >= kProbScale || start + freq > kProbScale)
+                return false;
+            for (uint32_t slot = 0; slot < freq; slot++)
+                table[start + slot] = static_cast<uint32_t>(s) | (freq << 8) | (slot << 20);
+            start += freq;
+        }
+        if (start != kProbScale)
+            return false;
+
+        uint32_t states[kRansStates];
+        for (int k = 0; k < kRansStates; k++)
+        {
+            if (!reader.U32(states[k]) || states[k] < kRansLow)
+                return false;
+        }
+
+        const uint8_t* words = nullptr;
+        const size_t wordBytes = reader.Remaining() & ~size_t(1);
+        reader.Skip(wordBytes, words);
+        const uint8_t* const wordsEnd = words + wordBytes;
+
+        // Checked steps for the last symbols
+        auto step = [&](uint32_t& x, uint8_t& symbol) -> bool
+        {
+            const uint32_t entry = table[x & (kProbScale - 1)];
+            symbol = static_cast<uint8_t>(entry);
+            x = ((entry >> 8) & 0xFFF) * (x >> kProbBits) + (entry >> 20);
+            if (x < kRansLow)
+            {
+                if (words == wordsEnd)
+                    return false;
+                uint16_t word;
+                memcpy(&word, words, 2);
+                words += 2;
+                x = (x << 16) | word;
+            }
+            return true;
+        };
+
+#ifdef MESH_CODEC_X86
+        // With the AVX2 backend of SimdMath, so SIMD_MATH_SCALAR_ONLY and SetBackend apply here too
+        size_t i = SimdMath::GetBackend() == SimdMath::Backend::AVX2 ? DecodeRansAVX2(table, states, words, wordsEnd, dest, size)
+            : DecodeRansFast(table, states, words, wordsEnd, dest, size);
+#else
+        size_t i = DecodeRansFast(table, states, words, wordsEnd, dest, size);
+#endif
+        for (; i < size; i++)
+        {
+            if (!step(states[i % kRansStates], dest[i]))
+                return false;
+        }
+
+        // The encoder started every state at kRansLow and wrote every word.
+        for (int k = 0; k < kRansStates; k++)
+        {
+            if (states[k] != kRansLow)
+                return false;
+        }
+        return words == wordsEnd;
+    }
+
+    // expectedSize is checked unless it is SIZE_MAX. dest must hold the raw size.
+    bool DecodeStream(Reader& reader, std::vector<uint8_t>& dest, size_t expectedSize)
+    {
+        uint32_t encodedSize, rawSize;
+        const uint8_t* encoded;
+        if (!reader.U32(encodedSize) || !reader.Skip(encodedSize, encoded))
+            return false;
+
+        Reader stream(encoded, encodedSize);
+        uint8_t mode;
+        if (!stream.U32(rawSize) || !stream.Byte(mode) || (expectedSize != SIZE_MAX && rawSize != expectedSize))
+            return false;
+
+        switch (mode)
+        {
+        case kStreamRaw:
+        {
+            const uint8_t* bytes;
+            if (stream.Remaining() != rawSize || !stream.Skip(rawSize, bytes))
+                return false;
+            dest.assign(bytes, bytes + rawSize);
+            return true;
+        }
+
+        case kStreamConstant:
+        {
+            uint8_t symbol;
+            if (!stream.Byte(symbol) || stream.Remaining() != 0)
+                return false;
+            dest.assign(rawSize, symbol);
+            return true;
+        }
+
+        case kStreamRans:
+            dest.resize(rawSize);
+            return DecodeRans(stream, dest.data(), rawSize);
+
+        default:
+            return false;
+        }
+    }
+
+    struct Edge
+    {
+        uint32_t A, B;
+    };
+
+    // Both FIFOs are rings, slot 0 is the most recent entry.
+    struct IndexFifos
+    {
+        Edge Edges[kEdgeFifoSize];
+        uint32_t Vertices[kVertexFifoSize];
+        unsigned EdgeOffset = 0;
+        unsigned VertexOffset = 0;
+
+        IndexFifos()
+        {
+            // Invalid entries never match a real triangle
+            for (Edge& edge : Edges)
+                edge = Edge{ UINT32_MAX, UINT32_MAX };
+            for (uint32_t& vertex : Vertices)
+                vertex = UINT32_MAX;
+        }
+
+        const Edge& GetEdge(int slot) const { return Edges[(EdgeOffset - 1 - slot) & (kEdgeFifoSize - 1)]; }
+        uint32_t GetVertex(int slot) const { return Vertices[(VertexOffset - 1 - slot) & (kVertexFifoSize - 1)]; }
+
+        void PushEdge(uint32_t a, uint32_t b)
+        {
+            Edges[EdgeOffset & (kEdgeFifoSize - 1)] = Edge{ a, b };
+            EdgeOffset++;
+        }
+
+        void PushVertex(uint32_t vertex)
+        {
+            Vertices[VertexOffset & (kVertexFifoSize - 1)] = vertex;
+            VertexOffset++;
+        }
+
+        int FindVertex(uint32_t vertex) const
+        {
+            for (int slot = 0; slot < kVertexFifoSearch; slot++)
+            {
+                if (GetVertex(slot) == vertex)
+                    return slot;
+            }
+            return -1;
+        }
+    };
+
+    // Vertex code for one vertex, which is added to the vertex FIFO unless it was found there.
+    uint8_t EncodeVertex(uint32_t vertex, IndexFifos& fifos, uint32_t& next, uint32_t& lastExplicit, std::vector<uint8_t>& explicitIndices)
+    {
+        if (vertex == next)
+        {
+            next++;
+            fifos.PushVertex(vertex);
+            return kVertexNext;
+        }
+
+        int slot = fifos.FindVertex(vertex);
+        if (slot >= 0)
+            return static_cast<uint8_t>(kVertexFifoFirst + slot);
+
+        PutVarint(explicitIndices, ZigZag(vertex - lastExplicit));
+        lastExplicit = vertex;
+        fifos.PushVertex(vertex);
+        return kVertexExplicit;
+    }
+
+    bool DecodeVertex(uint8_t code, IndexFifos& fifos, uint32_t& next, uint32_t& lastExplicit, Reader& explicitIndices, uint32_t& vertex)
+    {
+        if (code == kVertexNext)
+        {
+            vertex = next++;
+            fifos.PushVertex(vertex);
+            return true;
+        }
+        if (code < kVertexExplicit)
+        {
+            vertex = fifos.GetVertex(code - kVertexFifoFirst);
+            return vertex != UINT32_MAX;
+        }
+
+        uint32_t delta;
+        if (!explicitIndices.Varint(delta))
+            return false;
+        vertex = lastExplicit + UnZigZag(delta);
+        lastExplicit = vertex;
+        fifos.PushVertex(vertex);
+        return true;
+    }
+}
+
+void MeshCodec::EncodeVertices(const void* vertices, size_t count, size_t stride, std::vector<uint8_t>& out)
+{
+    const size_t wordCount = stride / 4;
+    const uint8_t* bytes = static_cast<const uint8_t*>(vertices);
+    std::vector<uint8_t> planes[4];
+    for (std::vector<uint8_t>& plane : planes)
+        plane.resize(count);
+
+    for (size_t column = 0; column < wordCount; column++)
+    {
+        uint32_t previous = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t word;
+            memcpy(&word, bytes + i * stride + column * 4, 4);
+            const uint32_t delta = ZigZag(word - previous);
+            previous = word;
+            planes[0][i] = static_cast<uint8_t>(delta);
+            planes[1][i] = static_cast<uint8_t>(delta >> 8);
+            planes[2][i] = static_cast<uint8_t>(delta >> 16);
+            planes[3][i] = static_cast<uint8_t>(delta >> 24);
+        }
+        for (const std::vector<uint8_t>& plane : planes)
+            EncodeStream(plane.data(), count, out);
+    }
+}
+
+bool MeshCodec::DecodeVertices(const uint8_t* data, size_t size, void* vertices, size_t count, size_t stride)
+{
+    // The streams of each column are found first, so the columns can be decoded in parallel.
+    const size_t wordCount = stride / 4;
+    std::vector<Reader> columnData;
+    columnData.reserve(wordCount);
+    Reader reader(data, size);
+    for (size_t column = 0; column < wordCount; column++)
+    {
+        const size_t remaining = reader.Remaining();
+        const uint8_t* columnStart = data + (size - remaining);
+        for (int plane = 0; plane < 4; plane++)
+        {
+            uint32_t encodedSize;
+            const uint8_t* encoded;
+            if (!reader.U32(encodedSize) || !reader.Skip(encodedSize, encoded))
+                return false;
+        }
+        columnData.push_back(Reader(columnStart, remaining - reader.Remaining()));
+    }
+    if (reader.Remaining() != 0)
+        return false;
+
+    // On several threads, columns are delta decoded into their own arrays and copied into
+    // the vertices at the end by vertex ranges, so that no two threads write to the same
+    // cache lines. On one thread they go straight into the vertices.
+    const bool parallel = count * stride >= kParallelDecodeSize && JobSystem::Get().GetThreadCount() > 1;
+    std::vector<uint32_t> columns(parallel ? wordCount * count : 0);
+    std::atomic<bool> failed(false);
+    auto decodeColumns = [&](size_t first, size_t end)
+    {
+        std::vector<uint8_t> planes[4];
+        for (size_t column = first; column < end; column++)
+        {
+            Reader columnReader = columnData[column];
+            for (std::vector<uint8_t>& plane : planes)
+            {
+                if (!DecodeStream(columnReader, plane, count))
+                {
+                    failed = true;
+                    return;
+                }
+            }
+
+            uint8_t* words = parallel ? reinterpret_cast<uint8_t*>(columns.data() + column * count) : static_cast<uint8_t*>(vertices) + column * 4;
+            const size_t wordStride = parallel ? 4 : stride;
+            uint32_t previous = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                const uint32_t delta = planes[0][i] | (planes[1][i] << 8) | (planes[2][i] << 16) | (static_cast<uint32_t>(planes[3][i]) << 24);
+                previous += UnZigZag(delta);
+                memcpy(words + i * wordStride, &previous, 4);
+            }
+        }
+    };
+    auto interleave = [&](size_t first, size_t end)
+    {
+        uint8_t* bytes = static_cast<uint8_t*>(vertices);
+        for (size_t i = first; i < end; i++)
+        {
+            for (size_t column = 0; column < wordCount; column++)
+                memcpy(bytes + i * stride + column * 4, &columns[column * count + i], 4);
+        }
+    };
+
+    if (!parallel)
+    {
+        decodeColumns(0, wordCount);
+    }
+    else
+    {
+        JobSystem& jobs = JobSystem::Get();
+        jobs.ParallelFor(wordCount, 1, decodeColumns);
+        if (!failed)
+            jobs.ParallelFor(count, kInterleaveGrainSize, interleave);
+    }
+    return !failed;
+}
+
+void MeshCodec::EncodeIndices(const uint32_t* indices, size_t count, std::vector<uint8_t>& out)
+{
+    IndexFifos fifos;
+    std::vector<uint8_t> codes, explicitIndices;
+    codes.reserve(count / 3 + 16);
+    uint32_t next = 0, lastExplicit = 0;
+
+    for (size_t i = 0; i + 2 < count; i += 3)
+    {
+        const uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+
+        // A neighbour that shares an edge, in any rotation of the triangle
+        int edgeSlot = -1;
+        uint32_t x = a, y = b, z = c;
+        for (int slot = 0; slot < kEdgeFifoSearch && edgeSlot < 0; slot++)
+        {
+            const Edge& edge = fifos.GetEdge(slot);
+            if (edge.A == a && edge.B == b)
+                edgeSlot = slot, x = a, y = b, z = c;
+            else if (edge.A == b && edge.B == c)
+                edgeSlot = slot, x = b, y = c, z = a;
+            else if (edge.A == c && edge.B == a)
+                edgeSlot = slot, x = c, y = a, z = b;
+        }
+
+        if (edgeSlot >= 0)
+        {
+            const uint8_t vertexCode = EncodeVertex(z, fifos, next, lastExplicit, explicitIndices);
+            codes.push_back(static_cast<uint8_t>((edgeSlot << 4) | vertexCode));
+        }
+        else
+        {
+            codes.push_back(kFreeTriangle);
+            codes.push_back(EncodeVertex(x, fifos, next, lastExplicit, explicitIndices));
+            codes.push_back(EncodeVertex(y, fifos, next, lastExplicit, explicitIndices));
+            codes.push_back(EncodeVertex(z, fifos, next, lastExplicit, explicitIndices));
+            fifos.PushEdge(y, x);
+        }
+
+        // Reversed, the way the neighbours across them walk these edges
+        fifos.PushEdge(z, y);
+        fifos.PushEdge(x, z);
+    }
+
+    EncodeStream(codes.data(), codes.size(), out);
+    EncodeStream(explicitIndices.data(), explicitIndices.size(), out);
+}
+
+bool MeshCodec::DecodeIndices(const uint8_t* data, size_t size, uint32_t* indices, size_t count, size_t vertexCount)
+{
+    if (count % 3 != 0)
+        return false;
+
+    Reader reader(data, size);
+    std::vector<uint8_t> codes, explicitData;
+    if (!DecodeStream(reader, codes, SIZE_MAX) || !DecodeStream(reader, explicitData, SIZE_MAX) || reader.Remaining() != 0)
+        return false;
+
+    IndexFifos fifos;
+    Reader codeReader(codes.data(), codes.size());
+    Reader explicitIndices(explicitData.data(), explicitData.size());
+    uint32_t next = 0, lastExplicit = 0;
+
+    for (size_t i = 0; i < count; i += 3)
+    {
+        uint8_t code;
+        if (!codeReader.Byte(code))
+            return false;
+
+        uint32_t x, y, z;
+        if (code < kFreeTriangle)
+        {
+            const Edge& edge = fifos.GetEdge(code >> 4);
+            x = edge.A;
+            y = edge.B;
+            if (x == UINT32_MAX || !DecodeVertex(code & 0xF, fifos, next, lastExplicit, explicitIndices, z))
+                return false;
+        }
+        else
+        {
+            uint8_t vertexCodes[3];
+            if (code != kFreeTriangle || !codeReader.Byte(vertexCodes[0]) || !codeReader.Byte(vertexCodes[1]) || !codeReader.Byte(vertexCodes[2]) ||
+                vertexCodes[0] > kVertexExplicit || vertexCodes[1] > kVertexExplicit || vertexCodes[2] > kVertexExplicit ||
+                !DecodeVertex(vertexCodes[0], fifos, next, lastExplicit, explicitIndices, x) ||
+                !DecodeVertex(vertexCodes[1], fifos, next, lastExplicit, explicitIndices, y) ||
+                !DecodeVertex(vertexCodes[2], fifos, next, lastExplicit, explicitIndices, z))
+                return false;
+            fifos.PushEdge(y, x);
+        }
+        fifos.PushEdge(z, y);
+        fifos.PushEdge(x, z);
+
+        if (x >= vertexCount || y >= vertexCount || z >= vertexCount)
+            return false;
+        indices[i] = x;
+        indices[i + 1] = y;
+        indices[i + 2] = z;
+    }
+    return codeReader.Remaining() == 0 && explicitIndices.Remaining() == 0;
+}
+
+std::vector<uint32_t> MeshCodec::ReorderByFirstUse(uint32_t* indices, size_t indexCount, size_t vertexCount)
+{
+    std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        uint32_t& mapped = remap[indices[i]];
+        if (mapped == UINT32_MAX)
+            mapped = next++;
+        indices[i] = mapped;
+    }
+    for (uint32_t& mapped : remap)
+    {
+        if (mapped == UINT32_MAX)
+            mapped = next++;
+    }
+    return remap;
+}
@@ -0,0 +1,221 @@
+#include <Metrics.h>
+
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+namespace
+{
+    // Shared memory layout: Header, MetricCount MetricInfo, then SlotCount slots of a
+    // SlotHeader followed by MetricCount doubles
+    const uint32_t kMagic = 0x544D5844; // "DXMT"
+    const uint32_t kVersion = 1;
+    const size_t kNameSize = 48;
+
+    struct Header
+    {
+        std::atomic<uint32_t> Magic; // Set last, once the rest is written
+        uint32_t Version;
+        uint32_t MetricCount;
+        uint32_t SlotCount;
+        uint32_t SlotSize; // Bytes
+        uint32_t Reserved;
+        std::atomic<uint64_t> Published; // Slots written since the ring was created
+    };
+
+    struct MetricInfo
+    {
+        char Name[kNameSize];
+        MetricKind Kind;
+        uint32_t Reserved;
+    };
+
+    struct SlotHeader
+    {
+        std::atomic<uint64_t> Sequence; // 2 * index + 2 once slot index is written, odd while it is
+        uint64_t Frame;
+        double Seconds;
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "the ring is shared between processes");
+
+    size_t GetSlotSize(uint32_t metricCount)
+    {
+        return sizeof(SlotHeader) + metricCount * sizeof(double);
+    }
+
+    size_t GetSlotsOffset(uint32_t metricCount)
+    {
+        return sizeof(Header) + metricCount * sizeof(MetricInfo);
+    }
+
+    double GetSeconds()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+MetricsRegistry::MetricsRegistry()
+    : mValues(new std::atomic<double>[kMaxMetrics]),
+    mpSlots(nullptr),
+    mSlotCount(0),
+    mSlotSize(0),
+    mPublished(0),
+    mStartSeconds(0.0)
+{
+    for (size_t i = 0; i < kMaxMetrics; i++)
+        mValues[i].store(0.0, std::memory_order_relaxed);
+}
+
+MetricsRegistry::~MetricsRegistry()
+{
+    Close();
+}
+
+MetricsRegistry::Handle MetricsRegistry::AddMetric(const char* name, MetricKind kind)
+{
+    assert(!IsOpen() && mNames.size() < kMaxMetrics);
+    mNames.push_back(name);
+    mKinds.push_back(kind);
+    return static_cast<Handle>(mNames.size() - 1);
+}
+
+bool MetricsRegistry::Open(const char* name, uint32_t slotCount)
+{
+    Close();
+
+    const uint32_t metricCount = static_cast<uint32_t>(mNames.size());
+    const size_t slotsOffset = GetSlotsOffset(metricCount);
+    const size_t slotSize = GetSlotSize(metricCount);
+    if (!mMemory.Create(name, slotsOffset + slotSize * slotCount))
+        return false;
+
+    // A mapping reused from a previous run is invalid until the new layout is written
+    Header* header = reinterpret_cast<Header*>(mMemory.Data());
+    header->Magic.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memset(mMemory.Data() + sizeof(header->Magic), 0, mMemory.Size() - sizeof(header->Magic));
+
+    header->Version = kVersion;
+    header->MetricCount = metricCount;
+    header->SlotCount = slotCount;
+    header->SlotSize = static_cast<uint32_t>(slotSize);
+    MetricInfo* infos = reinterpret_cast<MetricInfo*>(mMemory.Data() + sizeof(Header));
+    for (uint32_t i = 0; i < metricCount; i++)
+    {
+        // Zeroed above, the name stays terminated
+        memcpy(infos[i].Name, mNames[i], strnlen(mNames[i], kNameSize - 1));
+        infos[i].Kind = mKinds[i];
+    }
+    header->Magic.store(kMagic, std::memory_order_release);
+
+    mpSlots = mMemory.Data() + slotsOffset;
+    mSlotCount = slotCount;
+    mSlotSize = static_cast<uint32_t>(slotSize);
+    mPublished = 0;
+    mStartSeconds = GetSeconds();
+    return true;
+}
+
+void MetricsRegistry::Close()
+{
+    mpSlots = nullptr;
+    mMemory.Close();
+}
+
+void MetricsRegistry::Publish(uint64_t frame)
+{
+    if (!mpSlots)
+        return;
+
+    // The odd sequence is visible before any value changes, the even one after all of them
+    SlotHeader* slot = reinterpret_cast<SlotHeader*>(mpSlots + (mPublished % mSlotCount) * mSlotSize);
+    slot->Sequence.store(2 * mPublished + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->Frame = frame;
+    slot->Seconds = GetSeconds() - mStartSeconds;
+    double* values = reinterpret_cast<double*>(slot + 1);
+    for (size_t i = 0; i < mNames.size(); i++)
+        values[i] = mValues[i].load(std::memory_order_relaxed);
+
+    slot->Sequence.store(2 * mPublished + 2, std::memory_order_release);
+    mPublished++;
+    reinterpret_cast<Header*>(mMemory.Data())->Published.store(mPublished, std::memory_order_release);
+}
+
+MetricsReader::MetricsReader()
+    : mpSlots(nullptr),
+    mSlotCount(0),
+    mSlotSize(0)
+{
+}
+
+bool MetricsReader::Open(const char* name)
+{
+    Close();
+
+    if (!mMemory.Open(name) || mMemory.Size() < sizeof(Header))
+    {
+        Close();
+        return false;
+    }
+
+    const Header* header = reinterpret_cast<const Header*>(mMemory.Data());
+    if (header->Magic.load(std::memory_order_acquire) != kMagic || header->Version != kVersion || header->SlotCount == 0 ||
+        header->SlotSize != GetSlotSize(header->MetricCount) ||
+        GetSlotsOffset(header->MetricCount) + size_t(header->SlotSize) * header->SlotCount > mMemory.Size())
+    {
+        Close();
+        return false;
+    }
+
+    const MetricInfo* infos = reinterpret_cast<const MetricInfo*>(mMemory.Data() + sizeof(Header));
+    for (uint32_t i = 0; i < header->MetricCount; i++)
+    {
+        mNames.emplace_back(infos[i].Name, strnlen(infos[i].Name, kNameSize));
+        mKinds.push_back(infos[i].Kind);
+    }
+    mpSlots = mMemory.Data() + GetSlotsOffset(header->MetricCount);
+    mSlotCount = header->SlotCount;
+    mSlotSize = header->SlotSize;
+    return true;
+}
+
+void MetricsReader::Close()
+{
+    mNames.clear();
+    mKinds.clear();
+    mpSlots = nullptr;
+    mSlotCount = 0;
+    mSlotSize = 0;
+    mMemory.Close();
+}
+
+uint64_t MetricsReader::GetPublished() const
+{
+    if (!mpSlots)
+        return 0;
+    return reinterpret_cast<const Header*>(mMemory.Data())->Published.load(std::memory_order_acquire);
+}
+
+bool MetricsReader::Read(uint64_t index, Sample& sample) const
+{
+    if (!mpSlots)
+        return false;
+
+    const SlotHeader* slot = reinterpret_cast<const SlotHeader*>(mpSlots + (index % mSlotCount) * mSlotSize);
+    const uint64_t sequence = slot->Sequence.load(std::memory_order_acquire);
+    if (sequence != 2 * index + 2)
+        return false;
+
+    sample.Index = index;
+    sample.Frame = slot->Frame;
+    sample.Seconds = slot->Seconds;
+    sample.Values.resize(mNames.size());
+    memcpy(sample.Values.data(), slot + 1, mNames.size() * sizeof(double));
+
+    // A writer that started on the slot meanwhile has changed the sequence
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot->Sequence.load(std::memory_order_relaxed) == sequence;
+}
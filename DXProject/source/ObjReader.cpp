@@ -0,0 +1,730 @@
+#include <ObjReader.h>
+#include <MappedFile.h>
+#include <VertexWelder.h>
+#include <JobSystem.h>
+#include <AssetPaths.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define OBJ_USE_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+    // Files smaller than this are parsed on the calling thread.
+    const size_t kParallelThreshold = 4 * 1024 * 1024;
+    // Smallest chunk handed to a job, there are a few chunks per thread to balance the load.
+    const size_t kMinChunkSize = 1024 * 1024;
+    const size_t kChunksPerThread = 4;
+
+    const double kPowersOf10[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    // Default material, same values FBXReader uses for materials it can not read.
+    MaterialDesc DefaultMaterial(const std::string& name)
+    {
+        MaterialDesc desc;
+        desc.Name = name;
+        desc.Ambient = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+        desc.Diffuse = DirectX::XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+        desc.Specular = DirectX::XMFLOAT4(0.5f, 0.5f, 0.5f, 5.0f);
+        return desc;
+    }
+
+    inline int CountTrailingZeros(uint32_t mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    // Next '\n' in [p, end), or end.
+    const char* FindLineEnd(const char* p, const char* end)
+    {
+#ifdef OBJ_USE_SSE2
+        const __m128i newline = _mm_set1_epi8('\n');
+        for (; end - p >= 16; p += 16)
+        {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)));
+            if (mask)
+                return p + CountTrailingZeros(mask);
+        }
+#endif
+        const void* found = memchr(p, '\n', end - p);
+        return found ? static_cast<const char*>(found) : end;
+    }
+
+    inline bool IsDigit(char c)
+    {
+        return static_cast<unsigned char>(c - '0') < 10;
+    }
+
+    inline bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    inline const char* SkipSpaces(const char* p, const char* end)
+    {
+        while (p < end && IsSpace(*p))
+            p++;
+        return p;
+    }
+
+    // Eight ASCII digits packed in a little-endian word are checked and converted
+    // with a few integer operations instead of a loop (SWAR).
+    inline bool IsEightDigits(uint64_t word)
+    {
+        return ((word & 0xF0F0F0F0F0F0F0F0ull) |
+            (((word + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull;
+    }
+
+    inline uint32_t EightDigitsValue(uint64_t word)
+    {
+        word -= 0x3030303030303030ull;
+        word = word * 10 + (word >> 8);
+        word = (((word & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+            (((word >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+        return static_cast<uint32_t>(word);
+    }
+
+    // [sign] digits [. digits] [e [sign] digits], as written by exporters.
+    // Up to 19 significant digits are accumulated exactly and scaled by one exact
+    // power of ten, which is within rounding of strtof for any float an exporter writes.
+    bool ParseFloat(const char*& p, const char* end, float& value)
+    {
+        const char* s = p;
+        bool negative = false;
+        if (s < end && (*s == '-' || *s == '+'))
+        {
+            negative = *s == '-';
+            s++;
+        }
+
+        uint64_t mantissa = 0;
+        int digits = 0; // Significant digits in mantissa
+        int exponent = 0;
+
+        const char* integerStart = s;
+        for (; s < end && IsDigit(*s); s++)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*s - '0');
+                digits += mantissa != 0;
+            }
+            else
+            {
+                exponent++;
+            }
+        }
+        bool anyDigits = s != integerStart;
+
+        if (s < end && *s == '.')
+        {
+            s++;
+            const char* fractionStart = s;
+
+            // Keeps the mantissa below 10^19
+            while (end - s >= 8 && digits <= 11)
+            {
+                uint64_t word;
+                memcpy(&word, s, 8);
+                if (!IsEightDigits(word))
+                    break;
+                mantissa = mantissa * 100000000 + EightDigitsValue(word);
+                digits += mantissa != 0 ? 8 : 0;
+                exponent -= 8;
+                s += 8;
+            }
+
+            for (; s < end && IsDigit(*s); s++)
+            {
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (*s - '0');
+                    digits += mantissa != 0;
+                    exponent--;
+                }
+            }
+            anyDigits = anyDigits || s != fractionStart;
+        }
+
+        if (!anyDigits)
+            return false;
+
+        if (s < end && (*s == 'e' || *s == 'E'))
+        {
+            const char* e = s + 1;
+            bool negativeExponent = false;
+            if (e < end && (*e == '-' || *e == '+'))
+            {
+                negativeExponent = *e == '-';
+                e++;
+            }
+
+            if (e < end && IsDigit(*e))
+            {
+                int explicitExponent = 0;
+                for (; e < end && IsDigit(*e); e++)
+                {
+                    if (explicitExponent < 10000)
+                        explicitExponent = explicitExponent * 10 + (*e - '0');
+                }
+                exponent += negativeExponent ? -explicitExponent : explicitExponent;
+                s = e;
+            }
+        }
+
+        double result = static_cast<double>(mantissa);
+        if (mantissa != 0 && exponent != 0)
+        {
+            if (exponent < 0 && exponent >= -22)
+                result /= kPowersOf10[-exponent];
+            else if (exponent > 0 && exponent <= 22)
+                result *= kPowersOf10[exponent];
+            else
+                result *= std::pow(10.0, exponent);
+        }
+
+        value = static_cast<float>(negative ? -result : result);
+        p = s;
+        return true;
+    }
+
+    bool ParseInt(const char*& p, const char* end, int& value)
+    {
+        const char* s = p;
+        bool negative = false;
+        if (s < end && (*s == '-' || *s == '+'))
+        {
+            negative = *s == '-';
+            s++;
+        }
+
+        const char* digitsStart = s;
+        int64_t result = 0;
+        for (; s < end && IsDigit(*s); s++)
+        {
+            if (result < INT32_MAX)
+                result = result * 10 + (*s - '0');
+        }
+        if (s == digitsStart)
+            return false;
+
+        result = (std::min<int64_t>)(result, INT32_MAX);
+        value = static_cast<int>(negative ? -result : result);
+        p = s;
+        return true;
+    }
+
+    // Missing components read as zero, extra ones (w, vertex colors) are ignored.
+    void ParseFloats(const char* p, const char* end, std::vector<float>& out, int count)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            float value = 0.0f;
+            p = SkipSpaces(p, end);
+            if (!ParseFloat(p, end, value))
+                value = 0.0f;
+            out.push_back(value);
+        }
+    }
+
+    // Rest of a "keyword argument" line without surrounding whitespace
+    std::string Argument(const char* p, const char* end)
+    {
+        p = SkipSpaces(p, end);
+        while (end > p && (IsSpace(end[-1]) || end[-1] == '\r'))
+            end--;
+        return std::string(p, end);
+    }
+
+    bool StartsWithKeyword(const char* p, const char* end, const char* keyword)
+    {
+        size_t length = strlen(keyword);
+        return static_cast<size_t>(end - p) > length && memcmp(p, keyword, length) == 0 && IsSpace(p[length]);
+    }
+
+    // Texture statement, options such as "-bm 1.0" come before the file name.
+    std::string TextureFile(const char* p, const char* end)
+    {
+        std::string argument = Argument(p, end);
+        size_t space = argument.find_last_of(" \t");
+        return space == std::string::npos ? argument : argument.substr(space + 1);
+    }
+}
+
+ObjReader::ObjReader()
+{
+}
+
+void ObjReader::ParseChunk(const char* begin, const char* end, Chunk& chunk)
+{
+    // OBJ indices are 1-based, negative ones count back from the last element read.
+    auto addCorner = [&chunk](int index, size_t elementCount)
+    {
+        if (index > 0)
+        {
+            chunk.Corners.push_back(index - 1);
+        }
+        else if (index < 0)
+        {
+            chunk.RelativeIndices.push_back({ chunk.Corners.size(), static_cast<int>(elementCount) + index });
+            chunk.Corners.push_back(-1);
+        }
+        else
+        {
+            chunk.Corners.push_back(-1);
+        }
+    };
+
+    for (const char* line = begin; line < end;)
+    {
+        const char* lineEnd = FindLineEnd(line, end);
+        const char* next = lineEnd < end ? lineEnd + 1 : end;
+        if (lineEnd > line && lineEnd[-1] == '\r')
+            lineEnd--;
+
+        const char* p = SkipSpaces(line, lineEnd);
+        if (lineEnd - p >= 2)
+        {
+            if (p[0] == 'v')
+            {
+                if (IsSpace(p[1]))
+                    ParseFloats(p + 2, lineEnd, chunk.Positions, 3);
+                else if (p[1] == 't' && lineEnd - p >= 3 && IsSpace(p[2]))
+                    ParseFloats(p + 3, lineEnd, chunk.TexCoords, 2);
+                else if (p[1] == 'n' && lineEnd - p >= 3 && IsSpace(p[2]))
+                    ParseFloats(p + 3, lineEnd, chunk.Normals, 3);
+            }
+            else if (p[0] == 'f' && IsSpace(p[1]))
+            {
+                const size_t counts[3] = { chunk.Positions.size() / 3, chunk.TexCoords.size() / 2, chunk.Normals.size() / 3 };
+                const size_t firstCorner = chunk.Corners.size();
+                const size_t firstRelative = chunk.RelativeIndices.size();
+
+                // Corners are v, v/vt, v//vn or v/vt/vn
+                uint32_t size = 0;
+                const char* s = p + 2;
+                for (;;)
+                {
+                    s = SkipSpaces(s, lineEnd);
+                    int index[3] = { 0, 0, 0 };
+                    if (!ParseInt(s, lineEnd, index[0]))
+                        break;
+                    for (int k = 1; k < 3 && s < lineEnd && *s == '/'; k++)
+                    {
+                        s++;
+                        ParseInt(s, lineEnd, index[k]);
+                    }
+
+                    for (int k = 0; k < 3; k++)
+                        addCorner(index[k], counts[k]);
+                    size++;
+                }
+
+                if (size >= 3)
+                {
+                    chunk.FaceSizes.push_back(size);
+                }
+                else
+                {
+                    // Points and lines have no triangles
+                    chunk.Corners.resize(firstCorner);
+                    chunk.RelativeIndices.resize(firstRelative);
+                }
+            }
+            else if (StartsWithKeyword(p, lineEnd, "usemtl"))
+            {
+                chunk.MaterialChanges.emplace_back(chunk.FaceSizes.size(), Argument(p + 6, lineEnd));
+            }
+            else if (StartsWithKeyword(p, lineEnd, "mtllib"))
+            {
+                chunk.MaterialLibraries.push_back(Argument(p + 6, lineEnd));
+            }
+        }
+
+        line = next;
+    }
+}
+
+bool ObjReader::LoadObjFile(const std::string& filename)
+{
+    using Clock = std::chrono::high_resolution_clock;
+    auto start = Clock::now();
+
+    mFilename = filename;
+
+    MappedFile file;
+    if (!file.Open(std::filesystem::u8path(filename)))
+    {
+        LOG("OBJ: can not open ", filename);
+        return false;
+    }
+
+    const char* data = reinterpret_cast<const char*>(file.Data());
+    const size_t size = file.Size();
+
+    size_t threadCount = 1;
+    if (size >= kParallelThreshold)
+        threadCount = JobSystem::Get().GetThreadCount();
+    size_t chunkCount = (std::max<size_t>)(1, (std::min)(threadCount * kChunksPerThread, size / kMinChunkSize));
+    threadCount = (std::min)(threadCount, chunkCount);
+
+    // Chunk boundaries are moved forward to the next line start.
+    std::vector<const char*> bounds(1, data);
+    for (size_t i = 1; i < chunkCount; i++)
+    {
+        const char* p = (std::max)(bounds.back(), data + size / chunkCount * i);
+        p = FindLineEnd(p, data + size);
+        bounds.push_back(p < data + size ? p + 1 : p);
+    }
+    bounds.push_back(data + size);
+
+    std::vector<Chunk> chunks(chunkCount);
+    auto parse = [&](size_t first, size_t end)
+    {
+        for (size_t i = first; i < end; i++)
+            ParseChunk(bounds[i], bounds[i + 1], chunks[i]);
+    };
+    if (threadCount > 1)
+        JobSystem::Get().ParallelFor(chunkCount, 1, parse);
+    else
+        parse(0, chunkCount);
+
+    auto parsed = Clock::now();
+    MergeChunks(chunks);
+    auto merged = Clock::now();
+
+    double parseMs = std::chrono::duration<double, std::milli>(parsed - start).count();
+    double totalMs = std::chrono::duration<double, std::milli>(merged - start).count();
+    double megabytes = size / (1024.0 * 1024.0);
+    LOG("OBJ ", std::filesystem::u8path(filename).filename().u8string(), ": ", megabytes, " MB parsed in ", parseMs, " ms (",
+        megabytes * 1000.0 / parseMs, " MB/s, ", chunkCount, " chunks on ", threadCount, " threads), ", totalMs, " ms with merge (",
+        megabytes * 1000.0 / totalMs, " MB/s)");
+    LOG("OBJ: ", mPositions.size() / 3, " positions, ", mTexCoords.size() / 2, " texcoords, ", mNormals.size() / 3, " normals, ",
+        mFaceSizes.size(), " faces");
+
+    if (mPositions.empty())
+    {
+        LOG("OBJ: no geometry in ", filename);
+        return false;
+    }
+    return true;
+}
+
+void ObjReader::MergeChunks(std::vector<Chunk>& chunks)
+{
+    size_t positions = 0, texCoords = 0, normals = 0, corners = 0, faces = 0;
+    for (const Chunk& chunk : chunks)
+    {
+        positions += chunk.Positions.size();
+        texCoords += chunk.TexCoords.size();
+        normals += chunk.Normals.size();
+        corners += chunk.Corners.size();
+        faces += chunk.FaceSizes.size();
+    }
+    mPositions.reserve(positions);
+    mTexCoords.reserve(texCoords);
+    mNormals.reserve(normals);
+    mCorners.reserve(corners);
+    mFaceSizes.reserve(faces);
+
+    for (Chunk& chunk : chunks)
+    {
+        const int bases[3] =
+        {
+            static_cast<int>(mPositions.size() / 3),
+            static_cast<int>(mTexCoords.size() / 2),
+            static_cast<int>(mNormals.size() / 3)
+        };
+        for (const Chunk::RelativeIndex& relative : chunk.RelativeIndices)
+            chunk.Corners[relative.Corner] = bases[relative.Corner % 3] + relative.LocalIndex;
+
+        const size_t faceBase = mFaceSizes.size();
+        for (auto& change : chunk.MaterialChanges)
+            mMaterialChanges.emplace_back(faceBase + change.first, std::move(change.second));
+        for (const std::string& library : chunk.MaterialLibraries)
+            LoadMaterialLibrary(library);
+
+        mPositions.insert(mPositions.end(), chunk.Positions.begin(), chunk.Positions.end());
+        mTexCoords.insert(mTexCoords.end(), chunk.TexCoords.begin(), chunk.TexCoords.end());
+        mNormals.insert(mNormals.end(), chunk.Normals.begin(), chunk.Normals.end());
+        mCorners.insert(mCorners.end(), chunk.Corners.begin(), chunk.Corners.end());
+        mFaceSizes.insert(mFaceSizes.end(), chunk.FaceSizes.begin(), chunk.FaceSizes.end());
+
+        // Merged data is kept only once
+        chunk = Chunk();
+    }
+}
+
+void ObjReader::LoadMaterialLibrary(const std::string& name)
+{
+    if (std::find(mLibraries.begin(), mLibraries.end(), name) != mLibraries.end())
+        return;
+    mLibraries.push_back(name);
+
+    const std::filesystem::path objFile = std::filesystem::u8path(mFilename);
+    std::wstring path = ResolveAssetPath(objFile, name, name);
+    std::ifstream file(path.empty() ? std::filesystem::path() : std::filesystem::path(path));
+    if (!file)
+    {
+        LOG("OBJ: material library not found: ", name);
+        return;
+    }
+
+    // Texture names are relative to the library.
+    const std::filesystem::path libraryFile(path);
+    auto resolveTexture = [&](const std::string& texture)
+    {
+        std::wstring texturePath = ResolveAssetPath(libraryFile, texture, texture);
+        if (texturePath.empty())
+            LOG("Texture not found: ", texture);
+        return texturePath;
+    };
+
+    // Ka, Kd and Ks may list a single value for all channels.
+    auto readColor = [](const char* p, const char* end, DirectX::XMFLOAT4& color)
+    {
+        float values[3];
+        int count = 0;
+        for (const char* s = p; count < 3; count++)
+        {
+            s = SkipSpaces(s, end);
+            if (!ParseFloat(s, end, values[count]))
+                break;
+        }
+        if (count == 0)
+            return;
+
+        color.x = values[0];
+        color.y = count > 1 ? values[1] : values[0];
+        color.z = count > 2 ? values[2] : values[0];
+    };
+
+    MaterialDesc* pMaterial = nullptr;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        const char* end = line.data() + line.size();
+        const char* p = SkipSpaces(line.data(), end);
+
+        if (StartsWithKeyword(p, end, "newmtl"))
+        {
+            std::string materialName = Argument(p + 6, end);
+            pMaterial = &mLibraryMaterials.emplace(materialName, DefaultMaterial(materialName)).first->second;
+        }
+        else if (!pMaterial)
+        {
+            continue;
+        }
+        else if (StartsWithKeyword(p, end, "Ka"))
+        {
+            readColor(p + 2, end, pMaterial->Ambient);
+        }
+        else if (StartsWithKeyword(p, end, "Kd"))
+        {
+            readColor(p + 2, end, pMaterial->Diffuse);
+        }
+        else if (StartsWithKeyword(p, end, "Ks"))
+        {
+            readColor(p + 2, end, pMaterial->Specular);
+        }
+        else if (StartsWithKeyword(p, end, "Ns"))
+        {
+            const char* s = SkipSpaces(p + 2, end);
+            ParseFloat(s, end, pMaterial->Specular.w);
+        }
+        else if (StartsWithKeyword(p, end, "map_Kd"))
+        {
+            pMaterial->ColorMapFile = resolveTexture(TextureFile(p + 6, end));
+        }
+        else if (pMaterial->NormalMapFile.empty() &&
+            (StartsWithKeyword(p, end, "norm") || StartsWithKeyword(p, end, "map_Bump") ||
+            StartsWithKeyword(p, end, "map_bump") || StartsWithKeyword(p, end, "bump")))
+        {
+            pMaterial->NormalMapFile = resolveTexture(TextureFile(p + (p[0] == 'm' ? 8 : 4), end));
+        }
+    }
+}
+
+UINT ObjReader::GetMaterialIndex(const std::string& name)
+{
+    auto it = mMaterialIndices.find(name);
+    if (it != mMaterialIndices.end())
+        return it->second;
+
+    MaterialDesc desc;
+    auto library = mLibraryMaterials.find(name);
+    if (library != mLibraryMaterials.end())
+    {
+        desc = library->second;
+    }
+    else
+    {
+        if (!name.empty())
+            LOG("OBJ: material ", name, " is not defined");
+        desc = DefaultMaterial(name.empty() ? "Default" : name);
+    }
+
+    UINT index = static_cast<UINT>(mMaterials.size());
+    mMaterials.push_back(desc);
+    mMaterialIndices.emplace(name, index);
+
+    LOG("Material ", index, ": ", desc.Name);
+    return index;
+}
+
+void ObjReader::GetVertices(std::vector<VertexTextured>& vertices, std::vector<UINT>& indices)
+{
+    std::vector<SubMesh> subMeshes;
+    GetVertices(vertices, indices, subMeshes);
+}
+
+void ObjReader::GetVertices(std::vector<VertexTextured>& vertices, std::vector<UINT>& indices, std::vector<SubMesh>& subMeshes)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    mArena.Reset();
+
+    const int positionCount = static_cast<int>(mPositions.size() / 3);
+    const int texCoordCount = static_cast<int>(mTexCoords.size() / 2);
+    const int normalCount = static_cast<int>(mNormals.size() / 3);
+    const size_t faceCount = mFaceSizes.size();
+
+    // Counting pass, positions are the control points. Faces with a position out of range are dropped.
+    VertexWelder welder;
+    welder.Begin(mArena, positionCount);
+    bool* faceValid = mArena.AllocateArray<bool>(faceCount);
+    uint32_t maxFaceSize = 0;
+    size_t invalidFaces = 0;
+
+    for (size_t face = 0, corner = 0; face < faceCount; corner += mFaceSizes[face], face++)
+    {
+        bool valid = true;
+        for (uint32_t i = 0; i < mFaceSizes[face]; i++)
+        {
+            int position = mCorners[(corner + i) * 3];
+            valid = valid && position >= 0 && position < positionCount;
+        }
+
+        faceValid[face] = valid;
+        if (!valid)
+        {
+            invalidFaces++;
+            continue;
+        }
+
+        for (uint32_t i = 0; i < mFaceSizes[face]; i++)
+            welder.CountCorner(mCorners[(corner + i) * 3]);
+        maxFaceSize = (std::max)(maxFaceSize, mFaceSizes[face]);
+    }
+
+    if (invalidFaces > 0)
+        LOG("OBJ: ", invalidFaces, " faces with invalid vertex indices skipped");
+
+    welder.Finalize();
+    vertices.reserve(vertices.size() + positionCount);
+
+    // Triangles per material, materials are numbered in order of first use.
+    const UINT kUnresolved = UINT(-1);
+    std::vector<std::vector<UINT>> batches;
+    std::string materialName;
+    UINT materialIndex = kUnresolved;
+    size_t nextChange = 0;
+
+    UINT* tempIndices = mArena.AllocateArray<UINT>(maxFaceSize); // Indices for one face
+
+    for (size_t face = 0, corner = 0; face < faceCount; corner += mFaceSizes[face], face++)
+    {
+        for (; nextChange < mMaterialChanges.size() && mMaterialChanges[nextChange].first == face; nextChange++)
+        {
+            materialName = mMaterialChanges[nextChange].second;
+            materialIndex = kUnresolved;
+        }
+
+        if (!faceValid[face])
+            continue;
+
+        if (materialIndex == kUnresolved)
+        {
+            materialIndex = GetMaterialIndex(materialName);
+            if (batches.size() <= materialIndex)
+                batches.resize(materialIndex + 1);
+        }
+
+        const uint32_t faceSize = mFaceSizes[face];
+        for (uint32_t i = 0; i < faceSize; i++)
+        {
+            const int* c = &mCorners[(corner + i) * 3];
+
+            VertexTextured vertex;
+            vertex.Pos.x = mPositions[c[0] * 3];
+            vertex.Pos.y = mPositions[c[0] * 3 + 1];
+            vertex.Pos.z = mPositions[c[0] * 3 + 2];
+
+            // Missing or invalid attributes read as zero
+            bool hasUV = c[1] >= 0 && c[1] < texCoordCount;
+            vertex.Tex.x = hasUV ? mTexCoords[c[1] * 2] : 0.0f;
+            vertex.Tex.y = hasUV ? mTexCoords[c[1] * 2 + 1] : 0.0f;
+
+            bool hasNormal = c[2] >= 0 && c[2] < normalCount;
+            vertex.Normal.x = hasNormal ? mNormals[c[2] * 3] : 0.0f;
+            vertex.Normal.y = hasNormal ? mNormals[c[2] * 3 + 1] : 0.0f;
+            vertex.Normal.z = hasNormal ? mNormals[c[2] * 3 + 2] : 0.0f;
+
+            tempIndices[i] = welder.Weld(c[0], vertex, vertices);
+        }
+
+        // Split into triangles
+        std::vector<UINT>& batch = batches[materialIndex];
+        for (uint32_t i = 2; i < faceSize; ++i)
+        {
+            batch.push_back(tempIndices[0]);
+            batch.push_back(tempIndices[i - 1]);
+            batch.push_back(tempIndices[i]);
+        }
+    }
+
+    // One submesh per material
+    for (UINT material = 0; material < batches.size(); material++)
+    {
+        if (batches[material].empty())
+            continue;
+
+        SubMesh subMesh;
+        subMesh.StartIndex = static_cast<UINT>(indices.size());
+        subMesh.IndexCount = static_cast<UINT>(batches[material].size());
+        subMesh.MaterialIndex = material;
+        subMeshes.push_back(subMesh);
+        indices.insert(indices.end(), batches[material].begin(), batches[material].end());
+    }
+
+    LOG("OBJ import: ", vertices.size(), " vertices, ", indices.size(), " indices in ",
+        std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count(), " ms, peak temporary ",
+        mArena.GetPeakBytes() / 1024, " KB");
+}
+
+void ObjReader::GetMaterials(std::vector<MaterialDesc>& materials)
+{
+    materials = mMaterials;
+}
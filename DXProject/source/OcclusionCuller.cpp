@@ -0,0 +1,415 @@
+#include <OcclusionCuller.h>
+#include <JobSystem.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <emmintrin.h>
+
+namespace
+{
+    const int kTileWidth = 32;
+    const int kTileHeight = 4;
+    // Tile rows are handed to the slices in groups interleaved over the screen,
+    // so occluders in one part of the screen are still shared by all slices.
+    const int kRowsPerGroup = 2;
+    const float kInfinity = 1e30f;
+
+    struct ScreenVertex
+    {
+        float X, Y, Z;
+        bool Valid; // In front of the near plane
+    };
+
+    ScreenVertex Project(const float* p, const DirectX::XMFLOAT4X4& m, float width, float height)
+    {
+        float x = p[0] * m.m[0][0] + p[1] * m.m[1][0] + p[2] * m.m[2][0] + m.m[3][0];
+        float y = p[0] * m.m[0][1] + p[1] * m.m[1][1] + p[2] * m.m[2][1] + m.m[3][1];
+        float z = p[0] * m.m[0][2] + p[1] * m.m[1][2] + p[2] * m.m[2][2] + m.m[3][2];
+        float w = p[0] * m.m[0][3] + p[1] * m.m[1][3] + p[2] * m.m[2][3] + m.m[3][3];
+
+        ScreenVertex v;
+        v.Valid = z >= 0.0f && w > 0.0f;
+        float invW = v.Valid ? 1.0f / w : 0.0f;
+        v.X = (x * invW * 0.5f + 0.5f) * width;
+        v.Y = (0.5f - y * invW * 0.5f) * height;
+        v.Z = z * invW;
+        return v;
+    }
+
+    // Bits [0, n) set for n in [0, 32]. 2^n is built in the float exponent, the
+    // conversion of 2^31 and above gives the sign bit which is what is needed here.
+    inline __m128i LowBits(__m128i n)
+    {
+        __m128i pow2 = _mm_cvttps_epi32(_mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23)));
+        __m128i full = _mm_cmpgt_epi32(n, _mm_set1_epi32(kTileWidth - 1));
+        return _mm_or_si128(_mm_sub_epi32(pow2, _mm_set1_epi32(1)), full);
+    }
+
+    // Pixel mask of the spans [begin, end) of four rows, relative to the tile start
+    inline __m128i SpanMask(__m128 begin, __m128 end, float tileX)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 width = _mm_set1_ps(float(kTileWidth));
+        const __m128 offset = _mm_set1_ps(tileX);
+        __m128i first = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_sub_ps(begin, offset), zero), width));
+        __m128i last = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_sub_ps(end, offset), zero), width));
+        return _mm_andnot_si128(LowBits(first), LowBits(last));
+    }
+
+    // ceil for non-negative values, SSE2 has no rounding instruction
+    inline __m128 CeilPositive(__m128 v)
+    {
+        __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+        return _mm_add_ps(truncated, _mm_and_ps(_mm_cmplt_ps(truncated, v), _mm_set1_ps(1.0f)));
+    }
+
+    inline bool IsZero(__m128i v)
+    {
+        return _mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_setzero_si128())) == 0xFFFF;
+    }
+
+    inline bool IsFull(__m128i v)
+    {
+        return _mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_set1_epi32(-1))) == 0xFFFF;
+    }
+}
+
+OcclusionCuller::OcclusionCuller()
+    : mWidth(0),
+    mHeight(0),
+    mTilesX(0),
+    mTilesY(0),
+    mTriangleCount(0),
+    mSliceCount(1),
+    mStats()
+{
+}
+
+void OcclusionCuller::Init(int width, int height, unsigned sliceCount)
+{
+    mTilesX = (std::max)(1, (width + kTileWidth - 1) / kTileWidth);
+    mTilesY = (std::max)(1, (height + kTileHeight - 1) / kTileHeight);
+    mWidth = mTilesX * kTileWidth;
+    mHeight = mTilesY * kTileHeight;
+    mTiles.resize(size_t(mTilesX) * mTilesY);
+
+    mSliceCount = (std::max)(1u, sliceCount);
+    mSetups.resize(mSliceCount);
+
+    BeginFrame();
+}
+
+void OcclusionCuller::BeginFrame()
+{
+    for (Tile& tile : mTiles)
+    {
+        tile.Mask[0] = tile.Mask[1] = tile.Mask[2] = tile.Mask[3] = 0;
+        tile.ZMax0 = 1.0f;
+        tile.ZMax1 = 0.0f;
+    }
+
+    mOccluders.clear();
+    mTriangleCount = 0;
+    mStats = Stats();
+}
+
+void OcclusionCuller::AddOccluder(const float* positions, size_t positionStride, const uint32_t* indices, size_t indexCount,
+    const DirectX::XMFLOAT4X4& worldViewProj)
+{
+    Occluder occluder;
+    occluder.Positions = positions;
+    occluder.PositionStride = positionStride;
+    occluder.Indices = indices;
+    occluder.IndexCount = indexCount;
+    occluder.WorldViewProj = worldViewProj;
+    occluder.FirstTriangle = mTriangleCount;
+    mOccluders.push_back(occluder);
+
+    mTriangleCount += indexCount / 3;
+}
+
+void OcclusionCuller::EndOccluders()
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Triangles are set up in slices, then each slice rasterizes its tile rows.
+    JobSystem& jobs = JobSystem::Get();
+    jobs.ParallelFor(mSliceCount, 1, [this](size_t first, size_t end)
+    {
+        for (size_t slice = first; slice < end; slice++)
+            SetupTriangles(static_cast<unsigned>(slice));
+    });
+    jobs.ParallelFor(mSliceCount, 1, [this](size_t first, size_t end)
+    {
+        for (size_t slice = first; slice < end; slice++)
+            RasterizeTriangles(static_cast<unsigned>(slice));
+    });
+
+    mStats.OccluderTriangles = mTriangleCount;
+    mStats.RasterizedTriangles = 0;
+    for (const auto& setups : mSetups)
+        mStats.RasterizedTriangles += setups.size();
+    mStats.RasterMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void OcclusionCuller::SetupTriangles(unsigned slice)
+{
+    std::vector<TriangleSetup>& setups = mSetups[slice];
+    setups.clear();
+
+    const size_t begin = mTriangleCount * slice / mSliceCount;
+    const size_t end = mTriangleCount * (slice + 1) / mSliceCount;
+    const float width = float(mWidth);
+    const float height = float(mHeight);
+
+    for (const Occluder& occluder : mOccluders)
+    {
+        const size_t first = (std::max)(begin, occluder.FirstTriangle);
+        const size_t last = (std::min)(end, occluder.FirstTriangle + occluder.IndexCount / 3);
+        for (size_t t = first; t < last; t++)
+        {
+            const uint32_t* tri = occluder.Indices + (t - occluder.FirstTriangle) * 3;
+            ScreenVertex v[3];
+            for (int i = 0; i < 3; i++)
+            {
+                const float* p = reinterpret_cast<const float*>(reinterpret_cast<const char*>(occluder.Positions) + occluder.PositionStride * tri[i]);
+                v[i] = Project(p, occluder.WorldViewProj, width, height);
+            }
+
+            // Clipping is not worth it for occluders, a triangle crossing the near plane is dropped.
+            if (!v[0].Valid || !v[1].Valid || !v[2].Valid)
+                continue;
+
+            // Clockwise on screen (y down) is front facing
+            float area = (v[1].X - v[0].X) * (v[2].Y - v[0].Y) - (v[2].X - v[0].X) * (v[1].Y - v[0].Y);
+            if (!(area > 0.0f))
+                continue;
+
+            TriangleSetup setup;
+            setup.MinX = (std::min)({ v[0].X, v[1].X, v[2].X });
+            setup.MaxX = (std::max)({ v[0].X, v[1].X, v[2].X });
+            setup.MinY = (std::min)({ v[0].Y, v[1].Y, v[2].Y });
+            setup.MaxY = (std::max)({ v[0].Y, v[1].Y, v[2].Y });
+
+            // Pixels whose centers are inside the bounds
+            setup.FirstPixelX = static_cast<int>(std::ceil((std::max)(setup.MinX - 0.5f, 0.0f)));
+            setup.EndPixelX = static_cast<int>(std::ceil((std::min)(setup.MaxX - 0.5f, width)));
+            setup.FirstPixelY = static_cast<int>(std::ceil((std::max)(setup.MinY - 0.5f, 0.0f)));
+            setup.EndPixelY = static_cast<int>(std::ceil((std::min)(setup.MaxY - 0.5f, height)));
+            if (setup.FirstPixelX >= setup.EndPixelX || setup.FirstPixelY >= setup.EndPixelY)
+                continue;
+
+            float invArea = 1.0f / area;
+            float dz1 = v[1].Z - v[0].Z, dz2 = v[2].Z - v[0].Z;
+            setup.ZA = (dz1 * (v[2].Y - v[0].Y) - dz2 * (v[1].Y - v[0].Y)) * invArea;
+            setup.ZB = (dz2 * (v[1].X - v[0].X) - dz1 * (v[2].X - v[0].X)) * invArea;
+            setup.ZC = v[0].Z - setup.ZA * v[0].X - setup.ZB * v[0].Y;
+            setup.ZMax = (std::max)({ v[0].Z, v[1].Z, v[2].Z });
+
+            // Going down the screen an edge bounds the span on the right, going up on the left.
+            int leftCount = 0, rightCount = 0;
+            for (int i = 0; i < 3; i++)
+            {
+                const ScreenVertex& p = v[i];
+                const ScreenVertex& q = v[(i + 1) % 3];
+                float dy = q.Y - p.Y;
+                if (dy == 0.0f)
+                    continue;
+
+                float slope = (q.X - p.X) / dy;
+                float x0 = p.X - p.Y * slope;
+                if (dy > 0.0f)
+                {
+                    setup.RightX0[rightCount] = x0;
+                    setup.RightSlope[rightCount++] = slope;
+                }
+                else
+                {
+                    setup.LeftX0[leftCount] = x0;
+                    setup.LeftSlope[leftCount++] = slope;
+                }
+            }
+            for (; leftCount < 2; leftCount++)
+            {
+                setup.LeftX0[leftCount] = -kInfinity;
+                setup.LeftSlope[leftCount] = 0.0f;
+            }
+            for (; rightCount < 2; rightCount++)
+            {
+                setup.RightX0[rightCount] = kInfinity;
+                setup.RightSlope[rightCount] = 0.0f;
+            }
+
+            setups.push_back(setup);
+        }
+    }
+}
+
+void OcclusionCuller::RasterizeTriangles(unsigned slice)
+{
+    for (const auto& setups : mSetups)
+    {
+        for (const TriangleSetup& triangle : setups)
+        {
+            const int firstRow = triangle.FirstPixelY / kTileHeight;
+            const int lastRow = (triangle.EndPixelY - 1) / kTileHeight;
+            for (int row = firstRow; row <= lastRow; row++)
+            {
+                if (static_cast<unsigned>(row / kRowsPerGroup) % mSliceCount == slice)
+                    RasterizeTileRow(triangle, row);
+            }
+        }
+    }
+}
+
+void OcclusionCuller::RasterizeTileRow(const TriangleSetup& triangle, int tileRow)
+{
+    const int y0 = tileRow * kTileHeight;
+    const __m128 rowCenters = _mm_add_ps(_mm_set1_ps(float(y0)), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+
+    __m128 left = _mm_max_ps(
+        _mm_add_ps(_mm_set1_ps(triangle.LeftX0[0]), _mm_mul_ps(rowCenters, _mm_set1_ps(triangle.LeftSlope[0]))),
+        _mm_add_ps(_mm_set1_ps(triangle.LeftX0[1]), _mm_mul_ps(rowCenters, _mm_set1_ps(triangle.LeftSlope[1]))));
+    __m128 right = _mm_min_ps(
+        _mm_add_ps(_mm_set1_ps(triangle.RightX0[0]), _mm_mul_ps(rowCenters, _mm_set1_ps(triangle.RightSlope[0]))),
+        _mm_add_ps(_mm_set1_ps(triangle.RightX0[1]), _mm_mul_ps(rowCenters, _mm_set1_ps(triangle.RightSlope[1]))));
+
+    // Pixel x is covered when x + 0.5 is in [left, right), so x is in [ceil(left - 0.5), ceil(right - 0.5)).
+    const __m128 firstPixel = _mm_set1_ps(float(triangle.FirstPixelX));
+    const __m128 endPixel = _mm_set1_ps(float(triangle.EndPixelX));
+    const __m128 half = _mm_set1_ps(0.5f);
+    __m128 begin = CeilPositive(_mm_min_ps(_mm_max_ps(_mm_sub_ps(left, half), firstPixel), endPixel));
+    __m128 end = CeilPositive(_mm_min_ps(_mm_max_ps(_mm_sub_ps(right, half), firstPixel), endPixel));
+
+    // Rows outside the triangle get empty spans
+    __m128i rows = _mm_add_epi32(_mm_set1_epi32(y0), _mm_setr_epi32(0, 1, 2, 3));
+    __m128 rowInside = _mm_castsi128_ps(_mm_and_si128(
+        _mm_cmpgt_epi32(rows, _mm_set1_epi32(triangle.FirstPixelY - 1)),
+        _mm_cmplt_epi32(rows, _mm_set1_epi32(triangle.EndPixelY))));
+    end = _mm_or_ps(_mm_and_ps(rowInside, end), _mm_andnot_ps(rowInside, begin));
+
+    const float tileMinY = (std::max)(float(y0), triangle.MinY);
+    const float tileMaxY = (std::min)(float(y0 + kTileHeight), triangle.MaxY);
+    const float farY = triangle.ZB > 0.0f ? tileMaxY : tileMinY;
+
+    const int firstTile = triangle.FirstPixelX / kTileWidth;
+    const int lastTile = (triangle.EndPixelX - 1) / kTileWidth;
+    for (int tileX = firstTile; tileX <= lastTile; tileX++)
+    {
+        const float x0 = float(tileX * kTileWidth);
+        __m128i coverage = SpanMask(begin, end, x0);
+        if (IsZero(coverage))
+            continue;
+
+        // The plane is farthest at a corner of the tile clipped to the triangle bounds.
+        const float farX = triangle.ZA > 0.0f ? (std::min)(x0 + kTileWidth, triangle.MaxX) : (std::max)(x0, triangle.MinX);
+        const float zTriangle = (std::min)(triangle.ZA * farX + triangle.ZB * farY + triangle.ZC, triangle.ZMax);
+
+        Tile& tile = mTiles[size_t(tileRow) * mTilesX + tileX];
+        if (zTriangle >= tile.ZMax0)
+            continue;
+
+        // Merge into the working layer. It is dropped instead when the triangle is much
+        // closer than the layer, the layer is then close to the reference layer anyway.
+        __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(tile.Mask));
+        if (tile.ZMax1 - zTriangle > tile.ZMax0 - tile.ZMax1)
+        {
+            mask = _mm_setzero_si128();
+            tile.ZMax1 = 0.0f;
+        }
+        tile.ZMax1 = (std::max)(tile.ZMax1, zTriangle);
+        mask = _mm_or_si128(mask, coverage);
+
+        // A fully covered tile becomes the new reference layer.
+        if (IsFull(mask))
+        {
+            tile.ZMax0 = tile.ZMax1;
+            tile.ZMax1 = 0.0f;
+            mask = _mm_setzero_si128();
+        }
+        _mm_store_si128(reinterpret_cast<__m128i*>(tile.Mask), mask);
+    }
+}
+
+bool OcclusionCuller::IsVisible(const DirectX::XMFLOAT3& boxMin, const DirectX::XMFLOAT3& boxMax, const DirectX::XMFLOAT4X4& worldViewProj)
+{
+    mStats.Tested++;
+
+    float minX = kInfinity, maxX = -kInfinity, minY = kInfinity, maxY = -kInfinity, minZ = kInfinity;
+    for (int i = 0; i < 8; i++)
+    {
+        const float corner[3] =
+        {
+            (i & 1) ? boxMax.x : boxMin.x,
+            (i & 2) ? boxMax.y : boxMin.y,
+            (i & 4) ? boxMax.z : boxMin.z
+        };
+        ScreenVertex v = Project(corner, worldViewProj, float(mWidth), float(mHeight));
+
+        // Crossing the near plane, can not be tested
+        if (!v.Valid)
+            return true;
+
+        minX = (std::min)(minX, v.X);
+        maxX = (std::max)(maxX, v.X);
+        minY = (std::min)(minY, v.Y);
+        maxY = (std::max)(maxY, v.Y);
+        minZ = (std::min)(minZ, v.Z);
+    }
+
+    // Every pixel the box touches
+    const int firstX = (std::max)(0, static_cast<int>(std::floor(minX)));
+    const int endX = (std::min)(mWidth, static_cast<int>(std::floor(maxX)) + 1);
+    const int firstY = (std::max)(0, static_cast<int>(std::floor(minY)));
+    const int endY = (std::min)(mHeight, static_cast<int>(std::floor(maxY)) + 1);
+    if (firstX >= endX || firstY >= endY || minZ > 1.0f)
+    {
+        mStats.Culled++;
+        return false;
+    }
+
+    for (int tileY = firstY / kTileHeight; tileY <= (endY - 1) / kTileHeight; tileY++)
+    {
+        const int y0 = tileY * kTileHeight;
+        __m128i rows = _mm_add_epi32(_mm_set1_epi32(y0), _mm_setr_epi32(0, 1, 2, 3));
+        __m128 rowInside = _mm_castsi128_ps(_mm_and_si128(
+            _mm_cmpgt_epi32(rows, _mm_set1_epi32(firstY - 1)),
+            _mm_cmplt_epi32(rows, _mm_set1_epi32(endY))));
+        __m128 begin = _mm_set1_ps(float(firstX));
+        __m128 end = _mm_or_ps(_mm_and_ps(rowInside, _mm_set1_ps(float(endX))), _mm_andnot_ps(rowInside, begin));
+
+        for (int tileX = firstX / kTileWidth; tileX <= (endX - 1) / kTileWidth; tileX++)
+        {
+            const Tile& tile = mTiles[size_t(tileY) * mTilesX + tileX];
+            if (minZ <= tile.ZMax0)
+            {
+                // Pixels in the mask are at most at ZMax1, the others at ZMax0.
+                if (minZ <= tile.ZMax1)
+                    return true;
+
+                __m128i rect = SpanMask(begin, end, float(tileX * kTileWidth));
+                __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i*>(tile.Mask));
+                if (!IsZero(_mm_andnot_si128(mask, rect)))
+                    return true;
+            }
+        }
+    }
+
+    mStats.Culled++;
+    return false;
+}
+
+void OcclusionCuller::GetDepth(std::vector<float>& depth) const
+{
+    depth.resize(size_t(mWidth) * mHeight);
+    for (int y = 0; y < mHeight; y++)
+    {
+        for (int x = 0; x < mWidth; x++)
+        {
+            const Tile& tile = mTiles[size_t(y / kTileHeight) * mTilesX + x / kTileWidth];
+            bool inMask = (tile.Mask[y % kTileHeight] >> (x % kTileWidth)) & 1;
+            depth[size_t(y) * mWidth + x] = inMask ? (std::min)(tile.ZMax0, tile.ZMax1) : tile.ZMax0;
+        }
+    }
+}
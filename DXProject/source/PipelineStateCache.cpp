@@ -0,0 +1,121 @@
+#include <PipelineStateCache.h>
+#include <Hash.h>
+#include <Utils.h>
+#include <assert.h>
+#include <cstring>
+#include <utility>
+
+PipelineStateCache::PipelineStateCache()
+    : mDevice(nullptr)
+{
+    mStats.Created = 0;
+    mStats.Reused = 0;
+}
+
+PipelineStateCache::~PipelineStateCache()
+{
+}
+
+void PipelineStateCache::Init(ComPtr<ID3D11Device> device)
+{
+    mDevice = device;
+}
+
+ID3D11InputLayout* PipelineStateCache::GetInputLayout(const VertexFormat& format, const void* shaderBytecode, size_t bytecodeLength)
+{
+    uint64_t bytecodeHash = Hash::Bytes(shaderBytecode, bytecodeLength);
+    uint64_t key = Hash::Combine(format.GetHash(), bytecodeHash);
+
+    auto range = mInputLayouts.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (Matches(it->second, format, bytecodeHash, bytecodeLength))
+        {
+            mStats.Reused++;
+            return it->second.Object.Get();
+        }
+    }
+
+    InputLayoutEntry entry;
+    HR(mDevice->CreateInputLayout(format.GetElements(), format.GetElementCount(), shaderBytecode, bytecodeLength, entry.Object.GetAddressOf()));
+    if (!entry.Object)
+        return nullptr;
+
+    entry.Elements.assign(format.GetElements(), format.GetElements() + format.GetElementCount());
+    for (const D3D11_INPUT_ELEMENT_DESC& element : entry.Elements)
+        entry.SemanticNames.push_back(element.SemanticName);
+    entry.BytecodeHash = bytecodeHash;
+    entry.BytecodeLength = bytecodeLength;
+
+    mStats.Created++;
+    return mInputLayouts.emplace(key, std::move(entry))->second.Object.Get();
+}
+
+bool PipelineStateCache::Matches(const InputLayoutEntry& entry, const VertexFormat& format, uint64_t bytecodeHash, size_t bytecodeLength)
+{
+    if (entry.BytecodeHash != bytecodeHash || entry.BytecodeLength != bytecodeLength || entry.Elements.size() != format.GetElementCount())
+        return false;
+
+    // Semantic names are compared by value, the pointers may differ between identical formats.
+    for (size_t i = 0; i < entry.Elements.size(); i++)
+    {
+        const D3D11_INPUT_ELEMENT_DESC& a = entry.Elements[i];
+        const D3D11_INPUT_ELEMENT_DESC& b = format.GetElements()[i];
+        if (entry.SemanticNames[i] != b.SemanticName || a.SemanticIndex != b.SemanticIndex || a.Format != b.Format ||
+            a.InputSlot != b.InputSlot || a.AlignedByteOffset != b.AlignedByteOffset || a.InputSlotClass != b.InputSlotClass ||
+            a.InstanceDataStepRate != b.InstanceDataStepRate)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Desc, typename State, typename CreateFunc>
+State* PipelineStateCache::GetState(std::unordered_multimap<uint64_t, StateEntry<Desc, State>>& cache, const Desc& desc, CreateFunc create)
+{
+    // Descriptions are plain structures without padding, so they are hashed and compared bytewise.
+    uint64_t key = Hash::Value(desc);
+
+    auto range = cache.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (memcmp(&it->second.Description, &desc, sizeof(Desc)) == 0)
+        {
+            mStats.Reused++;
+            return it->second.Object.Get();
+        }
+    }
+
+    StateEntry<Desc, State> entry;
+    entry.Description = desc;
+    HR(create(&desc, entry.Object.GetAddressOf()));
+    if (!entry.Object)
+        return nullptr;
+
+    mStats.Created++;
+    return cache.emplace(key, entry)->second.Object.Get();
+}
+
+ID3D11RasterizerState* PipelineStateCache::GetRasterizerState(const D3D11_RASTERIZER_DESC& desc)
+{
+    return GetState(mRasterizerStates, desc,
+        [this](const D3D11_RASTERIZER_DESC* d, ID3D11RasterizerState** s) { return mDevice->CreateRasterizerState(d, s); });
+}
+
+ID3D11BlendState* PipelineStateCache::GetBlendState(const D3D11_BLEND_DESC& desc)
+{
+    return GetState(mBlendStates, desc,
+        [this](const D3D11_BLEND_DESC* d, ID3D11BlendState** s) { return mDevice->CreateBlendState(d, s); });
+}
+
+ID3D11DepthStencilState* PipelineStateCache::GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc)
+{
+    return GetState(mDepthStencilStates, desc,
+        [this](const D3D11_DEPTH_STENCIL_DESC* d, ID3D11DepthStencilState** s) { return mDevice->CreateDepthStencilState(d, s); });
+}
+
+void PipelineStateCache::LogStats() const
+{
+    LOG("Pipeline state cache: ", mStats.Created, " objects created, ", mStats.Reused, " creations avoided");
+}
@@ -0,0 +1,148 @@
+#include <RangeAllocator.h>
+
+#include <iterator>
+
+RangeAllocator::RangeAllocator(uint32_t capacity)
+    : mCapacity(0),
+    mUsed(0)
+{
+    Grow(capacity);
+}
+
+uint32_t RangeAllocator::Allocate(uint32_t size)
+{
+    if (size == 0)
+        return kInvalidOffset;
+
+    auto best = mFreeBySize.lower_bound(size);
+    if (best == mFreeBySize.end())
+        return kInvalidOffset;
+
+    const uint32_t offset = best->second;
+    const uint32_t freeSize = best->first;
+    RemoveFreeRange(mFreeByOffset.find(offset));
+    if (freeSize > size)
+        AddFreeRange(offset + size, freeSize - size);
+
+    mAllocations[offset] = size;
+    mUsed += size;
+    return offset;
+}
+
+void RangeAllocator::Free(uint32_t offset)
+{
+    auto allocation = mAllocations.find(offset);
+    if (allocation == mAllocations.end())
+        return;
+
+    uint32_t size = allocation->second;
+    mAllocations.erase(allocation);
+    mUsed -= size;
+
+    // Merge with the free ranges on both sides
+    auto next = mFreeByOffset.lower_bound(offset);
+    if (next != mFreeByOffset.begin())
+    {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset)
+        {
+            offset = previous->first;
+            size += previous->second;
+            RemoveFreeRange(previous);
+        }
+    }
+    if (next != mFreeByOffset.end() && offset + size == next->first)
+    {
+        size += next->second;
+        RemoveFreeRange(next);
+    }
+    AddFreeRange(offset, size);
+}
+
+void RangeAllocator::Clear()
+{
+    const uint32_t capacity = mCapacity;
+    mFreeByOffset.clear();
+    mFreeBySize.clear();
+    mAllocations.clear();
+    mCapacity = 0;
+    mUsed = 0;
+    Grow(capacity);
+}
+
+void RangeAllocator::Grow(uint32_t capacity)
+{
+    if (capacity <= mCapacity)
+        return;
+
+    uint32_t offset = mCapacity;
+    uint32_t size = capacity - mCapacity;
+    mCapacity = capacity;
+
+    // The last free range may end at the old capacity
+    if (!mFreeByOffset.empty())
+    {
+        auto last = std::prev(mFreeByOffset.end());
+        if (last->first + last->second == offset)
+        {
+            offset = last->first;
+            size += last->second;
+            RemoveFreeRange(last);
+        }
+    }
+    AddFreeRange(offset, size);
+}
+
+std::vector<RangeAllocator::Move> RangeAllocator::Compact()
+{
+    std::vector<Move> moves;
+    std::map<uint32_t, uint32_t> packed;
+    uint32_t next = 0;
+    for (const auto& allocation : mAllocations)
+    {
+        if (allocation.first != next)
+            moves.push_back(Move{ allocation.first, next, allocation.second });
+        packed.emplace_hint(packed.end(), next, allocation.second);
+        next += allocation.second;
+    }
+
+    mAllocations.swap(packed);
+    mFreeByOffset.clear();
+    mFreeBySize.clear();
+    if (next < mCapacity)
+        AddFreeRange(next, mCapacity - next);
+    return moves;
+}
+
+RangeAllocator::Stats RangeAllocator::GetStats() const
+{
+    Stats stats;
+    stats.Capacity = mCapacity;
+    stats.Used = mUsed;
+    stats.Allocations = static_cast<uint32_t>(mAllocations.size());
+    stats.FreeRanges = static_cast<uint32_t>(mFreeByOffset.size());
+    stats.LargestFree = mFreeBySize.empty() ? 0 : std::prev(mFreeBySize.end())->first;
+    const uint32_t freeSize = mCapacity - mUsed;
+    stats.Fragmentation = freeSize == 0 ? 0.0f : 1.0f - static_cast<float>(stats.LargestFree) / freeSize;
+    return stats;
+}
+
+void RangeAllocator::AddFreeRange(uint32_t offset, uint32_t size)
+{
+    mFreeByOffset[offset] = size;
+    mFreeBySize.emplace(size, offset);
+}
+
+void RangeAllocator::RemoveFreeRange(std::map<uint32_t, uint32_t>::iterator range)
+{
+    auto bySize = mFreeBySize.equal_range(range->second);
+    for (auto it = bySize.first; it != bySize.second; ++it)
+    {
+        if (it->second == range->first)
+        {
+            mFreeBySize.erase(it);
+            break;
+        }
+    }
+    mFreeByOffset.erase(range);
+}
@@ -0,0 +1,346 @@
+#include <RenderGraph.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+RenderGraph::TextureHandle RenderGraph::PassBuilder::Create(const char* name, const TextureDesc& desc)
+{
+    assert(mPass + 1 == mGraph.mPasses.size());
+    const uint32_t texture = static_cast<uint32_t>(mGraph.mTextures.size());
+    mGraph.mTextures.push_back(Texture{ name, desc, false, 0, kNone, 0, kNone });
+    const TextureHandle version = mGraph.AddVersion(texture, mPass);
+    mGraph.AddAccess(mPass, kNone, version);
+    return version;
+}
+
+RenderGraph::TextureHandle RenderGraph::PassBuilder::Write(TextureHandle texture)
+{
+    assert(mPass + 1 == mGraph.mPasses.size() && texture < mGraph.mVersions.size());
+    const TextureHandle version = mGraph.AddVersion(mGraph.mVersions[texture].Texture, mPass);
+    mGraph.AddAccess(mPass, texture, version);
+    return version;
+}
+
+void RenderGraph::PassBuilder::Read(TextureHandle texture)
+{
+    assert(mPass + 1 == mGraph.mPasses.size() && texture < mGraph.mVersions.size());
+    mGraph.AddAccess(mPass, texture, kNone);
+}
+
+void RenderGraph::PassBuilder::SetSideEffects()
+{
+    mGraph.mPasses[mPass].SideEffects = true;
+}
+
+void RenderGraph::PassBuilder::Execute(ExecuteFunc func)
+{
+    mGraph.mPasses[mPass].Execute = std::move(func);
+}
+
+RenderGraph::RenderGraph()
+    : mStats()
+{
+}
+
+void RenderGraph::Reset()
+{
+    mTextures.clear();
+    mVersions.clear();
+    mAccesses.clear();
+    mPasses.clear();
+    mOutputs.clear();
+    mOrder.clear();
+    mPhysicalTextures.clear();
+}
+
+RenderGraph::TextureHandle RenderGraph::Import(const char* name, const TextureDesc& desc)
+{
+    const uint32_t texture = static_cast<uint32_t>(mTextures.size());
+    mTextures.push_back(Texture{ name, desc, true, 0, kNone, 0, kNone });
+    return AddVersion(texture, kNone);
+}
+
+RenderGraph::PassBuilder RenderGraph::AddPass(const char* name)
+{
+    const uint32_t pass = static_cast<uint32_t>(mPasses.size());
+    mPasses.push_back(Pass{ name, ExecuteFunc(), static_cast<uint32_t>(mAccesses.size()), 0, false, false });
+    return PassBuilder(*this, pass);
+}
+
+void RenderGraph::MarkOutput(TextureHandle texture)
+{
+    assert(texture < mVersions.size());
+    mOutputs.push_back(texture);
+}
+
+RenderGraph::TextureHandle RenderGraph::AddVersion(uint32_t texture, uint32_t producer)
+{
+    mVersions.push_back(Version{ texture, producer });
+    return static_cast<TextureHandle>(mVersions.size() - 1);
+}
+
+void RenderGraph::AddAccess(uint32_t pass, uint32_t input, uint32_t output)
+{
+    mAccesses.push_back(Access{ input, output });
+    mPasses[pass].AccessCount++;
+}
+
+void RenderGraph::Compile()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    CullPasses();
+    OrderPasses();
+    AssignPhysicalTextures();
+
+    mStats.CompileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    mStats.Passes = static_cast<uint32_t>(mPasses.size());
+    mStats.CulledPasses = static_cast<uint32_t>(mPasses.size() - mOrder.size());
+}
+
+void RenderGraph::CullPasses()
+{
+    // Back from the outputs and the passes with side effects through the producers of
+    // everything a kept pass reads or writes over
+    mWorklist.clear();
+    for (Pass& pass : mPasses)
+    {
+        pass.Live = pass.SideEffects;
+        if (pass.Live)
+            mWorklist.push_back(static_cast<uint32_t>(&pass - mPasses.data()));
+    }
+    for (TextureHandle output : mOutputs)
+    {
+        const uint32_t producer = mVersions[output].Producer;
+        if (producer != kNone && !mPasses[producer].Live)
+        {
+            mPasses[producer].Live = true;
+            mWorklist.push_back(producer);
+        }
+    }
+
+    while (!mWorklist.empty())
+    {
+        const Pass& pass = mPasses[mWorklist.back()];
+        mWorklist.pop_back();
+        for (uint32_t i = 0; i < pass.AccessCount; i++)
+        {
+            const Access& access = mAccesses[pass.FirstAccess + i];
+            if (access.Input == kNone)
+                continue;
+            const uint32_t producer = mVersions[access.Input].Producer;
+            if (producer != kNone && !mPasses[producer].Live)
+            {
+                mPasses[producer].Live = true;
+                mWorklist.push_back(producer);
+            }
+        }
+    }
+}
+
+void RenderGraph::OrderPasses()
+{
+    // Live readers of each version, a write must wait for the readers of the version it
+    // overwrites
+    const size_t versionCount = mVersions.size();
+    mReaderOffsets.assign(versionCount + 1, 0);
+    for (const Pass& pass : mPasses)
+    {
+        if (!pass.Live)
+            continue;
+        for (uint32_t i = 0; i < pass.AccessCount; i++)
+        {
+            const Access& access = mAccesses[pass.FirstAccess + i];
+            if (access.Output == kNone)
+                mReaderOffsets[access.Input + 1]++;
+        }
+    }
+    for (size_t v = 0; v < versionCount; v++)
+        mReaderOffsets[v + 1] += mReaderOffsets[v];
+    mReaders.resize(mReaderOffsets[versionCount]);
+    mWorklist.assign(mReaderOffsets.begin(), mReaderOffsets.end() - 1); // Fill positions
+    for (uint32_t p = 0; p < mPasses.size(); p++)
+    {
+        const Pass& pass = mPasses[p];
+        if (!pass.Live)
+            continue;
+        for (uint32_t i = 0; i < pass.AccessCount; i++)
+        {
+            const Access& access = mAccesses[pass.FirstAccess + i];
+            if (access.Output == kNone)
+                mReaders[mWorklist[access.Input]++] = p;
+        }
+    }
+
+    // Calls func for every pass that has to run before pass: the producers of what it
+    // reads or writes over, and the other readers of what it writes over
+    auto forEachPredecessor = [this](uint32_t p, auto&& func)
+    {
+        const Pass& pass = mPasses[p];
+        for (uint32_t i = 0; i < pass.AccessCount; i++)
+        {
+            const Access& access = mAccesses[pass.FirstAccess + i];
+            if (access.Input == kNone)
+                continue;
+            const uint32_t producer = mVersions[access.Input].Producer;
+            if (producer != kNone)
+                func(producer);
+            if (access.Output == kNone)
+                continue;
+            for (uint32_t r = mReaderOffsets[access.Input]; r < mReaderOffsets[access.Input + 1]; r++)
+            {
+                if (mReaders[r] != p)
+                    func(mReaders[r]);
+            }
+        }
+    };
+
+    mDependentCount.assign(mPasses.size(), 0);
+    for (uint32_t p = 0; p < mPasses.size(); p++)
+    {
+        if (mPasses[p].Live)
+            forEachPredecessor(p, [this](uint32_t q) { mDependentCount[q]++; });
+    }
+
+    // Scheduled from the end: a pass is placed once every pass after it is. Among the
+    // ready ones the pass whose last dependent was placed most recently goes first, then
+    // the latest declared, so reversed a pass runs right before the passes that need it.
+    // Ready entries are the step the pass became ready above the pass index.
+    mReady.clear();
+    for (uint32_t p = 0; p < mPasses.size(); p++)
+    {
+        if (mPasses[p].Live && mDependentCount[p] == 0)
+            mReady.push_back(p);
+    }
+    std::make_heap(mReady.begin(), mReady.end());
+
+    mOrder.clear();
+    while (!mReady.empty())
+    {
+        std::pop_heap(mReady.begin(), mReady.end());
+        const uint32_t p = static_cast<uint32_t>(mReady.back());
+        mReady.pop_back();
+        mOrder.push_back(p);
+        const uint64_t step = mOrder.size();
+        forEachPredecessor(p, [this, step](uint32_t q)
+        {
+            if (--mDependentCount[q] == 0)
+            {
+                mReady.push_back(step << 32 | q);
+                std::push_heap(mReady.begin(), mReady.end());
+            }
+        });
+    }
+    std::reverse(mOrder.begin(), mOrder.end());
+}
+
+void RenderGraph::AssignPhysicalTextures()
+{
+    for (Texture& texture : mTextures)
+    {
+        texture.Usage = 0;
+        texture.FirstUse = kNone;
+        texture.LastUse = 0;
+        texture.Physical = kNone;
+    }
+
+    for (uint32_t position = 0; position < mOrder.size(); position++)
+    {
+        const Pass& pass = mPasses[mOrder[position]];
+        for (uint32_t i = 0; i < pass.AccessCount; i++)
+        {
+            const Access& access = mAccesses[pass.FirstAccess + i];
+            Texture& texture = mTextures[mVersions[access.Output != kNone ? access.Output : access.Input].Texture];
+            if (access.Output == kNone)
+                texture.Usage |= UsageShaderResource;
+            else
+                texture.Usage |= IsDepthFormat(texture.Desc.Format) ? UsageDepthStencil : UsageRenderTarget;
+            texture.FirstUse = (std::min)(texture.FirstUse, position);
+            texture.LastUse = (std::max)(texture.LastUse, position);
+        }
+    }
+
+    // In order of first use, each transient texture takes a free physical texture of the
+    // same description or a new one
+    mWorklist.clear();
+    for (uint32_t t = 0; t < mTextures.size(); t++)
+    {
+        if (mTextures[t].FirstUse != kNone)
+            mWorklist.push_back(t);
+    }
+    std::sort(mWorklist.begin(), mWorklist.end(), [this](uint32_t a, uint32_t b)
+    {
+        return mTextures[a].FirstUse != mTextures[b].FirstUse ? mTextures[a].FirstUse < mTextures[b].FirstUse : a < b;
+    });
+
+    mPhysicalTextures.clear();
+    mPhysicalLastUse.clear();
+    mStats.Textures = 0;
+    mStats.PhysicalTextures = 0;
+    mStats.RequestedBytes = 0;
+    mStats.AllocatedBytes = 0;
+    for (uint32_t t : mWorklist)
+    {
+        Texture& texture = mTextures[t];
+        if (!texture.Imported)
+        {
+            mStats.Textures++;
+            mStats.RequestedBytes += GetTextureBytes(texture.Desc);
+            for (uint32_t p = 0; p < mPhysicalTextures.size(); p++)
+            {
+                const PhysicalTexture& physical = mPhysicalTextures[p];
+                if (!physical.Imported && mPhysicalLastUse[p] < texture.FirstUse && physical.Desc.Width == texture.Desc.Width &&
+                    physical.Desc.Height == texture.Desc.Height && physical.Desc.Format == texture.Desc.Format &&
+                    physical.Desc.SampleCount == texture.Desc.SampleCount)
+                {
+                    texture.Physical = p;
+                    break;
+                }
+            }
+        }
+
+        if (texture.Physical == kNone)
+        {
+            texture.Physical = static_cast<uint32_t>(mPhysicalTextures.size());
+            mPhysicalTextures.push_back(PhysicalTexture{ texture.Desc, 0, texture.Imported });
+            mPhysicalLastUse.push_back(0);
+            if (!texture.Imported)
+            {
+                mStats.PhysicalTextures++;
+                mStats.AllocatedBytes += GetTextureBytes(texture.Desc);
+            }
+        }
+        mPhysicalTextures[texture.Physical].Usage |= texture.Usage;
+        mPhysicalLastUse[texture.Physical] = texture.LastUse;
+    }
+}
+
+void RenderGraph::Execute() const
+{
+    for (uint32_t p : mOrder)
+    {
+        if (mPasses[p].Execute)
+            mPasses[p].Execute(*this);
+    }
+}
+
+uint32_t RenderGraph::GetPhysicalTexture(TextureHandle texture) const
+{
+    assert(texture < mVersions.size());
+    return mTextures[mVersions[texture].Texture].Physical;
+}
+
+uint64_t RenderGraph::GetTextureBytes(const TextureDesc& desc)
+{
+    uint64_t bytesPerPixel = 4;
+    switch (desc.Format)
+    {
+    case TextureFormat::RGBA16F:
+        bytesPerPixel = 8;
+        break;
+    default:
+        break;
+    }
+    return uint64_t(desc.Width) * desc.Height * bytesPerPixel * (std::max)(desc.SampleCount, 1u);
+}
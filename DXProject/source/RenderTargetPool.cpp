@@ -0,0 +1,199 @@
+#include <RenderTargetPool.h>
+#include <MemoryTracker.h>
+#include <Utils.h>
+
+#include <algorithm>
+
+namespace
+{
+    struct FormatSet
+    {
+        DXGI_FORMAT Texture;
+        DXGI_FORMAT View;           // Render target or depth stencil
+        DXGI_FORMAT ShaderResource;
+    };
+
+    // Depth textures are typeless so they can also be read by shaders
+    FormatSet GetFormats(RenderGraph::TextureFormat format)
+    {
+        switch (format)
+        {
+        case RenderGraph::TextureFormat::RGBA16F:
+            return { DXGI_FORMAT_R16G16B16A16_FLOAT, DXGI_FORMAT_R16G16B16A16_FLOAT, DXGI_FORMAT_R16G16B16A16_FLOAT };
+        case RenderGraph::TextureFormat::RG16F:
+            return { DXGI_FORMAT_R16G16_FLOAT, DXGI_FORMAT_R16G16_FLOAT, DXGI_FORMAT_R16G16_FLOAT };
+        case RenderGraph::TextureFormat::R32F:
+            return { DXGI_FORMAT_R32_FLOAT, DXGI_FORMAT_R32_FLOAT, DXGI_FORMAT_R32_FLOAT };
+        case RenderGraph::TextureFormat::D24S8:
+            return { DXGI_FORMAT_R24G8_TYPELESS, DXGI_FORMAT_D24_UNORM_S8_UINT, DXGI_FORMAT_R24_UNORM_X8_TYPELESS };
+        case RenderGraph::TextureFormat::D32F:
+            return { DXGI_FORMAT_R32_TYPELESS, DXGI_FORMAT_D32_FLOAT, DXGI_FORMAT_R32_FLOAT };
+        default:
+            return { DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT_R8G8B8A8_UNORM };
+        }
+    }
+
+    bool SameDesc(const RenderGraph::TextureDesc& a, const RenderGraph::TextureDesc& b)
+    {
+        return a.Width == b.Width && a.Height == b.Height && a.Format == b.Format && a.SampleCount == b.SampleCount;
+    }
+}
+
+RenderTargetPool::RenderTargetPool()
+    : mMsaaQuality(0)
+{
+}
+
+void RenderTargetPool::Init(ComPtr<ID3D11Device> device, UINT msaaQuality)
+{
+    mDevice = device;
+    mMsaaQuality = msaaQuality;
+    Clear();
+}
+
+void RenderTargetPool::Realize(const RenderGraph& graph)
+{
+    for (Target& target : mTargets)
+        target.Used = false;
+
+    const std::vector<RenderGraph::PhysicalTexture>& physicalTextures = graph.GetPhysicalTextures();
+    std::vector<uint32_t>& targetIndices = mTargetIndices;
+    targetIndices.assign(physicalTextures.size(), UINT32_MAX);
+    for (size_t p = 0; p < physicalTextures.size(); p++)
+    {
+        const RenderGraph::PhysicalTexture& physical = physicalTextures[p];
+        if (physical.Imported)
+            continue;
+
+        for (size_t t = 0; t < mTargets.size(); t++)
+        {
+            Target& target = mTargets[t];
+            if (!target.Used && target.Usage == physical.Usage && SameDesc(target.Desc, physical.Desc))
+            {
+                target.Used = true;
+                targetIndices[p] = static_cast<uint32_t>(t);
+                break;
+            }
+        }
+        if (targetIndices[p] == UINT32_MAX)
+        {
+            Target target = {};
+            target.Desc = physical.Desc;
+            target.Usage = physical.Usage;
+            target.Used = true;
+            CreateTarget(target);
+            targetIndices[p] = static_cast<uint32_t>(mTargets.size());
+            mTargets.push_back(std::move(target));
+        }
+    }
+
+    // Released by the device once the frames in flight are done with them
+    size_t kept = 0;
+    for (size_t t = 0; t < mTargets.size(); t++)
+    {
+        if (!mTargets[t].Used)
+            continue;
+        for (uint32_t& index : targetIndices)
+        {
+            if (index == t)
+                index = static_cast<uint32_t>(kept);
+        }
+        if (kept != t)
+            mTargets[kept] = std::move(mTargets[t]);
+        kept++;
+    }
+    mTargets.resize(kept);
+
+    mViews.assign(physicalTextures.size(), Views{ nullptr, nullptr, nullptr });
+    for (size_t p = 0; p < physicalTextures.size(); p++)
+    {
+        if (targetIndices[p] == UINT32_MAX)
+            continue;
+        const Target& target = mTargets[targetIndices[p]];
+        mViews[p] = Views{ target.RenderTarget.Get(), target.DepthStencil.Get(), target.ShaderResource.Get() };
+    }
+}
+
+void RenderTargetPool::SetImported(const RenderGraph& graph, RenderGraph::TextureHandle texture, ID3D11RenderTargetView* renderTarget,
+    ID3D11DepthStencilView* depthStencil, ID3D11ShaderResourceView* shaderResource)
+{
+    const uint32_t physical = graph.GetPhysicalTexture(texture);
+    if (physical < mViews.size())
+        mViews[physical] = Views{ renderTarget, depthStencil, shaderResource };
+}
+
+void RenderTargetPool::Clear()
+{
+    mTargets.clear();
+    mViews.clear();
+}
+
+ID3D11RenderTargetView* RenderTargetPool::GetRenderTargetView(const RenderGraph& graph, RenderGraph::TextureHandle texture) const
+{
+    const uint32_t physical = graph.GetPhysicalTexture(texture);
+    return physical < mViews.size() ? mViews[physical].RenderTarget : nullptr;
+}
+
+ID3D11DepthStencilView* RenderTargetPool::GetDepthStencilView(const RenderGraph& graph, RenderGraph::TextureHandle texture) const
+{
+    const uint32_t physical = graph.GetPhysicalTexture(texture);
+    return physical < mViews.size() ? mViews[physical].DepthStencil : nullptr;
+}
+
+ID3D11ShaderResourceView* RenderTargetPool::GetShaderResourceView(const RenderGraph& graph, RenderGraph::TextureHandle texture) const
+{
+    const uint32_t physical = graph.GetPhysicalTexture(texture);
+    return physical < mViews.size() ? mViews[physical].ShaderResource : nullptr;
+}
+
+void RenderTargetPool::CreateTarget(Target& target)
+{
+    const FormatSet formats = GetFormats(target.Desc.Format);
+    const bool multisampled = target.Desc.SampleCount > 1;
+
+    D3D11_TEXTURE2D_DESC desc;
+    desc.Width = target.Desc.Width;
+    desc.Height = target.Desc.Height;
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = formats.Texture;
+    desc.SampleDesc.Count = (std::max)(target.Desc.SampleCount, 1u);
+    desc.SampleDesc.Quality = multisampled && mMsaaQuality > 0 ? mMsaaQuality - 1 : 0;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = 0;
+    if (target.Usage & RenderGraph::UsageRenderTarget)
+        desc.BindFlags |= D3D11_BIND_RENDER_TARGET;
+    if (target.Usage & RenderGraph::UsageDepthStencil)
+        desc.BindFlags |= D3D11_BIND_DEPTH_STENCIL;
+    if (target.Usage & RenderGraph::UsageShaderResource)
+        desc.BindFlags |= D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+
+    HR(mDevice->CreateTexture2D(&desc, nullptr, target.Texture.GetAddressOf()));
+    MemoryTracker::TrackGpuResource(target.Texture.Get(), MemoryTag::GpuTargets);
+
+    if (target.Usage & RenderGraph::UsageRenderTarget)
+    {
+        D3D11_RENDER_TARGET_VIEW_DESC viewDesc = {};
+        viewDesc.Format = formats.View;
+        viewDesc.ViewDimension = multisampled ? D3D11_RTV_DIMENSION_TEXTURE2DMS : D3D11_RTV_DIMENSION_TEXTURE2D;
+        HR(mDevice->CreateRenderTargetView(target.Texture.Get(), &viewDesc, target.RenderTarget.GetAddressOf()));
+    }
+    if (target.Usage & RenderGraph::UsageDepthStencil)
+    {
+        D3D11_DEPTH_STENCIL_VIEW_DESC viewDesc = {};
+        viewDesc.Format = formats.View;
+        viewDesc.ViewDimension = multisampled ? D3D11_DSV_DIMENSION_TEXTURE2DMS : D3D11_DSV_DIMENSION_TEXTURE2D;
+        HR(mDevice->CreateDepthStencilView(target.Texture.Get(), &viewDesc, target.DepthStencil.GetAddressOf()));
+    }
+    if (target.Usage & RenderGraph::UsageShaderResource)
+    {
+        D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+        viewDesc.Format = formats.ShaderResource;
+        viewDesc.ViewDimension = multisampled ? D3D11_SRV_DIMENSION_TEXTURE2DMS : D3D11_SRV_DIMENSION_TEXTURE2D;
+        viewDesc.Texture2D.MostDetailedMip = 0;
+        viewDesc.Texture2D.MipLevels = 1;
+        HR(mDevice->CreateShaderResourceView(target.Texture.Get(), &viewDesc, target.ShaderResource.GetAddressOf()));
+    }
+}
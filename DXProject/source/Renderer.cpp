@@ -5,7 +5,89 @@
 #include <DirectXColors.h>
 #include <d3d11shader.h>
 #include <sstream>
+#include <chrono>
 #include <FbxReader.h>
+#include <FbxBinaryReader.h>
+#include <ObjReader.h>
+#include <CookedAssets.h>
+#include <EnvironmentLighting.h>
+#include <TangentGenerator.h>
+#include <JobSystem.h>
+#include <MemoryTracker.h>
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+	//const std::string kModelFile = "C:\\repositories\\DXProject\\models\\coca-cola\\coca-cola.fbx";
+	const std::string kModelFile = "C:\\repositories\\DXProject\\models\\coca-cola-2\\Coke_Can_Final.fbx";
+	//const std::string kModelFile = "C:\\repositories\\DXProject\\models\\eyeball\\eyeball.fbx";
+
+	// Used by materials that do not reference a color map of their own.
+	const std::wstring kFallbackColorMap =
+		//L"C:\\repositories\\DXProject\\\models\\coca-cola-2\\Coke_Clean\\test.tga",
+		L"C:\\repositories\\DXProject\\\models\\coca-cola-2\\Coke_Clean\\Coke_Can_VRayMtl1_Reflection.tga";
+	const std::wstring kFallbackNormalMap =
+		L"C:\\repositories\\DXProject\\\models\\coca-cola-2\\Coke_Clean\\Coke_Can_VRayMtl1_Normal.tga";
+
+	const char kVertexShaderFile[] = "ShadersBin\\VertexShader.cso";
+	const char kPixelShaderFile[] = "ShadersBin\\PixelShader.cso";
+	const char kDepthVertexShaderFile[] = "ShadersBin\\DepthVS.cso";
+
+	// Initial geometry pool size, it doubles when a mesh does not fit
+	const UINT kGeometryPoolVertices = 256 * 1024;
+	const UINT kGeometryPoolIndices = 1024 * 1024;
+
+	// Point and spot lights of the demo scene, binned into the light clusters
+	const size_t kLocalLightCount = 256;
+
+	// Latitude-longitude TGA for the ambient and the reflections, a procedural sky without it
+	const std::wstring kEnvironmentMapFile = L"C:\\repositories\\DXProject\\models\\environment.tga";
+	const uint32_t kEnvironmentSize = 128;
+	const uint32_t kEnvironmentLevels = 6;
+
+	// Frames of metrics kept in shared memory, about 17 seconds at 60 frames per second
+	const uint32_t kMetricSlots = 1024;
+
+	// The shader always declares the tangent stream. When it is not bound the input
+	// assembler reads zeros and the pixel shader skips normal mapping.
+	const VertexFormat& MeshVertexFormat(bool splitStreams)
+	{
+		return splitStreams ? VertexFormat::SplitTangent() : VertexFormat::TexturedTangent();
+	}
+
+	std::vector<char> ReadFile(const std::filesystem::path& file)
+	{
+		std::ifstream stream(file, std::ios::binary);
+		return std::vector<char>((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+	}
+
+	// The changed file is the source or its cooked version.
+	bool IsAssetFile(const std::filesystem::path& changed, const std::filesystem::path& source, const std::filesystem::path& cooked)
+	{
+		std::error_code ec;
+		return !source.empty() && (std::filesystem::equivalent(changed, source, ec) || std::filesystem::equivalent(changed, cooked, ec));
+	}
+}
+
+bool Renderer::WriteImportReference()
+{
+	// Uncompressed, so the vertices are stored exactly as the SDK gave them
+	CookedAssets::Mesh mesh;
+	FBXReader reader;
+	if (!reader.LoadFbxFile(kModelFile))
+	{
+		LOG("Import reference: cannot import ", kModelFile);
+		return false;
+	}
+	reader.GetVertices(mesh.Vertices, mesh.Indices, mesh.SubMeshes);
+	reader.GetMaterials(mesh.Materials);
+
+	const std::filesystem::path file = CookedAssets::ReferenceMeshPath(std::filesystem::u8path(kModelFile));
+	bool written = !mesh.Vertices.empty() && CookedAssets::WriteMesh(file, mesh, false);
+	LOG("Import reference ", file.u8string(), written ? ": written, " : ": not written, ", mesh.Vertices.size(), " vertices");
+	return written;
+}
 
 Renderer::Renderer()
     : md3dDriverType(D3D_DRIVER_TYPE_HARDWARE),
@@ -13,40 +95,52 @@ Renderer::Renderer()
     mClientWidth(800),
     mClientHeight(600),
     mEnable4xMsaa(true),
+    mEnableNormalMapping(true),
+    mEnableOcclusionCulling(true),
+    mEnableFramePipelining(true),
+    mEnableHotReload(true),
+    mEnableSplitStreams(true),
+    mEnableDepthPrepass(false),
+    mEnableLocalLights(true),
     m4xMsaaQuality(0),
 
 
     md3dDevice(nullptr),
     md3dImmediateContext(nullptr),
     mSwapChain(0),
-    mDepthStencilBuffer(0),
     mRenderTargetView(0),
-    mDepthStencilView(0),
     mVertexShader(nullptr),
     mPixelShader(nullptr),
     mInputLayout(nullptr),
 	mPerFrameCbuffer(nullptr),
+    mModelGeometry(GeometryPool::kInvalidHandle),
     mDirectionalLightBuffer(nullptr),
 
-    mTheta(0),
-    mPhi(0.5f * XM_PI),
-    mRadius(5.0f),
-
-	mIndexCount(0)
+    mFrameStates(mEnableFramePipelining ? 2 : 1),
+    mhFrameReleased(CreateEvent(nullptr, FALSE, FALSE, nullptr)),
+    mbResizePending(false),
+    mPendingWidth(0),
+    mPendingHeight(0),
+    mUpdateMs(0.0),
+    mUpdateWaitMs(0.0),
+    mSlotWaitMs(0.0),
+    mpTimings(nullptr),
+    mModelGeneration(0),
+    mLoadUploadBytes(0)
 {
     ZeroMemory(&mScreenViewport, sizeof(D3D11_VIEWPORT));
+    mRenderStats = RenderStats();
 
     mLastMousePos.x = 0;
     mLastMousePos.y = 0;
-
-    XMMATRIX I = XMMatrixIdentity();
-    XMStoreFloat4x4(&mWorld, I);
-    XMStoreFloat4x4(&mView, I);
-    XMStoreFloat4x4(&mProj, I);
 }
 
 Renderer::~Renderer()
 {
+    StopRenderThread();
+    if (mhFrameReleased)
+        CloseHandle(mhFrameReleased);
+
     // Restore all default settings.
     if (md3dImmediateContext)
         md3dImmediateContext->ClearState();
@@ -54,62 +148,427 @@ Renderer::~Renderer()
 
 bool Renderer::Init(HWND mhMainWnd)
 {
+	// Created first so that this thread, which runs the message loop, is worker 0.
+	LOG("Job system: ", JobSystem::Get().GetThreadCount(), " threads");
+	CreateMetrics();
+
 	if (!InitDirect3D(mhMainWnd)) return false;
 
+	mPipelineStateCache.Init(md3dDevice);
+	mStateCache.Init(md3dImmediateContext);
+	mRenderTargetPool.Init(md3dDevice, m4xMsaaQuality);
+
 	CreateShaders();
-	CreateMesh();
+	CreateRenderStates();
+	CreateGeometryPool();
+	LoadedModel model;
+	auto loadStart = std::chrono::high_resolution_clock::now();
+	const bool modelLoaded = LoadModel(kModelFile, model);
+	mMetrics.Set(mMetricIds.ModelImportMs, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count());
+	// Without a model the scene stays empty, a hot reload of the file can still bring it in.
+	if (modelLoaded)
+		SwapInModel(model);
+	else
+		LOG("Model ", kModelFile, ": failed to load");
 	CreateConstantBuffers();
-	CreateMaterial();
+	CreateEnvironmentLighting();
+	if (mEnableLocalLights)
+		mSimulation.SetLocalLightCount(kLocalLightCount);
+	LOG("Local lights: ", mEnableLocalLights ? kLocalLightCount : 0, " in ", mLightClusters.GetTilesX(), "x", mLightClusters.GetTilesY(), "x",
+		mLightClusters.GetSlices(), " clusters");
+
+	mPipelineStateCache.LogStats();
+	MemoryTracker::LogStats("after init");
 
-    SetupLights();
+	// From here on only the render thread uses the device context.
+	LOG("Frame pipelining: ", mEnableFramePipelining ? "on" : "off");
+	mRenderThread = std::thread(&Renderer::RenderLoop, this);
+
+	if (mEnableHotReload)
+	{
+		WatchAssetDirectories(mMaterialDescs);
+		mReloadThread = std::thread(&Renderer::ReloadLoop, this);
+	}
 
 	mbInitialized = true;
     return true;
 }
 
+void Renderer::StopRenderThread()
+{
+	// Waits for the imports in progress
+	mFileWatcher.Stop();
+	if (mReloadThread.joinable())
+		mReloadThread.join();
+
+	mFrameStates.Stop();
+	if (mRenderThread.joinable())
+		mRenderThread.join();
+}
+
+bool Renderer::WaitForFrameSlot()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	bool ready = mFrameStates.CanWrite();
+	// Queued messages wake the wait too, not only new ones
+	while (!ready && MsgWaitForMultipleObjectsEx(1, &mhFrameReleased, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE) == WAIT_OBJECT_0)
+		ready = mFrameStates.CanWrite();
+	mSlotWaitMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return ready;
+}
+
 void Renderer::UpdateScene(float dt)
 {
-    // Get camera position in Cartesian coordinates
-	float x = mRadius * sinf(mPhi) * cosf(mTheta);
-	float z = mRadius * sinf(mPhi) * sinf(mTheta);
-	float y = mRadius * cosf(mPhi);
-	
-	// Build the view matrix
-	XMVECTOR pos = XMVectorSet(x, y, z, 1.0f);
-	XMVECTOR target = XMVectorZero();
-	XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-	XMMATRIX view = XMMatrixLookAtLH(pos, target, up);
-	XMStoreFloat4x4(&mView, view);
-
-	XMMATRIX world = XMLoadFloat4x4(&mWorld);
-	XMMATRIX proj = XMLoadFloat4x4(&mProj);
-	XMMATRIX worldViewProj = XMMatrixTranspose(world * view * proj);
+	// Only waits if the caller did not wait in WaitForFrameSlot, while the render thread
+	// is still drawing the frame before the previous one.
+	auto start = std::chrono::high_resolution_clock::now();
+	FrameState* state = mFrameStates.BeginWrite();
+	if (!state)
+		return;
+	auto ready = std::chrono::high_resolution_clock::now();
+
+	mSimulation.Update(dt, *state);
+	mFrameStates.EndWrite();
+
+	double waitMs = std::chrono::duration<double, std::milli>(ready - start).count() + mSlotWaitMs;
+	mSlotWaitMs = 0.0;
+	double updateMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - ready).count();
+	mUpdateWaitMs += waitMs;
+	mUpdateMs += updateMs;
+	mMetrics.Set(mMetricIds.UpdateMs, updateMs);
+	mMetrics.Set(mMetricIds.UpdateWaitMs, waitMs);
+	if (mpTimings)
+	{
+		mpTimings->Add(mTimingColumns.Update, updateMs);
+		mpTimings->Add(mTimingColumns.UpdateWait, waitMs);
+	}
+}
+
+void Renderer::RecordTimings(FrameTimings* timings)
+{
+	std::lock_guard<std::mutex> lock(mRenderStatsMutex);
+	mpTimings = timings;
+	if (timings)
+	{
+		mTimingColumns.Update = timings->AddColumn("update ms");
+		mTimingColumns.UpdateWait = timings->AddColumn("update wait ms");
+		mTimingColumns.Draw = timings->AddColumn("draw ms");
+		mTimingColumns.Occlusion = timings->AddColumn("occlusion raster ms");
+		mTimingColumns.LightBinning = timings->AddColumn("light binning ms");
+		mTimingColumns.Latency = timings->AddColumn("latency ms");
+	}
+}
+
+void Renderer::CreateMetrics()
+{
+	// Gauges are the values of the last frame, counters totals since start
+	mMetricIds.UpdateMs = mMetrics.AddGauge("frame.update_ms");
+	mMetricIds.UpdateWaitMs = mMetrics.AddGauge("frame.update_wait_ms");
+	mMetricIds.DrawMs = mMetrics.AddGauge("frame.draw_ms");
+	mMetricIds.LatencyMs = mMetrics.AddGauge("frame.latency_ms");
+	mMetricIds.Frames = mMetrics.AddCounter("frame.count");
+	mMetricIds.Draws = mMetrics.AddGauge("render.draws");
+	mMetricIds.Triangles = mMetrics.AddGauge("render.triangles");
+	mMetricIds.StateCalls = mMetrics.AddGauge("render.state_calls");
+	mMetricIds.UploadBytes = mMetrics.AddCounter("render.upload_bytes");
+	mMetricIds.VisibleSubMeshes = mMetrics.AddGauge("culling.visible_submeshes");
+	mMetricIds.OcclusionMs = mMetrics.AddGauge("culling.occlusion_ms");
+	mMetricIds.LightsInView = mMetrics.AddGauge("lights.in_view");
+	mMetricIds.LightBinningMs = mMetrics.AddGauge("lights.binning_ms");
+	mMetricIds.GraphCompileMs = mMetrics.AddGauge("graph.compile_ms");
+	mMetricIds.CpuBytes = mMetrics.AddGauge("memory.cpu_bytes");
+	mMetricIds.GpuBytes = mMetrics.AddGauge("memory.gpu_bytes");
+	mMetricIds.ModelImportMs = mMetrics.AddGauge("import.model_ms");
+	mMetricIds.Reloads = mMetrics.AddCounter("import.reloads");
+	mMetricIds.ReloadImportMs = mMetrics.AddGauge("import.reload_ms");
+
+	// Without the shared memory the values are kept but not published
+	const bool opened = mMetrics.Open(kMetricsName, kMetricSlots);
+	LOG("Metrics: ", mMetrics.GetMetricCount(), " published to ", opened ? kMetricsName : "nothing", ", ", kMetricSlots, " frames kept");
+}
+
+void Renderer::RenderLoop()
+{
+	while (const FrameState* state = mFrameStates.BeginRead())
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		bool resize = false;
+		int width = 0, height = 0;
+		{
+			std::lock_guard<std::mutex> lock(mResizeMutex);
+			std::swap(resize, mbResizePending);
+			width = mPendingWidth;
+			height = mPendingHeight;
+		}
+		if (resize)
+			ResizeBuffers(width, height);
+		ApplyReloads();
+
+		DrawScene(*state);
+
+		// The slot is only released after Present, which bounds the latency to one frame.
+		auto end = std::chrono::steady_clock::now();
+		double latencyMs = std::chrono::duration<double, std::milli>(end - state->UpdateStart).count();
+		double drawMs = std::chrono::duration<double, std::milli>(end - start).count();
+		const uint64_t frame = state->Frame;
+		mFrameStates.EndRead();
+		SetEvent(mhFrameReleased);
+
+		PublishMetrics(frame, drawMs, latencyMs);
+
+		std::lock_guard<std::mutex> lock(mRenderStatsMutex);
+		mRenderStats.Frames++;
+		mRenderStats.DrawMs += drawMs;
+		mRenderStats.LatencyMs += latencyMs;
+		mRenderStats.Occlusion = mSceneCulling.GetStats();
+		mRenderStats.Lights = mLightClusters.GetStats();
+		mRenderStats.Graph = mRenderGraph.GetStats();
+		mRenderStats.StateChanges = mStateCache.GetStats();
+		if (mpTimings)
+		{
+			mpTimings->Add(mTimingColumns.Draw, drawMs);
+			mpTimings->Add(mTimingColumns.Occlusion, mEnableOcclusionCulling ? mSceneCulling.GetStats().RasterMs : 0.0);
+			mpTimings->Add(mTimingColumns.LightBinning, mEnableLocalLights ? mLightClusters.GetStats().BinMs : 0.0);
+			mpTimings->Add(mTimingColumns.Latency, latencyMs);
+		}
+	}
+}
+
+void Renderer::PublishMetrics(uint64_t frame, double drawMs, double latencyMs)
+{
+	const StateCache::Stats& state = mStateCache.GetStats();
+	mMetrics.Set(mMetricIds.DrawMs, drawMs);
+	mMetrics.Set(mMetricIds.LatencyMs, latencyMs);
+	mMetrics.Add(mMetricIds.Frames, 1.0);
+	mMetrics.Set(mMetricIds.Draws, state.Draws);
+	mMetrics.Set(mMetricIds.Triangles, state.Vertices / 3);
+	mMetrics.Set(mMetricIds.StateCalls, state.Issued);
+	mMetrics.Set(mMetricIds.VisibleSubMeshes, static_cast<double>(mVisibleSubMeshes.size()));
+	mMetrics.Set(mMetricIds.OcclusionMs, mEnableOcclusionCulling ? mSceneCulling.GetStats().RasterMs : 0.0);
+	mMetrics.Set(mMetricIds.LightsInView, mEnableLocalLights ? static_cast<double>(mLightClusters.GetStats().LightsInView) : 0.0);
+	mMetrics.Set(mMetricIds.LightBinningMs, mEnableLocalLights ? mLightClusters.GetStats().BinMs : 0.0);
+	mMetrics.Set(mMetricIds.GraphCompileMs, mRenderGraph.GetStats().CompileMs);
+
+	// Model geometry and textures are uploaded when loaded, textures off the render thread
+	const uint64_t loadUploadBytes = mGeometryPool.GetUploadedBytes() + TextureCache::getInstance().GetStats().UploadedBytes;
+	mMetrics.Add(mMetricIds.UploadBytes, static_cast<double>(loadUploadBytes - mLoadUploadBytes));
+	mLoadUploadBytes = loadUploadBytes;
+
+	int64_t gpuBytes = 0;
+	for (MemoryTag tag : { MemoryTag::GpuBuffers, MemoryTag::GpuTextures, MemoryTag::GpuTargets })
+		gpuBytes += MemoryTracker::GetStats(tag).CurrentBytes;
+	mMetrics.Set(mMetricIds.CpuBytes, static_cast<double>(MemoryTracker::GetTotalStats().CurrentBytes - gpuBytes));
+	mMetrics.Set(mMetricIds.GpuBytes, static_cast<double>(gpuBytes));
+
+	mMetrics.Publish(frame);
+}
+
+void Renderer::UploadFrameConstants(const FrameState& state)
+{
+	XMMATRIX world = XMLoadFloat4x4(&state.World);
+	XMMATRIX worldViewProj = XMMatrixTranspose(world * XMLoadFloat4x4(&state.View) * XMLoadFloat4x4(&state.Proj));
 	XMMATRIX worldInvTrans = XMMatrixTranspose(XMMatrixInverse(nullptr, world));
 
 	D3D11_MAPPED_SUBRESOURCE mappedResource;
 	ZeroMemory(&mappedResource, sizeof(D3D11_MAPPED_SUBRESOURCE));
 	md3dImmediateContext->Map(mPerFrameCbuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	mMetrics.Add(mMetricIds.UploadBytes, sizeof(PER_FRAME_CBUFFER));
 	PER_FRAME_CBUFFER* data = static_cast<PER_FRAME_CBUFFER*>(mappedResource.pData);
 	XMStoreFloat4x4(&data->mWorldViewProj, worldViewProj);
 	XMStoreFloat4x4(&data->mWorldInvTrans, worldInvTrans);
-	data->mWorld = mWorld;
-	data->CamPos = XMFLOAT4(x, y, z, 1.0f);
+	data->mWorld = state.World;
+	data->CamPos = XMFLOAT4(state.CameraPosition.x, state.CameraPosition.y, state.CameraPosition.z, 1.0f);
 	md3dImmediateContext->Unmap(mPerFrameCbuffer.Get(), 0);
+
+	if (state.LightChanged)
+	{
+		ZeroMemory(&mappedResource, sizeof(D3D11_MAPPED_SUBRESOURCE));
+		md3dImmediateContext->Map(mDirectionalLightBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		mMetrics.Add(mMetricIds.UploadBytes, sizeof(LIGHTS_CBUFFER));
+		LIGHTS_CBUFFER* lights = static_cast<LIGHTS_CBUFFER*>(mappedResource.pData);
+		lights->DirLight = state.Light;
+		md3dImmediateContext->Unmap(mDirectionalLightBuffer.Get(), 0);
+	}
+
+	UploadLightClusters(state);
+}
+
+void Renderer::UploadLightClusters(const FrameState& state)
+{
+	if (mEnableLocalLights)
+	{
+		mLightClusters.Bin(state.LocalLights.data(), state.LocalLights.size(), state.View, state.Proj);
+
+		const std::vector<LightClusters::Range>& clusters = mLightClusters.GetClusters();
+		const std::vector<uint32_t>& indices = mLightClusters.GetLightIndices();
+		UploadShaderBuffer(mLocalLightBuffer, state.LocalLights.data(), sizeof(LOCAL_LIGHT), static_cast<UINT>(state.LocalLights.size()));
+		UploadShaderBuffer(mClusterBuffer, clusters.data(), sizeof(LightClusters::Range), static_cast<UINT>(clusters.size()));
+		UploadShaderBuffer(mClusterLightIndexBuffer, indices.data(), sizeof(uint32_t), static_cast<UINT>(indices.size()));
+	}
+	CLUSTER_CBUFFER constants = mLightClusters.GetShaderConstants(mScreenViewport.Width, mScreenViewport.Height);
+	if (!mEnableLocalLights)
+		constants.LightCount = 0;
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	ZeroMemory(&mappedResource, sizeof(D3D11_MAPPED_SUBRESOURCE));
+	md3dImmediateContext->Map(mClusterCbuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	mMetrics.Add(mMetricIds.UploadBytes, sizeof(CLUSTER_CBUFFER));
+	*static_cast<CLUSTER_CBUFFER*>(mappedResource.pData) = constants;
+	md3dImmediateContext->Unmap(mClusterCbuffer.Get(), 0);
 }
 
-void Renderer::DrawScene()
+void Renderer::UploadShaderBuffer(ShaderBuffer& buffer, const void* data, UINT stride, UINT count)
 {
-	const FLOAT blue[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+	// Never empty, the shader always has the views bound
+	if (!buffer.Buffer || count > buffer.Capacity)
+	{
+		buffer.Capacity = (std::max)({ count, 2 * buffer.Capacity, 64u });
+
+		D3D11_BUFFER_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.ByteWidth = stride * buffer.Capacity;
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		desc.StructureByteStride = stride;
+		buffer.Buffer.Reset();
+		buffer.View.Reset();
+		HR(md3dDevice->CreateBuffer(&desc, nullptr, buffer.Buffer.GetAddressOf()));
+		MemoryTracker::TrackGpuResource(buffer.Buffer.Get(), MemoryTag::GpuBuffers);
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+		ZeroMemory(&viewDesc, sizeof(viewDesc));
+		viewDesc.Format = DXGI_FORMAT_UNKNOWN;
+		viewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		viewDesc.Buffer.FirstElement = 0;
+		viewDesc.Buffer.NumElements = buffer.Capacity;
+		HR(md3dDevice->CreateShaderResourceView(buffer.Buffer.Get(), &viewDesc, buffer.View.GetAddressOf()));
+	}
+
+	if (count == 0)
+		return;
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	ZeroMemory(&mappedResource, sizeof(D3D11_MAPPED_SUBRESOURCE));
+	md3dImmediateContext->Map(buffer.Buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	memcpy(mappedResource.pData, data, size_t(stride) * count);
+	mMetrics.Add(mMetricIds.UploadBytes, double(stride) * count);
+	md3dImmediateContext->Unmap(buffer.Buffer.Get(), 0);
+}
 
+void Renderer::DrawScene(const FrameState& state)
+{
 	assert(md3dImmediateContext);
 	assert(mSwapChain);
 
-	md3dImmediateContext->ClearRenderTargetView(mRenderTargetView.Get(), blue);
-	md3dImmediateContext->ClearDepthStencilView(mDepthStencilView.Get(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
-	md3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	md3dImmediateContext->IASetInputLayout(mInputLayout.Get());
+	mStateCache.BeginFrame();
+	UploadFrameConstants(state);
 
-	md3dImmediateContext->DrawIndexed(mIndexCount, 0, 0);
+	// Occluders are rasterized on the CPU first, submeshes hidden behind them are not drawn.
+	XMFLOAT4X4 worldViewProj;
+	XMStoreFloat4x4(&worldViewProj, XMLoadFloat4x4(&state.World) * XMLoadFloat4x4(&state.View) * XMLoadFloat4x4(&state.Proj));
+	if (mEnableOcclusionCulling)
+	{
+		mSceneCulling.Cull(worldViewProj, mVisibleSubMeshes);
+	}
+	else
+	{
+		mVisibleSubMeshes.resize(mSubMeshes.size());
+		std::iota(mVisibleSubMeshes.begin(), mVisibleSubMeshes.end(), 0u);
+	}
+
+	// Every frame asks for all the state it draws with, the cache only passes on changes.
+	mStateCache.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	mStateCache.SetRasterizerState(mRasterizerState.Get());
+	mStateCache.SetBlendState(mBlendState.Get());
+	mStateCache.SetVSConstantBuffer(0, mPerFrameCbuffer.Get());
+	mStateCache.SetPSConstantBuffer(0, mPerFrameCbuffer.Get());
+	mStateCache.SetPSConstantBuffer(1, mDirectionalLightBuffer.Get());
+	mStateCache.SetPSConstantBuffer(3, mClusterCbuffer.Get());
+	mStateCache.SetPSConstantBuffer(4, mEnvironmentCbuffer.Get());
+	mStateCache.SetPSShaderResource(2, mLocalLightBuffer.View.Get());
+	mStateCache.SetPSShaderResource(3, mClusterBuffer.View.Get());
+	mStateCache.SetPSShaderResource(4, mClusterLightIndexBuffer.View.Get());
+	mStateCache.SetPSShaderResource(5, mEnvironmentMap.Get());
+	// The model is drawn from its ranges in the pool buffers
+	mGeometryPool.Bind(mStateCache);
+	GeometryPool::Range geometry = {};
+	if (mModelGeometry != GeometryPool::kInvalidHandle)
+		geometry = mGeometryPool.GetRange(mModelGeometry);
+	else
+		mVisibleSubMeshes.clear();
+
+	// The passes declare the targets they write, the graph creates the depth buffer
+	// and orders the passes; the pool holds the textures between frames.
+	const RenderGraph::TextureDesc backBufferDesc = { static_cast<uint32_t>(mScreenViewport.Width),
+		static_cast<uint32_t>(mScreenViewport.Height), RenderGraph::TextureFormat::RGBA8, mEnable4xMsaa ? 4u : 1u };
+	RenderGraph::TextureDesc depthDesc = backBufferDesc;
+	depthDesc.Format = RenderGraph::TextureFormat::D24S8;
+
+	mRenderGraph.Reset();
+	RenderGraph::TextureHandle backBuffer = mRenderGraph.Import("Back buffer", backBufferDesc);
+	RenderGraph::TextureHandle depth = RenderGraph::kInvalidTexture;
+
+	// Depth from the position stream alone, so the main pass shades every pixel once.
+	// Without split streams the positions are fetched from the interleaved vertices.
+	if (mEnableDepthPrepass)
+	{
+		RenderGraph::PassBuilder pass = mRenderGraph.AddPass("Depth prepass");
+		depth = pass.Create("Depth", depthDesc);
+		pass.Execute([this, depth, geometry](const RenderGraph& graph)
+		{
+			ID3D11DepthStencilView* depthView = mRenderTargetPool.GetDepthStencilView(graph, depth);
+			md3dImmediateContext->ClearDepthStencilView(depthView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+			md3dImmediateContext->OMSetRenderTargets(0, nullptr, depthView);
+
+			mStateCache.SetInputLayout(mDepthInputLayout.Get());
+			mStateCache.SetVertexShader(mDepthVertexShader.Get());
+			mStateCache.SetPixelShader(nullptr);
+			mStateCache.SetDepthStencilState(mDepthStencilState.Get(), 0);
+			for (UINT i : mVisibleSubMeshes)
+			{
+				const SubMesh& subMesh = mSubMeshes[i];
+				mStateCache.DrawIndexed(subMesh.IndexCount, geometry.StartIndex + subMesh.StartIndex, geometry.BaseVertex);
+			}
+		});
+	}
+
+	{
+		RenderGraph::PassBuilder pass = mRenderGraph.AddPass("Scene");
+		const bool clearDepth = depth == RenderGraph::kInvalidTexture;
+		depth = clearDepth ? pass.Create("Depth", depthDesc) : pass.Write(depth);
+		backBuffer = pass.Write(backBuffer);
+		pass.Execute([this, depth, backBuffer, clearDepth, geometry](const RenderGraph& graph)
+		{
+			const FLOAT blue[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+			ID3D11RenderTargetView* colorView = mRenderTargetPool.GetRenderTargetView(graph, backBuffer);
+			ID3D11DepthStencilView* depthView = mRenderTargetPool.GetDepthStencilView(graph, depth);
+			md3dImmediateContext->ClearRenderTargetView(colorView, blue);
+			if (clearDepth)
+				md3dImmediateContext->ClearDepthStencilView(depthView, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+			md3dImmediateContext->OMSetRenderTargets(1, &colorView, depthView);
+
+			mStateCache.SetInputLayout(mInputLayout.Get());
+			mStateCache.SetVertexShader(mVertexShader.Get());
+			mStateCache.SetPixelShader(mPixelShader.Get());
+			mStateCache.SetDepthStencilState(mEnableDepthPrepass ? mDepthEqualState.Get() : mDepthStencilState.Get(), 0);
+
+			// Submeshes are sorted by material, so the cache drops the binds within a group.
+			for (UINT i : mVisibleSubMeshes)
+			{
+				const SubMesh& subMesh = mSubMeshes[i];
+				mMaterials[subMesh.MaterialIndex].AttachToShaders(mStateCache);
+				mStateCache.DrawIndexed(subMesh.IndexCount, geometry.StartIndex + subMesh.StartIndex, geometry.BaseVertex);
+			}
+		});
+	}
+	mRenderGraph.MarkOutput(backBuffer);
+
+	mRenderGraph.Compile();
+	mRenderTargetPool.Realize(mRenderGraph);
+	mRenderTargetPool.SetImported(mRenderGraph, backBuffer, mRenderTargetView.Get(), nullptr, nullptr);
+	mRenderGraph.Execute();
 
 	HR(mSwapChain->Present(0, 0));
 }
@@ -232,11 +691,50 @@ void Renderer::CalculateFrameStats(const GameTimer& timer, std::wstring& mMainWn
 		float fps = (float)frameCnt; // fps = frameCnt / 1
 		float mspf = 1000.0f / fps;
 
+		RenderStats render;
+		{
+			std::lock_guard<std::mutex> lock(mRenderStatsMutex);
+			render = mRenderStats;
+			mRenderStats.Frames = 0;
+			mRenderStats.DrawMs = 0.0;
+			mRenderStats.LatencyMs = 0.0;
+		}
+		const double renderFrames = (std::max)(render.Frames, uint64_t(1));
+		const double drawMs = render.DrawMs / renderFrames;
+		const double latencyMs = render.LatencyMs / renderFrames;
+		const double updateMs = mUpdateMs / frameCnt;
+		const double waitMs = mUpdateWaitMs / frameCnt;
+		const StateCache::Stats& state = render.StateChanges;
+		LOG("State cache: ", state.Requested, " binds requested, ", state.Filtered, " filtered, ", state.Issued, " calls issued for ",
+			state.Draws, " draws");
+		// Taking turns on one thread a frame would cost the update and the drawing.
+		LOG("Frame pipeline: ", mFrameStates.GetFramesInFlight(), " frames in flight, update ", updateMs, " ms (waiting ", waitMs,
+			" ms), draw ", drawMs, " ms, frame ", mspf, " ms (", updateMs + drawMs, " ms serial), latency ", latencyMs, " ms");
+		mUpdateMs = 0.0;
+		mUpdateWaitMs = 0.0;
+
 		std::wostringstream outs;
 		outs.precision(6);
 		outs << mMainWndCaption << L"    "
 			<< L"FPS: " << fps << L"    "
-			<< L"Frame Time: " << mspf << L" (ms)";
+			<< L"Frame Time: " << mspf << L" (ms)    "
+			<< L"Latency: " << latencyMs << L" (ms)";
+		if (mEnableOcclusionCulling)
+		{
+			const OcclusionCuller::Stats& occlusion = render.Occlusion;
+			outs << L"    Occlusion: " << occlusion.RasterMs << L" ms, culled " << occlusion.Culled << L"/" << occlusion.Tested;
+			LOG("Occlusion culling: raster ", occlusion.RasterMs, " ms (", occlusion.RasterizedTriangles, " of ", occlusion.OccluderTriangles,
+				" triangles), ", occlusion.Culled, " of ", occlusion.Tested, " submeshes culled");
+		}
+		if (mEnableLocalLights)
+		{
+			const LightClusters::Stats& lights = render.Lights;
+			LOG("Light clusters: binning ", lights.BinMs, " ms, ", lights.LightsInView, " of ", lights.Lights, " lights in view, ", lights.Indices,
+				" indices, up to ", lights.MaxPerCluster, " per cluster");
+		}
+		const RenderGraph::Stats& graph = render.Graph;
+		LOG("Render graph: ", graph.Passes - graph.CulledPasses, " of ", graph.Passes, " passes, ", graph.Textures, " transient textures in ",
+			graph.PhysicalTextures, ", ", (graph.RequestedBytes - graph.AllocatedBytes) / 1024, " KB saved by aliasing, compile ", graph.CompileMs, " ms");
 		SetWindowText(mhMainWnd, outs.str().c_str());
 
 		// Reset for next average.
@@ -247,149 +745,218 @@ void Renderer::CalculateFrameStats(const GameTimer& timer, std::wstring& mMainWn
 
 void Renderer::CreateShaders()
 {
-	std::ifstream shaderFile;
-
-	shaderFile.open("ShadersBin\\VertexShader.cso", std::ios::binary);
-	std::vector<char> fileData((std::istreambuf_iterator<char>(shaderFile)), std::istreambuf_iterator<char>());
+	std::vector<char> fileData = ReadFile(kVertexShaderFile);
 
 	HR(md3dDevice->CreateVertexShader(fileData.data(), fileData.size(), nullptr, &mVertexShader));
-	md3dImmediateContext->VSSetShader(mVertexShader.Get(), nullptr, 0);
 
-	D3D11_INPUT_ELEMENT_DESC desc[] =
+	mInputLayout = mPipelineStateCache.GetInputLayout(MeshVertexFormat(mEnableSplitStreams), fileData.data(), fileData.size());
+
+	fileData = ReadFile(kPixelShaderFile);
+
+	HR(md3dDevice->CreatePixelShader(fileData.data(), fileData.size(), nullptr, &mPixelShader));
+
+	if (mEnableDepthPrepass)
 	{
-		{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0}
-	};
+		fileData = ReadFile(kDepthVertexShaderFile);
 
-	HR(md3dDevice->CreateInputLayout(desc, 3, fileData.data(), fileData.size(), &mInputLayout));
+		HR(md3dDevice->CreateVertexShader(fileData.data(), fileData.size(), nullptr, &mDepthVertexShader));
 
-	shaderFile.close();
-	shaderFile.open("ShadersBin\\PixelShader.cso", std::ios::binary);
-	fileData.clear();
-	fileData = { (std::istreambuf_iterator<char>(shaderFile)), std::istreambuf_iterator<char>() };
+		// Reads the position at the start of slot 0, with or without split streams
+		mDepthInputLayout = mPipelineStateCache.GetInputLayout(VertexFormat::Position(), fileData.data(), fileData.size());
+	}
+}
 
-	HR(md3dDevice->CreatePixelShader(fileData.data(), fileData.size(), nullptr, &mPixelShader));
-	md3dImmediateContext->PSSetShader(mPixelShader.Get(), nullptr, 0);
-}
-
-void Renderer::CreateMesh()
-{
-	std::vector<VertexTextured> vertices;
-	std::vector<UINT> indices;
-
-	FBXReader fbxReader;
-	//fbxReader.LoadFbxFile("C:\\repositories\\DXProject\\models\\coca-cola\\coca-cola.fbx");
-	fbxReader.LoadFbxFile("C:\\repositories\\DXProject\\models\\coca-cola-2\\Coke_Can_Final.fbx");
-	//fbxReader.LoadFbxFile("C:\\repositories\\DXProject\\models\\eyeball\\eyeball.fbx");
-	fbxReader.GetVertices(vertices, indices);
-	mIndexCount = indices.size();
-
-	D3D11_BUFFER_DESC vertexBufDescr;
-	vertexBufDescr.Usage = D3D11_USAGE_IMMUTABLE;
-	vertexBufDescr.ByteWidth = sizeof(VertexTextured) * static_cast<UINT>(vertices.size());
-	vertexBufDescr.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vertexBufDescr.CPUAccessFlags = 0;
-	vertexBufDescr.MiscFlags = 0;
-	vertexBufDescr.StructureByteStride = 0;
-
-	D3D11_SUBRESOURCE_DATA vertexData;
-	vertexData.pSysMem = vertices.data();
-
-	ID3D11Buffer* vertexBuffer;
-	HR(md3dDevice->CreateBuffer(&vertexBufDescr, &vertexData, &vertexBuffer));
-
-	UINT stride = sizeof(VertexTextured);
-	UINT offset = 0;
-	md3dImmediateContext->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
-
-
-	D3D11_BUFFER_DESC indexBufDescr;
-	indexBufDescr.Usage = D3D11_USAGE_IMMUTABLE;
-	indexBufDescr.ByteWidth = sizeof(UINT) * static_cast<UINT>(indices.size());
-	indexBufDescr.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	indexBufDescr.CPUAccessFlags = 0;
-	indexBufDescr.MiscFlags = 0;
-	indexBufDescr.StructureByteStride = 0;
-
-	D3D11_SUBRESOURCE_DATA indexData;
-	indexData.pSysMem = indices.data();
-
-	ID3D11Buffer* indexBuffer;
-	HR(md3dDevice->CreateBuffer(&indexBufDescr, &indexData, &indexBuffer));
-
-	md3dImmediateContext->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
-}
-
-void Renderer::CreateCubeMesh()
-{
-	CubeVertex vertices[] =
-	{
-		{ XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT4((const float*)&Colors::White) },
-		{ XMFLOAT3(-1.0f, +1.0f, -1.0f), XMFLOAT4((const float*)&Colors::Black) },
-		{ XMFLOAT3(+1.0f, +1.0f, -1.0f), XMFLOAT4((const float*)&Colors::Red) },
-		{ XMFLOAT3(+1.0f, -1.0f, -1.0f), XMFLOAT4((const float*)&Colors::Green) },
-		{ XMFLOAT3(-1.0f, -1.0f, +1.0f), XMFLOAT4((const float*)&Colors::Blue) },
-		{ XMFLOAT3(-1.0f, +1.0f, +1.0f), XMFLOAT4((const float*)&Colors::Yellow) },
-		{ XMFLOAT3(+1.0f, +1.0f, +1.0f), XMFLOAT4((const float*)&Colors::Cyan) },
-		{ XMFLOAT3(+1.0f, -1.0f, +1.0f), XMFLOAT4((const float*)&Colors::Magenta) }
-	};
-
-	D3D11_BUFFER_DESC vertexBufDescr;
-	vertexBufDescr.Usage = D3D11_USAGE_IMMUTABLE;
-	vertexBufDescr.ByteWidth = sizeof(CubeVertex) * 8;
-	vertexBufDescr.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vertexBufDescr.CPUAccessFlags = 0;
-	vertexBufDescr.MiscFlags = 0;
-	vertexBufDescr.StructureByteStride = 0;
-
-	D3D11_SUBRESOURCE_DATA vertexData;
-	vertexData.pSysMem = vertices;
-
-	ID3D11Buffer* vertexBuffer;
-	HR(md3dDevice->CreateBuffer(&vertexBufDescr, &vertexData, &vertexBuffer));
-
-	UINT stride = sizeof(CubeVertex);
-	UINT offset = 0;
-	md3dImmediateContext->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
-
-
-	UINT indices[] = {
-		// front face
-		0, 1, 2,
-		0, 2, 3,
-		// back face
-		4, 6, 5,
-		4, 7, 6,
-		// left face
-		4, 5, 1,
-		4, 1, 0,
-		// right face
-		3, 2, 6,
-		3, 6, 7,
-		// top face
-		1, 5, 6,
-		1, 6, 2,
-		// bottom face
-		4, 0, 3,
-		4, 3, 7
-	};
-
-	D3D11_BUFFER_DESC indexBufDescr;
-	indexBufDescr.Usage = D3D11_USAGE_IMMUTABLE;
-	indexBufDescr.ByteWidth = sizeof(UINT) * 36;
-	indexBufDescr.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	indexBufDescr.CPUAccessFlags = 0;
-	indexBufDescr.MiscFlags = 0;
-	indexBufDescr.StructureByteStride = 0;
-
-	D3D11_SUBRESOURCE_DATA indexData;
-	indexData.pSysMem = indices;
-
-	ID3D11Buffer* indexBuffer;
-	HR(md3dDevice->CreateBuffer(&indexBufDescr, &indexData, &indexBuffer));
-
-	md3dImmediateContext->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+void Renderer::CreateRenderStates()
+{
+	D3D11_RASTERIZER_DESC rasterizerDesc;
+	ZeroMemory(&rasterizerDesc, sizeof(rasterizerDesc));
+	rasterizerDesc.FillMode = D3D11_FILL_SOLID;
+	rasterizerDesc.CullMode = D3D11_CULL_BACK;
+	rasterizerDesc.DepthClipEnable = TRUE;
+	rasterizerDesc.MultisampleEnable = FALSE;
+	mRasterizerState = mPipelineStateCache.GetRasterizerState(rasterizerDesc);
+
+	D3D11_DEPTH_STENCIL_DESC depthStencilDesc;
+	ZeroMemory(&depthStencilDesc, sizeof(depthStencilDesc));
+	depthStencilDesc.DepthEnable = TRUE;
+	depthStencilDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	depthStencilDesc.DepthFunc = D3D11_COMPARISON_LESS;
+	mDepthStencilState = mPipelineStateCache.GetDepthStencilState(depthStencilDesc);
+
+	// After the prepass only the closest surface passes, and depth is already written.
+	depthStencilDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	depthStencilDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+	mDepthEqualState = mPipelineStateCache.GetDepthStencilState(depthStencilDesc);
+
+	D3D11_BLEND_DESC blendDesc;
+	ZeroMemory(&blendDesc, sizeof(blendDesc));
+	blendDesc.RenderTarget[0].BlendEnable = FALSE;
+	blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+	blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_ZERO;
+	blendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+	blendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+	blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
+	blendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+	blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	mBlendState = mPipelineStateCache.GetBlendState(blendDesc);
+}
+
+bool Renderer::LoadModel(const std::string& modelFile, LoadedModel& model)
+{
+	if (!CreateMesh(modelFile, model))
+		return false;
+	CreateMaterials(model);
+	return true;
+}
+
+bool Renderer::CreateMesh(const std::string& modelFile, LoadedModel& model)
+{
+	std::vector<VertexTextured>& vertices = model.Vertices;
+	std::vector<UINT>& indices = model.Indices;
+	MemoryTracker::Scope memoryScope(MemoryTag::Import);
+
+	// Use the cooker output if it is current, the model is imported from the source otherwise.
+	// OBJ files have their own importer. For FBX the native reader handles binary files,
+	// ASCII and old files go through the FBX SDK.
+	CookedAssets::Mesh cooked;
+	const std::filesystem::path cookedFile = CookedAssets::MeshPath(modelFile);
+	FbxBinaryReader binaryReader;
+	if (CookedAssets::IsUpToDate(cookedFile, modelFile) && CookedAssets::ReadMesh(cookedFile, cooked))
+	{
+		LOG("Cooked mesh ", cookedFile.filename().string(), ": ", cooked.Vertices.size(), " vertices, ", cooked.Indices.size(), " indices");
+		vertices.swap(cooked.Vertices);
+		indices.swap(cooked.Indices);
+		model.SubMeshes.swap(cooked.SubMeshes);
+		model.MaterialDescs.swap(cooked.Materials);
+	}
+	else if (_wcsicmp(std::filesystem::u8path(modelFile).extension().c_str(), L".obj") == 0)
+	{
+		ObjReader objReader;
+		if (objReader.LoadObjFile(modelFile))
+		{
+			objReader.GetVertices(vertices, indices, model.SubMeshes);
+			objReader.GetMaterials(model.MaterialDescs);
+		}
+	}
+	else if (binaryReader.LoadFbxFile(modelFile))
+	{
+		binaryReader.GetVertices(vertices, indices, model.SubMeshes);
+		binaryReader.GetMaterials(model.MaterialDescs);
+	}
+	else
+	{
+		// The SDK allocates its scene from its own heap, counted until the reader is gone
+		MemoryTracker::ExternalAllocation sdkMemory(MemoryTag::Import);
+		FBXReader fbxReader;
+		fbxReader.LoadFbxFile(modelFile);
+		sdkMemory.Measure();
+		LOG("FBX SDK scene: ", sdkMemory.GetBytes() / 1024, " KB");
+		fbxReader.GetVertices(vertices, indices, model.SubMeshes);
+		fbxReader.GetMaterials(model.MaterialDescs);
+	}
+
+	if (vertices.empty() || indices.empty())
+	{
+		LOG("Model ", modelFile, ": no triangles imported");
+		return false;
+	}
+
+	// Tangents come first, generating them can split vertices
+	if (mEnableNormalMapping)
+	{
+		model.Tangents.swap(cooked.Tangents);
+		CreateTangents(vertices, indices, model.Tangents);
+	}
+
+	// Split streams keep the positions packed, for the depth prepass and the CPU passes below.
+	TangentGenerator::Input attributes;
+	if (mEnableSplitStreams)
+	{
+		VertexStreams& streams = model.Streams;
+		streams = VertexStreams::Split(vertices);
+		std::vector<VertexTextured>().swap(vertices);
+
+		attributes.Positions = &streams.Positions.data()->x;
+		attributes.PositionStride = sizeof(XMFLOAT3);
+		attributes.Normals = &streams.Normals.data()->x;
+		attributes.NormalStride = sizeof(XMFLOAT3);
+		attributes.TexCoords = &streams.TexCoords.data()->x;
+		attributes.TexCoordStride = sizeof(XMFLOAT2);
+		attributes.VertexCount = streams.GetVertexCount();
+	}
+	else
+	{
+		attributes.Positions = &vertices.data()->Pos.x;
+		attributes.PositionStride = sizeof(VertexTextured);
+		attributes.Normals = &vertices.data()->Normal.x;
+		attributes.NormalStride = sizeof(VertexTextured);
+		attributes.TexCoords = &vertices.data()->Tex.x;
+		attributes.TexCoordStride = sizeof(VertexTextured);
+		attributes.VertexCount = vertices.size();
+	}
+	attributes.Indices = indices.data();
+	attributes.IndexCount = indices.size();
+
+	MemoryTracker::Scope sceneScope(MemoryTag::Scene);
+	model.Culling.Init(attributes.Positions, attributes.PositionStride, attributes.VertexCount, indices.data(), model.SubMeshes);
+
+	model.Bvh.Build(attributes.Positions, attributes.PositionStride, indices.data(), indices.size());
+	const MeshBvh::BuildStats& bvhStats = model.Bvh.GetBuildStats();
+	LOG("Mesh BVH: ", bvhStats.TriangleCount, " triangles, ", bvhStats.NodeCount, " nodes, ", bvhStats.LeafCount, " leaves in ",
+		bvhStats.Milliseconds, " ms on ", bvhStats.ThreadCount, " threads");
+
+	return true;
+}
+
+void Renderer::CreateTangents(std::vector<VertexTextured>& vertices, std::vector<UINT>& indices, std::vector<XMFLOAT4>& tangents)
+{
+	// Cooked meshes come with tangents
+	if (!tangents.empty() || vertices.empty())
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	TangentGenerator::Input input;
+	input.Positions = &vertices.data()->Pos.x;
+	input.PositionStride = sizeof(VertexTextured);
+	input.Normals = &vertices.data()->Normal.x;
+	input.NormalStride = sizeof(VertexTextured);
+	input.TexCoords = &vertices.data()->Tex.x;
+	input.TexCoordStride = sizeof(VertexTextured);
+	input.VertexCount = vertices.size();
+	input.Indices = indices.data();
+	input.IndexCount = indices.size();
+
+	tangents.resize(vertices.size());
+	std::vector<TangentGenerator::SplitVertex> splits;
+	TangentGenerator::Generate(input, &tangents.data()->x, indices.data(), splits);
+
+	// Vertices shared by mirrored and unmirrored triangles get a copy for the mirrored side
+	vertices.reserve(vertices.size() + splits.size());
+	tangents.reserve(tangents.size() + splits.size());
+	for (const TangentGenerator::SplitVertex& split : splits)
+	{
+		vertices.push_back(vertices[split.Source]);
+		tangents.push_back(XMFLOAT4(split.Tangent[0], split.Tangent[1], split.Tangent[2], split.Tangent[3]));
+	}
+
+	LOG("Tangents generated in ",
+		std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count(), " ms, ",
+		splits.size(), " vertices split");
+}
+
+void Renderer::CreateGeometryPool()
+{
+	// The streams in the order of the input layout slots
+	std::vector<UINT> strides;
+	if (mEnableSplitStreams)
+		strides = { sizeof(XMFLOAT3), sizeof(XMFLOAT3), sizeof(XMFLOAT2) };
+	else
+		strides = { sizeof(VertexTextured) };
+	if (mEnableNormalMapping)
+		strides.push_back(sizeof(XMFLOAT4));
+
+	mGeometryPool.Init(md3dDevice, md3dImmediateContext, strides, kGeometryPoolVertices, kGeometryPoolIndices);
 }
 
 void Renderer::CreateConstantBuffers()
@@ -416,8 +983,7 @@ void Renderer::CreateConstantBuffers()
 	InitData.SysMemSlicePitch = 0;
 
 	HR(md3dDevice->CreateBuffer(&cbDesc, &InitData, mPerFrameCbuffer.GetAddressOf()));
-	md3dImmediateContext->VSSetConstantBuffers(0, 1, mPerFrameCbuffer.GetAddressOf());
-	md3dImmediateContext->PSSetConstantBuffers(0, 1, mPerFrameCbuffer.GetAddressOf());
+	MemoryTracker::TrackGpuResource(mPerFrameCbuffer.Get(), MemoryTag::GpuBuffers);
 
 	//-------------- LIGHTS_CBUFFER ---------------
 
@@ -429,119 +995,462 @@ void Renderer::CreateConstantBuffers()
 	cbDesc.StructureByteStride = 0;
 
 	HR(md3dDevice->CreateBuffer(&cbDesc, nullptr, mDirectionalLightBuffer.GetAddressOf()));
-	md3dImmediateContext->PSSetConstantBuffers(1, 1, mDirectionalLightBuffer.GetAddressOf());
+	MemoryTracker::TrackGpuResource(mDirectionalLightBuffer.Get(), MemoryTag::GpuBuffers);
+
+	//-------------- CLUSTER_CBUFFER ---------------
+
+	cbDesc.ByteWidth = sizeof(CLUSTER_CBUFFER);
+
+	HR(md3dDevice->CreateBuffer(&cbDesc, nullptr, mClusterCbuffer.GetAddressOf()));
+	MemoryTracker::TrackGpuResource(mClusterCbuffer.Get(), MemoryTag::GpuBuffers);
+
+	// Empty until the first frame, the views are bound from the start
+	UploadShaderBuffer(mLocalLightBuffer, nullptr, sizeof(LOCAL_LIGHT), 0);
+	UploadShaderBuffer(mClusterBuffer, nullptr, sizeof(LightClusters::Range), 0);
+	UploadShaderBuffer(mClusterLightIndexBuffer, nullptr, sizeof(uint32_t), 0);
 }
 
-void Renderer::CreateMaterial()
+void Renderer::CreateEnvironmentLighting()
 {
-    
-    mMaterial.LoadTextures(md3dDevice,
-		//L"C:\\repositories\\DXProject\\\models\\coca-cola-2\\Coke_Clean\\test.tga",
-		L"C:\\repositories\\DXProject\\\models\\coca-cola-2\\Coke_Clean\\Coke_Can_VRayMtl1_Reflection.tga",
-		L"C:\\repositories\\DXProject\\\models\\coca-cola-2\\Coke_Clean\\Coke_Can_VRayMtl1_Normal.tga"
-	);
-    mMaterial.AttachToShaders(md3dImmediateContext);
+	EnvironmentLighting environment;
+	{
+		MemoryTracker::Scope memoryScope(MemoryTag::Textures);
+		const bool loaded = environment.LoadEquirect(kEnvironmentMapFile, kEnvironmentSize);
+		if (!loaded)
+			environment.SetProceduralSky(kEnvironmentSize, mSimulation.GetLight().Direction);
+		environment.Bake(kEnvironmentLevels);
+
+		const EnvironmentLighting::Stats& stats = environment.GetStats();
+		LOG("Environment lighting from ", loaded ? "environment map" : "procedural sky", ": ", stats.BaseSize, " base size, ", stats.Levels,
+			" levels, source ", stats.SourceMs, " ms, SH ", stats.ShMs, " ms, prefilter ", stats.PrefilterMs, " ms on ", stats.Threads, " threads");
+	}
+
+	// One subresource per face and mip, face after face
+	const std::vector<EnvironmentLighting::CubeLevel>& levels = environment.GetPrefilteredLevels();
+	const UINT levelCount = static_cast<UINT>(levels.size());
+	std::vector<D3D11_SUBRESOURCE_DATA> initData(6 * levelCount);
+	for (UINT face = 0; face < 6; face++)
+	{
+		for (UINT level = 0; level < levelCount; level++)
+		{
+			const EnvironmentLighting::CubeLevel& cubeLevel = levels[level];
+			D3D11_SUBRESOURCE_DATA& data = initData[face * levelCount + level];
+			data.pSysMem = cubeLevel.Texels.data() + size_t(face) * cubeLevel.Size * cubeLevel.Size;
+			data.SysMemPitch = cubeLevel.Size * sizeof(XMFLOAT4);
+			data.SysMemSlicePitch = 0;
+		}
+	}
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = levels[0].Size;
+	desc.Height = levels[0].Size;
+	desc.MipLevels = levelCount;
+	desc.ArraySize = 6;
+	desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+
+	ComPtr<ID3D11Texture2D> texture;
+	HR(md3dDevice->CreateTexture2D(&desc, initData.data(), texture.GetAddressOf()));
+	MemoryTracker::TrackGpuResource(texture.Get(), MemoryTag::GpuTextures);
+	for (const EnvironmentLighting::CubeLevel& level : levels)
+		mMetrics.Add(mMetricIds.UploadBytes, static_cast<double>(level.Texels.size() * sizeof(XMFLOAT4)));
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+	viewDesc.Format = desc.Format;
+	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+	viewDesc.TextureCube.MostDetailedMip = 0;
+	viewDesc.TextureCube.MipLevels = levelCount;
+	HR(md3dDevice->CreateShaderResourceView(texture.Get(), &viewDesc, mEnvironmentMap.GetAddressOf()));
+
+	ENVIRONMENT_CBUFFER constants = {};
+	for (int i = 0; i < 9; i++)
+		constants.AmbientSh[i] = environment.GetShCoefficients()[i];
+	constants.PrefilteredLevels = static_cast<float>(levelCount);
+
+	D3D11_BUFFER_DESC cbDesc = {};
+	cbDesc.ByteWidth = sizeof(ENVIRONMENT_CBUFFER);
+	cbDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+	D3D11_SUBRESOURCE_DATA cbData = {};
+	cbData.pSysMem = &constants;
+
+	HR(md3dDevice->CreateBuffer(&cbDesc, &cbData, mEnvironmentCbuffer.GetAddressOf()));
+	MemoryTracker::TrackGpuResource(mEnvironmentCbuffer.Get(), MemoryTag::GpuBuffers);
 }
 
-void Renderer::SetupLights()
+void Renderer::CreateMaterials(LoadedModel& model)
 {
-	D3D11_MAPPED_SUBRESOURCE mappedResource;
-	ZeroMemory(&mappedResource, sizeof(D3D11_MAPPED_SUBRESOURCE));
-	md3dImmediateContext->Map(mDirectionalLightBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	LIGHTS_CBUFFER* lights = static_cast<LIGHTS_CBUFFER*>(mappedResource.pData);
+	model.Materials.resize(model.MaterialDescs.size());
+	for (size_t i = 0; i < model.MaterialDescs.size(); i++)
+	{
+		MaterialDesc& desc = model.MaterialDescs[i];
+		if (desc.ColorMapFile.empty())
+		{
+			desc.ColorMapFile = kFallbackColorMap;
+			if (desc.NormalMapFile.empty())
+				desc.NormalMapFile = kFallbackNormalMap;
+		}
+		HR(model.Materials[i].Init(md3dDevice, desc));
+	}
 
-    lights->DirLight.Ambient = XMFLOAT4(0.5f, 0.5f, 0.5f, 1.0f);
-    lights->DirLight.Diffuse = XMFLOAT4(0.5f, 0.5f, 0.5f, 1.0f);
-    lights->DirLight.Specular = XMFLOAT4(0.5f, 0.5f, 0.5f, 2.0f);
+	LOG("Materials: ", model.Materials.size(), ", submeshes: ", model.SubMeshes.size());
+	TextureCache::getInstance().LogStats();
+}
 
-    XMVECTOR dir = XMVectorSet(-0.5f, 0.0f, 0.0f, 0.0f);
-    dir = XMVector3Normalize(dir);
-    XMStoreFloat3(&lights->DirLight.Direction, dir);
+void Renderer::SwapInModel(LoadedModel& model)
+{
+	std::lock_guard<std::mutex> lock(mModelMutex);
 
-	md3dImmediateContext->Unmap(mDirectionalLightBuffer.Get(), 0);
+	// The old mesh stays in the pool until the new one is in, the draws still reading
+	// the freed ranges are ordered before later uploads into them.
+	std::vector<const void*> streams;
+	if (mEnableSplitStreams)
+		streams = { model.Streams.Positions.data(), model.Streams.Normals.data(), model.Streams.TexCoords.data() };
+	else
+		streams = { model.Vertices.data() };
+	if (mEnableNormalMapping)
+		streams.push_back(model.Tangents.empty() ? nullptr : model.Tangents.data());
+	const UINT vertexCount = static_cast<UINT>(mEnableSplitStreams ? model.Streams.GetVertexCount() : model.Vertices.size());
+	GeometryPool::Handle geometry = mGeometryPool.Add(streams.data(), vertexCount, model.Indices.data(), static_cast<UINT>(model.Indices.size()));
+	mGeometryPool.Remove(mModelGeometry);
+	mModelGeometry = geometry;
+	mGeometryPool.LogStats();
+
+	mSubMeshes.swap(model.SubMeshes);
+	mMaterialDescs.swap(model.MaterialDescs);
+	mMaterials.swap(model.Materials);
+	std::swap(mSceneCulling, model.Culling);
+	mSceneCulling.Resize(static_cast<int>(mScreenViewport.Width), static_cast<int>(mScreenViewport.Height));
+	std::swap(mBvh, model.Bvh);
+	mModelGeneration++;
 }
 
-void Renderer::OnResize(int width, int height)
+void Renderer::WatchAssetDirectories(const std::vector<MaterialDesc>& materialDescs)
 {
-	mClientWidth = width;
-    mClientHeight = height;
+	// Cooked files are written next to their sources.
+	std::vector<std::filesystem::path> files = { std::filesystem::u8path(kModelFile), kVertexShaderFile, kPixelShaderFile };
+	for (const MaterialDesc& desc : materialDescs)
+	{
+		files.push_back(desc.ColorMapFile);
+		files.push_back(desc.NormalMapFile);
+	}
 
-	assert(md3dImmediateContext);
-	assert(md3dDevice);
-	assert(mSwapChain);
+	for (const std::filesystem::path& file : files)
+	{
+		if (!file.empty())
+			mFileWatcher.Watch(std::filesystem::absolute(file).parent_path());
+	}
+}
 
-	// Release the old views, as they hold references to the buffers we
-	// will be destroying.  Also release the old depth/stencil buffer.
+void Renderer::ReloadLoop()
+{
+	std::vector<FileWatcher::Change> changes;
+	while (mFileWatcher.WaitForChanges(changes))
+	{
+		std::vector<MaterialDesc> materialDescs;
+		uint64_t modelGeneration = 0;
+		{
+			std::lock_guard<std::mutex> lock(mModelMutex);
+			materialDescs = mMaterialDescs;
+			modelGeneration = mModelGeneration;
+		}
+
+		std::vector<std::unique_ptr<AssetReload>> reloads;
+		auto addReload = [&](AssetType type, const std::filesystem::path& source, const FileWatcher::Change& change)
+		{
+			reloads.push_back(std::make_unique<AssetReload>());
+			AssetReload& reload = *reloads.back();
+			reload.Type = type;
+			reload.Source = source;
+			reload.Changed = change.FirstSeen;
+			reload.ImportMs = 0.0;
+			reload.Succeeded = false;
+			reload.ModelGeneration = modelGeneration;
+			return &reload;
+		};
+
+		// A new model loads all of its textures again.
+		const std::filesystem::path modelFile = std::filesystem::u8path(kModelFile);
+		bool modelChanged = std::any_of(changes.begin(), changes.end(), [&](const FileWatcher::Change& change)
+		{
+			return IsAssetFile(change.File, modelFile, CookedAssets::MeshPath(modelFile));
+		});
+
+		for (const FileWatcher::Change& change : changes)
+		{
+			if (IsAssetFile(change.File, modelFile, CookedAssets::MeshPath(modelFile)))
+			{
+				addReload(AssetType::Model, modelFile, change);
+			}
+			else if (IsAssetFile(change.File, kVertexShaderFile, kVertexShaderFile))
+			{
+				addReload(AssetType::VertexShader, kVertexShaderFile, change);
+			}
+			else if (IsAssetFile(change.File, kPixelShaderFile, kPixelShaderFile))
+			{
+				addReload(AssetType::PixelShader, kPixelShaderFile, change);
+			}
+			else if (!modelChanged)
+			{
+				AssetReload* reload = nullptr;
+				for (size_t i = 0; i < materialDescs.size(); i++)
+				{
+					const MaterialDesc& desc = materialDescs[i];
+					for (const std::wstring& texture : { desc.ColorMapFile, desc.NormalMapFile })
+					{
+						if (!IsAssetFile(change.File, texture, CookedAssets::TexturePath(texture)))
+							continue;
+						if (!reload)
+							reload = addReload(AssetType::Texture, texture, change);
+						reload->MaterialDescs.emplace_back(i, desc);
+						break;
+					}
+				}
+			}
+		}
+
+		// Each asset on its own job, the importers split their work further.
+		JobSystem& jobs = JobSystem::Get();
+		JobSystem::Counter counter;
+		for (std::unique_ptr<AssetReload>& reload : reloads)
+		{
+			AssetReload* pReload = reload.get();
+			jobs.Run([this, pReload]() { ReloadAsset(*pReload); }, &counter);
+		}
+		jobs.Wait(counter);
+
+		for (std::unique_ptr<AssetReload>& reload : reloads)
+		{
+			if (!reload->Succeeded)
+				LOG("Hot reload ", reload->Source.filename().string(), ": failed after ", reload->ImportMs, " ms, keeping the loaded version");
+			// Textures of the new model may be in other directories.
+			else if (reload->Type == AssetType::Model)
+				WatchAssetDirectories(reload->Model->MaterialDescs);
+		}
+
+		std::lock_guard<std::mutex> lock(mReloadMutex);
+		for (std::unique_ptr<AssetReload>& reload : reloads)
+		{
+			if (reload->Succeeded)
+				mPendingReloads.push_back(std::move(reload));
+		}
+	}
+}
 
-	mRenderTargetView.Reset();
-	mDepthStencilView.Reset();
-	mDepthStencilBuffer.Reset();
+void Renderer::ReloadAsset(AssetReload& reload)
+{
+	auto start = std::chrono::high_resolution_clock::now();
 
+	switch (reload.Type)
+	{
+	case AssetType::Model:
+		reload.Model = std::make_unique<LoadedModel>();
+		reload.Succeeded = LoadModel(reload.Source.u8string(), *reload.Model);
+		break;
 
-	// Resize the swap chain and recreate the render target view.
+	case AssetType::Texture:
+	{
+		// Decoded once here, the materials get it from the texture cache. A file that
+		// cannot be read yet leaves the materials as they are.
+		TextureHandle texture;
+		reload.Succeeded = SUCCEEDED(TextureCache::getInstance().LoadTGA(md3dDevice, reload.Source.wstring(), texture));
+		reload.Materials.resize(reload.MaterialDescs.size());
+		for (size_t i = 0; reload.Succeeded && i < reload.MaterialDescs.size(); i++)
+			reload.Succeeded = SUCCEEDED(reload.Materials[i].Init(md3dDevice, reload.MaterialDescs[i].second));
+		break;
+	}
 
-	HR(mSwapChain->ResizeBuffers(1, mClientWidth, mClientHeight, DXGI_FORMAT_R8G8B8A8_UNORM, 0));
-	ID3D11Texture2D* backBuffer;
-	HR(mSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&backBuffer)));
-	HR(md3dDevice->CreateRenderTargetView(backBuffer, 0, mRenderTargetView.GetAddressOf()));
-	ReleaseCOM(backBuffer);
+	case AssetType::VertexShader:
+		reload.ShaderCode = ReadFile(reload.Source);
+		reload.Succeeded = !reload.ShaderCode.empty() &&
+			SUCCEEDED(md3dDevice->CreateVertexShader(reload.ShaderCode.data(), reload.ShaderCode.size(), nullptr, reload.VertexShader.GetAddressOf()));
+		break;
+
+	case AssetType::PixelShader:
+		reload.ShaderCode = ReadFile(reload.Source);
+		reload.Succeeded = !reload.ShaderCode.empty() &&
+			SUCCEEDED(md3dDevice->CreatePixelShader(reload.ShaderCode.data(), reload.ShaderCode.size(), nullptr, reload.PixelShader.GetAddressOf()));
+		break;
+	}
 
-	// Create the depth/stencil buffer and view.
+	reload.ImportMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
 
-	D3D11_TEXTURE2D_DESC depthStencilDesc;
+void Renderer::ApplyReloads()
+{
+	std::vector<std::unique_ptr<AssetReload>> reloads;
+	{
+		std::lock_guard<std::mutex> lock(mReloadMutex);
+		reloads.swap(mPendingReloads);
+	}
 
-	depthStencilDesc.Width = mClientWidth;
-	depthStencilDesc.Height = mClientHeight;
-	depthStencilDesc.MipLevels = 1;
-	depthStencilDesc.ArraySize = 1;
-	depthStencilDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	// The replaced resources are released with the reloads at the end.
+	bool modelSwapped = false;
+	for (std::unique_ptr<AssetReload>& reload : reloads)
+	{
+		switch (reload->Type)
+		{
+		case AssetType::Model:
+			SwapInModel(*reload->Model);
+			modelSwapped = true;
+			break;
+
+		case AssetType::Texture:
+			// Material indices are only valid for the model they were taken from.
+			if (reload->ModelGeneration != mModelGeneration)
+				continue;
+			for (size_t i = 0; i < reload->MaterialDescs.size(); i++)
+				std::swap(mMaterials[reload->MaterialDescs[i].first], reload->Materials[i]);
+			break;
+
+		case AssetType::VertexShader:
+			mVertexShader.Swap(reload->VertexShader);
+			mInputLayout = mPipelineStateCache.GetInputLayout(MeshVertexFormat(mEnableSplitStreams), reload->ShaderCode.data(), reload->ShaderCode.size());
+			// A shader saved back to bytecode seen before gets its layout from the cache
+			mPipelineStateCache.LogStats();
+			break;
+
+		case AssetType::PixelShader:
+			mPixelShader.Swap(reload->PixelShader);
+			break;
+		}
+
+		double latencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - reload->Changed).count();
+		LOG("Hot reload ", reload->Source.filename().string(), ": imported in ", reload->ImportMs, " ms, drawn ", latencyMs,
+			" ms after the change");
+		mMetrics.Add(mMetricIds.Reloads, 1.0);
+		mMetrics.Set(mMetricIds.ReloadImportMs, reload->ImportMs);
+	}
 
-	// Use 4X MSAA? --must match swap chain MSAA values.
-	if (mEnable4xMsaa)
+	if (modelSwapped)
 	{
-		depthStencilDesc.SampleDesc.Count = 4;
-		depthStencilDesc.SampleDesc.Quality = m4xMsaaQuality - 1;
+		reloads.clear();
+		MemoryTracker::LogStats("after the model reload");
 	}
-	// No MSAA
-	else
+}
+
+void Renderer::OnResize(int width, int height)
+{
+	mClientWidth = width;
+    mClientHeight = height;
+	mSimulation.SetAspectRatio(AspectRatio());
+
+	// Once the render thread runs it owns the swap chain, it resizes before its next frame.
+	if (mRenderThread.joinable())
 	{
-		depthStencilDesc.SampleDesc.Count = 1;
-		depthStencilDesc.SampleDesc.Quality = 0;
+		std::lock_guard<std::mutex> lock(mResizeMutex);
+		mbResizePending = true;
+		mPendingWidth = width;
+		mPendingHeight = height;
+		return;
 	}
+	ResizeBuffers(width, height);
+}
 
-	depthStencilDesc.Usage = D3D11_USAGE_DEFAULT;
-	depthStencilDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
-	depthStencilDesc.CPUAccessFlags = 0;
-	depthStencilDesc.MiscFlags = 0;
+void Renderer::ResizeBuffers(int width, int height)
+{
+	assert(md3dImmediateContext);
+	assert(md3dDevice);
+	assert(mSwapChain);
 
-	HR(md3dDevice->CreateTexture2D(&depthStencilDesc, 0, mDepthStencilBuffer.GetAddressOf()));
-	HR(md3dDevice->CreateDepthStencilView(mDepthStencilBuffer.Get(), 0, mDepthStencilView.GetAddressOf()));
+	// Release the old view, as it holds a reference to the buffer we
+	// will be destroying. The depth buffer follows the back buffer size in the
+	// render graph, the pool replaces it on the next frame.
 
+	md3dImmediateContext->OMSetRenderTargets(0, nullptr, nullptr);
+	mRenderTargetView.Reset();
 
-	// Bind the render target view and depth/stencil view to the pipeline.
 
-	md3dImmediateContext->OMSetRenderTargets(1, mRenderTargetView.GetAddressOf(), mDepthStencilView.Get());
+	// Resize the swap chain and recreate the render target view.
 
+	HR(mSwapChain->ResizeBuffers(1, width, height, DXGI_FORMAT_R8G8B8A8_UNORM, 0));
+	ID3D11Texture2D* backBuffer;
+	HR(mSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&backBuffer)));
+	MemoryTracker::TrackGpuResource(backBuffer, MemoryTag::GpuTargets);
+	HR(md3dDevice->CreateRenderTargetView(backBuffer, 0, mRenderTargetView.GetAddressOf()));
+	ReleaseCOM(backBuffer);
 
 	// Set the viewport transform.
 
 	mScreenViewport.TopLeftX = 0;
 	mScreenViewport.TopLeftY = 0;
-	mScreenViewport.Width = static_cast<float>(mClientWidth);
-	mScreenViewport.Height = static_cast<float>(mClientHeight);
+	mScreenViewport.Width = static_cast<float>(width);
+	mScreenViewport.Height = static_cast<float>(height);
 	mScreenViewport.MinDepth = 0.0f;
 	mScreenViewport.MaxDepth = 1.0f;
 
 	md3dImmediateContext->RSSetViewports(1, &mScreenViewport);
 
-	XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f * XM_PI, AspectRatio(), 1.0f, 1000.0f);
-	XMStoreFloat4x4(&mProj, P);
+	mSceneCulling.Resize(width, height);
 }
 
 void Renderer::OnMouseDown(WPARAM btnState, int x, int y)
 {
 	mLastMousePos.x = x;
 	mLastMousePos.y = y;
+
+	// The middle button picks, the other ones move the camera.
+	if ((btnState & MK_MBUTTON) != 0)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		PickResult pick;
+		bool hit = Pick(x, y, pick);
+		double microseconds = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+		if (hit)
+		{
+			// The model may have been reloaded since the pick.
+			std::lock_guard<std::mutex> lock(mModelMutex);
+			const std::string& material = pick.SubMesh >= mSubMeshes.size() || mMaterialDescs.empty() ? std::string() :
+				mMaterialDescs[mSubMeshes[pick.SubMesh].MaterialIndex].Name;
+			LOG("Picked submesh ", pick.SubMesh, " (", material, ") triangle ", pick.Triangle, " at barycentrics ", pick.U, ", ", pick.V,
+				" in ", microseconds, " us");
+		}
+		else
+		{
+			LOG("Picked nothing in ", microseconds, " us");
+		}
+	}
+}
+
+bool Renderer::Pick(int x, int y, PickResult& result) const
+{
+	std::lock_guard<std::mutex> lock(mModelMutex);
+	if (mBvh.IsEmpty())
+		return false;
+
+	// Unproject the pixel center on the near and far plane into model space.
+	float ndcX = 2.0f * (x + 0.5f) / mClientWidth - 1.0f;
+	float ndcY = 1.0f - 2.0f * (y + 0.5f) / mClientHeight;
+	// The camera of the last update, the render thread may still be a frame behind.
+	const FrameState& state = mSimulation.GetState();
+	XMMATRIX worldViewProj = XMLoadFloat4x4(&state.World) * XMLoadFloat4x4(&state.View) * XMLoadFloat4x4(&state.Proj);
+	XMMATRIX inverse = XMMatrixInverse(nullptr, worldViewProj);
+	XMVECTOR nearPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 0.0f, 1.0f), inverse);
+	XMVECTOR farPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 1.0f, 1.0f), inverse);
+
+	XMFLOAT3 origin, direction;
+	XMStoreFloat3(&origin, nearPoint);
+	XMStoreFloat3(&direction, farPoint - nearPoint);
+
+	MeshBvh::Hit hit;
+	if (!mBvh.Intersect(&origin.x, &direction.x, 1.0f, hit))
+		return false;
+
+	const UINT firstIndex = hit.Triangle * 3;
+	auto subMesh = std::find_if(mSubMeshes.begin(), mSubMeshes.end(), [&](const SubMesh& s)
+	{
+		return firstIndex >= s.StartIndex && firstIndex < s.StartIndex + s.IndexCount;
+	});
+	result.SubMesh = static_cast<UINT>(subMesh - mSubMeshes.begin());
+	result.Triangle = hit.Triangle;
+	result.U = hit.U;
+	result.V = hit.V;
+	XMStoreFloat3(&result.Position, nearPoint + hit.Distance * (farPoint - nearPoint));
+	return subMesh != mSubMeshes.end();
 }
 
 void Renderer::OnMouseMove(WPARAM btnState, int x, int y)
@@ -554,10 +1463,7 @@ void Renderer::OnMouseMove(WPARAM btnState, int x, int y)
 		float dy = -XMConvertToRadians(
 			0.25f * static_cast<float>(y - mLastMousePos.y));
 		// Update angles based on input to orbit camera around box.
-		mTheta += dx;
-		mPhi += dy;
-		// Restrict the angle mPhi.
-		mPhi = Clamp(mPhi, 0.1f, XM_PI - 0.1f);
+		mSimulation.RotateCamera(dx, dy);
 	}
 	else if ((btnState & MK_RBUTTON) != 0)
 	{
@@ -565,9 +1471,7 @@ void Renderer::OnMouseMove(WPARAM btnState, int x, int y)
 		float dx = -0.005f * static_cast<float>(x - mLastMousePos.x);
 		float dy = -0.005f * static_cast<float>(y - mLastMousePos.y);
 		// Update the camera radius based on input.
-		mRadius += dx - dy;
-		// Restrict the radius.
-		mRadius = Clamp(mRadius, 3.0f, 15.0f);
+		mSimulation.ZoomCamera(dx - dy);
 	}
 	mLastMousePos.x = x;
 	mLastMousePos.y = y;
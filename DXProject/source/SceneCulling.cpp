@@ -0,0 +1,117 @@
+#include <SceneCulling.h>
+#include <JobSystem.h>
+#include <SimdMath.h>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+using namespace DirectX;
+
+static_assert(sizeof(SceneCulling::Bounds) == sizeof(SimdMath::Aabb), "Bounds are tested as SimdMath boxes");
+
+namespace
+{
+    // Occlusion buffer width in pixels, the height follows the window aspect ratio.
+    const int kOcclusionBufferWidth = 320;
+    const unsigned kOcclusionSlices = 4;
+    // Submeshes at least this large relative to the model are occluders, up to the triangle budget.
+    const float kMinOccluderSize = 0.25f;
+    const size_t kMaxOccluderTriangles = 16 * 1024;
+
+    float Diagonal(const SceneCulling::Bounds& bounds)
+    {
+        XMFLOAT3 size(bounds.Max.x - bounds.Min.x, bounds.Max.y - bounds.Min.y, bounds.Max.z - bounds.Min.z);
+        return sqrtf(size.x * size.x + size.y * size.y + size.z * size.z);
+    }
+}
+
+void SceneCulling::Init(const float* positions, size_t positionStride, size_t vertexCount, const uint32_t* indices,
+    const std::vector<SubMesh>& subMeshes)
+{
+    auto position = [&](uint32_t index)
+    {
+        return reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const char*>(positions) + index * positionStride);
+    };
+
+    const float inf = std::numeric_limits<float>::infinity();
+    Bounds modelBounds = { XMFLOAT3(inf, inf, inf), XMFLOAT3(-inf, -inf, -inf) };
+
+    mSubMeshBounds.resize(subMeshes.size());
+    for (size_t i = 0; i < subMeshes.size(); i++)
+    {
+        Bounds& bounds = mSubMeshBounds[i];
+        bounds = { XMFLOAT3(inf, inf, inf), XMFLOAT3(-inf, -inf, -inf) };
+        for (UINT j = 0; j < subMeshes[i].IndexCount; j++)
+        {
+            const XMFLOAT3& p = *position(indices[subMeshes[i].StartIndex + j]);
+            bounds.Min = XMFLOAT3((std::min)(bounds.Min.x, p.x), (std::min)(bounds.Min.y, p.y), (std::min)(bounds.Min.z, p.z));
+            bounds.Max = XMFLOAT3((std::max)(bounds.Max.x, p.x), (std::max)(bounds.Max.y, p.y), (std::max)(bounds.Max.z, p.z));
+        }
+        modelBounds.Min = XMFLOAT3((std::min)(modelBounds.Min.x, bounds.Min.x), (std::min)(modelBounds.Min.y, bounds.Min.y), (std::min)(modelBounds.Min.z, bounds.Min.z));
+        modelBounds.Max = XMFLOAT3((std::max)(modelBounds.Max.x, bounds.Max.x), (std::max)(modelBounds.Max.y, bounds.Max.y), (std::max)(modelBounds.Max.z, bounds.Max.z));
+    }
+
+    // Large submeshes hide the most, small ones would only cost raster time. Biggest first.
+    std::vector<size_t> order(subMeshes.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return Diagonal(mSubMeshBounds[a]) > Diagonal(mSubMeshBounds[b]); });
+
+    const float minSize = kMinOccluderSize * Diagonal(modelBounds);
+    std::vector<uint32_t> remap(vertexCount, UINT_MAX);
+    size_t occluderCount = 0;
+    mOccluderPositions.clear();
+    mOccluderIndices.clear();
+    for (size_t i : order)
+    {
+        const SubMesh& subMesh = subMeshes[i];
+        if (Diagonal(mSubMeshBounds[i]) < minSize || (mOccluderIndices.size() + subMesh.IndexCount) / 3 > kMaxOccluderTriangles)
+            continue;
+
+        for (UINT j = 0; j < subMesh.IndexCount; j++)
+        {
+            uint32_t index = indices[subMesh.StartIndex + j];
+            if (remap[index] == UINT_MAX)
+            {
+                remap[index] = static_cast<uint32_t>(mOccluderPositions.size());
+                mOccluderPositions.push_back(*position(index));
+            }
+            mOccluderIndices.push_back(remap[index]);
+        }
+        occluderCount++;
+    }
+
+    LOG("Occlusion culling: ", occluderCount, " of ", subMeshes.size(), " submeshes are occluders, ", mOccluderIndices.size() / 3, " triangles");
+}
+
+void SceneCulling::Resize(int width, int height)
+{
+    int occlusionHeight = static_cast<int>(kOcclusionBufferWidth * height / width);
+    unsigned occlusionSlices = (std::min)(kOcclusionSlices, JobSystem::Get().GetThreadCount());
+    mOcclusionCuller.Init(kOcclusionBufferWidth, occlusionHeight, occlusionSlices);
+}
+
+void SceneCulling::Cull(const XMFLOAT4X4& worldViewProj, std::vector<UINT>& visible)
+{
+    mOcclusionCuller.BeginFrame();
+    if (!mOccluderIndices.empty())
+        mOcclusionCuller.AddOccluder(&mOccluderPositions[0].x, sizeof(XMFLOAT3), mOccluderIndices.data(), mOccluderIndices.size(), worldViewProj);
+    mOcclusionCuller.EndOccluders();
+
+    // Boxes outside the view first, the occlusion test keeps those crossing the near plane.
+    SimdMath::Matrix4 matrix;
+    memcpy(matrix.m, worldViewProj.m, sizeof(matrix.m));
+    mInFrustum.resize(mSubMeshBounds.size());
+    SimdMath::TestFrustum(reinterpret_cast<const SimdMath::Aabb*>(mSubMeshBounds.data()), mSubMeshBounds.size(),
+        SimdMath::Frustum::FromMatrix(matrix), mInFrustum.data());
+
+    visible.clear();
+    for (size_t i = 0; i < mSubMeshBounds.size(); i++)
+    {
+        if (mInFrustum[i] && mOcclusionCuller.IsVisible(mSubMeshBounds[i].Min, mSubMeshBounds[i].Max, worldViewProj))
+            visible.push_back(static_cast<UINT>(i));
+    }
+}
@@ -0,0 +1,173 @@
+#include <SharedMemory.h>
+
+#include <cstdio>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SharedMemory::SharedMemory()
+    : mpData(nullptr),
+    mSize(0),
+#ifdef _WIN32
+    mMappingHandle(nullptr)
+#else
+    mName(),
+    mCreated(false)
+#endif
+{
+}
+
+SharedMemory::~SharedMemory()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+namespace
+{
+    // Session local, no privilege needed
+    std::wstring GetMappingName(const char* name)
+    {
+        std::wstring result = L"Local\\";
+        for (const char* c = name; *c; c++)
+            result += static_cast<wchar_t>(*c);
+        return result;
+    }
+}
+
+bool SharedMemory::Create(const char* name, size_t size)
+{
+    Close();
+
+    const uint64_t size64 = size;
+    mMappingHandle = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(size64 >> 32),
+        static_cast<DWORD>(size64), GetMappingName(name).c_str());
+    if (!mMappingHandle)
+        return false;
+
+    mpData = static_cast<uint8_t*>(MapViewOfFile(mMappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, size));
+    if (!mpData)
+    {
+        Close();
+        return false;
+    }
+
+    mSize = size;
+    return true;
+}
+
+bool SharedMemory::Open(const char* name)
+{
+    Close();
+
+    mMappingHandle = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, GetMappingName(name).c_str());
+    if (!mMappingHandle)
+        return false;
+
+    mpData = static_cast<uint8_t*>(MapViewOfFile(mMappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+    if (!mpData)
+    {
+        Close();
+        return false;
+    }
+
+    // The view is rounded up to pages, the creator's size is not kept
+    MEMORY_BASIC_INFORMATION info;
+    mSize = VirtualQuery(mpData, &info, sizeof(info)) ? info.RegionSize : 0;
+    return true;
+}
+
+void SharedMemory::Close()
+{
+    if (mpData)
+    {
+        UnmapViewOfFile(mpData);
+        mpData = nullptr;
+    }
+
+    if (mMappingHandle)
+    {
+        CloseHandle(mMappingHandle);
+        mMappingHandle = nullptr;
+    }
+
+    mSize = 0;
+}
+
+#else
+
+bool SharedMemory::Create(const char* name, size_t size)
+{
+    Close();
+
+    snprintf(mName, sizeof(mName), "/%s", name);
+    // A segment left by a process that did not close it is replaced
+    shm_unlink(mName);
+    const int fd = shm_open(mName, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+        return false;
+    mCreated = true;
+
+    void* data = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(size)) == 0)
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+
+    mpData = static_cast<uint8_t*>(data);
+    mSize = size;
+    return true;
+}
+
+bool SharedMemory::Open(const char* name)
+{
+    Close();
+
+    snprintf(mName, sizeof(mName), "/%s", name);
+    const int fd = shm_open(mName, O_RDWR, 0);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    mpData = static_cast<uint8_t*>(data);
+    mSize = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+void SharedMemory::Close()
+{
+    if (mpData)
+    {
+        munmap(mpData, mSize);
+        mpData = nullptr;
+    }
+
+    if (mCreated)
+    {
+        shm_unlink(mName);
+        mCreated = false;
+    }
+
+    mSize = 0;
+}
+
+#endif
@@ -0,0 +1,570 @@
+#include <SimdMath.h>
+
+#include <cmath>
+
+// Define to build the scalar kernels only, to compare against them in the renderer.
+//#define SIMD_MATH_SCALAR_ONLY
+
+#if (defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)) && !defined(SIMD_MATH_SCALAR_ONLY)
+#define SIMD_MATH_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC compiles the intrinsics of any instruction set, GCC and Clang only in functions
+// that target it.
+#if defined(SIMD_MATH_X86) && defined(__GNUC__)
+#define SIMD_TARGET_SSE4 __attribute__((target("sse4.1")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define SIMD_TARGET_SSE4
+#define SIMD_TARGET_AVX2
+#endif
+
+using namespace SimdMath;
+
+namespace
+{
+    struct Kernels
+    {
+        void (*TransformPoints)(const Float3* points, size_t count, const Matrix4& m, Float4* out);
+        void (*MultiplyMatrices)(const Matrix4* a, size_t count, const Matrix4& b, Matrix4* out);
+        void (*TestFrustum)(const Aabb* boxes, size_t count, const Frustum& frustum, uint8_t* visible);
+        void (*NormalizeVectors)(Float3* vectors, size_t count);
+    };
+
+    // The SIMD kernels leave the last count % width items to these, and evaluate in the
+    // same order so that only FMA changes results.
+
+    void TransformPointsScalar(const Float3* points, size_t count, const Matrix4& m, Float4* out)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            const Float3 p = points[i];
+            out[i].x = p.x * m.m[0][0] + p.y * m.m[1][0] + p.z * m.m[2][0] + m.m[3][0];
+            out[i].y = p.x * m.m[0][1] + p.y * m.m[1][1] + p.z * m.m[2][1] + m.m[3][1];
+            out[i].z = p.x * m.m[0][2] + p.y * m.m[1][2] + p.z * m.m[2][2] + m.m[3][2];
+            out[i].w = p.x * m.m[0][3] + p.y * m.m[1][3] + p.z * m.m[2][3] + m.m[3][3];
+        }
+    }
+
+    void MultiplyMatricesScalar(const Matrix4* a, size_t count, const Matrix4& b, Matrix4* out)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            // A row of the product only needs the same row of a
+            for (int row = 0; row < 4; row++)
+            {
+                const float* r = a[i].m[row];
+                float product[4];
+                for (int column = 0; column < 4; column++)
+                    product[column] = r[0] * b.m[0][column] + r[1] * b.m[1][column] + r[2] * b.m[2][column] + r[3] * b.m[3][column];
+                for (int column = 0; column < 4; column++)
+                    out[i].m[row][column] = product[column];
+            }
+        }
+    }
+
+    // A box is outside a plane when its center is further outside than its extent
+    // reaches back in along the plane normal.
+    void TestFrustumScalar(const Aabb* boxes, size_t count, const Frustum& frustum, uint8_t* visible)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            const Aabb& box = boxes[i];
+            const float cx = (box.Min.x + box.Max.x) * 0.5f, ex = (box.Max.x - box.Min.x) * 0.5f;
+            const float cy = (box.Min.y + box.Max.y) * 0.5f, ey = (box.Max.y - box.Min.y) * 0.5f;
+            const float cz = (box.Min.z + box.Max.z) * 0.5f, ez = (box.Max.z - box.Min.z) * 0.5f;
+
+            bool outside = false;
+            for (const Float4& plane : frustum.Planes)
+            {
+                const float distance = plane.x * cx + plane.y * cy + plane.z * cz + plane.w;
+                const float reach = std::fabs(plane.x) * ex + std::fabs(plane.y) * ey + std::fabs(plane.z) * ez;
+                outside |= distance + reach < 0.0f;
+            }
+            visible[i] = outside ? 0 : 1;
+        }
+    }
+
+    void NormalizeVectorsScalar(Float3* vectors, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            Float3& v = vectors[i];
+            const float lengthSq = v.x * v.x + v.y * v.y + v.z * v.z;
+            if (lengthSq > 0.0f)
+            {
+                const float length = std::sqrt(lengthSq);
+                v.x = v.x / length;
+                v.y = v.y / length;
+                v.z = v.z / length;
+            }
+        }
+    }
+
+    // What the SIMD frustum tests broadcast of each plane: the normal, the distance and
+    // the absolute normal
+    const int kPlaneTerms = 7;
+
+    void GetPlaneTerms(const Float4& plane, float* terms)
+    {
+        terms[0] = plane.x;
+        terms[1] = plane.y;
+        terms[2] = plane.z;
+        terms[3] = plane.w;
+        terms[4] = std::fabs(plane.x);
+        terms[5] = std::fabs(plane.y);
+        terms[6] = std::fabs(plane.z);
+    }
+
+    const Kernels kScalarKernels = { TransformPointsScalar, MultiplyMatricesScalar, TestFrustumScalar, NormalizeVectorsScalar };
+
+#ifdef SIMD_MATH_X86
+    // Four Float3 in three registers to x, y and z of each. The shuffles stay within 128 bit
+    // lanes, so the AVX2 versions below do the same on two groups of four.
+    SIMD_TARGET_SSE4 inline void Deinterleave3(__m128 a, __m128 b, __m128 c, __m128& x, __m128& y, __m128& z)
+    {
+        // a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+        const __m128 x1y1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 3, 3));
+        const __m128 xy01 = _mm_shuffle_ps(a, x1y1, _MM_SHUFFLE(2, 0, 1, 0));
+        const __m128 xy23 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));
+        x = _mm_shuffle_ps(xy01, xy23, _MM_SHUFFLE(2, 0, 2, 0));
+        y = _mm_shuffle_ps(xy01, xy23, _MM_SHUFFLE(3, 1, 3, 1));
+        const __m128 z01 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+        const __m128 z23 = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0));
+        z = _mm_shuffle_ps(z01, z23, _MM_SHUFFLE(2, 0, 2, 0));
+    }
+
+    SIMD_TARGET_SSE4 inline void Interleave3(__m128 x, __m128 y, __m128 z, __m128& a, __m128& b, __m128& c)
+    {
+        const __m128 xy01 = _mm_unpacklo_ps(x, y);
+        const __m128 xy23 = _mm_unpackhi_ps(x, y);
+        a = _mm_shuffle_ps(xy01, _mm_shuffle_ps(z, xy01, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+        b = _mm_shuffle_ps(_mm_shuffle_ps(xy01, z, _MM_SHUFFLE(1, 1, 3, 3)), xy23, _MM_SHUFFLE(1, 0, 2, 0));
+        c = _mm_shuffle_ps(_mm_shuffle_ps(z, xy23, _MM_SHUFFLE(2, 2, 2, 2)), _mm_shuffle_ps(xy23, z, _MM_SHUFFLE(3, 3, 3, 3)),
+            _MM_SHUFFLE(2, 0, 2, 0));
+    }
+
+    // One point per register, x, y and z broadcast and multiplied with the rows of m.
+    // Deinterleaving four points and transposing the results back costs more shuffles.
+    SIMD_TARGET_SSE4 void TransformPointsSSE4(const Float3* points, size_t count, const Matrix4& m, Float4* out)
+    {
+        const __m128 m0 = _mm_loadu_ps(m.m[0]);
+        const __m128 m1 = _mm_loadu_ps(m.m[1]);
+        const __m128 m2 = _mm_loadu_ps(m.m[2]);
+        const __m128 m3 = _mm_loadu_ps(m.m[3]);
+        for (size_t i = 0; i < count; i++)
+        {
+            const Float3& p = points[i];
+            __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x), m0), _mm_mul_ps(_mm_set1_ps(p.y), m1));
+            r = _mm_add_ps(_mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(p.z), m2)), m3);
+            _mm_storeu_ps(&out[i].x, r);
+        }
+    }
+
+    SIMD_TARGET_SSE4 void MultiplyMatricesSSE4(const Matrix4* a, size_t count, const Matrix4& b, Matrix4* out)
+    {
+        const __m128 b0 = _mm_loadu_ps(b.m[0]);
+        const __m128 b1 = _mm_loadu_ps(b.m[1]);
+        const __m128 b2 = _mm_loadu_ps(b.m[2]);
+        const __m128 b3 = _mm_loadu_ps(b.m[3]);
+        for (size_t i = 0; i < count; i++)
+        {
+            for (int row = 0; row < 4; row++)
+            {
+                const __m128 r = _mm_loadu_ps(a[i].m[row]);
+                __m128 product = _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+                product = _mm_add_ps(product, _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+                product = _mm_add_ps(product, _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+                product = _mm_add_ps(product, _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+                _mm_storeu_ps(out[i].m[row], product);
+            }
+        }
+    }
+
+    SIMD_TARGET_SSE4 void TestFrustumSSE4(const Aabb* boxes, size_t count, const Frustum& frustum, uint8_t* visible)
+    {
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 zero = _mm_setzero_ps();
+        // Out of frustum before the loop, visible could alias it as far as the compiler knows
+        __m128 planes[6][kPlaneTerms];
+        for (int plane = 0; plane < 6; plane++)
+        {
+            float terms[kPlaneTerms];
+            GetPlaneTerms(frustum.Planes[plane], terms);
+            for (int term = 0; term < kPlaneTerms; term++)
+                planes[plane][term] = _mm_set1_ps(terms[term]);
+        }
+
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            // Four boxes are eight Float3, minimum and maximum alternating
+            const float* p = &boxes[i].Min.x;
+            __m128 x01, y01, z01, x23, y23, z23;
+            Deinterleave3(_mm_loadu_ps(p), _mm_loadu_ps(p + 4), _mm_loadu_ps(p + 8), x01, y01, z01);
+            Deinterleave3(_mm_loadu_ps(p + 12), _mm_loadu_ps(p + 16), _mm_loadu_ps(p + 20), x23, y23, z23);
+            const __m128 minX = _mm_shuffle_ps(x01, x23, _MM_SHUFFLE(2, 0, 2, 0)), maxX = _mm_shuffle_ps(x01, x23, _MM_SHUFFLE(3, 1, 3, 1));
+            const __m128 minY = _mm_shuffle_ps(y01, y23, _MM_SHUFFLE(2, 0, 2, 0)), maxY = _mm_shuffle_ps(y01, y23, _MM_SHUFFLE(3, 1, 3, 1));
+            const __m128 minZ = _mm_shuffle_ps(z01, z23, _MM_SHUFFLE(2, 0, 2, 0)), maxZ = _mm_shuffle_ps(z01, z23, _MM_SHUFFLE(3, 1, 3, 1));
+
+            const __m128 cx = _mm_mul_ps(_mm_add_ps(minX, maxX), half), ex = _mm_mul_ps(_mm_sub_ps(maxX, minX), half);
+            const __m128 cy = _mm_mul_ps(_mm_add_ps(minY, maxY), half), ey = _mm_mul_ps(_mm_sub_ps(maxY, minY), half);
+            const __m128 cz = _mm_mul_ps(_mm_add_ps(minZ, maxZ), half), ez = _mm_mul_ps(_mm_sub_ps(maxZ, minZ), half);
+
+            __m128 outside = zero;
+            for (const __m128* plane : planes)
+            {
+                __m128 distance = _mm_add_ps(_mm_mul_ps(plane[0], cx), _mm_mul_ps(plane[1], cy));
+                distance = _mm_add_ps(_mm_add_ps(distance, _mm_mul_ps(plane[2], cz)), plane[3]);
+                __m128 reach = _mm_add_ps(_mm_mul_ps(plane[4], ex), _mm_mul_ps(plane[5], ey));
+                reach = _mm_add_ps(reach, _mm_mul_ps(plane[6], ez));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), zero));
+            }
+
+            const int mask = _mm_movemask_ps(outside);
+            for (int lane = 0; lane < 4; lane++)
+                visible[i + lane] = static_cast<uint8_t>(((mask >> lane) & 1) ^ 1);
+        }
+        TestFrustumScalar(boxes + i, count - i, frustum, visible + i);
+    }
+
+    SIMD_TARGET_SSE4 void NormalizeVectorsSSE4(Float3* vectors, size_t count)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            float* p = &vectors[i].x;
+            __m128 x, y, z;
+            Deinterleave3(_mm_loadu_ps(p), _mm_loadu_ps(p + 4), _mm_loadu_ps(p + 8), x, y, z);
+
+            const __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+            const __m128 length = _mm_sqrt_ps(lengthSq);
+            const __m128 normalize = _mm_cmpgt_ps(lengthSq, zero);
+            x = _mm_blendv_ps(x, _mm_div_ps(x, length), normalize);
+            y = _mm_blendv_ps(y, _mm_div_ps(y, length), normalize);
+            z = _mm_blendv_ps(z, _mm_div_ps(z, length), normalize);
+
+            __m128 a, b, c;
+            Interleave3(x, y, z, a, b, c);
+            _mm_storeu_ps(p, a);
+            _mm_storeu_ps(p + 4, b);
+            _mm_storeu_ps(p + 8, c);
+        }
+        NormalizeVectorsScalar(vectors + i, count - i);
+    }
+
+    const Kernels kSSE4Kernels = { TransformPointsSSE4, MultiplyMatricesSSE4, TestFrustumSSE4, NormalizeVectorsSSE4 };
+
+    SIMD_TARGET_AVX2 inline __m256 Load2x4(const float* lane0, const float* lane1)
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lane0)), _mm_loadu_ps(lane1), 1);
+    }
+
+    // Two groups of four Float3, one per 128 bit lane
+    SIMD_TARGET_AVX2 inline void Load3x8(const float* lane0, const float* lane1, __m256& x, __m256& y, __m256& z)
+    {
+        const __m256 a = Load2x4(lane0, lane1);
+        const __m256 b = Load2x4(lane0 + 4, lane1 + 4);
+        const __m256 c = Load2x4(lane0 + 8, lane1 + 8);
+
+        const __m256 x1y1 = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 3, 3));
+        const __m256 xy01 = _mm256_shuffle_ps(a, x1y1, _MM_SHUFFLE(2, 0, 1, 0));
+        const __m256 xy23 = _mm256_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));
+        x = _mm256_shuffle_ps(xy01, xy23, _MM_SHUFFLE(2, 0, 2, 0));
+        y = _mm256_shuffle_ps(xy01, xy23, _MM_SHUFFLE(3, 1, 3, 1));
+        const __m256 z01 = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+        const __m256 z23 = _mm256_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0));
+        z = _mm256_shuffle_ps(z01, z23, _MM_SHUFFLE(2, 0, 2, 0));
+    }
+
+    SIMD_TARGET_AVX2 inline void Store3x8(float* p, __m256 x, __m256 y, __m256 z)
+    {
+        const __m256 xy01 = _mm256_unpacklo_ps(x, y);
+        const __m256 xy23 = _mm256_unpackhi_ps(x, y);
+        const __m256 a = _mm256_shuffle_ps(xy01, _mm256_shuffle_ps(z, xy01, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+        const __m256 b = _mm256_shuffle_ps(_mm256_shuffle_ps(xy01, z, _MM_SHUFFLE(1, 1, 3, 3)), xy23, _MM_SHUFFLE(1, 0, 2, 0));
+        const __m256 c = _mm256_shuffle_ps(_mm256_shuffle_ps(z, xy23, _MM_SHUFFLE(2, 2, 2, 2)), _mm256_shuffle_ps(xy23, z, _MM_SHUFFLE(3, 3, 3, 3)),
+            _MM_SHUFFLE(2, 0, 2, 0));
+
+        // Lane 0 holds the first four vectors, lane 1 the next four
+        _mm256_storeu_ps(p, _mm256_permute2f128_ps(a, b, 0x20));
+        _mm256_storeu_ps(p + 8, _mm256_permute2f128_ps(c, a, 0x30));
+        _mm256_storeu_ps(p + 16, _mm256_permute2f128_ps(b, c, 0x31));
+    }
+
+    // Two points per register, one per lane
+    SIMD_TARGET_AVX2 inline __m256 Broadcast2(const float* lane0, const float* lane1)
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_broadcast_ss(lane0)), _mm_broadcast_ss(lane1), 1);
+    }
+
+    SIMD_TARGET_AVX2 void TransformPointsAVX2(const Float3* points, size_t count, const Matrix4& m, Float4* out)
+    {
+        const __m256 m0 = Load2x4(m.m[0], m.m[0]);
+        const __m256 m1 = Load2x4(m.m[1], m.m[1]);
+        const __m256 m2 = Load2x4(m.m[2], m.m[2]);
+        const __m256 m3 = Load2x4(m.m[3], m.m[3]);
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2)
+        {
+            const Float3& p0 = points[i];
+            const Float3& p1 = points[i + 1];
+            __m256 r = _mm256_mul_ps(Broadcast2(&p0.x, &p1.x), m0);
+            r = _mm256_fmadd_ps(Broadcast2(&p0.y, &p1.y), m1, r);
+            r = _mm256_add_ps(_mm256_fmadd_ps(Broadcast2(&p0.z, &p1.z), m2, r), m3);
+            _mm256_storeu_ps(&out[i].x, r);
+        }
+        // The compiler does not always clear the upper halves before a tail call, and SSE
+        // code running with them dirty is slowed down on every instruction on many CPUs.
+        _mm256_zeroupper();
+        TransformPointsScalar(points + i, count - i, m, out + i);
+    }
+
+    SIMD_TARGET_AVX2 void MultiplyMatricesAVX2(const Matrix4* a, size_t count, const Matrix4& b, Matrix4* out)
+    {
+        // Two rows of a at once, each lane multiplied with all of b
+        const __m256 b0 = Load2x4(b.m[0], b.m[0]);
+        const __m256 b1 = Load2x4(b.m[1], b.m[1]);
+        const __m256 b2 = Load2x4(b.m[2], b.m[2]);
+        const __m256 b3 = Load2x4(b.m[3], b.m[3]);
+        for (size_t i = 0; i < count; i++)
+        {
+            for (int row = 0; row < 4; row += 2)
+            {
+                const __m256 r = _mm256_loadu_ps(a[i].m[row]);
+                __m256 product = _mm256_mul_ps(_mm256_permute_ps(r, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+                product = _mm256_fmadd_ps(_mm256_permute_ps(r, _MM_SHUFFLE(1, 1, 1, 1)), b1, product);
+                product = _mm256_fmadd_ps(_mm256_permute_ps(r, _MM_SHUFFLE(2, 2, 2, 2)), b2, product);
+                product = _mm256_fmadd_ps(_mm256_permute_ps(r, _MM_SHUFFLE(3, 3, 3, 3)), b3, product);
+                _mm256_storeu_ps(out[i].m[row], product);
+            }
+        }
+        _mm256_zeroupper();
+    }
+
+    SIMD_TARGET_AVX2 void TestFrustumAVX2(const Aabb* boxes, size_t count, const Frustum& frustum, uint8_t* visible)
+    {
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 zero = _mm256_setzero_ps();
+        __m256 planes[6][kPlaneTerms];
+        for (int plane = 0; plane < 6; plane++)
+        {
+            float terms[kPlaneTerms];
+            GetPlaneTerms(frustum.Planes[plane], terms);
+            for (int term = 0; term < kPlaneTerms; term++)
+                planes[plane][term] = _mm256_set1_ps(terms[term]);
+        }
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            // Boxes 0 to 3 in lane 0 and 4 to 7 in lane 1, as Float3 in the order
+            // min0 max0 min1 max1 | min4 max4 min5 max5, then the same for 2, 3, 6 and 7.
+            const float* p = &boxes[i].Min.x;
+            __m256 x01, y01, z01, x23, y23, z23;
+            Load3x8(p, p + 24, x01, y01, z01);
+            Load3x8(p + 12, p + 36, x23, y23, z23);
+            const __m256 minX = _mm256_shuffle_ps(x01, x23, _MM_SHUFFLE(2, 0, 2, 0)), maxX = _mm256_shuffle_ps(x01, x23, _MM_SHUFFLE(3, 1, 3, 1));
+            const __m256 minY = _mm256_shuffle_ps(y01, y23, _MM_SHUFFLE(2, 0, 2, 0)), maxY = _mm256_shuffle_ps(y01, y23, _MM_SHUFFLE(3, 1, 3, 1));
+            const __m256 minZ = _mm256_shuffle_ps(z01, z23, _MM_SHUFFLE(2, 0, 2, 0)), maxZ = _mm256_shuffle_ps(z01, z23, _MM_SHUFFLE(3, 1, 3, 1));
+
+            const __m256 cx = _mm256_mul_ps(_mm256_add_ps(minX, maxX), half), ex = _mm256_mul_ps(_mm256_sub_ps(maxX, minX), half);
+            const __m256 cy = _mm256_mul_ps(_mm256_add_ps(minY, maxY), half), ey = _mm256_mul_ps(_mm256_sub_ps(maxY, minY), half);
+            const __m256 cz = _mm256_mul_ps(_mm256_add_ps(minZ, maxZ), half), ez = _mm256_mul_ps(_mm256_sub_ps(maxZ, minZ), half);
+
+            __m256 outside = zero;
+            for (const __m256* plane : planes)
+            {
+                __m256 distance = _mm256_fmadd_ps(plane[1], cy, _mm256_mul_ps(plane[0], cx));
+                distance = _mm256_add_ps(_mm256_fmadd_ps(plane[2], cz, distance), plane[3]);
+                __m256 reach = _mm256_fmadd_ps(plane[5], ey, _mm256_mul_ps(plane[4], ex));
+                reach = _mm256_fmadd_ps(plane[6], ez, reach);
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero, _CMP_LT_OQ));
+            }
+
+            const int mask = _mm256_movemask_ps(outside);
+            for (int lane = 0; lane < 8; lane++)
+                visible[i + lane] = static_cast<uint8_t>(((mask >> lane) & 1) ^ 1);
+        }
+        _mm256_zeroupper();
+        TestFrustumScalar(boxes + i, count - i, frustum, visible + i);
+    }
+
+    SIMD_TARGET_AVX2 void NormalizeVectorsAVX2(Float3* vectors, size_t count)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            float* p = &vectors[i].x;
+            __m256 x, y, z;
+            Load3x8(p, p + 12, x, y, z);
+
+            const __m256 lengthSq = _mm256_fmadd_ps(z, z, _mm256_fmadd_ps(y, y, _mm256_mul_ps(x, x)));
+            const __m256 length = _mm256_sqrt_ps(lengthSq);
+            const __m256 normalize = _mm256_cmp_ps(lengthSq, zero, _CMP_GT_OQ);
+            x = _mm256_blendv_ps(x, _mm256_div_ps(x, length), normalize);
+            y = _mm256_blendv_ps(y, _mm256_div_ps(y, length), normalize);
+            z = _mm256_blendv_ps(z, _mm256_div_ps(z, length), normalize);
+
+            Store3x8(p, x, y, z);
+        }
+        _mm256_zeroupper();
+        NormalizeVectorsScalar(vectors + i, count - i);
+    }
+
+    const Kernels kAVX2Kernels = { TransformPointsAVX2, MultiplyMatricesAVX2, TestFrustumAVX2, NormalizeVectorsAVX2 };
+
+    bool CpuHasSSE41()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 19)) != 0;
+#else
+        return __builtin_cpu_supports("sse4.1");
+#endif
+    }
+
+    bool CpuHasAVX2()
+    {
+#ifdef _MSC_VER
+        // FMA and AVX, and the OS saving the YMM registers
+        int info[4];
+        __cpuid(info, 1);
+        const int kFma = 1 << 12, kOsXsave = 1 << 27, kAvx = 1 << 28;
+        if ((info[2] & (kFma | kOsXsave | kAvx)) != (kFma | kOsXsave | kAvx) || (_xgetbv(0) & 6) != 6)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    }
+#else
+    bool CpuHasSSE41()
+    {
+        return false;
+    }
+
+    bool CpuHasAVX2()
+    {
+        return false;
+    }
+#endif
+
+    const Kernels& GetKernels(Backend backend)
+    {
+#ifdef SIMD_MATH_X86
+        switch (backend)
+        {
+        case Backend::AVX2:
+            return kAVX2Kernels;
+        case Backend::SSE4:
+            return kSSE4Kernels;
+        default:
+            break;
+        }
+#endif
+        (void)backend;
+        return kScalarKernels;
+    }
+
+    struct Dispatch
+    {
+        Backend Current;
+        const Kernels* Table;
+    };
+
+    Dispatch& GetDispatch()
+    {
+        static Dispatch dispatch = []()
+        {
+            Backend backend = CpuHasAVX2() ? Backend::AVX2 : CpuHasSSE41() ? Backend::SSE4 : Backend::Scalar;
+            return Dispatch{ backend, &GetKernels(backend) };
+        }();
+        return dispatch;
+    }
+}
+
+Frustum Frustum::FromMatrix(const Matrix4& viewProj)
+{
+    // Clip space x = p * column 0 and so on, inside is -w <= x <= w, -w <= y <= w, 0 <= z <= w
+    const Matrix4& m = viewProj;
+    auto column = [&m](int c, float sign) { return Float4{ sign * m.m[0][c], sign * m.m[1][c], sign * m.m[2][c], sign * m.m[3][c] }; };
+    auto add = [](Float4 a, Float4 b) { return Float4{ a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w }; };
+
+    const Float4 w = column(3, 1.0f);
+    Frustum frustum;
+    frustum.Planes[0] = add(w, column(0, 1.0f));  // Left
+    frustum.Planes[1] = add(w, column(0, -1.0f)); // Right
+    frustum.Planes[2] = add(w, column(1, 1.0f));  // Bottom
+    frustum.Planes[3] = add(w, column(1, -1.0f)); // Top
+    frustum.Planes[4] = column(2, 1.0f);          // Near
+    frustum.Planes[5] = add(w, column(2, -1.0f)); // Far
+    return frustum;
+}
+
+Backend SimdMath::GetBackend()
+{
+    return GetDispatch().Current;
+}
+
+bool SimdMath::SetBackend(Backend backend)
+{
+    if (!IsSupported(backend))
+        return false;
+    GetDispatch() = Dispatch{ backend, &GetKernels(backend) };
+    return true;
+}
+
+bool SimdMath::IsSupported(Backend backend)
+{
+    switch (backend)
+    {
+    case Backend::AVX2:
+        return CpuHasAVX2();
+    case Backend::SSE4:
+        return CpuHasSSE41();
+    default:
+        return true;
+    }
+}
+
+const char* SimdMath::GetBackendName(Backend backend)
+{
+    switch (backend)
+    {
+    case Backend::AVX2:
+        return "AVX2";
+    case Backend::SSE4:
+        return "SSE4.1";
+    default:
+        return "scalar";
+    }
+}
+
+void SimdMath::TransformPoints(const Float3* points, size_t count, const Matrix4& m, Float4* out)
+{
+    GetDispatch().Table->TransformPoints(points, count, m, out);
+}
+
+void SimdMath::MultiplyMatrices(const Matrix4* a, size_t count, const Matrix4& b, Matrix4* out)
+{
+    GetDispatch().Table->MultiplyMatrices(a, count, b, out);
+}
+
+void SimdMath::TestFrustum(const Aabb* boxes, size_t count, const Frustum& frustum, uint8_t* visible)
+{
+    GetDispatch().Table->TestFrustum(boxes, count, frustum, visible);
+}
+
+void SimdMath::NormalizeVectors(Float3* vectors, size_t count)
+{
+    GetDispatch().Table->NormalizeVectors(vectors, count);
+}
@@ -0,0 +1,125 @@
+#include <Simulation.h>
+#include <Utils.h>
+
+#include <random>
+
+using namespace DirectX;
+
+Simulation::Simulation()
+    : mOrbit{ 0.0f, 0.5f * XM_PI, 5.0f },
+    mAspectRatio(800.0f / 600.0f),
+    mbLightChanged(true)
+{
+    XMStoreFloat4x4(&mWorld, XMMatrixIdentity());
+
+    // Unused by the pixel shader, the ambient comes from the environment lighting
+    mLight.Ambient = XMFLOAT4(0.5f, 0.5f, 0.5f, 1.0f);
+    mLight.Diffuse = XMFLOAT4(0.5f, 0.5f, 0.5f, 1.0f);
+    mLight.Specular = XMFLOAT4(0.5f, 0.5f, 0.5f, 2.0f);
+    XMStoreFloat3(&mLight.Direction, XMVector3Normalize(XMVectorSet(-0.5f, 0.0f, 0.0f, 0.0f)));
+    mLight.Pad = 0.0f;
+
+    mState = FrameState();
+    mState.World = mWorld;
+    mState.View = mWorld;
+    mState.Proj = mWorld;
+}
+
+void Simulation::SetLocalLightCount(size_t count)
+{
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    mLightOrbits.resize(count);
+    mLocalLights.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        LightOrbit& orbit = mLightOrbits[i];
+        orbit.Radius = 0.5f + 5.5f * unit(random);
+        orbit.Height = -3.0f + 6.0f * unit(random);
+        orbit.Angle = XM_2PI * unit(random);
+        orbit.Speed = (unit(random) < 0.5f ? -1.0f : 1.0f) * (0.2f + 0.8f * unit(random));
+
+        LOCAL_LIGHT& light = mLocalLights[i];
+        light.Range = 0.4f + 0.6f * unit(random);
+        // Random colors, bright enough to show over the short ranges
+        XMStoreFloat3(&light.Color, XMVectorScale(XMVectorSet(unit(random), unit(random), unit(random), 0.0f), 1.5f));
+        light.Direction = XMFLOAT3(0.0f, -1.0f, 0.0f);
+        if (i % 4 == 3)
+        {
+            const float outer = XMConvertToRadians(20.0f + 25.0f * unit(random));
+            light.Range *= 2.0f;
+            light.SpotCosOuter = cosf(outer);
+            light.SpotCosInner = cosf(0.75f * outer);
+        }
+        else
+        {
+            light.SpotCosOuter = -2.0f;
+            light.SpotCosInner = -1.0f;
+        }
+    }
+}
+
+void Simulation::SetAspectRatio(float aspectRatio)
+{
+    mAspectRatio = aspectRatio;
+}
+
+void Simulation::RotateCamera(float dTheta, float dPhi)
+{
+    mOrbit.Theta += dTheta;
+    mOrbit.Phi = Clamp(mOrbit.Phi + dPhi, 0.1f, XM_PI - 0.1f);
+}
+
+void Simulation::ZoomCamera(float dRadius)
+{
+    mOrbit.Radius = Clamp(mOrbit.Radius + dRadius, 3.0f, 15.0f);
+}
+
+void Simulation::SetOrbit(const CameraOrbit& orbit)
+{
+    mOrbit.Theta = orbit.Theta;
+    mOrbit.Phi = Clamp(orbit.Phi, 0.1f, XM_PI - 0.1f);
+    mOrbit.Radius = Clamp(orbit.Radius, 3.0f, 15.0f);
+}
+
+void Simulation::Update(float dt, FrameState& state)
+{
+    mState.UpdateStart = std::chrono::steady_clock::now();
+    mState.Frame++;
+    mState.DeltaTime = dt;
+
+    // Get camera position in Cartesian coordinates
+    float x = mOrbit.Radius * sinf(mOrbit.Phi) * cosf(mOrbit.Theta);
+    float z = mOrbit.Radius * sinf(mOrbit.Phi) * sinf(mOrbit.Theta);
+    float y = mOrbit.Radius * cosf(mOrbit.Phi);
+    mState.CameraPosition = XMFLOAT3(x, y, z);
+
+    XMVECTOR pos = XMVectorSet(x, y, z, 1.0f);
+    XMVECTOR target = XMVectorZero();
+    XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+    XMStoreFloat4x4(&mState.View, XMMatrixLookAtLH(pos, target, up));
+    XMStoreFloat4x4(&mState.Proj, XMMatrixPerspectiveFovLH(0.25f * XM_PI, mAspectRatio, 1.0f, 1000.0f));
+    mState.World = mWorld;
+
+    mState.Light = mLight;
+    mState.LightChanged = mbLightChanged;
+    mbLightChanged = false;
+
+    // Spot lights look down at the model axis
+    for (size_t i = 0; i < mLocalLights.size(); i++)
+    {
+        LightOrbit& orbit = mLightOrbits[i];
+        orbit.Angle = fmodf(orbit.Angle + orbit.Speed * dt, XM_2PI);
+        LOCAL_LIGHT& light = mLocalLights[i];
+        light.Position = XMFLOAT3(orbit.Radius * cosf(orbit.Angle), orbit.Height, orbit.Radius * sinf(orbit.Angle));
+        if (light.SpotCosOuter > -1.0f)
+        {
+            XMVECTOR toAxis = XMVectorSet(-light.Position.x, -0.5f * orbit.Radius - 1.0f, -light.Position.z, 0.0f);
+            XMStoreFloat3(&light.Direction, XMVector3Normalize(toAxis));
+        }
+    }
+    mState.LocalLights = mLocalLights;
+
+    state = mState;
+}
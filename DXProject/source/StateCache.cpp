@@ -0,0 +1,283 @@
+#include <StateCache.h>
+#include <Utils.h>
+
+template<typename T>
+bool StateCache::Slot<T>::Set(const T& value)
+{
+    if (Dirty ? Pending == value : (Valid && Bound == value))
+        return false;
+    Pending = value;
+    Dirty = true;
+    return true;
+}
+
+template<typename T>
+bool StateCache::Slot<T>::Resolve()
+{
+    if (!Dirty)
+        return false;
+    Dirty = false;
+    // Set back to the bound value before the draw
+    if (Valid && Bound == Pending)
+        return false;
+    Bound = Pending;
+    Valid = true;
+    return true;
+}
+
+template<typename T, UINT N>
+bool StateCache::SlotArray<T, N>::Set(UINT slot, const T& value)
+{
+    ASSERT(slot < N, "Slot out of range");
+    const uint32_t bit = 1u << slot;
+    if ((DirtyMask & bit) ? Pending[slot] == value : ((ValidMask & bit) && Bound[slot] == value))
+        return false;
+    Pending[slot] = value;
+    DirtyMask |= bit;
+    return true;
+}
+
+template<typename T, UINT N>
+template<typename BindFunc>
+UINT StateCache::SlotArray<T, N>::Flush(BindFunc bind)
+{
+    // Drop slots that were set back to the bound value.
+    for (UINT i = 0; i < N && (DirtyMask & ValidMask); i++)
+    {
+        if ((DirtyMask & ValidMask & (1u << i)) && Bound[i] == Pending[i])
+            DirtyMask &= ~(1u << i);
+    }
+
+    UINT calls = 0;
+    UINT slot = 0;
+    while (DirtyMask)
+    {
+        while (!(DirtyMask & (1u << slot)))
+            slot++;
+        UINT end = slot;
+        while (end < N && (DirtyMask & (1u << end)))
+        {
+            Bound[end] = Pending[end];
+            DirtyMask &= ~(1u << end);
+            ValidMask |= 1u << end;
+            end++;
+        }
+        bind(slot, end - slot, &Bound[slot]);
+        calls++;
+        slot = end;
+    }
+    return calls;
+}
+
+StateCache::StateCache()
+    : mContext(nullptr)
+{
+    BeginFrame();
+}
+
+void StateCache::Init(ComPtr<ID3D11DeviceContext> context)
+{
+    mContext = context;
+    Invalidate();
+}
+
+void StateCache::BeginFrame()
+{
+    mStats.Requested = 0;
+    mStats.Filtered = 0;
+    mStats.Issued = 0;
+    mStats.Draws = 0;
+    mStats.Vertices = 0;
+}
+
+void StateCache::Invalidate()
+{
+    // Pending binds are kept, they are still wanted.
+    mInputLayout.Valid = false;
+    mTopology.Valid = false;
+    mIndexBuffer.Valid = false;
+    mVertexShader.Valid = false;
+    mPixelShader.Valid = false;
+    mRasterizerState.Valid = false;
+    mDepthStencilState.Valid = false;
+    mBlendState.Valid = false;
+    mVertexBuffers.ValidMask = 0;
+    mVSConstantBuffers.ValidMask = 0;
+    mPSConstantBuffers.ValidMask = 0;
+    mPSShaderResources.ValidMask = 0;
+    mPSSamplers.ValidMask = 0;
+}
+
+template<typename T>
+void StateCache::Request(Slot<T>& slot, const T& value)
+{
+    mStats.Requested++;
+    if (!slot.Set(value))
+        mStats.Filtered++;
+}
+
+template<typename T, UINT N>
+void StateCache::Request(SlotArray<T, N>& slots, UINT slot, const T& value)
+{
+    mStats.Requested++;
+    if (!slots.Set(slot, value))
+        mStats.Filtered++;
+}
+
+void StateCache::SetInputLayout(ID3D11InputLayout* layout)
+{
+    Request(mInputLayout, layout);
+}
+
+void StateCache::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+    Request(mTopology, topology);
+}
+
+void StateCache::SetVertexBuffer(UINT slot, ID3D11Buffer* buffer, UINT stride, UINT offset)
+{
+    Request(mVertexBuffers, slot, VertexBufferBinding{ buffer, stride, offset });
+}
+
+void StateCache::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+    Request(mIndexBuffer, IndexBufferBinding{ buffer, format, offset });
+}
+
+void StateCache::SetVertexShader(ID3D11VertexShader* shader)
+{
+    Request(mVertexShader, shader);
+}
+
+void StateCache::SetPixelShader(ID3D11PixelShader* shader)
+{
+    Request(mPixelShader, shader);
+}
+
+void StateCache::SetVSConstantBuffer(UINT slot, ID3D11Buffer* buffer)
+{
+    Request(mVSConstantBuffers, slot, buffer);
+}
+
+void StateCache::SetPSConstantBuffer(UINT slot, ID3D11Buffer* buffer)
+{
+    Request(mPSConstantBuffers, slot, buffer);
+}
+
+void StateCache::SetPSShaderResource(UINT slot, ID3D11ShaderResourceView* view)
+{
+    Request(mPSShaderResources, slot, view);
+}
+
+void StateCache::SetPSSampler(UINT slot, ID3D11SamplerState* sampler)
+{
+    Request(mPSSamplers, slot, sampler);
+}
+
+void StateCache::SetRasterizerState(ID3D11RasterizerState* state)
+{
+    Request(mRasterizerState, state);
+}
+
+void StateCache::SetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef)
+{
+    Request(mDepthStencilState, DepthStencilBinding{ state, stencilRef });
+}
+
+void StateCache::SetBlendState(ID3D11BlendState* state)
+{
+    Request(mBlendState, state);
+}
+
+void StateCache::Flush()
+{
+    ID3D11DeviceContext* context = mContext.Get();
+
+    if (mInputLayout.Resolve())
+    {
+        context->IASetInputLayout(mInputLayout.Bound);
+        mStats.Issued++;
+    }
+    if (mTopology.Resolve())
+    {
+        context->IASetPrimitiveTopology(mTopology.Bound);
+        mStats.Issued++;
+    }
+    mStats.Issued += mVertexBuffers.Flush([context](UINT first, UINT count, const VertexBufferBinding* bindings)
+    {
+        ID3D11Buffer* buffers[kMaxVertexBuffers];
+        UINT strides[kMaxVertexBuffers];
+        UINT offsets[kMaxVertexBuffers];
+        for (UINT i = 0; i < count; i++)
+        {
+            buffers[i] = bindings[i].Buffer;
+            strides[i] = bindings[i].Stride;
+            offsets[i] = bindings[i].Offset;
+        }
+        context->IASetVertexBuffers(first, count, buffers, strides, offsets);
+    });
+    if (mIndexBuffer.Resolve())
+    {
+        context->IASetIndexBuffer(mIndexBuffer.Bound.Buffer, mIndexBuffer.Bound.Format, mIndexBuffer.Bound.Offset);
+        mStats.Issued++;
+    }
+
+    if (mVertexShader.Resolve())
+    {
+        context->VSSetShader(mVertexShader.Bound, nullptr, 0);
+        mStats.Issued++;
+    }
+    if (mPixelShader.Resolve())
+    {
+        context->PSSetShader(mPixelShader.Bound, nullptr, 0);
+        mStats.Issued++;
+    }
+    mStats.Issued += mVSConstantBuffers.Flush([context](UINT first, UINT count, ID3D11Buffer* const* buffers)
+    {
+        context->VSSetConstantBuffers(first, count, buffers);
+    });
+    mStats.Issued += mPSConstantBuffers.Flush([context](UINT first, UINT count, ID3D11Buffer* const* buffers)
+    {
+        context->PSSetConstantBuffers(first, count, buffers);
+    });
+    mStats.Issued += mPSShaderResources.Flush([context](UINT first, UINT count, ID3D11ShaderResourceView* const* views)
+    {
+        context->PSSetShaderResources(first, count, views);
+    });
+    mStats.Issued += mPSSamplers.Flush([context](UINT first, UINT count, ID3D11SamplerState* const* samplers)
+    {
+        context->PSSetSamplers(first, count, samplers);
+    });
+
+    if (mRasterizerState.Resolve())
+    {
+        context->RSSetState(mRasterizerState.Bound);
+        mStats.Issued++;
+    }
+    if (mDepthStencilState.Resolve())
+    {
+        context->OMSetDepthStencilState(mDepthStencilState.Bound.State, mDepthStencilState.Bound.StencilRef);
+        mStats.Issued++;
+    }
+    if (mBlendState.Resolve())
+    {
+        context->OMSetBlendState(mBlendState.Bound, nullptr, 0xFFFFFFFF);
+        mStats.Issued++;
+    }
+}
+
+void StateCache::DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex)
+{
+    Flush();
+    mContext->DrawIndexed(indexCount, startIndex, baseVertex);
+    mStats.Draws++;
+    mStats.Vertices += indexCount;
+}
+
+void StateCache::Draw(UINT vertexCount, UINT startVertex)
+{
+    Flush();
+    mContext->Draw(vertexCount, startVertex);
+    mStats.Draws++;
+    mStats.Vertices += vertexCount;
+}
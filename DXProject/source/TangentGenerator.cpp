@@ -0,0 +1,230 @@
+#include <TangentGenerator.h>
+#include <JobSystem.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    // Meshes below this size are processed on the calling thread.
+    const size_t kParallelThreshold = 64 * 1024;
+    // Triangles or vertices per job
+    const size_t kGrainSize = 16 * 1024;
+
+    struct Vec3
+    {
+        float x, y, z;
+    };
+
+    Vec3 operator+(Vec3 a, Vec3 b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+    Vec3 operator-(Vec3 a, Vec3 b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    Vec3 operator*(Vec3 a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+    float Dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    Vec3 Cross(Vec3 a, Vec3 b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+    float Length(Vec3 a) { return std::sqrt(Dot(a, a)); }
+
+    Vec3 NormalizeOrZero(Vec3 a)
+    {
+        float len = Length(a);
+        return len > 1e-20f ? a * (1.0f / len) : Vec3{ 0.0f, 0.0f, 0.0f };
+    }
+
+    // Removes the component along n and normalizes.
+    Vec3 ProjectOnPlane(Vec3 v, Vec3 n)
+    {
+        return NormalizeOrZero(v - n * Dot(n, v));
+    }
+
+    Vec3 Load3(const float* base, size_t stride, size_t index)
+    {
+        const float* p = reinterpret_cast<const float*>(reinterpret_cast<const char*>(base) + stride * index);
+        return { p[0], p[1], p[2] };
+    }
+
+    void Load2(const float* base, size_t stride, size_t index, float& u, float& v)
+    {
+        const float* p = reinterpret_cast<const float*>(reinterpret_cast<const char*>(base) + stride * index);
+        u = p[0];
+        v = p[1];
+    }
+
+    // Angle-weighted tangent and bitangent contributed by one triangle corner
+    struct CornerFrame
+    {
+        Vec3 Tangent;
+        Vec3 Bitangent;
+        int Group; // 0 or 1 by the UV winding of the triangle, -1 if it has no UV area
+    };
+
+    // Frames of the corners of one vertex, summed by UV winding group
+    struct GroupSums
+    {
+        Vec3 Tangent[2];
+        Vec3 Bitangent[2];
+        uint32_t Corners[2];
+
+        // The group that keeps the vertex, the larger one
+        int Kept() const { return Corners[1] > Corners[0] ? 1 : 0; }
+        bool NeedsSplit() const { return Corners[0] != 0 && Corners[1] != 0; }
+    };
+
+    template<typename Func>
+    void ParallelFor(size_t count, size_t workSize, const Func& func)
+    {
+        if (workSize < kParallelThreshold)
+        {
+            func(size_t(0), count);
+            return;
+        }
+        JobSystem::Get().ParallelFor(count, kGrainSize, func);
+    }
+
+    void ComputeCornerFrames(const TangentGenerator::Input& in, size_t firstTriangle, size_t lastTriangle, CornerFrame* corners)
+    {
+        for (size_t t = firstTriangle; t < lastTriangle; t++)
+        {
+            const uint32_t* tri = in.Indices + t * 3;
+            Vec3 p[3];
+            float u[3], v[3];
+            for (int i = 0; i < 3; i++)
+            {
+                p[i] = Load3(in.Positions, in.PositionStride, tri[i]);
+                Load2(in.TexCoords, in.TexCoordStride, tri[i], u[i], v[i]);
+            }
+
+            Vec3 e1 = p[1] - p[0];
+            Vec3 e2 = p[2] - p[0];
+            float du1 = u[1] - u[0], dv1 = v[1] - v[0];
+            float du2 = u[2] - u[0], dv2 = v[2] - v[0];
+
+            // Only the orientation of the UV mapping matters, the magnitude is normalized away.
+            float signedArea = du1 * dv2 - du2 * dv1;
+            float orientation = signedArea > 0.0f ? 1.0f : -1.0f;
+            Vec3 faceTangent = (e1 * dv2 - e2 * dv1) * orientation;
+            Vec3 faceBitangent = (e2 * du1 - e1 * du2) * orientation;
+            bool degenerate = std::fabs(signedArea) < 1e-20f;
+
+            for (int i = 0; i < 3; i++)
+            {
+                CornerFrame& corner = corners[t * 3 + i];
+                Vec3 n = NormalizeOrZero(Load3(in.Normals, in.NormalStride, tri[i]));
+                Vec3 edgeA = ProjectOnPlane(p[(i + 1) % 3] - p[i], n);
+                Vec3 edgeB = ProjectOnPlane(p[(i + 2) % 3] - p[i], n);
+                float angle = std::acos(std::clamp(Dot(edgeA, edgeB), -1.0f, 1.0f));
+
+                if (degenerate)
+                {
+                    corner.Tangent = { 0.0f, 0.0f, 0.0f };
+                    corner.Bitangent = { 0.0f, 0.0f, 0.0f };
+                    corner.Group = -1;
+                    continue;
+                }
+
+                corner.Tangent = ProjectOnPlane(faceTangent, n) * angle;
+                corner.Bitangent = ProjectOnPlane(faceBitangent, n) * angle;
+                corner.Group = orientation > 0.0f ? 0 : 1;
+            }
+        }
+    }
+
+    GroupSums SumGroups(const CornerFrame* corners, const uint32_t* vertexCorners, uint32_t first, uint32_t end)
+    {
+        GroupSums sums = {};
+        for (uint32_t i = first; i < end; i++)
+        {
+            const CornerFrame& corner = corners[vertexCorners[i]];
+            if (corner.Group < 0)
+                continue;
+            sums.Tangent[corner.Group] = sums.Tangent[corner.Group] + corner.Tangent;
+            sums.Bitangent[corner.Group] = sums.Bitangent[corner.Group] + corner.Bitangent;
+            sums.Corners[corner.Group]++;
+        }
+        return sums;
+    }
+
+    void ResolveFrame(Vec3 n, Vec3 sumTangent, Vec3 sumBitangent, float* out)
+    {
+        Vec3 t = ProjectOnPlane(sumTangent, n);
+        if (Length(t) == 0.0f)
+        {
+            // No usable UV gradient, any vector perpendicular to the normal will do.
+            Vec3 axis = std::fabs(n.x) < 0.9f ? Vec3{ 1.0f, 0.0f, 0.0f } : Vec3{ 0.0f, 1.0f, 0.0f };
+            t = ProjectOnPlane(axis, n);
+        }
+
+        float sign = Dot(Cross(n, t), sumBitangent) < 0.0f ? -1.0f : 1.0f;
+
+        out[0] = t.x;
+        out[1] = t.y;
+        out[2] = t.z;
+        out[3] = sign;
+    }
+}
+
+void TangentGenerator::Generate(const Input& input, float* tangents, uint32_t* indices, std::vector<SplitVertex>& splits)
+{
+    splits.clear();
+    if (input.VertexCount == 0)
+        return;
+
+    const size_t triangleCount = input.IndexCount / 3;
+    const size_t cornerCount = triangleCount * 3;
+
+    std::vector<CornerFrame> corners(cornerCount);
+    ParallelFor(triangleCount, triangleCount, [&](size_t begin, size_t end)
+    {
+        ComputeCornerFrames(input, begin, end, corners.data());
+    });
+
+    // Corners of each vertex in CSR form, so vertices can be resolved independently.
+    std::vector<uint32_t> offsets(input.VertexCount + 1, 0);
+    for (size_t c = 0; c < cornerCount; c++)
+        offsets[input.Indices[c] + 1]++;
+    for (size_t i = 0; i < input.VertexCount; i++)
+        offsets[i + 1] += offsets[i];
+
+    std::vector<uint32_t> vertexCorners(cornerCount);
+    {
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t c = 0; c < cornerCount; c++)
+            vertexCorners[cursor[input.Indices[c]]++] = static_cast<uint32_t>(c);
+    }
+
+    // Vertices with corners in both winding groups, split below on this thread so that
+    // the copies are numbered in vertex order.
+    std::vector<uint8_t> needsSplit(input.VertexCount, 0);
+    ParallelFor(input.VertexCount, triangleCount, [&](size_t begin, size_t end)
+    {
+        for (size_t vertex = begin; vertex < end; vertex++)
+        {
+            Vec3 n = NormalizeOrZero(Load3(input.Normals, input.NormalStride, vertex));
+            GroupSums sums = SumGroups(corners.data(), vertexCorners.data(), offsets[vertex], offsets[vertex + 1]);
+            int kept = sums.Kept();
+            ResolveFrame(n, sums.Tangent[kept], sums.Bitangent[kept], tangents + vertex * 4);
+            needsSplit[vertex] = sums.NeedsSplit() ? 1 : 0;
+        }
+    });
+
+    for (size_t vertex = 0; vertex < input.VertexCount; vertex++)
+    {
+        if (!needsSplit[vertex])
+            continue;
+
+        Vec3 n = NormalizeOrZero(Load3(input.Normals, input.NormalStride, vertex));
+        GroupSums sums = SumGroups(corners.data(), vertexCorners.data(), offsets[vertex], offsets[vertex + 1]);
+        int moved = 1 - sums.Kept();
+
+        SplitVertex split;
+        split.Source = static_cast<uint32_t>(vertex);
+        ResolveFrame(n, sums.Tangent[moved], sums.Bitangent[moved], split.Tangent);
+        const uint32_t copy = static_cast<uint32_t>(input.VertexCount + splits.size());
+        splits.push_back(split);
+
+        for (uint32_t i = offsets[vertex]; i < offsets[vertex + 1]; i++)
+        {
+            if (corners[vertexCorners[i]].Group == moved)
+                indices[vertexCorners[i]] = copy;
+        }
+    }
+}
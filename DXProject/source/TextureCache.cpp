@@ -0,0 +1,239 @@
+#include <TextureCache.h>
+#include <TgaReader.h>
+#include <CookedAssets.h>
+#include <Hash.h>
+#include <MemoryTracker.h>
+#include <filesystem>
+#include <sstream>
+#include <vector>
+
+TextureCache::TextureCache()
+    : mHits(0),
+    mMisses(0),
+    mDecodesSkipped(0),
+    mBytesSaved(0),
+    mUploadedBytes(0)
+{
+    // Make sure the log outlives the cache, statistics are written on destruction.
+    LogWriter::getInstance();
+}
+
+TextureCache::~TextureCache()
+{
+    LogStats();
+}
+
+std::wstring TextureCache::MakePathKey(ID3D11Device* device, const std::wstring& file)
+{
+    // Size and modification time are part of the key, so an edited file is decoded again.
+    // So is the time of the cooked file, which the cooker may write for an unchanged source.
+    std::error_code ec;
+    std::filesystem::path path = std::filesystem::weakly_canonical(file, ec);
+    if (ec)
+        path = file;
+
+    uintmax_t size = std::filesystem::file_size(path, ec);
+    auto writeTime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+    auto cookedWriteTime = std::filesystem::last_write_time(CookedAssets::TexturePath(path), ec).time_since_epoch().count();
+
+    std::wostringstream key;
+    key << path.wstring() << L'|' << size << L'|' << writeTime << L'|' << cookedWriteTime << L'|' << reinterpret_cast<uintptr_t>(device);
+    return key.str();
+}
+
+HRESULT TextureCache::LoadTGA(ComPtr<ID3D11Device> device, const std::wstring& file, TextureHandle& handle)
+{
+    const std::wstring pathKey = MakePathKey(device.Get(), file);
+
+    std::promise<LoadResult> promise;
+    std::shared_future<LoadResult> pending;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        auto byPath = mByPath.find(pathKey);
+        if (byPath != mByPath.end())
+        {
+            if (TextureHandle existing = byPath->second.lock())
+            {
+                mHits++;
+                mDecodesSkipped++;
+                mBytesSaved += existing->SizeBytes;
+                handle = existing;
+                return S_OK;
+            }
+            mByPath.erase(byPath);
+        }
+
+        auto inFlight = mPending.find(pathKey);
+        if (inFlight != mPending.end())
+            pending = inFlight->second;
+        else
+            mPending.emplace(pathKey, promise.get_future().share());
+    }
+
+    if (pending.valid())
+    {
+        // Another thread is decoding this file, share its result.
+        const LoadResult& result = pending.get();
+        if (SUCCEEDED(result.Result))
+        {
+            mHits++;
+            mDecodesSkipped++;
+            mBytesSaved += result.Handle->SizeBytes;
+            handle = result.Handle;
+        }
+        return result.Result;
+    }
+
+    LoadResult result;
+    try
+    {
+        result = DecodeAndCreate(device, file);
+    }
+    catch (...)
+    {
+        // Waiting loads get the exception too, later ones decode again
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPending.erase(pathKey);
+        }
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (SUCCEEDED(result.Result))
+            mByPath[pathKey] = result.Handle;
+        mPending.erase(pathKey);
+    }
+    promise.set_value(result);
+
+    if (SUCCEEDED(result.Result))
+        handle = result.Handle;
+    return result.Result;
+}
+
+TextureCache::LoadResult TextureCache::DecodeAndCreate(ComPtr<ID3D11Device> device, const std::wstring& file)
+{
+    MemoryTracker::Scope memoryScope(MemoryTag::Textures);
+
+    // A cooked texture is already in the upload format, only the source has to be decoded.
+    CookedAssets::Texture image;
+    const std::filesystem::path cookedFile = CookedAssets::TexturePath(file);
+    bool cooked = CookedAssets::IsUpToDate(cookedFile, file) && CookedAssets::ReadTexture(cookedFile, image);
+    if (!cooked)
+    {
+        TGAReader reader;
+        if (!reader.Open(file))
+            return { E_FAIL, nullptr };
+
+        // Decode straight into the upload buffer, the texture is created from it directly.
+        image.Width = reader.GetWidth();
+        image.Height = reader.GetHeight();
+        image.Pixels.resize(size_t(image.Width) * image.Height * 4);
+        if (!reader.Decode(image.Pixels.data(), size_t(image.Width) * 4))
+            return { E_FAIL, nullptr };
+    }
+
+    const UINT rowPitch = image.Width * 4;
+    const std::vector<uint8_t>& pixels = image.Pixels;
+
+    D3D11_TEXTURE2D_DESC desc;
+    desc.Width = image.Width;
+    desc.Height = image.Height;
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.Usage = D3D11_USAGE_IMMUTABLE;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = 0;
+
+    uint64_t contentHash = Hash::Bytes(pixels.data(), pixels.size());
+    contentHash = Hash::Combine(contentHash, desc.Format);
+    contentHash = Hash::Combine(contentHash, (uint64_t(desc.Width) << 32) | desc.Height);
+    contentHash = Hash::Combine(contentHash, reinterpret_cast<uintptr_t>(device.Get()));
+    // Only computed to tell apart two images with the same content hash
+    const uint64_t checkHash = Hash::Bytes(pixels.data(), pixels.size(), 0x9E3779B97F4A7C15ull);
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (TextureHandle existing = FindByContent(contentHash, checkHash))
+            return { S_OK, existing };
+    }
+
+    auto texture = std::make_shared<CachedTexture>();
+    texture->ContentHash = contentHash;
+    texture->CheckHash = checkHash;
+    texture->Desc = desc;
+    texture->SizeBytes = pixels.size();
+
+    D3D11_SUBRESOURCE_DATA initData;
+    initData.pSysMem = pixels.data();
+    initData.SysMemPitch = rowPitch;
+    initData.SysMemSlicePitch = 0;
+
+    HRESULT hr = device->CreateTexture2D(&desc, &initData, texture->Texture.GetAddressOf());
+    if (FAILED(hr))
+        return { hr, nullptr };
+    MemoryTracker::TrackGpuResource(texture->Texture.Get(), MemoryTag::GpuTextures);
+    mUploadedBytes += pixels.size();
+
+    hr = device->CreateShaderResourceView(texture->Texture.Get(), nullptr, texture->SRV.GetAddressOf());
+    if (FAILED(hr))
+        return { hr, nullptr };
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // Another file with the same content may have been created while we were uploading.
+    if (TextureHandle existing = FindByContent(contentHash, checkHash))
+        return { S_OK, existing };
+
+    // A colliding live entry keeps its slot, this texture is just not shared
+    mMisses++;
+    std::weak_ptr<const CachedTexture>& slot = mByContent[contentHash];
+    if (slot.expired())
+        slot = texture;
+    return { S_OK, texture };
+}
+
+TextureHandle TextureCache::FindByContent(uint64_t contentHash, uint64_t checkHash)
+{
+    auto it = mByContent.find(contentHash);
+    if (it == mByContent.end())
+        return nullptr;
+
+    TextureHandle existing = it->second.lock();
+    if (!existing)
+    {
+        mByContent.erase(it);
+        return nullptr;
+    }
+    // Dimensions and format are part of both hashes, so only the pixels can differ
+    if (existing->CheckHash != checkHash)
+        return nullptr;
+
+    mHits++;
+    mBytesSaved += existing->SizeBytes;
+    return existing;
+}
+
+TextureCache::Stats TextureCache::GetStats() const
+{
+    Stats stats;
+    stats.Hits = mHits;
+    stats.Misses = mMisses;
+    stats.DecodesSkipped = mDecodesSkipped;
+    stats.BytesSaved = mBytesSaved;
+    stats.UploadedBytes = mUploadedBytes;
+    return stats;
+}
+
+void TextureCache::LogStats() const
+{
+    Stats stats = GetStats();
+    LOG("Texture cache: ", stats.Hits, " hits (", stats.DecodesSkipped, " without decoding), ",
+        stats.Misses, " misses, ", stats.BytesSaved / 1024, " KB saved, ", stats.UploadedBytes / 1024, " KB uploaded");
+}
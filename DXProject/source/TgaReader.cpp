@@ -0,0 +1,414 @@
+#include <TgaReader.h>
+#include <JobSystem.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define TGA_X86 1
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(TGA_X86) && defined(__GNUC__)
+#define TGA_TARGET_SSSE3 __attribute__((target("ssse3")))
+#else
+#define TGA_TARGET_SSSE3
+#endif
+
+namespace
+{
+    const uint8_t kImageTypeTrueColor = 2;
+    const uint8_t kImageTypeGrayscale = 3;
+    const uint8_t kImageTypeTrueColorRLE = 10;
+    const uint8_t kImageTypeGrayscaleRLE = 11;
+
+    const size_t kHeaderSize = 18;
+
+    // Images with fewer pixels are decoded on the calling thread,
+    // splitting them into jobs costs more than it saves.
+    const size_t kParallelPixelThreshold = 1024 * 1024;
+    const uint32_t kRowsPerJob = 64;
+
+    uint16_t ReadU16(const uint8_t* p)
+    {
+        return static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+
+    bool CpuHasSSSE3()
+    {
+#if defined(TGA_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 9)) != 0;
+#elif defined(TGA_X86) && defined(__GNUC__)
+        return __builtin_cpu_supports("ssse3");
+#else
+        return false;
+#endif
+    }
+
+    const bool gHasSSSE3 = CpuHasSSSE3();
+
+    uint32_t Pixel16ToRGBA(uint16_t v)
+    {
+        uint32_t r = (v >> 10) & 0x1F;
+        uint32_t g = (v >> 5) & 0x1F;
+        uint32_t b = v & 0x1F;
+        uint32_t a = (v & 0x8000) ? 0xFF : 0x00;
+        r = (r << 3) | (r >> 2);
+        g = (g << 3) | (g >> 2);
+        b = (b << 3) | (b >> 2);
+        return r | (g << 8) | (b << 16) | (a << 24);
+    }
+
+    uint32_t PixelToRGBA(const uint8_t* src, uint32_t bytesPerPixel)
+    {
+        switch (bytesPerPixel)
+        {
+        case 1:
+            return src[0] | (src[0] << 8) | (src[0] << 16) | 0xFF000000u;
+        case 2:
+            return Pixel16ToRGBA(ReadU16(src));
+        case 3:
+            return src[2] | (src[1] << 8) | (src[0] << 16) | 0xFF000000u;
+        default:
+            return src[2] | (src[1] << 8) | (src[0] << 16) | (static_cast<uint32_t>(src[3]) << 24);
+        }
+    }
+
+    // BGRA -> RGBA. Returns the OR of all source alpha bytes.
+    uint32_t ConvertBGRA(const uint8_t* src, uint8_t* dst, uint32_t count)
+    {
+        uint32_t x = 0;
+        uint32_t alpha = 0;
+
+#ifdef TGA_X86
+        const __m128i maskAG = _mm_set1_epi32(static_cast<int>(0xFF00FF00));
+        const __m128i maskRB = _mm_set1_epi32(0x00FF00FF);
+        __m128i alphaAcc = _mm_setzero_si128();
+        for (; x + 4 <= count; x += 4)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+            __m128i ag = _mm_and_si128(v, maskAG);
+            __m128i rb = _mm_and_si128(v, maskRB);
+            rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_or_si128(ag, rb));
+            alphaAcc = _mm_or_si128(alphaAcc, v);
+        }
+        alphaAcc = _mm_or_si128(alphaAcc, _mm_srli_si128(alphaAcc, 8));
+        alphaAcc = _mm_or_si128(alphaAcc, _mm_srli_si128(alphaAcc, 4));
+        alpha = static_cast<uint32_t>(_mm_cvtsi128_si32(alphaAcc)) >> 24;
+#endif
+
+        for (; x < count; x++)
+        {
+            uint32_t rgba = PixelToRGBA(src + x * 4, 4);
+            memcpy(dst + x * 4, &rgba, 4);
+            alpha |= rgba >> 24;
+        }
+        return alpha;
+    }
+
+    TGA_TARGET_SSSE3 uint32_t ConvertBGR_SSSE3(const uint8_t* src, uint8_t* dst, uint32_t count)
+    {
+        uint32_t x = 0;
+#ifdef TGA_X86
+        const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+        const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+        // Each iteration loads 16 bytes but consumes 12, stop early enough
+        // to never read past the end of the row.
+        for (; x + 6 <= count; x += 4)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 3));
+            v = _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), v);
+        }
+#endif
+        return x;
+    }
+
+    // BGR -> RGBA with opaque alpha.
+    void ConvertBGR(const uint8_t* src, uint8_t* dst, uint32_t count)
+    {
+        uint32_t x = gHasSSSE3 ? ConvertBGR_SSSE3(src, dst, count) : 0;
+        for (; x < count; x++)
+        {
+            uint32_t rgba = PixelToRGBA(src + x * 3, 3);
+            memcpy(dst + x * 4, &rgba, 4);
+        }
+    }
+
+    // Converts count source pixels to RGBA. Returns the OR of the produced alpha bytes.
+    uint32_t ConvertPixels(const uint8_t* src, uint8_t* dst, uint32_t count, uint32_t bytesPerPixel)
+    {
+        switch (bytesPerPixel)
+        {
+        case 4:
+            return ConvertBGRA(src, dst, count);
+        case 3:
+            ConvertBGR(src, dst, count);
+            return 0xFF;
+        default:
+        {
+            uint32_t alpha = 0;
+            for (uint32_t x = 0; x < count; x++)
+            {
+                uint32_t rgba = PixelToRGBA(src + x * bytesPerPixel, bytesPerPixel);
+                memcpy(dst + x * 4, &rgba, 4);
+                alpha |= rgba >> 24;
+            }
+            return alpha;
+        }
+        }
+    }
+
+    void FillPixels(uint8_t* dst, uint32_t rgba, uint32_t count)
+    {
+        for (uint32_t x = 0; x < count; x++)
+            memcpy(dst + x * 4, &rgba, 4);
+    }
+
+    // Some exporters write 32 bpp files with an unused, all-zero alpha channel.
+    // Such images are treated as opaque, the same way DirectXTex does.
+    void ForceOpaque(uint8_t* dest, size_t rowPitch, uint32_t width, uint32_t height)
+    {
+        for (uint32_t y = 0; y < height; y++)
+        {
+            uint8_t* row = dest + y * rowPitch;
+            uint32_t x = 0;
+#ifdef TGA_X86
+            const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128i* p = reinterpret_cast<__m128i*>(row + x * 4);
+                _mm_storeu_si128(p, _mm_or_si128(_mm_loadu_si128(p), alpha));
+            }
+#endif
+            for (; x < width; x++)
+                row[x * 4 + 3] = 0xFF;
+        }
+    }
+}
+
+TGAReader::TGAReader()
+    : mpPixels(nullptr),
+    mpEnd(nullptr),
+    mWidth(0),
+    mHeight(0),
+    mBytesPerPixel(0),
+    mbRLE(false),
+    mbGrayscale(false),
+    mbTopDown(false)
+{
+}
+
+TGAReader::~TGAReader()
+{
+}
+
+bool TGAReader::Open(const std::filesystem::path& filename)
+{
+    Close();
+
+    if (!mFile.Open(filename))
+        return false;
+
+    if (!ParseHeader())
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void TGAReader::Close()
+{
+    mFile.Close();
+    mpPixels = nullptr;
+    mpEnd = nullptr;
+    mWidth = 0;
+    mHeight = 0;
+}
+
+bool TGAReader::ParseHeader()
+{
+    if (mFile.Size() < kHeaderSize)
+        return false;
+
+    const uint8_t* header = mFile.Data();
+    uint8_t idLength = header[0];
+    uint8_t colorMapType = header[1];
+    uint8_t imageType = header[2];
+    uint16_t colorMapLength = ReadU16(header + 5);
+    uint8_t colorMapEntrySize = header[7];
+    mWidth = ReadU16(header + 12);
+    mHeight = ReadU16(header + 14);
+    uint8_t pixelDepth = header[16];
+    uint8_t descriptor = header[17];
+
+    switch (imageType)
+    {
+    case kImageTypeTrueColor:
+    case kImageTypeTrueColorRLE:
+        if (pixelDepth != 15 && pixelDepth != 16 && pixelDepth != 24 && pixelDepth != 32)
+            return false;
+        mbGrayscale = false;
+        break;
+    case kImageTypeGrayscale:
+    case kImageTypeGrayscaleRLE:
+        if (pixelDepth != 8)
+            return false;
+        mbGrayscale = true;
+        break;
+    default:
+        // Color-mapped images are not used by our assets.
+        return false;
+    }
+
+    // Right-to-left pixel order is not supported.
+    if (descriptor & 0x10)
+        return false;
+
+    if (mWidth == 0 || mHeight == 0)
+        return false;
+
+    mbRLE = imageType >= kImageTypeTrueColorRLE;
+    mbTopDown = (descriptor & 0x20) != 0;
+    mBytesPerPixel = (pixelDepth + 7) / 8;
+
+    // A color map may be present even if the image does not use it.
+    size_t colorMapSize = colorMapType ? colorMapLength * ((colorMapEntrySize + 7) / 8) : 0;
+    size_t pixelOffset = kHeaderSize + idLength + colorMapSize;
+    if (pixelOffset > mFile.Size())
+        return false;
+
+    mpPixels = mFile.Data() + pixelOffset;
+    mpEnd = mFile.Data() + mFile.Size();
+
+    if (!mbRLE && static_cast<size_t>(mpEnd - mpPixels) < size_t(mWidth) * mHeight * mBytesPerPixel)
+        return false;
+
+    return true;
+}
+
+uint8_t* TGAReader::DestRow(uint8_t* dest, size_t rowPitch, uint32_t fileRow) const
+{
+    // TGA stores rows bottom-up unless the descriptor says otherwise.
+    uint32_t y = mbTopDown ? fileRow : mHeight - 1 - fileRow;
+    return dest + y * rowPitch;
+}
+
+bool TGAReader::Decode(uint8_t* dest, size_t rowPitch) const
+{
+    if (!mpPixels || !dest || rowPitch < size_t(mWidth) * 4)
+        return false;
+
+    return mbRLE ? DecodeRLE(dest, rowPitch) : DecodeUncompressed(dest, rowPitch);
+}
+
+bool TGAReader::DecodeUncompressed(uint8_t* dest, size_t rowPitch) const
+{
+    const size_t srcPitch = size_t(mWidth) * mBytesPerPixel;
+
+    auto decodeRows = [&](uint32_t firstRow, uint32_t lastRow) -> uint32_t
+    {
+        uint32_t alpha = 0;
+        for (uint32_t row = firstRow; row < lastRow; row++)
+        {
+            alpha |= ConvertPixels(mpPixels + row * srcPitch, DestRow(dest, rowPitch, row), mWidth, mBytesPerPixel);
+        }
+        return alpha;
+    };
+
+    uint32_t alpha = 0;
+    if (size_t(mWidth) * mHeight < kParallelPixelThreshold)
+    {
+        alpha = decodeRows(0, mHeight);
+    }
+    else
+    {
+        // Rows are independent, so each job takes a band of them.
+        std::atomic<uint32_t> sharedAlpha(0);
+        JobSystem::Get().ParallelFor(mHeight, kRowsPerJob, [&](size_t first, size_t last)
+        {
+            sharedAlpha.fetch_or(decodeRows(static_cast<uint32_t>(first), static_cast<uint32_t>(last)), std::memory_order_relaxed);
+        });
+        alpha = sharedAlpha;
+    }
+
+    if (alpha == 0)
+        ForceOpaque(dest, rowPitch, mWidth, mHeight);
+
+    return true;
+}
+
+bool TGAReader::DecodeRLE(uint8_t* dest, size_t rowPitch) const
+{
+    const uint8_t* src = mpPixels;
+    uint32_t alpha = 0;
+
+    // Packets are allowed to cross row boundaries, so track the position
+    // in the destination separately from the packet being decoded.
+    uint32_t row = 0;
+    uint32_t x = 0;
+    uint8_t* dst = DestRow(dest, rowPitch, 0);
+
+    while (row < mHeight)
+    {
+        if (src >= mpEnd)
+            return false;
+
+        uint8_t packet = *src++;
+        uint32_t count = (packet & 0x7F) + 1;
+        bool repeat = (packet & 0x80) != 0;
+
+        size_t packetBytes = repeat ? mBytesPerPixel : size_t(count) * mBytesPerPixel;
+        if (static_cast<size_t>(mpEnd - src) < packetBytes)
+            return false;
+
+        uint32_t rgba = 0;
+        if (repeat)
+        {
+            rgba = PixelToRGBA(src, mBytesPerPixel);
+            alpha |= rgba >> 24;
+        }
+
+        while (count > 0 && row < mHeight)
+        {
+            uint32_t span = std::min(count, mWidth - x);
+            if (repeat)
+            {
+                FillPixels(dst + x * 4, rgba, span);
+            }
+            else
+            {
+                alpha |= ConvertPixels(src, dst + x * 4, span, mBytesPerPixel);
+                src += size_t(span) * mBytesPerPixel;
+            }
+
+            count -= span;
+            x += span;
+            if (x == mWidth)
+            {
+                x = 0;
+                if (++row < mHeight)
+                    dst = DestRow(dest, rowPitch, row);
+            }
+        }
+
+        if (repeat)
+            src += mBytesPerPixel;
+    }
+
+    if (alpha == 0)
+        ForceOpaque(dest, rowPitch, mWidth, mHeight);
+
+    return true;
+}
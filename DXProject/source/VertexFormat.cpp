@@ -0,0 +1,75 @@
+#include <VertexFormat.h>
+#include <RenderDefs.h>
+#include <Hash.h>
+#include <cstring>
+
+VertexFormat::VertexFormat(std::initializer_list<D3D11_INPUT_ELEMENT_DESC> elements)
+    : mElements(elements),
+    mHash(0)
+{
+    for (const D3D11_INPUT_ELEMENT_DESC& element : mElements)
+    {
+        // Hash the semantic name by value, the pointer may differ between identical formats.
+        mHash = Hash::Combine(mHash, Hash::Bytes(element.SemanticName, strlen(element.SemanticName)));
+        mHash = Hash::Combine(mHash, element.SemanticIndex);
+        mHash = Hash::Combine(mHash, element.Format);
+        mHash = Hash::Combine(mHash, element.InputSlot);
+        mHash = Hash::Combine(mHash, element.AlignedByteOffset);
+        mHash = Hash::Combine(mHash, element.InputSlotClass);
+        mHash = Hash::Combine(mHash, element.InstanceDataStepRate);
+    }
+}
+
+const VertexFormat& VertexFormat::Textured()
+{
+    static const VertexFormat format =
+    {
+        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(VertexTextured, Pos), D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(VertexTextured, Normal), D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, offsetof(VertexTextured, Tex), D3D11_INPUT_PER_VERTEX_DATA, 0}
+    };
+    return format;
+}
+
+const VertexFormat& VertexFormat::TexturedTangent()
+{
+    static const VertexFormat format =
+    {
+        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(VertexTextured, Pos), D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(VertexTextured, Normal), D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, offsetof(VertexTextured, Tex), D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"TANGENT", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0}
+    };
+    return format;
+}
+
+const VertexFormat& VertexFormat::SplitTangent()
+{
+    static const VertexFormat format =
+    {
+        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 2, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"TANGENT", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 3, 0, D3D11_INPUT_PER_VERTEX_DATA, 0}
+    };
+    return format;
+}
+
+const VertexFormat& VertexFormat::Position()
+{
+    static const VertexFormat format =
+    {
+        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0}
+    };
+    return format;
+}
+
+const VertexFormat& VertexFormat::Cube()
+{
+    static const VertexFormat format =
+    {
+        {"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(CubeVertex, Pos), D3D11_INPUT_PER_VERTEX_DATA, 0},
+        {"COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, offsetof(CubeVertex, Color), D3D11_INPUT_PER_VERTEX_DATA, 0}
+    };
+    return format;
+}
@@ -0,0 +1,143 @@
+#include <VertexStreams.h>
+
+#include <algorithm>
+#include <emmintrin.h>
+
+VertexStreams VertexStreams::Split(const std::vector<VertexTextured>& vertices)
+{
+    VertexStreams streams;
+    streams.Positions.resize(vertices.size());
+    streams.Normals.resize(vertices.size());
+    streams.TexCoords.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        streams.Positions[i] = vertices[i].Pos;
+        streams.Normals[i] = vertices[i].Normal;
+        streams.TexCoords[i] = vertices[i].Tex;
+    }
+    return streams;
+}
+
+PositionsSoA::PositionsSoA()
+    : mCount(0)
+{
+}
+
+void PositionsSoA::Assign(const float* positions, size_t stride, size_t count)
+{
+    mCount = count;
+    const size_t padded = (count + 3) & ~size_t(3);
+    mX.resize(padded);
+    mY.resize(padded);
+    mZ.resize(padded);
+
+    const char* bytes = reinterpret_cast<const char*>(positions);
+    for (size_t i = 0; i < padded; i++)
+    {
+        const float* p = reinterpret_cast<const float*>(bytes + (std::min)(i, count - 1) * stride);
+        mX[i] = p[0];
+        mY[i] = p[1];
+        mZ[i] = p[2];
+    }
+}
+
+namespace PositionPass
+{
+    void ComputeBounds(const float* positions, size_t stride, size_t count, DirectX::XMFLOAT3& min, DirectX::XMFLOAT3& max)
+    {
+        min = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+        max = min;
+        if (count == 0)
+            return;
+
+        const char* bytes = reinterpret_cast<const char*>(positions);
+        float lo[3] = { positions[0], positions[1], positions[2] };
+        float hi[3] = { positions[0], positions[1], positions[2] };
+        for (size_t i = 1; i < count; i++)
+        {
+            const float* p = reinterpret_cast<const float*>(bytes + i * stride);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                lo[axis] = (std::min)(lo[axis], p[axis]);
+                hi[axis] = (std::max)(hi[axis], p[axis]);
+            }
+        }
+        min = DirectX::XMFLOAT3(lo[0], lo[1], lo[2]);
+        max = DirectX::XMFLOAT3(hi[0], hi[1], hi[2]);
+    }
+
+    void ComputeBounds(const PositionsSoA& positions, DirectX::XMFLOAT3& min, DirectX::XMFLOAT3& max)
+    {
+        min = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+        max = min;
+        if (positions.GetCount() == 0)
+            return;
+
+        const float* xs = positions.GetX();
+        const float* ys = positions.GetY();
+        const float* zs = positions.GetZ();
+        __m128 loX = _mm_loadu_ps(xs), hiX = loX;
+        __m128 loY = _mm_loadu_ps(ys), hiY = loY;
+        __m128 loZ = _mm_loadu_ps(zs), hiZ = loZ;
+        for (size_t i = 4; i < positions.GetPaddedCount(); i += 4)
+        {
+            __m128 x = _mm_loadu_ps(xs + i);
+            __m128 y = _mm_loadu_ps(ys + i);
+            __m128 z = _mm_loadu_ps(zs + i);
+            loX = _mm_min_ps(loX, x);
+            hiX = _mm_max_ps(hiX, x);
+            loY = _mm_min_ps(loY, y);
+            hiY = _mm_max_ps(hiY, y);
+            loZ = _mm_min_ps(loZ, z);
+            hiZ = _mm_max_ps(hiZ, z);
+        }
+
+        alignas(16) float lanes[6][4];
+        _mm_store_ps(lanes[0], loX);
+        _mm_store_ps(lanes[1], loY);
+        _mm_store_ps(lanes[2], loZ);
+        _mm_store_ps(lanes[3], hiX);
+        _mm_store_ps(lanes[4], hiY);
+        _mm_store_ps(lanes[5], hiZ);
+        float result[6];
+        for (int i = 0; i < 6; i++)
+        {
+            result[i] = lanes[i][0];
+            for (int lane = 1; lane < 4; lane++)
+                result[i] = i < 3 ? (std::min)(result[i], lanes[i][lane]) : (std::max)(result[i], lanes[i][lane]);
+        }
+        min = DirectX::XMFLOAT3(result[0], result[1], result[2]);
+        max = DirectX::XMFLOAT3(result[3], result[4], result[5]);
+    }
+
+    void ProjectDepth(const float* positions, size_t stride, size_t count, const DirectX::XMFLOAT4X4& m, float* depths)
+    {
+        const char* bytes = reinterpret_cast<const char*>(positions);
+        for (size_t i = 0; i < count; i++)
+        {
+            const float* p = reinterpret_cast<const float*>(bytes + i * stride);
+            float z = p[0] * m.m[0][2] + p[1] * m.m[1][2] + p[2] * m.m[2][2] + m.m[3][2];
+            float w = p[0] * m.m[0][3] + p[1] * m.m[1][3] + p[2] * m.m[2][3] + m.m[3][3];
+            depths[i] = z / w;
+        }
+    }
+
+    void ProjectDepth(const PositionsSoA& positions, const DirectX::XMFLOAT4X4& m, float* depths)
+    {
+        const __m128 zx = _mm_set1_ps(m.m[0][2]), zy = _mm_set1_ps(m.m[1][2]), zz = _mm_set1_ps(m.m[2][2]), zw = _mm_set1_ps(m.m[3][2]);
+        const __m128 wx = _mm_set1_ps(m.m[0][3]), wy = _mm_set1_ps(m.m[1][3]), wz = _mm_set1_ps(m.m[2][3]), ww = _mm_set1_ps(m.m[3][3]);
+        const float* xs = positions.GetX();
+        const float* ys = positions.GetY();
+        const float* zs = positions.GetZ();
+        for (size_t i = 0; i < positions.GetPaddedCount(); i += 4)
+        {
+            __m128 x = _mm_loadu_ps(xs + i);
+            __m128 y = _mm_loadu_ps(ys + i);
+            __m128 z = _mm_loadu_ps(zs + i);
+            // Summed in the order of the scalar version, for identical results
+            __m128 clipZ = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, zx), _mm_mul_ps(y, zy)), _mm_mul_ps(z, zz)), zw);
+            __m128 clipW = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, wx), _mm_mul_ps(y, wy)), _mm_mul_ps(z, wz)), ww);
+            _mm_storeu_ps(depths + i, _mm_div_ps(clipZ, clipW));
+        }
+    }
+}
@@ -1,6 +1,8 @@
 #include "dxapp.h"
+#include <MemoryTracker.h>
 
 #include <WindowsX.h>
+#include <chrono>
 #include <vector>
 
 
@@ -10,6 +12,11 @@ namespace
     // procedure to our member function window procedure because we cannot
     // assign a member function to WNDCLASS::lpfnWndProc.
     DXApp* gd3dApp = 0;
+
+    // Benchmark runs advance the simulation by a fixed step per frame.
+    const float kBenchmarkTimeStep = 1.0f / 60.0f;
+    // Recorded camera keys are at least this far apart, the path interpolates between them.
+    const float kRecordInterval = 1.0f / 30.0f;
 }
 
 LRESULT CALLBACK
@@ -20,7 +27,7 @@ MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
     return gd3dApp->MsgProc(hwnd, msg, wParam, lParam);
 }
 
-DXApp::DXApp(HINSTANCE hInstance)
+DXApp::DXApp(HINSTANCE hInstance, const LaunchOptions& options)
     : mhAppInst(hInstance),
       mMainWndCaption(L"D3D11 Application"),
       mClientWidth(800),
@@ -29,7 +36,8 @@ DXApp::DXApp(HINSTANCE hInstance)
       mAppPaused(false),
       mMinimized(false),
       mMaximized(false),
-      mResizing(false)
+      mResizing(false),
+      mOptions(options)
 {
     // Get a pointer to the application object so we can forward 
     // Windows messages to the object's window procedure through
@@ -53,6 +61,9 @@ HWND DXApp::MainWnd() const
 
 int DXApp::Run()
 {
+	if (mOptions.BenchmarkFrames > 0)
+		return RunBenchmark();
+
 	MSG msg = { 0 };
 
 	mTimer.Reset();
@@ -68,13 +79,23 @@ int DXApp::Run()
 		// Otherwise, do animation/game stuff.
 		else
 		{
+			// Back to the messages if one arrives before the render thread frees a frame
+			if (!mAppPaused && !mRenderer.WaitForFrameSlot())
+				continue;
+
 			mTimer.Tick();
 
 			if (!mAppPaused)
 			{
 				mRenderer.CalculateFrameStats(mTimer, mMainWndCaption, mhMainWnd);
+				// Drawn on the render thread while the next frame is updated
 				mRenderer.UpdateScene(mTimer.DeltaTime());
-				mRenderer.DrawScene();
+
+				if (!mOptions.RecordFile.empty() &&
+					(mRecordedPath.IsEmpty() || mTimer.TotalTime() - mRecordedPath.GetStartTime() - mRecordedPath.GetDuration() >= kRecordInterval))
+				{
+					mRecordedPath.AddKey(mTimer.TotalTime(), mRenderer.GetCameraOrbit());
+				}
 			}
 			else
 			{
@@ -83,9 +104,74 @@ int DXApp::Run()
 		}
 	}
 
+	if (!mOptions.RecordFile.empty())
+	{
+		bool saved = mRecordedPath.Save(mOptions.RecordFile);
+		LOG("Camera path ", mOptions.RecordFile, saved ? ": saved " : ": cannot save ", mRecordedPath.GetKeyCount(), " keys");
+	}
+
 	return (int)msg.wParam;
 }
 
+int DXApp::RunBenchmark()
+{
+	CameraPath path = CameraPath::DefaultOrbit();
+	if (!mOptions.CameraPathFile.empty() && !path.Load(mOptions.CameraPathFile))
+		return 1;
+
+	const unsigned frameCount = mOptions.BenchmarkFrames;
+	LOG("Benchmark: ", frameCount, " frames, ", path.GetDuration(), " s camera path");
+
+	FrameTimings timings;
+	const size_t frameColumn = timings.AddColumn("frame ms");
+	mRenderer.RecordTimings(&timings);
+	timings.Reserve(frameCount);
+
+	// Window messages are still handled, but focus and input do not change the frames.
+	MSG msg = { 0 };
+	auto start = std::chrono::high_resolution_clock::now();
+	auto last = start;
+	unsigned frame = 0;
+	for (; frame < frameCount && msg.message != WM_QUIT; frame++)
+	{
+		// Messages are handled while waiting for the render thread, as in Run
+		do
+		{
+			while (PeekMessage(&msg, 0, 0, 0, PM_REMOVE) && msg.message != WM_QUIT)
+			{
+				TranslateMessage(&msg);
+				DispatchMessage(&msg);
+			}
+		} while (msg.message != WM_QUIT && !mRenderer.WaitForFrameSlot());
+		if (msg.message == WM_QUIT)
+			break;
+
+		mRenderer.SetCameraOrbit(path.Sample(frame * kBenchmarkTimeStep));
+		mRenderer.UpdateScene(kBenchmarkTimeStep);
+
+		auto now = std::chrono::high_resolution_clock::now();
+		timings.Add(frameColumn, std::chrono::duration<double, std::milli>(now - last).count());
+		last = now;
+	}
+
+	// The render thread does not touch the timings after this.
+	mRenderer.StopRenderThread();
+	mRenderer.RecordTimings(nullptr);
+
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	LOG("Benchmark: ", frame, " frames in ", seconds, " s, ", frame / seconds, " fps\n", timings.Report());
+	if (!mOptions.CsvFile.empty() && !timings.WriteCsv(mOptions.CsvFile))
+		LOG("Benchmark: cannot write ", mOptions.CsvFile);
+
+	if (msg.message != WM_QUIT)
+	{
+		DestroyWindow(mhMainWnd);
+		while (GetMessage(&msg, 0, 0, 0) > 0)
+			DispatchMessage(&msg);
+	}
+	return 0;
+}
+
 bool DXApp::Init()
 {
 	if (!InitMainWindow())
@@ -192,6 +278,7 @@ LRESULT DXApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 
 		// WM_DESTROY is sent when the window is being destroyed.
 	case WM_DESTROY:
+		mRenderer.StopRenderThread();
 		PostQuitMessage(0);
 		return 0;
 
@@ -220,6 +307,15 @@ LRESULT DXApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 	case WM_MOUSEMOVE:
 		OnMouseMove(wParam, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
 		return 0;
+
+		// M writes the memory statistics to the log.
+	case WM_KEYDOWN:
+		if (wParam == 'M')
+		{
+			MemoryTracker::LogStats("on request");
+			return 0;
+		}
+		break;
 	}
 
 	return DefWindowProc(hwnd, msg, wParam, lParam);
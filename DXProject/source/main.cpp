@@ -1,8 +1,40 @@
 #include <windows.h>
 #include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
 
 #include "dxapp.h"
+#include <MemoryTracker.h>
 
+namespace
+{
+	// -benchmark <frames> [-camera <path file>] [-csv <file>], -record <path file> or
+	// -import-reference, paths with spaces in quotes.
+	LaunchOptions ParseCommandLine(const char* cmdLine)
+	{
+		LaunchOptions options;
+		std::istringstream args(cmdLine ? cmdLine : "");
+		std::string arg;
+		while (args >> std::quoted(arg))
+		{
+			std::string value;
+			if (arg == "-benchmark" && args >> std::quoted(value))
+				options.BenchmarkFrames = static_cast<unsigned>(strtoul(value.c_str(), nullptr, 10));
+			else if (arg == "-camera" && args >> std::quoted(value))
+				options.CameraPathFile = value;
+			else if (arg == "-csv" && args >> std::quoted(value))
+				options.CsvFile = value;
+			else if (arg == "-record" && args >> std::quoted(value))
+				options.RecordFile = value;
+			else if (arg == "-import-reference")
+				options.WriteImportReference = true;
+			else
+				LOG("Unknown command line argument ", arg);
+		}
+		return options;
+	}
+}
 
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
@@ -12,13 +44,24 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 #if defined(DEBUG) | defined(_DEBUG)
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
-	DXApp theApp(hInstance);
-	if (!theApp.Init())
+	const LaunchOptions options = ParseCommandLine(cmdLine);
+	if (options.WriteImportReference)
+		return Renderer::WriteImportReference() ? 0 : 1;
+
+	int result = 0;
 	{
-		printf("init fail");
-		return 0;
+		DXApp theApp(hInstance, options);
+		if (!theApp.Init())
+		{
+			printf("init fail");
+			return 0;
+		}
+
+		printf("init success");
+		result = theApp.Run();
 	}
 
-	printf("init success");
-	return theApp.Run();
+	// What is left after the app is gone: globals like the texture cache, and leaks.
+	MemoryTracker::LogStats("at shutdown");
+	return result;
 }